@@ -0,0 +1,165 @@
+//***************************************************************************************
+// BatchCuller.cpp
+//***************************************************************************************
+
+#include "BatchCuller.h"
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define BATCHCULLER_SSE
+#include <xmmintrin.h>
+#endif
+
+BatchCuller::BatchCuller() :
+	mCount(0)
+{
+}
+
+void BatchCuller::Clear()
+{
+	Resize(0);
+}
+
+void BatchCuller::Resize(UINT count)
+{
+	UINT padded = (count + 3) & ~3u;
+
+	mCenterX.resize(padded, 0.0f);
+	mCenterY.resize(padded, 0.0f);
+	mCenterZ.resize(padded, 0.0f);
+	mExtentX.resize(padded, 0.0f);
+	mExtentY.resize(padded, 0.0f);
+	mExtentZ.resize(padded, 0.0f);
+	mRadius.resize(padded, 0.0f);
+
+	// A hugely negative radius puts the padding behind every plane.
+	XMFLOAT3 zero(0.0f, 0.0f, 0.0f);
+	for(UINT i = (count < mCount ? count : mCount); i < padded; ++i)
+		Set(i, zero, zero, -FLT_MAX);
+
+	mCount = count;
+}
+
+UINT BatchCuller::Add(const XNA::AxisAlignedBox& box)
+{
+	UINT i = mCount;
+	Resize(mCount + 1);
+	Set(i, box);
+	return i;
+}
+
+UINT BatchCuller::Add(const XNA::Sphere& sphere)
+{
+	UINT i = mCount;
+	Resize(mCount + 1);
+	Set(i, sphere);
+	return i;
+}
+
+void BatchCuller::Set(UINT i, const XNA::AxisAlignedBox& box)
+{
+	Set(i, box.Center, box.Extents, 0.0f);
+}
+
+void BatchCuller::Set(UINT i, const XNA::Sphere& sphere)
+{
+	Set(i, sphere.Center, XMFLOAT3(0.0f, 0.0f, 0.0f), sphere.Radius);
+}
+
+void BatchCuller::Set(UINT i, const XMFLOAT3& center, const XMFLOAT3& extents, float radius)
+{
+	mCenterX[i] = center.x;
+	mCenterY[i] = center.y;
+	mCenterZ[i] = center.z;
+	mExtentX[i] = extents.x;
+	mExtentY[i] = extents.y;
+	mExtentZ[i] = extents.z;
+	mRadius[i] = radius;
+}
+
+UINT BatchCuller::Cull(CXMMATRIX viewProj, std::vector<UINT>& visible)const
+{
+	XMFLOAT4 planes[6];
+	ExtractFrustumPlanes(planes, viewProj);
+	return Cull(planes, visible);
+}
+
+UINT BatchCuller::Cull(const XMFLOAT4 planes[6], std::vector<UINT>& visible)const
+{
+#if defined(BATCHCULLER_SSE)
+	UINT padded = (UINT)mCenterX.size();
+	visible.resize(padded);
+	if(padded == 0)
+		return 0;
+
+	// Each plane component splatted across the four lanes, plus |n| for the extents.
+	__m128 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+	for(int p = 0; p < 6; ++p)
+	{
+		px[p] = _mm_set1_ps(planes[p].x);
+		py[p] = _mm_set1_ps(planes[p].y);
+		pz[p] = _mm_set1_ps(planes[p].z);
+		pw[p] = _mm_set1_ps(planes[p].w);
+		ax[p] = _mm_set1_ps(fabsf(planes[p].x));
+		ay[p] = _mm_set1_ps(fabsf(planes[p].y));
+		az[p] = _mm_set1_ps(fabsf(planes[p].z));
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	UINT* out = &visible[0];
+	UINT n = 0;
+	for(UINT i = 0; i < padded; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&mCenterX[i]);
+		__m128 cy = _mm_loadu_ps(&mCenterY[i]);
+		__m128 cz = _mm_loadu_ps(&mCenterZ[i]);
+		__m128 ex = _mm_loadu_ps(&mExtentX[i]);
+		__m128 ey = _mm_loadu_ps(&mExtentY[i]);
+		__m128 ez = _mm_loadu_ps(&mExtentZ[i]);
+		__m128 r = _mm_loadu_ps(&mRadius[i]);
+
+		// Outside if, for any plane, even the point furthest along its normal is behind it.
+		__m128 outside = zero;
+		for(int p = 0; p < 6; ++p)
+		{
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, px[p]), _mm_mul_ps(cy, py[p])),
+				_mm_add_ps(_mm_mul_ps(cz, pz[p]), pw[p]));
+			__m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ax[p]), _mm_mul_ps(ey, ay[p])),
+				_mm_add_ps(_mm_mul_ps(ez, az[p]), r));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, e), zero));
+		}
+
+		// Branch-free compaction: every lane is written, only visible ones advance n.
+		int mask = ~_mm_movemask_ps(outside);
+		out[n] = i;     n += mask & 1;
+		out[n] = i + 1; n += (mask >> 1) & 1;
+		out[n] = i + 2; n += (mask >> 2) & 1;
+		out[n] = i + 3; n += (mask >> 3) & 1;
+	}
+
+	visible.resize(n);
+	return n;
+#else
+	return CullScalar(planes, visible);
+#endif
+}
+
+UINT BatchCuller::CullScalar(const XMFLOAT4 planes[6], std::vector<UINT>& visible)const
+{
+	visible.clear();
+	for(UINT i = 0; i < mCount; ++i)
+	{
+		bool inside = true;
+		for(int p = 0; p < 6 && inside; ++p)
+		{
+			const XMFLOAT4& pl = planes[p];
+			float d = mCenterX[i]*pl.x + mCenterY[i]*pl.y + mCenterZ[i]*pl.z + pl.w;
+			float e = mExtentX[i]*fabsf(pl.x) + mExtentY[i]*fabsf(pl.y) + mExtentZ[i]*fabsf(pl.z) + mRadius[i];
+			inside = d + e >= 0.0f;
+		}
+		if(inside)
+			visible.push_back(i);
+	}
+	return (UINT)visible.size();
+}
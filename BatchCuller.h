@@ -0,0 +1,61 @@
+//***************************************************************************************
+// BatchCuller.h
+//
+// Frustum culls many world space bounding volumes at once.  Bounds are kept as
+// structure-of-arrays so one SSE pass tests four of them against each plane, and the
+// result is a compacted list of the indices that survived.  Boxes and spheres can be
+// mixed in one culler; each element's distance to a plane is pushed out by its box
+// extents projected on the plane normal plus its sphere radius, one of which is zero.
+//
+// Suited to objects whose bounds rarely change (the instanced skulls); moving objects
+// can be re-Set each frame.
+//***************************************************************************************
+
+#ifndef BATCHCULLER_H
+#define BATCHCULLER_H
+
+#include "MathHelper.h"
+#include "xnacollision.h"
+#include <vector>
+
+class BatchCuller
+{
+public:
+	BatchCuller();
+
+	void Clear();
+	void Resize(UINT count);
+	UINT GetCount()const { return mCount; }
+
+	// Both return the element's index.
+	UINT Add(const XNA::AxisAlignedBox& box);
+	UINT Add(const XNA::Sphere& sphere);
+
+	void Set(UINT i, const XNA::AxisAlignedBox& box);
+	void Set(UINT i, const XNA::Sphere& sphere);
+
+	// Writes, in ascending order, the indices of the elements that touch the frustum of
+	// viewProj and returns how many there are.
+	UINT Cull(CXMMATRIX viewProj, std::vector<UINT>& visible)const;
+
+	// planes as ExtractFrustumPlanes returns them: normalized, facing inward.
+	UINT Cull(const XMFLOAT4 planes[6], std::vector<UINT>& visible)const;
+
+	// The same test one element at a time, for machines without SSE and for checking.
+	UINT CullScalar(const XMFLOAT4 planes[6], std::vector<UINT>& visible)const;
+
+private:
+	void Set(UINT i, const XMFLOAT3& center, const XMFLOAT3& extents, float radius);
+
+	// Padded to a multiple of four with elements no frustum can see.
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+	std::vector<float> mRadius;
+	UINT mCount;
+};
+
+#endif // BATCHCULLER_H
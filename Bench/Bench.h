@@ -0,0 +1,70 @@
+//***************************************************************************************
+// Bench.h
+//
+// Minimal harness for zeus_bench.  Each scenario is a function registered with
+// ZEUS_BENCH(name); it times the engine code it drives, prints its numbers and returns
+// false if a correctness check fails, which makes zeus_bench exit non-zero.
+//***************************************************************************************
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "Platform.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct BenchOptions
+{
+	// Smaller problem sizes and fewer iterations; used by the ctest smoke run.
+	bool Quick;
+
+	// Repository root, so scenarios can find Models/ and Textures/.
+	std::string AssetDir;
+
+	std::string AssetPath(const std::string& relative)const { return AssetDir + "/" + relative; }
+};
+
+typedef bool (*BenchFunc)(const BenchOptions& opts);
+
+class BenchRegistrar
+{
+public:
+	BenchRegistrar(const char* name, BenchFunc func);
+};
+
+#define ZEUS_BENCH(name)                                              \
+	static bool Bench_##name(const BenchOptions& opts);                \
+	static BenchRegistrar BenchRegistrar_##name(#name, Bench_##name);  \
+	static bool Bench_##name(const BenchOptions& opts)
+
+class BenchTimer
+{
+public:
+	BenchTimer() { Reset(); }
+
+	void Reset() { mStart = std::chrono::high_resolution_clock::now(); }
+
+	double ElapsedMs()const
+	{
+		std::chrono::duration<double, std::milli> d = std::chrono::high_resolution_clock::now() - mStart;
+		return d.count();
+	}
+
+private:
+	std::chrono::high_resolution_clock::time_point mStart;
+};
+
+// Prints one aligned result line: "  label  total ms  (per-iteration time)".
+void BenchReport(const char* label, double totalMs, int iterations);
+
+// Reports a failed check and returns false so scenarios can `return BenchCheck(...)`.
+bool BenchCheck(bool condition, const char* what);
+
+// Deterministic rolling-hills 8-bit heightmap, used when Textures/terrain3.raw is absent.
+void BenchMakeHeightmapRaw(std::vector<unsigned char>& raw, UINT width, UINT height);
+
+// name inside zeus_bench_cache/, which is created if needed; for scenarios that write files.
+std::string BenchScratchPath(const std::string& name);
+
+#endif // BENCH_H
@@ -0,0 +1,132 @@
+//***************************************************************************************
+// BenchMain.cpp
+//
+// zeus_bench [--quick] [--assets <dir>] [filter]
+//***************************************************************************************
+
+#include "Bench.h"
+#include "MathHelper.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeDirectory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MakeDirectory(path) mkdir(path, 0755)
+#endif
+
+#ifndef ZEUS_ASSET_DIR
+#define ZEUS_ASSET_DIR "."
+#endif
+
+namespace
+{
+	struct BenchEntry
+	{
+		const char* Name;
+		BenchFunc Func;
+	};
+
+	std::vector<BenchEntry>& Registry()
+	{
+		static std::vector<BenchEntry> entries;
+		return entries;
+	}
+}
+
+BenchRegistrar::BenchRegistrar(const char* name, BenchFunc func)
+{
+	BenchEntry e = { name, func };
+	Registry().push_back(e);
+}
+
+void BenchReport(const char* label, double totalMs, int iterations)
+{
+	printf("  %-40s %10.3f ms", label, totalMs);
+	if(iterations > 1)
+	{
+		double perIter = totalMs / iterations;
+		if(perIter >= 1.0)
+			printf("  (%.3f ms/iter, %d iters)", perIter, iterations);
+		else if(perIter >= 0.001)
+			printf("  (%.3f us/iter, %d iters)", perIter * 1000.0, iterations);
+		else
+			printf("  (%.2f ns/iter, %d iters)", perIter * 1000000.0, iterations);
+	}
+	printf("\n");
+}
+
+bool BenchCheck(bool condition, const char* what)
+{
+	if(!condition)
+		printf("  CHECK FAILED: %s\n", what);
+	return condition;
+}
+
+std::string BenchScratchPath(const std::string& name)
+{
+	MakeDirectory("zeus_bench_cache");
+	return "zeus_bench_cache/" + name;
+}
+
+void BenchMakeHeightmapRaw(std::vector<unsigned char>& raw, UINT width, UINT height)
+{
+	raw.resize(width*height);
+	for(UINT i = 0; i < height; ++i)
+	{
+		for(UINT j = 0; j < width; ++j)
+		{
+			float x = (float)j / width;
+			float z = (float)i / height;
+			float h = 0.5f + 0.25f*sinf(12.0f*x)*cosf(9.0f*z) + 0.15f*sinf(47.0f*x + 31.0f*z);
+
+			// A little hash noise so smoothing has real work to do.
+			UINT n = (i*73856093u) ^ (j*19349663u);
+			n = (n << 13) ^ n;
+			h += 0.05f*((float)((n*(n*n*15731u + 789221u) + 1376312589u) & 0xffff) / 65535.0f - 0.5f);
+
+			raw[i*width+j] = (unsigned char)(MathHelper::Clamp(h, 0.0f, 1.0f)*255.0f);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions opts;
+	opts.Quick = false;
+	opts.AssetDir = ZEUS_ASSET_DIR;
+
+	const char* filter = 0;
+	for(int i = 1; i < argc; ++i)
+	{
+		if(strcmp(argv[i], "--quick") == 0)
+			opts.Quick = true;
+		else if(strcmp(argv[i], "--assets") == 0 && i+1 < argc)
+			opts.AssetDir = argv[++i];
+		else
+			filter = argv[i];
+	}
+
+	int failed = 0;
+	int run = 0;
+	for(size_t i = 0; i < Registry().size(); ++i)
+	{
+		const BenchEntry& e = Registry()[i];
+		if(filter && !strstr(e.Name, filter))
+			continue;
+
+		printf("[%s]\n", e.Name);
+		++run;
+		if(!e.Func(opts))
+		{
+			printf("[%s] FAILED\n", e.Name);
+			++failed;
+		}
+	}
+
+	printf("%d scenario(s), %d failed\n", run, failed);
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,3202 @@
+//***************************************************************************************
+// CoreBench.cpp
+//
+// Baseline scenarios for the CPU systems that make up zeus_core.
+//***************************************************************************************
+
+#include "Bench.h"
+#include "BatchCuller.h"
+#include "Camera.h"
+#include "CookedMeshCache.h"
+#include "FixedStepper.h"
+#include "FrustumCuller.h"
+#include "GeometryGenerator.h"
+#include "Heightmap.h"
+#include "HeightmapFilter.h"
+#include "HeightPyramid.h"
+#include "HeightQuery.h"
+#include "HeightfieldBuilder.h"
+#include "InstanceBuffer.h"
+#include "LodSelector.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshWelder.h"
+#include "ObjLoader.h"
+#include "PassCache.h"
+#include "RenderQueue.h"
+#include "TangentGenerator.h"
+#include "TerrainQuadtree.h"
+#include "TerrainRaycaster.h"
+#include "TerrainStreamer.h"
+#include "TextureLoader.h"
+#include "TiledHeightmap.h"
+#include "VertexPacker.h"
+#include "VirtualTexture.h"
+#include "xnacollision.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <utility>
+
+namespace
+{
+	// Textures/terrain3.raw is 2049x2049; fall back to synthetic data when it is not
+	// checked out or a smaller quick run is wanted.
+	void LoadBenchRaw(const BenchOptions& opts, std::vector<unsigned char>& raw, UINT size)
+	{
+		if(size == 2049)
+		{
+			FILE* file = fopen(opts.AssetPath("Textures/terrain3.raw").c_str(), "rb");
+			if(file)
+			{
+				raw.resize(size*size);
+				bool read = fread(&raw[0], raw.size(), 1, file) == 1;
+				fclose(file);
+				if(read)
+					return;
+			}
+		}
+
+		BenchMakeHeightmapRaw(raw, size, size);
+	}
+
+	void LoadBenchHeightmap(const BenchOptions& opts, Heightmap& hmap, UINT size)
+	{
+		std::vector<unsigned char> raw;
+		LoadBenchRaw(opts, raw, size);
+		hmap.BuildFromRaw(raw, size, size, 50.0f);
+	}
+
+	// Heightmap::Smooth as it was before HeightmapFilter: one texel at a time, with
+	// bounds checks on every tap.  The reference the filter must match bit for bit.
+	void ReferenceSmooth(const std::vector<float>& src, UINT width, UINT height, std::vector<float>& dest)
+	{
+		dest.resize(src.size());
+		for(int i = 0; i < (int)height; ++i)
+		{
+			for(int j = 0; j < (int)width; ++j)
+			{
+				float avg = 0.0f;
+				float num = 0.0f;
+				for(int m = i-1; m <= i+1; ++m)
+				{
+					for(int n = j-1; n <= j+1; ++n)
+					{
+						if(m >= 0 && m < (int)height && n >= 0 && n < (int)width)
+						{
+							avg += src[m*width + n];
+							num += 1.0f;
+						}
+					}
+				}
+				dest[i*width + j] = avg / num;
+			}
+		}
+	}
+
+	bool SameBits(const std::vector<float>& a, const std::vector<float>& b)
+	{
+		return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size()*sizeof(float)) == 0);
+	}
+
+	UINT HashPage(UINT mip, UINT pageX, UINT pageY)
+	{
+		UINT h = mip*0x9e3779b1u ^ pageX*0x85ebca6bu ^ pageY*0xc2b2ae35u;
+		return h ^ (h >> 15);
+	}
+
+	// Fills each page with a value naming it, so the bench can check which page a slot
+	// holds.
+	class HashPageSource : public VirtualTextureSource
+	{
+	public:
+		HashPageSource(UINT texelsPerPage) : mTexelsPerPage(texelsPerPage) {}
+
+		void BuildPage(UINT mip, UINT pageX, UINT pageY, BYTE* texels)
+		{
+			UINT value = HashPage(mip, pageX, pageY);
+			UINT* out = (UINT*)texels;
+			for(UINT i = 0; i < mTexelsPerPage; ++i)
+				out[i] = value;
+		}
+
+	private:
+		UINT mTexelsPerPage;
+	};
+
+	// Every entry must name a slot holding the page itself or its ancestor at the
+	// entry's mip.
+	bool PageTableConsistent(const VirtualTexture& vt)
+	{
+		for(UINT m = 0; m < vt.GetNumMips(); ++m)
+		{
+			for(UINT y = 0; y < vt.GetNumPagesY(m); ++y)
+			{
+				for(UINT x = 0; x < vt.GetNumPagesX(m); ++x)
+				{
+					const VirtualTexture::PageTableEntry& e = vt.GetEntry(m, x, y);
+					UINT shift = e.Mip - m;
+					if(e.Mip < m || *(const UINT*)vt.GetSlotTexels(e.Slot) != HashPage(e.Mip, x >> shift, y >> shift))
+						return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// A CPU stand-in for a GPU feedback pass: a low resolution grid of screen rays
+	// against the ground plane, each reporting the (u, v) it lands on and the mip a
+	// full resolution pixel there would sample.
+	void TerrainFeedback(VirtualTexture& vt, const XMFLOAT3& eye, float yaw, float worldSize, float texelsPerMeter)
+	{
+		const UINT feedbackW = 160;
+		const UINT feedbackH = 90;
+		const float screenH = 1080.0f;
+		const float fovY = 0.25f*MathHelper::Pi;
+		const float pitch = 0.35f;
+		const float aspect = 16.0f / 9.0f;
+		float tanHalf = tanf(0.5f*fovY);
+
+		XMVECTOR forward = XMVectorSet(sinf(yaw)*cosf(pitch), -sinf(pitch), cosf(yaw)*cosf(pitch), 0.0f);
+		XMVECTOR right = XMVector3Normalize(XMVector3Cross(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), forward));
+		XMVECTOR up = XMVector3Cross(forward, right);
+
+		for(UINT j = 0; j < feedbackH; ++j)
+		{
+			for(UINT i = 0; i < feedbackW; ++i)
+			{
+				float sx = (2.0f*(i + 0.5f) / feedbackW - 1.0f)*tanHalf*aspect;
+				float sy = (1.0f - 2.0f*(j + 0.5f) / feedbackH)*tanHalf;
+				XMFLOAT3 d;
+				XMStoreFloat3(&d, XMVector3Normalize(forward + sx*right + sy*up));
+				if(d.y >= -1e-3f)
+					continue;
+
+				float t = -eye.y / d.y;
+				float x = eye.x + t*d.x;
+				float z = eye.z + t*d.z;
+				float u = x / worldSize + 0.5f;
+				float v = 0.5f - z / worldSize;
+				if(u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f)
+					continue;
+
+				// Texels under one full resolution pixel, stretched by the grazing angle.
+				float pixel = t*(2.0f*tanHalf / screenH);
+				float texels = pixel*texelsPerMeter / MathHelper::Max(-d.y, 0.2f);
+				vt.AddFeedback(u, v, texels > 1.0f ? logf(texels) / logf(2.0f) : 0.0f);
+			}
+		}
+	}
+
+	// Every triangle of every cell under the segment's footprint, for checking
+	// TerrainRaycaster.  Infinity if nothing is hit.
+	float BruteForceSegment(const Heightmap& hmap, float cellSpacing, const XMFLOAT3& p0, const XMFLOAT3& p1)
+	{
+		float originX = -0.5f*(hmap.GetNumCols()-1)*cellSpacing;
+		float originZ = 0.5f*(hmap.GetNumRows()-1)*cellSpacing;
+
+		XMVECTOR o = XMLoadFloat3(&p0);
+		XMVECTOR d = XMVectorSubtract(XMLoadFloat3(&p1), o);
+		float length = XMVectorGetX(XMVector3Length(d));
+		d = XMVectorScale(d, 1.0f / length);
+
+		int col0 = (int)floorf((MathHelper::Min(p0.x, p1.x) - originX) / cellSpacing) - 1;
+		int col1 = (int)floorf((MathHelper::Max(p0.x, p1.x) - originX) / cellSpacing) + 1;
+		int row0 = (int)floorf((originZ - MathHelper::Max(p0.z, p1.z)) / cellSpacing) - 1;
+		int row1 = (int)floorf((originZ - MathHelper::Min(p0.z, p1.z)) / cellSpacing) + 1;
+		col0 = MathHelper::Max(col0, 0);
+		row0 = MathHelper::Max(row0, 0);
+		col1 = MathHelper::Min(col1, (int)hmap.GetNumCols() - 2);
+		row1 = MathHelper::Min(row1, (int)hmap.GetNumRows() - 2);
+
+		float best = MathHelper::Infinity;
+		for(int i = row0; i <= row1; ++i)
+		{
+			for(int j = col0; j <= col1; ++j)
+			{
+				float x = originX + j*cellSpacing;
+				float z = originZ - i*cellSpacing;
+				XMVECTOR A = XMVectorSet(x, hmap.At(i, j), z, 0.0f);
+				XMVECTOR B = XMVectorSet(x + cellSpacing, hmap.At(i, j + 1), z, 0.0f);
+				XMVECTOR C = XMVectorSet(x, hmap.At(i + 1, j), z - cellSpacing, 0.0f);
+				XMVECTOR D = XMVectorSet(x + cellSpacing, hmap.At(i + 1, j + 1), z - cellSpacing, 0.0f);
+
+				float t;
+				if(XNA::IntersectRayTriangle(o, d, A, B, C, &t) && t <= length)
+					best = MathHelper::Min(best, t);
+				if(XNA::IntersectRayTriangle(o, d, D, C, B, &t) && t <= length)
+					best = MathHelper::Min(best, t);
+			}
+		}
+
+		return best;
+	}
+
+	// A plain ifstream and strtof reading of an OBJ, one vertex per face corner with no
+	// sharing; polygons are fanned as ObjLoader does.  The reference ObjLoader's
+	// indexed vertices must reproduce corner for corner.
+	bool ReferenceObjCorners(const std::string& filename, std::vector<GeometryGenerator::Vertex>& corners)
+	{
+		std::ifstream fin(filename.c_str());
+		if(!fin)
+			return false;
+
+		std::vector<XMFLOAT3> positions, normals;
+		std::vector<XMFLOAT2> texCoords;
+		std::vector<GeometryGenerator::Vertex> polygon;
+		corners.clear();
+
+		std::string line, keyword, token;
+		while(std::getline(fin, line))
+		{
+			std::istringstream in(line);
+			if(!(in >> keyword))
+				continue;
+
+			if(keyword == "v" || keyword == "vn" || keyword == "vt")
+			{
+				float f[3] = { 0.0f, 0.0f, 0.0f };
+				for(int k = 0; k < (keyword == "vt" ? 2 : 3) && in >> token; ++k)
+					f[k] = strtof(token.c_str(), 0);
+
+				if(keyword == "v")
+					positions.push_back(XMFLOAT3(f));
+				else if(keyword == "vn")
+					normals.push_back(XMFLOAT3(f));
+				else
+					texCoords.push_back(XMFLOAT2(f));
+			}
+			else if(keyword == "f")
+			{
+				polygon.clear();
+				while(in >> token)
+				{
+					// v, v/t, v//n or v/t/n; negative numbers count back from the end.
+					int number[3] = { 0, 0, 0 };
+					size_t start = 0;
+					for(int k = 0; k < 3 && start <= token.size(); ++k)
+					{
+						size_t slash = token.find('/', start);
+						std::string field = token.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+						number[k] = field.empty() ? 0 : atoi(field.c_str());
+						start = slash == std::string::npos ? token.size() + 1 : slash + 1;
+					}
+
+					int count[3] = { (int)positions.size(), (int)texCoords.size(), (int)normals.size() };
+					for(int k = 0; k < 3; ++k)
+					{
+						if(number[k] < 0)
+							number[k] += count[k] + 1;
+						if(number[k] > count[k] || (k == 0 && number[k] < 1) || number[k] < 0)
+							return false;
+					}
+
+					GeometryGenerator::Vertex v;
+					v.Position = positions[number[0] - 1];
+					v.TexC = number[1] ? texCoords[number[1] - 1] : XMFLOAT2(0.0f, 0.0f);
+					v.Normal = number[2] ? normals[number[2] - 1] : XMFLOAT3(0.0f, 0.0f, 0.0f);
+					v.TangentU = XMFLOAT3(0.0f, 0.0f, 0.0f);
+					polygon.push_back(v);
+				}
+
+				for(size_t i = 1; i + 1 < polygon.size(); ++i)
+				{
+					corners.push_back(polygon[0]);
+					corners.push_back(polygon[i]);
+					corners.push_back(polygon[i + 1]);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool SameCorners(const GeometryGenerator::MeshData& mesh, const std::vector<GeometryGenerator::Vertex>& corners)
+	{
+		if(mesh.Indices.size() != corners.size())
+			return false;
+
+		for(size_t i = 0; i < corners.size(); ++i)
+		{
+			if(mesh.Indices[i] >= mesh.Vertices.size() ||
+				memcmp(&mesh.Vertices[mesh.Indices[i]], &corners[i], sizeof(GeometryGenerator::Vertex)) != 0)
+				return false;
+		}
+		return true;
+	}
+}
+
+ZEUS_BENCH(HeightmapPreprocess)
+{
+	const UINT size = opts.Quick ? 513 : 2049;
+	const float heightScale = 50.0f;
+
+	std::vector<unsigned char> raw;
+	LoadBenchRaw(opts, raw, size);
+
+	Heightmap hmap;
+	BenchTimer t;
+	hmap.BuildFromRaw(raw, size, size, heightScale);
+	BenchReport("expand", t.ElapsedMs(), 1);
+	std::vector<float> unfiltered = hmap.GetData();
+
+	std::vector<float> reference;
+	t.Reset();
+	ReferenceSmooth(unfiltered, size, size, reference);
+	BenchReport("smooth 3x3, per-texel reference", t.ElapsedMs(), 1);
+
+	std::vector<float> oneThread(unfiltered.size());
+	t.Reset();
+	HeightmapFilter::Smooth(&unfiltered[0], &oneThread[0], size, size, 1);
+	BenchReport("smooth 3x3, SSE rows, 1 thread", t.ElapsedMs(), 1);
+
+	// Includes allocating and zeroing the destination, which the line above does not.
+	t.Reset();
+	hmap.Smooth();
+	BenchReport("Heightmap::Smooth, all threads", t.ElapsedMs(), 1);
+
+	// What Terrain::Init now does: expand, smooth and convert to half in one pass.
+	std::vector<float> fused(unfiltered.size());
+	std::vector<HALF> halves(unfiltered.size());
+	t.Reset();
+	HeightmapFilter::ExpandAndSmoothRaw8(&raw[0], heightScale, &fused[0], &halves[0], size, size);
+	BenchReport("expand + smooth + half, fused", t.ElapsedMs(), 1);
+
+	bool halvesMatch = true;
+	for(size_t i = 0; i < halves.size(); ++i)
+		halvesMatch = halvesMatch && halves[i] == XMConvertFloatToHalf(reference[i]);
+
+	// Odd little maps hit every border case and the scalar tails.
+	bool smallMatch = true;
+	for(UINT h = 1; h <= 6; ++h)
+	{
+		for(UINT w = 1; w <= 9; ++w)
+		{
+			std::vector<unsigned char> smallRaw(w*h);
+			for(UINT i = 0; i < w*h; ++i)
+				smallRaw[i] = (unsigned char)(i*37 + h*11);
+
+			Heightmap small;
+			small.BuildFromRaw(smallRaw, w, h, heightScale);
+			std::vector<float> expected;
+			ReferenceSmooth(small.GetData(), w, h, expected);
+
+			std::vector<float> smallFused(w*h);
+			HeightmapFilter::ExpandAndSmoothRaw8(&smallRaw[0], heightScale, &smallFused[0], 0, w, h, 3);
+			small.Smooth();
+			smallMatch = smallMatch && SameBits(small.GetData(), expected) && SameBits(smallFused, expected);
+		}
+	}
+
+	std::vector<XMFLOAT2> bounds;
+	t.Reset();
+	hmap.CalcPatchBoundsY(64, bounds);
+	BenchReport("patch bounds", t.ElapsedMs(), 1);
+
+	UINT patches = ((size-1)/64)*((size-1)/64);
+	bool ok = BenchCheck(bounds.size() == patches, "patch count");
+	for(size_t i = 0; i < bounds.size(); ++i)
+		ok = ok && bounds[i].x <= bounds[i].y && bounds[i].x >= 0.0f && bounds[i].y <= 50.0f;
+	return ok && BenchCheck(true, "patch bounds in range") &&
+		BenchCheck(SameBits(oneThread, reference), "single-threaded filter is bit-identical") &&
+		BenchCheck(SameBits(hmap.GetData(), reference), "Heightmap::Smooth is bit-identical") &&
+		BenchCheck(SameBits(fused, reference), "fused RAW pass is bit-identical") &&
+		BenchCheck(halvesMatch, "fused half heights match") &&
+		BenchCheck(smallMatch, "small and odd-sized maps are bit-identical");
+}
+
+ZEUS_BENCH(HeightPyramidBounds)
+{
+	const UINT size = opts.Quick ? 513 : 2049;
+	const int queries = opts.Quick ? 2000 : 20000;
+
+	Heightmap hmap;
+	LoadBenchHeightmap(opts, hmap, size);
+	hmap.Smooth();
+
+	std::vector<XMFLOAT2> flat;
+	BenchTimer t;
+	hmap.CalcPatchBoundsY(64, flat);
+	BenchReport("flat patch bounds (rescan)", t.ElapsedMs(), 1);
+
+	HeightPyramid oneThread;
+	t.Reset();
+	oneThread.Build(hmap, 1);
+	BenchReport("build pyramid, 1 thread", t.ElapsedMs(), 1);
+
+	HeightPyramid pyramid;
+	t.Reset();
+	pyramid.Build(hmap);
+	BenchReport("build pyramid, all threads", t.ElapsedMs(), 1);
+
+	std::vector<XMFLOAT2> fromPyramid, oddPatches, oddFlat;
+	t.Reset();
+	pyramid.GetPatchBoundsY(64, fromPyramid);
+	BenchReport("patch bounds from pyramid", t.ElapsedMs(), 1);
+	pyramid.GetPatchBoundsY(48, oddPatches);
+	hmap.CalcPatchBoundsY(48, oddFlat);
+
+	bool patchesMatch = fromPyramid.size() == flat.size() && oddPatches.size() == oddFlat.size();
+	for(size_t i = 0; patchesMatch && i < flat.size(); ++i)
+		patchesMatch = fromPyramid[i].x == flat[i].x && fromPyramid[i].y == flat[i].y;
+	for(size_t i = 0; patchesMatch && i < oddFlat.size(); ++i)
+		patchesMatch = oddPatches[i].x == oddFlat[i].x && oddPatches[i].y == oddFlat[i].y;
+
+	// Arbitrary cell rectangles against scanning their samples.
+	srand(7);
+	UINT cells = size - 1;
+	std::vector<UINT> rects(4*queries);
+	for(int q = 0; q < queries; ++q)
+	{
+		UINT r0 = rand() % cells, c0 = rand() % cells;
+		rects[4*q+0] = r0;
+		rects[4*q+1] = c0;
+		rects[4*q+2] = MathHelper::Min(r0 + 1 + rand() % 300, cells);
+		rects[4*q+3] = MathHelper::Min(c0 + 1 + rand() % 300, cells);
+	}
+
+	std::vector<XMFLOAT2> scanned(queries), queried(queries);
+	t.Reset();
+	for(int q = 0; q < queries; ++q)
+	{
+		XMFLOAT2 b(+MathHelper::Infinity, -MathHelper::Infinity);
+		for(UINT r = rects[4*q+0]; r <= rects[4*q+2]; ++r)
+		{
+			for(UINT c = rects[4*q+1]; c <= rects[4*q+3]; ++c)
+			{
+				b.x = MathHelper::Min(b.x, hmap.At(r, c));
+				b.y = MathHelper::Max(b.y, hmap.At(r, c));
+			}
+		}
+		scanned[q] = b;
+	}
+	BenchReport("region bounds, scan", t.ElapsedMs(), queries);
+
+	t.Reset();
+	for(int q = 0; q < queries; ++q)
+		queried[q] = pyramid.GetRegionBoundsY(rects[4*q+0], rects[4*q+1], rects[4*q+2], rects[4*q+3]);
+	BenchReport("region bounds, pyramid", t.ElapsedMs(), queries);
+
+	bool regionsMatch = true;
+	for(int q = 0; q < queries; ++q)
+		regionsMatch = regionsMatch && queried[q].x == scanned[q].x && queried[q].y == scanned[q].y;
+
+	// Every region of small, odd-shaped maps, where partial entries are most of the map.
+	for(UINT h = 2; h <= 7; ++h)
+	{
+		for(UINT w = 2; w <= 9; ++w)
+		{
+			std::vector<unsigned char> smallRaw(w*h);
+			for(UINT i = 0; i < w*h; ++i)
+				smallRaw[i] = (unsigned char)(i*73 + w*5);
+
+			Heightmap small;
+			small.BuildFromRaw(smallRaw, w, h, 1.0f);
+			HeightPyramid smallPyramid;
+			smallPyramid.Build(small);
+
+			for(UINT r0 = 0; r0 < h-1; ++r0)
+			for(UINT r1 = r0+1; r1 < h; ++r1)
+			for(UINT c0 = 0; c0 < w-1; ++c0)
+			for(UINT c1 = c0+1; c1 < w; ++c1)
+			{
+				XMFLOAT2 b(+MathHelper::Infinity, -MathHelper::Infinity);
+				for(UINT r = r0; r <= r1; ++r)
+				{
+					for(UINT c = c0; c <= c1; ++c)
+					{
+						b.x = MathHelper::Min(b.x, small.At(r, c));
+						b.y = MathHelper::Max(b.y, small.At(r, c));
+					}
+				}
+				XMFLOAT2 q = smallPyramid.GetRegionBoundsY(r0, c0, r1, c1);
+				regionsMatch = regionsMatch && q.x == b.x && q.y == b.y;
+			}
+		}
+	}
+
+	// Raise a crater, patch the pyramid and compare with a rebuild.
+	std::vector<float>& heights = hmap.GetData();
+	UINT row0 = size/3, col0 = size/5, row1 = row0 + 40, col1 = col0 + 70;
+	for(UINT r = row0; r <= row1; ++r)
+		for(UINT c = col0; c <= col1; ++c)
+			heights[r*size + c] = (r == row0 + 20 && c == col0 + 35) ? 500.0f : -10.0f;
+
+	t.Reset();
+	pyramid.Update(row0, col0, row1, col1);
+	BenchReport("incremental update", t.ElapsedMs(), 1);
+
+	HeightPyramid rebuilt;
+	rebuilt.Build(hmap);
+	bool updateMatches = pyramid.GetNumLevels() == rebuilt.GetNumLevels();
+	for(UINT k = 0; updateMatches && k < rebuilt.GetNumLevels(); ++k)
+	{
+		for(UINT i = 0; i < rebuilt.GetNumRows(k); ++i)
+		{
+			for(UINT j = 0; j < rebuilt.GetNumCols(k); ++j)
+			{
+				XMFLOAT2 a = pyramid.GetBoundsY(k, i, j);
+				XMFLOAT2 b = rebuilt.GetBoundsY(k, i, j);
+				updateMatches = updateMatches && a.x == b.x && a.y == b.y;
+			}
+		}
+	}
+
+	printf("  %u levels, whole map %.3f..%.3f after the crater\n",
+		pyramid.GetNumLevels(), pyramid.GetBoundsY().x, pyramid.GetBoundsY().y);
+	return BenchCheck(patchesMatch, "patch bounds match the rescan") &&
+		BenchCheck(regionsMatch, "region bounds match the scan") &&
+		BenchCheck(updateMatches, "incremental update matches a rebuild") &&
+		BenchCheck(pyramid.GetBoundsY().x == -10.0f && pyramid.GetBoundsY().y == 500.0f, "top level sees the crater");
+}
+
+ZEUS_BENCH(TerrainQuadtreeSelect)
+{
+	// Terrain::Draw's selection: the camera flies a loop over the map, and each frame the
+	// quadtree picks nodes and visible patches as Terrain does.
+	const UINT size = opts.Quick ? 513 : 2049;
+	const UINT cellsPerPatch = 64;
+	const float cellSpacing = 0.5f;
+	const int frames = opts.Quick ? 50 : 2000;
+
+	Heightmap hmap;
+	LoadBenchHeightmap(opts, hmap, size);
+	hmap.Smooth();
+	HeightPyramid pyramid;
+	pyramid.Build(hmap);
+
+	float halfWidth = 0.5f*(size-1)*cellSpacing;
+	TerrainQuadtree quadtree;
+	quadtree.Init(pyramid, cellsPerPatch, cellSpacing, -halfWidth, halfWidth);
+	quadtree.SetLodRanges(2.5f*cellsPerPatch*cellSpacing);
+
+	UINT numPatches = quadtree.GetNumPatchRows()*quadtree.GetNumPatchCols();
+	std::vector<XMFLOAT2> patchBounds;
+	pyramid.GetPatchBoundsY(cellsPerPatch, patchBounds);
+
+	Camera cam;
+	cam.SetLens(0.25f*XM_PI, 16.0f/9.0f, 1.0f, 1000.0f);
+
+	std::vector<TerrainNode> nodes;
+	std::vector<UINT> patches;
+	std::vector<UINT> patchNodes;
+	std::vector<int> patchLod(numPatches);
+	double selectMs = 0.0;
+	UINT totalVisited = 0, totalPatches = 0, missed = 0, duplicates = 0, lodJumps = 0, outOfRange = 0, misplaced = 0;
+	float maxLodGap = 0.0f;
+
+	for(int f = 0; f < frames; ++f)
+	{
+		float a = XM_2PI*f / frames;
+		XMFLOAT3 eye(0.6f*halfWidth*cosf(a), 0.0f, 0.6f*halfWidth*sinf(a));
+		eye.y = hmap.GetHeight(eye.x, eye.z, cellSpacing) + 10.0f + 40.0f*(f % 3);
+		XMFLOAT3 target(eye.x - 50.0f*sinf(a), eye.y - 15.0f, eye.z + 50.0f*cosf(a));
+		cam.LookAt(eye, target, XMFLOAT3(0.0f, 1.0f, 0.0f));
+		cam.UpdateViewMatrix();
+
+		BenchTimer t;
+		quadtree.Select(cam.ViewProj(), eye, nodes);
+		quadtree.GetVisiblePatches(nodes, patches, &patchNodes);
+		selectMs += t.ElapsedMs();
+
+		totalVisited += quadtree.GetStats().NodesVisited;
+		totalPatches += (UINT)patches.size();
+
+		// Every patch inside the frustum is drawn, once.
+		std::fill(patchLod.begin(), patchLod.end(), -1);
+		for(size_t n = 0; n < nodes.size(); ++n)
+		{
+			const TerrainNode& node = nodes[n];
+			for(UINT i = node.Row; i < MathHelper::Min(node.Row + node.Size, quadtree.GetNumPatchRows()); ++i)
+				for(UINT j = node.Col; j < MathHelper::Min(node.Col + node.Size, quadtree.GetNumPatchCols()); ++j)
+					patchLod[i*quadtree.GetNumPatchCols() + j] = (int)node.Lod;
+
+			// A node is never finer than its distance calls for.
+			XMFLOAT3 boxMin, boxMax;
+			quadtree.GetNodeBounds(node.Row, node.Col, node.Size, boxMin, boxMax);
+			if(node.Lod > 0)
+			{
+				XMVECTOR nearest = XMVectorClamp(XMLoadFloat3(&eye), XMLoadFloat3(&boxMin), XMLoadFloat3(&boxMax));
+				float d = XMVectorGetX(XMVector3Length(nearest - XMLoadFloat3(&eye)));
+				if(d < quadtree.GetLodRange(node.Lod - 1) && node.Size == (1u << node.Lod))
+					++outOfRange;
+			}
+		}
+
+		std::vector<bool> drawn(numPatches, false);
+		for(size_t p = 0; p < patches.size(); ++p)
+		{
+			if(drawn[patches[p]])
+				++duplicates;
+			drawn[patches[p]] = true;
+
+			// Terrain.fx tessellates a patch's inside by its node's LOD and its edges by
+			// distance alone; the two stay within one LOD of each other.
+			const TerrainNode& node = nodes[patchNodes[p]];
+			UINT i = patches[p] / quadtree.GetNumPatchCols();
+			UINT j = patches[p] % quadtree.GetNumPatchCols();
+			if(i < node.Row || i >= node.Row + node.Size || j < node.Col || j >= node.Col + node.Size)
+				++misplaced;
+
+			XMFLOAT3 boxMin, boxMax;
+			quadtree.GetNodeBounds(i, j, 1, boxMin, boxMax);
+			float d = XMVectorGetX(XMVector3Length(0.5f*(XMLoadFloat3(&boxMin) + XMLoadFloat3(&boxMax)) - XMLoadFloat3(&eye)));
+			maxLodGap = MathHelper::Max(maxLodGap, fabsf(TerrainQuadtree::GetNodeMorphLod(node, d) - quadtree.GetMorphLod(d)));
+		}
+
+		FrustumCuller culler(cam.ViewProj());
+		for(UINT p = 0; p < numPatches; ++p)
+		{
+			UINT i = p / quadtree.GetNumPatchCols();
+			UINT j = p % quadtree.GetNumPatchCols();
+			XMFLOAT3 boxMin, boxMax;
+			quadtree.GetNodeBounds(i, j, 1, boxMin, boxMax);
+
+			XNA::AxisAlignedBox box;
+			XMStoreFloat3(&box.Center, 0.5f*(XMLoadFloat3(&boxMin) + XMLoadFloat3(&boxMax)));
+			XMStoreFloat3(&box.Extents, 0.5f*(XMLoadFloat3(&boxMax) - XMLoadFloat3(&boxMin)));
+			if(culler.IsVisible(box) && !drawn[p])
+				++missed;
+
+			// CDLOD keeps drawn neighbors within one LOD of each other.
+			if(patchLod[p] >= 0 && j + 1 < quadtree.GetNumPatchCols() && patchLod[p+1] >= 0 && abs(patchLod[p] - patchLod[p+1]) > 1)
+				++lodJumps;
+			if(patchLod[p] >= 0 && i + 1 < quadtree.GetNumPatchRows() &&
+				patchLod[p + quadtree.GetNumPatchCols()] >= 0 && abs(patchLod[p] - patchLod[p + quadtree.GetNumPatchCols()]) > 1)
+				++lodJumps;
+		}
+	}
+	BenchReport("select + visible patches", selectMs, frames);
+
+	printf("  %u patches, %u LODs; per frame %.1f nodes visited, %.1f patches drawn (%.0f%%); inside/edge LOD gap %.2f\n",
+		numPatches, quadtree.GetNumLods(), (double)totalVisited / frames, (double)totalPatches / frames,
+		100.0*totalPatches / ((double)frames*numPatches), maxLodGap);
+
+	return BenchCheck(missed == 0, "every patch in the frustum is drawn") &&
+		BenchCheck(duplicates == 0, "no patch is drawn twice") &&
+		BenchCheck(lodJumps == 0, "neighboring patches within one LOD") &&
+		BenchCheck(outOfRange == 0, "nodes no coarser than a finer range allows") &&
+		BenchCheck(misplaced == 0 && maxLodGap <= 1.0f, "patches carry their node's LOD, within one of the edges'") &&
+		BenchCheck(totalPatches < (UINT)frames*numPatches, "patches outside the frustum are culled");
+}
+
+ZEUS_BENCH(HeightmapGetHeight)
+{
+	const UINT size = opts.Quick ? 513 : 2049;
+	const int queries = opts.Quick ? 100000 : 2000000;
+	const float cellSpacing = 0.5f;
+
+	Heightmap hmap;
+	LoadBenchHeightmap(opts, hmap, size);
+	hmap.Smooth();
+
+	// Stay on the map, where GetHeight and HeightQuery agree exactly.
+	float half = 0.5f*(size-1)*cellSpacing;
+
+	srand(1);
+	std::vector<XMFLOAT3> points(queries);
+	for(int i = 0; i < queries; ++i)
+		points[i] = XMFLOAT3(MathHelper::RandF(-half, half), 0.0f, MathHelper::RandF(-half, half));
+
+	BenchTimer t;
+	std::vector<float> expected(queries);
+	for(int i = 0; i < queries; ++i)
+		expected[i] = hmap.GetHeight(points[i].x, points[i].z, cellSpacing);
+	BenchReport("scalar GetHeight", t.ElapsedMs(), queries);
+
+	HeightQuery query;
+	query.Init(hmap, cellSpacing);
+
+	std::vector<float> heights(queries);
+	std::vector<float> scalarHeights(queries);
+	std::vector<XMFLOAT3> normals(queries);
+	std::vector<XMFLOAT3> scalarNormals(queries);
+
+	t.Reset();
+	query.GetHeightsScalar(&points[0], queries, &scalarHeights[0], &scalarNormals[0]);
+	BenchReport("HeightQuery scalar, heights and normals", t.ElapsedMs(), queries);
+
+	t.Reset();
+	query.GetHeights(&points[0], queries, &heights[0], 0);
+	BenchReport("HeightQuery batch, heights", t.ElapsedMs(), queries);
+	bool heightsMatch = memcmp(&heights[0], &expected[0], queries*sizeof(float)) == 0;
+
+	t.Reset();
+	query.GetHeights(&points[0], queries, &heights[0], &normals[0]);
+	BenchReport("HeightQuery batch, heights and normals", t.ElapsedMs(), queries);
+	heightsMatch = heightsMatch && memcmp(&heights[0], &expected[0], queries*sizeof(float)) == 0;
+
+	float maxNormalError = 0.0f;
+	float maxLengthError = 0.0f;
+	for(int i = 0; i < queries; ++i)
+	{
+		XMVECTOR n = XMLoadFloat3(&normals[i]);
+		XMVECTOR diff = XMVectorSubtract(n, XMLoadFloat3(&scalarNormals[i]));
+		maxNormalError = MathHelper::Max(maxNormalError, XMVectorGetX(XMVector3Length(diff)));
+		maxLengthError = MathHelper::Max(maxLengthError, fabsf(XMVectorGetX(XMVector3Length(n)) - 1.0f));
+	}
+	printf("  max normal error vs scalar %g, max length error %g\n", maxNormalError, maxLengthError);
+
+	// A few hundred agents a frame, each batch small enough to stay in the cache.
+	const UINT agents = 256;
+	const int frames = queries / agents;
+	t.Reset();
+	for(int f = 0; f < frames; ++f)
+		query.GetHeights(&points[(f*agents) % (queries - agents)], agents, &heights[0], &normals[0]);
+	BenchReport("HeightQuery, 256 agents a frame", t.ElapsedMs(), frames*agents);
+
+	// Off the map, each point reads the edge point nearest it.
+	XMFLOAT3 off[6] =
+	{
+		XMFLOAT3(-2.0f*half, 0.0f, 0.3f), XMFLOAT3(5.0f*half, 0.0f, -0.7f), XMFLOAT3(1.1f, 0.0f, 3.0f*half),
+		XMFLOAT3(-0.4f, 0.0f, -9.0f*half), XMFLOAT3(-1e30f, 0.0f, 1e30f), XMFLOAT3(sqrtf(-1.0f), 0.0f, 0.0f)
+	};
+	XMFLOAT3 edge[6] =
+	{
+		XMFLOAT3(-half, 0.0f, 0.3f), XMFLOAT3(half, 0.0f, -0.7f), XMFLOAT3(1.1f, 0.0f, half),
+		XMFLOAT3(-0.4f, 0.0f, -half), XMFLOAT3(-half, 0.0f, half), XMFLOAT3(-half, 0.0f, 0.0f)
+	};
+	float offHeights[6], edgeHeights[6];
+	XMFLOAT3 offNormals[6];
+	query.GetHeights(off, 6, offHeights, offNormals);
+	query.GetHeightsScalar(edge, 6, edgeHeights, 0);
+	bool edgesClamp = true;
+	for(int i = 0; i < 6; ++i)
+		edgesClamp = edgesClamp && fabsf(offHeights[i] - edgeHeights[i]) <= 1e-3f && offNormals[i].y > 0.0f;
+
+	return BenchCheck(expected[0] > 0.0f && expected[0] == expected[0], "heights finite and positive") &&
+		BenchCheck(heightsMatch, "batched heights match GetHeight exactly") &&
+		BenchCheck(maxNormalError <= 1e-5f && maxLengthError <= 1e-5f, "batched normals match the scalar path") &&
+		BenchCheck(edgesClamp, "points off the map read its edge");
+}
+
+ZEUS_BENCH(TerrainRaycast)
+{
+	const UINT size = opts.Quick ? 513 : 2049;
+	const UINT numRays = opts.Quick ? 2000 : 20000;
+	const UINT numChecked = opts.Quick ? 200 : 500;
+	const float cellSpacing = 0.5f;
+
+	Heightmap hmap;
+	LoadBenchHeightmap(opts, hmap, size);
+	hmap.Smooth();
+
+	HeightPyramid pyramid;
+	pyramid.Build(hmap);
+
+	float half = 0.5f*(size-1)*cellSpacing;
+	TerrainRaycaster raycaster;
+	raycaster.Init(hmap, pyramid, cellSpacing, -half, half);
+
+	// Line of sight between points a couple of meters off the ground, as hit validation
+	// casts them, and picking rays from a camera 30 meters up toward a point on the map.
+	srand(3);
+	std::vector<TerrainRay> sight(numRays);
+	std::vector<TerrainRay> picks(numRays);
+	for(UINT i = 0; i < numRays; ++i)
+	{
+		float x0 = MathHelper::RandF(-half, half);
+		float z0 = MathHelper::RandF(-half, half);
+		float x1 = MathHelper::Clamp(x0 + MathHelper::RandF(-60.0f, 60.0f), -half, half);
+		float z1 = MathHelper::Clamp(z0 + MathHelper::RandF(-60.0f, 60.0f), -half, half);
+		XMFLOAT3 p0(x0, hmap.GetHeight(x0, z0, cellSpacing) + 2.0f, z0);
+		XMFLOAT3 p1(x1, hmap.GetHeight(x1, z1, cellSpacing) + 2.0f, z1);
+
+		sight[i].Origin = p0;
+		sight[i].Direction = XMFLOAT3(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+		sight[i].MaxDistance = sqrtf(sight[i].Direction.x*sight[i].Direction.x +
+			sight[i].Direction.y*sight[i].Direction.y + sight[i].Direction.z*sight[i].Direction.z);
+
+		float tx = MathHelper::RandF(-half, half);
+		float tz = MathHelper::RandF(-half, half);
+		picks[i].Origin = XMFLOAT3(x0, p0.y + 30.0f, z0);
+		picks[i].Direction = XMFLOAT3(tx - x0, hmap.GetHeight(tx, tz, cellSpacing) - picks[i].Origin.y, tz - z0);
+		picks[i].MaxDistance = 4.0f*half;
+	}
+
+	std::vector<TerrainRayHit> sightHits(numRays);
+	std::vector<TerrainRayHit> pickHits(numRays);
+
+	BenchTimer t;
+	UINT numBlocked = raycaster.Raycast(&sight[0], numRays, &sightHits[0]);
+	BenchReport("line of sight, 2 m up, up to 85 m", t.ElapsedMs(), numRays);
+
+	t.Reset();
+	UINT numPicked = raycaster.Raycast(&picks[0], numRays, &pickHits[0]);
+	BenchReport("picking rays from 30 m up", t.ElapsedMs(), numRays);
+
+	std::vector<TerrainRayHit> threadedHits(numRays);
+	t.Reset();
+	raycaster.Raycast(&picks[0], numRays, &threadedHits[0], 0);
+	BenchReport("picking rays, all threads", t.ElapsedMs(), numRays);
+	printf("  %u of %u sight lines blocked, %u of %u picks hit\n", numBlocked, numRays, numPicked, numRays);
+
+	bool threadsAgree = true;
+	for(UINT i = 0; i < numRays; ++i)
+		threadsAgree = threadsAgree && threadedHits[i].Distance == pickHits[i].Distance;
+
+	// The first hit must be the one testing every triangle under the segment finds.
+	UINT mismatches = 0;
+	t.Reset();
+	for(UINT i = 0; i < numChecked; ++i)
+	{
+		const TerrainRay& ray = sight[i];
+		XMFLOAT3 end(ray.Origin.x + ray.Direction.x, ray.Origin.y + ray.Direction.y, ray.Origin.z + ray.Direction.z);
+		float expected = BruteForceSegment(hmap, cellSpacing, ray.Origin, end);
+
+		TerrainRayHit hit;
+		bool found = raycaster.RaycastSegment(ray.Origin, end, hit);
+		bool agree = found ? fabsf(hit.Distance - expected) <= 1e-3f : expected == MathHelper::Infinity;
+		agree = agree && hit.Distance == sightHits[i].Distance;
+		mismatches += agree ? 0 : 1;
+	}
+	BenchReport("line of sight, brute force", t.ElapsedMs(), numChecked);
+
+	// Straight down, the hit is GetHeight's height, and the normal faces up.
+	float maxHeightError = 0.0f;
+	bool normalsUp = true;
+	for(UINT i = 0; i < numChecked; ++i)
+	{
+		float x = MathHelper::RandF(-half, half);
+		float z = MathHelper::RandF(-half, half);
+		TerrainRayHit hit;
+		if(!raycaster.Raycast(XMFLOAT3(x, 1000.0f, z), XMFLOAT3(0.0f, -1.0f, 0.0f), 2000.0f, hit))
+		{
+			maxHeightError = MathHelper::Infinity;
+			break;
+		}
+		maxHeightError = MathHelper::Max(maxHeightError, fabsf(hit.Position.y - hmap.GetHeight(x, z, cellSpacing)));
+		normalsUp = normalsUp && hit.Normal.y > 0.0f;
+	}
+	printf("  %u of %u segments differ from brute force, max vertical error %g\n", mismatches, numChecked, maxHeightError);
+
+	TerrainRayHit miss;
+	bool skyward = !raycaster.Raycast(XMFLOAT3(0.0f, 1000.0f, 0.0f), XMFLOAT3(0.3f, 1.0f, 0.0f), 1e6f, miss);
+
+	return BenchCheck(mismatches == 0, "first hits match testing every triangle") &&
+		BenchCheck(maxHeightError <= 1e-3f && normalsUp, "downward rays land on GetHeight") &&
+		BenchCheck(threadsAgree, "threaded batch matches the single threaded one") &&
+		BenchCheck(skyward && numPicked > 0 && numBlocked > 0, "rays miss the sky and hit the ground");
+}
+
+namespace
+{
+	// A tile's height at (x, z) as PhysX interpolates it (Gu::HeightField's
+	// getHeightInternal2), with the tess flag set on every sample or on none.
+	float PhysXTileHeight(const HeightfieldTile& tile, float heightUnit, float cellSpacing, float x, float z, bool tessFlag)
+	{
+		float fx = (x - tile.Origin.x) / cellSpacing;
+		float fz = (z - tile.Origin.z) / cellSpacing;
+		int row = MathHelper::Clamp((int)floorf(fx), 0, (int)tile.NumRows - 2);
+		int col = MathHelper::Clamp((int)floorf(fz), 0, (int)tile.NumCols - 2);
+		float fracX = fx - (float)row;
+		float fracZ = fz - (float)col;
+
+		const short* h = &tile.Heights[row*tile.NumCols + col];
+		UINT cols = tile.NumCols;
+		float height;
+		if(tessFlag)
+		{
+			float h0 = h[0], h2 = h[cols + 1];
+			if(fracZ > fracX)
+				height = h0 + fracZ*(h[1] - h0) + fracX*(h2 - h[1]);
+			else
+				height = h0 + fracX*(h[cols] - h0) + fracZ*(h2 - h[cols]);
+		}
+		else
+		{
+			float h1 = h[1], h2 = h[cols];
+			if(fracX + fracZ < 1.0f)
+				height = h[0] + fracZ*(h1 - h[0]) + fracX*(h2 - h[0]);
+			else
+				height = h[cols + 1] + (1.0f - fracZ)*(h2 - h[cols + 1]) + (1.0f - fracX)*(h1 - h[cols + 1]);
+		}
+		return height*heightUnit;
+	}
+}
+
+ZEUS_BENCH(HeightfieldBuild)
+{
+	const UINT size = opts.Quick ? 513 : 2049;
+	const float cellSpacing = 0.5f;
+	const UINT tileCells = 128;
+
+	Heightmap hmap;
+	LoadBenchHeightmap(opts, hmap, size);
+	hmap.Smooth();
+
+	BenchTimer t;
+	HeightfieldBuilder builder(hmap, cellSpacing);
+	HeightfieldTile whole;
+	builder.BuildTile(0, 0, 0, whole);
+	BenchReport("whole heightfield", t.ElapsedMs(), 1);
+
+	// Dequantized samples must land on the rendered surface.  GetHeight reads one cell
+	// towards +x and -z, so skip the last physics row and the first column.
+	float maxError = 0.0f;
+	for(UINT r = 0; r + 1 < whole.NumRows; r += 7)
+	{
+		for(UINT c = 1; c < whole.NumCols; c += 7)
+		{
+			float x = whole.Origin.x + r*cellSpacing;
+			float z = whole.Origin.z + c*cellSpacing;
+			float h = whole.Heights[r*whole.NumCols + c]*builder.GetHeightUnit();
+			maxError = MathHelper::Max(maxError, fabsf(h - hmap.GetHeight(x, z, cellSpacing)));
+		}
+	}
+	printf("  max sample error %g (height unit %g)\n", maxError, builder.GetHeightUnit());
+
+	// Inside cells the collision surface must split along GetHeight's diagonal, as it
+	// does with the tess flag that CreateTerrainHeightField sets; the other diagonal
+	// is there to show the check can tell them apart.
+	float maxCellError = 0.0f, maxOtherError = 0.0f;
+	for(UINT r = 0; r + 1 < whole.NumRows; r += 5)
+	{
+		for(UINT c = 0; c + 1 < whole.NumCols; c += 5)
+		{
+			for(UINT k = 0; k < 4; ++k)
+			{
+				// Points either side of both diagonals.
+				float u = k & 1 ? 0.7f : 0.2f;
+				float v = k & 2 ? 0.75f : 0.3f;
+				float x = whole.Origin.x + (r + u)*cellSpacing;
+				float z = whole.Origin.z + (c + v)*cellSpacing;
+				float expected = hmap.GetHeight(x, z, cellSpacing);
+				maxCellError = MathHelper::Max(maxCellError,
+					fabsf(PhysXTileHeight(whole, builder.GetHeightUnit(), cellSpacing, x, z, true) - expected));
+				maxOtherError = MathHelper::Max(maxOtherError,
+					fabsf(PhysXTileHeight(whole, builder.GetHeightUnit(), cellSpacing, x, z, false) - expected));
+			}
+		}
+	}
+	printf("  max mid-cell error %g (other diagonal %g)\n", maxCellError, maxOtherError);
+
+	UINT numTilesX = builder.GetNumTilesX(tileCells);
+	UINT numTilesZ = builder.GetNumTilesZ(tileCells);
+	std::vector<HeightfieldTile> tiles(numTilesX*numTilesZ);
+	t.Reset();
+	for(UINT tz = 0; tz < numTilesZ; ++tz)
+		for(UINT tx = 0; tx < numTilesX; ++tx)
+			builder.BuildTile(tileCells, tx, tz, tiles[tz*numTilesX + tx]);
+	BenchReport("all tiles", t.ElapsedMs(), (int)tiles.size());
+
+	// Tiles repeat the whole heightfield and share their border samples.
+	bool tilesMatch = true;
+	for(size_t i = 0; i < tiles.size(); ++i)
+	{
+		const HeightfieldTile& tile = tiles[i];
+		UINT r0 = tile.TileX*tileCells;
+		UINT c0 = tile.TileZ*tileCells;
+		for(UINT r = 0; r < tile.NumRows; ++r)
+			for(UINT c = 0; c < tile.NumCols; ++c)
+				tilesMatch = tilesMatch && tile.Heights[r*tile.NumCols + c] == whole.Heights[(r0 + r)*whole.NumCols + c0 + c];
+	}
+
+	std::vector<UINT> nearby;
+	builder.GetTilesInRadius(tileCells, 0.0f, 0.0f, 10.0f, nearby);
+
+	return BenchCheck(whole.NumRows == size && whole.NumCols == size, "whole heightfield covers the heightmap") &&
+		BenchCheck(maxError <= builder.GetHeightUnit(), "samples match Heightmap::GetHeight") &&
+		BenchCheck(maxCellError <= builder.GetHeightUnit() && maxOtherError > maxCellError,
+			"cells split along Heightmap::GetHeight's diagonal") &&
+		BenchCheck(tilesMatch, "tiles match the whole heightfield") &&
+		BenchCheck(nearby.size() == 4, "four tiles meet at the terrain center");
+}
+
+ZEUS_BENCH(TiledTerrainStream)
+{
+	// A RAW map converted to memory-mapped 16-bit tiles, then streamed around a camera
+	// walking across it.  Full runs use an 8193^2 map, four times Terrain's 2049^2.
+	const UINT size = opts.Quick ? 1025 : 8193;
+	const UINT tileCells = opts.Quick ? 64 : 256;
+	const float cellSpacing = 0.5f;
+	const float heightScale = 50.0f;
+	const float radius = 4.0f*tileCells*cellSpacing;
+
+	std::vector<unsigned char> raw;
+	BenchMakeHeightmapRaw(raw, size, size);
+	std::string rawPath = BenchScratchPath("tiled_terrain.raw");
+	std::string tiledPath = BenchScratchPath("tiled_terrain.zth");
+	FILE* rawFile = fopen(rawPath.c_str(), "wb");
+	bool rawWritten = rawFile && fwrite(&raw[0], raw.size(), 1, rawFile) == 1;
+	if(rawFile)
+		fclose(rawFile);
+
+	BenchTimer t;
+	bool converted = rawWritten && TiledHeightmap::ConvertRaw(rawPath, size, size, 1, heightScale, true,
+		tiledPath, tileCells, TiledHeightmap::FormatUnorm16);
+	BenchReport("convert RAW to tiles", t.ElapsedMs(), 1);
+
+	TiledHeightmap tiled;
+	if(!BenchCheck(converted && tiled.Open(tiledPath), "tiled heightmap written and opened"))
+		return false;
+
+	// What Terrain builds in memory today, for reference.
+	Heightmap hmap;
+	hmap.BuildFromRaw(raw, size, size, heightScale);
+	hmap.Smooth();
+	raw.clear();
+
+	float quantum = heightScale / 65535.0f;
+	float maxSampleError = 0.0f;
+	for(UINT r = 0; r < size; r += 13)
+		for(UINT c = 0; c < size; c += 7)
+			maxSampleError = MathHelper::Max(maxSampleError, fabsf(tiled.GetSample(r, c) - hmap.At(r, c)));
+
+	// Directory bounds cover every decoded sample of their tile.
+	std::vector<float> samples(tiled.GetTileSamples()*tiled.GetTileSamples());
+	bool boundsHold = true;
+	for(UINT tz = 0; tz < tiled.GetNumTilesZ(); tz += 3)
+	{
+		for(UINT tx = 0; tx < tiled.GetNumTilesX(); tx += 3)
+		{
+			XMFLOAT2 bounds = tiled.GetTileBoundsY(tx, tz);
+			tiled.DecodeTile(tx, tz, &samples[0]);
+			for(size_t i = 0; i < samples.size(); ++i)
+				boundsHold = boundsHold && samples[i] >= bounds.x && samples[i] <= bounds.y;
+		}
+	}
+
+	// Walk corner to corner, letting the worker catch up every few frames.
+	float halfWidth = 0.5f*(size-1)*cellSpacing;
+	const int frames = opts.Quick ? 200 : 2000;
+	TerrainStreamer streamer;
+	streamer.Start(tiled, cellSpacing, radius);
+
+	UINT maxResident = 0;
+	float maxHeightError = 0.0f;
+	t.Reset();
+	for(int f = 0; f < frames; ++f)
+	{
+		float a = (float)f / (frames - 1);
+		float x = -halfWidth + a*2.0f*halfWidth;
+		float z = -halfWidth + a*2.0f*halfWidth*0.8f;
+		streamer.Update(x, z);
+		if(f % 10 == 0)
+			streamer.Flush();
+
+		maxResident = MathHelper::Max(maxResident, streamer.GetNumResident());
+		float h = streamer.GetHeight(x, z);
+		maxHeightError = MathHelper::Max(maxHeightError, fabsf(h - hmap.GetHeight(x, z, cellSpacing)));
+	}
+	BenchReport("stream walk", t.ElapsedMs(), frames);
+
+	// Resident tiles near the focus answer height queries without touching the mapping.
+	streamer.Flush();
+	TerrainStreamer::Stats before = streamer.GetStats();
+	const int queries = opts.Quick ? 100000 : 10000000;
+	float sum = 0.0f;
+	t.Reset();
+	for(int i = 0; i < queries; ++i)
+		sum += streamer.GetHeight(halfWidth*0.95f - (i % 1000)*0.01f, halfWidth*0.75f - (i % 777)*0.01f);
+	BenchReport("GetHeight, resident tiles", t.ElapsedMs(), queries);
+	TerrainStreamer::Stats after = streamer.GetStats();
+
+	// The resident set can never exceed the tiles within the eviction radius of some
+	// point, however big the map.
+	UINT span = (UINT)ceilf(2.0f*radius*TerrainStreamer::EvictScale / (tileCells*cellSpacing)) + 1;
+	printf("  %u x %u tiles, at most %u resident (bound %u), %u loads, %u evictions, sum %g\n",
+		tiled.GetNumTilesX(), tiled.GetNumTilesZ(), maxResident, span*span, after.TilesLoaded, after.TilesEvicted, sum);
+	streamer.Stop();
+
+	// 32-bit tiles round trip exactly.
+	std::string floatPath = BenchScratchPath("tiled_terrain_f32.zth");
+	TiledHeightmap floatTiled;
+	bool floatExact = TiledHeightmap::Write(floatPath, hmap, tileCells, TiledHeightmap::FormatFloat32) &&
+		floatTiled.Open(floatPath);
+	for(UINT r = 0; r < size && floatExact; r += 11)
+		for(UINT c = 0; c < size && floatExact; c += 5)
+			floatExact = floatTiled.GetSample(r, c) == hmap.At(r, c);
+	floatTiled.Close();
+
+	// Headers whose tile stride cannot hold a tile, or whose tiles would run past the
+	// end of the file only through overflow, are refused.  TileStride is the header's
+	// last field, 48 bytes in.
+	std::vector<char> fileBytes;
+	if(FILE* file = fopen(floatPath.c_str(), "rb"))
+	{
+		char buffer[4096];
+		size_t n;
+		while((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+			fileBytes.insert(fileBytes.end(), buffer, buffer + n);
+		fclose(file);
+	}
+
+	bool corruptRejected = fileBytes.size() > 56;
+	const UINT64 badStrides[] = { 4, 0x8000000000000000ull };
+	for(UINT i = 0; i < 2 && corruptRejected; ++i)
+	{
+		std::vector<char> corrupt = fileBytes;
+		memcpy(&corrupt[48], &badStrides[i], sizeof(UINT64));
+		FILE* file = fopen(floatPath.c_str(), "wb");
+		corruptRejected = file && fwrite(&corrupt[0], 1, corrupt.size(), file) == corrupt.size();
+		if(file)
+			fclose(file);
+		corruptRejected = corruptRejected && !floatTiled.Open(floatPath);
+	}
+
+	tiled.Close();
+	remove(rawPath.c_str());
+	remove(tiledPath.c_str());
+	remove(floatPath.c_str());
+
+	return BenchCheck(maxSampleError <= quantum, "16-bit tiles match the smoothed heightmap") &&
+		BenchCheck(boundsHold, "tile bounds cover their samples") &&
+		BenchCheck(maxHeightError <= 2.0f*quantum, "streamed heights match Heightmap::GetHeight") &&
+		BenchCheck(maxResident <= span*span, "resident tiles bounded by the radius") &&
+		BenchCheck(after.HeightMisses == before.HeightMisses, "resident queries never miss") &&
+		BenchCheck(floatExact, "32-bit tiles are exact") &&
+		BenchCheck(corruptRejected, "corrupt tile strides are refused");
+}
+
+ZEUS_BENCH(VirtualTextureStream)
+{
+	const UINT frames = opts.Quick ? 60 : 600;
+	const UINT settleFrames = 40;
+	const float worldSize = 2048.0f;
+
+	// A 64K^2 blend map over the whole world against a 16K^2 one: the same camera needs
+	// about the same pages from both.
+	const float texelsPerMeter[2] = { 32.0f, 8.0f };
+	bool consistent = true;
+	bool settled = true;
+	bool evicted = true;
+	UINT onScreen[2] = { 0, 0 };
+
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		VirtualTexture::InitInfo info;
+		info.Width = (UINT)(worldSize*texelsPerMeter[pass]);
+		info.Height = info.Width;
+		info.PageSize = 128;
+		info.Border = 4;
+		info.BytesPerTexel = 4;
+		info.NumSlots = 512;
+		info.MaxPagesPerUpdate = 32;
+
+		UINT side = info.PageSize + 2*info.Border;
+		HashPageSource source(side*side);
+		VirtualTexture vt;
+		vt.Init(info, &source);
+
+		// Fly a loop at 20 m, then hover until everything asked for is in.
+		double feedbackMs = 0.0;
+		double updateMs = 0.0;
+		UINT missing = 0;
+		for(UINT f = 0; f < frames + settleFrames; ++f)
+		{
+			float a = 2.0f*MathHelper::Pi*MathHelper::Min(f, frames) / frames;
+			XMFLOAT3 eye(0.3f*worldSize*cosf(a), 20.0f, 0.3f*worldSize*sinf(a));
+
+			BenchTimer t;
+			TerrainFeedback(vt, eye, -a, worldSize, texelsPerMeter[pass]);
+			feedbackMs += t.ElapsedMs();
+
+			t.Reset();
+			vt.Update();
+			updateMs += t.ElapsedMs();
+			vt.ClearDirty();
+
+			missing = vt.GetStats().PagesMissing;
+			if(f % 50 == 0)
+				consistent = consistent && PageTableConsistent(vt);
+		}
+		consistent = consistent && PageTableConsistent(vt);
+		settled = settled && missing == 0;
+
+		const VirtualTexture::Stats& stats = vt.GetStats();
+		onScreen[pass] = stats.PagesRequested;
+		evicted = evicted && stats.TotalEvicted > 0;
+		double virtualMB = (double)info.Width*info.Height*info.BytesPerTexel*4.0/3.0 / (1024.0*1024.0);
+		double physicalMB = (double)info.NumSlots*vt.GetSlotBytes() / (1024.0*1024.0);
+		printf("  %ux%u virtual (%.0f MB with mips) in %.0f MB of slots: %u mips, %u pages on screen, %u built, %u evicted\n",
+			info.Width, info.Height, virtualMB, physicalMB, vt.GetNumMips(), onScreen[pass], stats.TotalBuilt, stats.TotalEvicted);
+		BenchReport(pass == 0 ? "64K^2 CPU feedback, per frame" : "16K^2 CPU feedback, per frame", feedbackMs, frames + settleFrames);
+		BenchReport(pass == 0 ? "64K^2 Update, per frame" : "16K^2 Update, per frame", updateMs, frames + settleFrames);
+	}
+
+	return BenchCheck(consistent, "page table entries name their page or its nearest ancestor") &&
+		BenchCheck(settled, "a still camera gets every page it asks for") &&
+		BenchCheck(evicted, "pages that leave the screen are evicted for new ones") &&
+		BenchCheck(onScreen[0] <= 512 && onScreen[1] <= 512, "both sizes fit the screen's pages in the same slots");
+}
+
+ZEUS_BENCH(TextureLoad)
+{
+	// What ZeusApp::Init loads, the terrain's layer array aside.
+	const char* files[] =
+	{
+		"Textures/floor.dds", "Textures/bricks.dds", "Textures/nvidiaFlag_d.jpg", "Textures/floor_nmap.dds",
+		"Textures/bricks_nmap.dds", "Textures/stones.dds", "Textures/stones_nmap.dds", "Textures/sky.dds",
+		"Textures/flare0.dds", "Textures/raindrop.dds"
+	};
+	const UINT numFiles = sizeof(files) / sizeof(files[0]);
+	const int iterations = opts.Quick ? 2 : 20;
+
+	std::vector<TextureData> serial(numFiles);
+	bool loaded = true;
+	BenchTimer t;
+	for(int it = 0; it < iterations; ++it)
+	{
+		// Into fresh buffers each time, as the loader's are.
+		for(UINT i = 0; i < numFiles; ++i)
+		{
+			TextureData tex;
+			loaded = tex.Load(opts.AssetPath(files[i])) && loaded;
+			serial[i] = std::move(tex);
+		}
+	}
+	BenchReport("one at a time", t.ElapsedMs(), iterations);
+
+	// Every subresource accounted for: the layout covers the file past its header.
+	bool layoutMatches = true;
+	for(UINT i = 0; i < numFiles && loaded; ++i)
+	{
+		FILE* file = fopen(opts.AssetPath(files[i]).c_str(), "rb");
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fclose(file);
+
+		const TextureData& tex = serial[i];
+		size_t header = tex.IsEncoded() ? 0 : 128;
+		layoutMatches = layoutMatches && tex.Texels.size() + header == (size_t)size;
+	}
+
+	// floor.dds is 512^2 DXT1 without mips, grass.dds 512^2 X8R8G8B8 with a full chain.
+	const TextureData& floor = serial[0];
+	bool floorLayout = loaded && floor.Format == DXGI_FORMAT_BC1_UNORM && floor.MipLevels == 1 &&
+		floor.Subresources[0].RowPitch == 128*8;
+
+	TextureLoader loader;
+	loader.Start();
+	std::vector<TextureData> parallel(numFiles);
+	bool same = true;
+	t.Reset();
+	for(int it = 0; it < iterations; ++it)
+	{
+		TextureLoader::Handle handles[numFiles];
+		for(UINT i = 0; i < numFiles; ++i)
+			handles[i] = loader.Load(opts.AssetPath(files[i]));
+		for(UINT i = 0; i < numFiles; ++i)
+			same = loader.Take(handles[i], parallel[i]) && same;
+	}
+	BenchReport("TextureLoader, all queued", t.ElapsedMs(), iterations);
+
+	for(UINT i = 0; i < numFiles; ++i)
+		same = same && parallel[i].Texels == serial[i].Texels;
+
+	// The terrain's layers, X8 and A8 files mixed, read into one array.
+	std::vector<std::string> layers;
+	layers.push_back(opts.AssetPath("Textures/grass.dds"));
+	layers.push_back(opts.AssetPath("Textures/darkdirt.dds"));
+	layers.push_back(opts.AssetPath("Textures/stone.dds"));
+	layers.push_back(opts.AssetPath("Textures/lightdirt.dds"));
+	layers.push_back(opts.AssetPath("Textures/snow.dds"));
+
+	TextureData layerArray;
+	t.Reset();
+	TextureLoader::Handle arrayHandle = loader.LoadArray(layers);
+	bool arrayLoaded = loader.Take(arrayHandle, layerArray);
+	BenchReport("terrain layer array", t.ElapsedMs(), 1);
+
+	bool arrayLayout = arrayLoaded && layerArray.ArraySize == 5 && layerArray.MipLevels == 10 &&
+		layerArray.Format == DXGI_FORMAT_B8G8R8A8_UNORM && layerArray.Subresources.size() == 50;
+	bool opaque = arrayLoaded;
+	for(UINT mip = 0; mip < layerArray.MipLevels && opaque; ++mip)
+	{
+		const TextureSubresource& s = layerArray.Subresources[layerArray.GetSubresource(mip, 0)];
+		const BYTE* texels = layerArray.GetTexels(layerArray.GetSubresource(mip, 0));
+		for(UINT k = 3; k < s.SlicePitch && opaque; k += 4)
+			opaque = texels[k] == 0xff;
+	}
+
+	// A slice laid out as the file it came from.
+	TextureData snow;
+	bool sliceMatches = arrayLoaded && snow.LoadDds(layers[4]) &&
+		memcmp(layerArray.GetTexels(layerArray.GetSubresource(0, 4)), &snow.Texels[0], snow.Texels.size()) == 0;
+
+	std::vector<std::string> mismatched;
+	mismatched.push_back(opts.AssetPath("Textures/grass.dds"));
+	mismatched.push_back(opts.AssetPath("Textures/bricks.dds"));
+	TextureData rejected;
+	bool mismatchFails = !loader.Take(loader.LoadArray(mismatched), rejected) && rejected.Texels.empty();
+	bool missingFails = !loader.Take(loader.Load(opts.AssetPath("Textures/missing.dds")), rejected);
+	loader.Stop();
+
+	return BenchCheck(loaded, "every texture loads") &&
+		BenchCheck(layoutMatches, "subresources cover each DDS file exactly") &&
+		BenchCheck(floorLayout, "DXT1 pitch is per 4x4 block") &&
+		BenchCheck(same, "loader threads match serial loads") &&
+		BenchCheck(arrayLayout, "layer array has every slice and mip") &&
+		BenchCheck(opaque, "X8R8G8B8 slices get opaque alpha") &&
+		BenchCheck(sliceMatches, "array slices match their files") &&
+		BenchCheck(mismatchFails, "mismatched array slices are rejected") &&
+		BenchCheck(missingFails, "missing files fail");
+}
+
+ZEUS_BENCH(GeometryGenerator)
+{
+	const int iterations = opts.Quick ? 20 : 200;
+
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData box, sphere, geosphere, cylinder, grid;
+
+	BenchTimer t;
+	for(int i = 0; i < iterations; ++i)
+	{
+		geoGen.CreateBox(1.0f, 1.0f, 1.0f, box);
+		geoGen.CreateSphere(1.0f, 20, 20, sphere);
+		geoGen.CreateGeosphere(1.0f, 3, geosphere);
+		geoGen.CreateCylinder(0.5f, 0.5f, 3.0f, 15, 15, cylinder);
+		geoGen.CreateGrid(20.0f, 30.0f, 50, 40, grid);
+	}
+	BenchReport("scene shapes", t.ElapsedMs(), iterations);
+
+	return BenchCheck(box.Indices.size() == 36, "box index count") &&
+		BenchCheck(grid.Vertices.size() == 50*40, "grid vertex count");
+}
+
+ZEUS_BENCH(ObjLoad)
+{
+	const int iterations = opts.Quick ? 1 : 5;
+	const char* models[] = { "cow.obj", "tree1.obj", "bug.obj", "largetree.obj", "building.obj" };
+	const UINT numModels = sizeof(models) / sizeof(models[0]);
+
+	ObjLoader loader;
+	GeometryGenerator::MeshData meshes[numModels];
+	std::vector<GeometryGenerator::Vertex> corners[numModels];
+
+	BenchTimer t;
+	bool referenceLoaded = true;
+	for(int i = 0; i < iterations; ++i)
+	{
+		for(UINT m = 0; m < numModels; ++m)
+			referenceLoaded = ReferenceObjCorners(opts.AssetPath(std::string("Models/") + models[m]), corners[m]) && referenceLoaded;
+	}
+	BenchReport("Models/*.obj, ifstream reference", t.ElapsedMs(), iterations);
+
+	t.Reset();
+	bool loaded = true;
+	for(int i = 0; i < iterations; ++i)
+	{
+		for(UINT m = 0; m < numModels; ++m)
+			loaded = loader.Load(opts.AssetPath(std::string("Models/") + models[m]), meshes[m]) && loaded;
+	}
+	BenchReport("Models/*.obj", t.ElapsedMs(), iterations);
+
+	GeometryGenerator::MeshData& cow = meshes[0];
+	t.Reset();
+	for(int i = 0; i < iterations; ++i)
+		loaded = loader.Load(opts.AssetPath("Models/cow.obj"), cow) && loaded;
+	BenchReport("cow.obj", t.ElapsedMs(), iterations);
+
+	bool same = loaded && referenceLoaded;
+	size_t numTriangles = 0;
+	for(UINT m = 0; m < numModels && same; ++m)
+	{
+		same = SameCorners(meshes[m], corners[m]);
+		numTriangles += meshes[m].Indices.size() / 3;
+	}
+
+	// Chunks split at arbitrary lines must give the single threaded result.
+	std::vector<char> text;
+	FILE* file = fopen(opts.AssetPath("Models/tree1.obj").c_str(), "rb");
+	if(file)
+	{
+		fseek(file, 0, SEEK_END);
+		text.resize((size_t)ftell(file));
+		fseek(file, 0, SEEK_SET);
+		if(text.empty() || fread(&text[0], text.size(), 1, file) != 1)
+			text.clear();
+		fclose(file);
+	}
+	GeometryGenerator::MeshData serial, split;
+	bool chunked = !text.empty() && loader.Parse(&text[0], text.size(), serial, 1) && loader.Parse(&text[0], text.size(), split, 7) &&
+		serial.Indices == split.Indices && serial.Vertices.size() == split.Vertices.size() &&
+		memcmp(&serial.Vertices[0], &split.Vertices[0], serial.Vertices.size()*sizeof(GeometryGenerator::Vertex)) == 0;
+
+	// Relative numbers, a quad, CRLF, comments and a corner sharing v but not vt.
+	const char quad[] =
+		"# quad\r\nv 0 0 0\r\nv 1 0 0\r\nv 1 1 0\r\nv 0 1 0\r\nvt 0 0\r\nvt 1 .5\r\ng side\r\n"
+		"f -4/1 -3/2 -2/2 -1/1\r\nf 1/2 2/2 3/2";
+	GeometryGenerator::MeshData small;
+	bool parsed = loader.Parse(quad, sizeof(quad) - 1, small) && small.Indices.size() == 9 && small.Vertices.size() == 5 &&
+		small.Indices[3] == 0 && small.Indices[5] == 3 && small.Vertices[1].TexC.y == 0.5f && small.Indices[6] == 4 && small.Indices[7] == 1 && small.Vertices[4].TexC.x == 1.0f;
+
+	const char badIndex[] = "v 0 0 0\nv 1 0 0\nf 1 2 3\n";
+	const char badNumber[] = "v 0 x 0\n";
+	// Too many digits for an int saturate and are out of range, not wrapped into it.
+	const char hugeIndex[] = "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 42949672963\nf 1 2 -42949672963\n";
+	bool refused = !loader.Parse(badIndex, sizeof(badIndex) - 1, small) && !loader.Parse(badNumber, sizeof(badNumber) - 1, small) &&
+		!loader.Parse(hugeIndex, sizeof(hugeIndex) - 1, small) && !loader.Load(opts.AssetPath("Models/missing.obj"), small);
+
+	return BenchCheck(loaded, "Models/*.obj load") &&
+		BenchCheck(cow.Vertices.size() == 11610, "cow vertex count") &&
+		BenchCheck(cow.Indices.size() == 23216*3, "cow index count") &&
+		BenchCheck(same, "every corner matches the ifstream reference") &&
+		BenchCheck(numTriangles == 37616 + 2524, "bug.obj quads give two triangles each") &&
+		BenchCheck(chunked, "parallel chunks match one thread") &&
+		BenchCheck(parsed, "relative indices, quads and CRLF") &&
+		BenchCheck(refused, "missing elements, bad and huge numbers and files fail");
+}
+
+ZEUS_BENCH(CookedMeshCache)
+{
+	// ZeusApp::CreateTreeMatrixes registers the same tree mesh once per tree; every
+	// registration after the first should cost one hash and a map lookup.
+	const int instances = opts.Quick ? 29 : 290;
+
+	ObjLoader loader;
+	GeometryGenerator::MeshData cow;
+	if(!BenchCheck(loader.Load(opts.AssetPath("Models/cow.obj"), cow), "Models/cow.obj loads"))
+		return false;
+
+	std::vector<XMFLOAT3> verts(cow.Vertices.size());
+	for(size_t i = 0; i < cow.Vertices.size(); ++i)
+		verts[i] = cow.Vertices[i].Position;
+	std::vector<int> inds(cow.Indices.begin(), cow.Indices.end());
+
+	BenchTimer t;
+	UINT64 hash = 0;
+	for(int i = 0; i < instances; ++i)
+		hash = CookedMeshCache::HashMesh(&verts[0].x, (UINT)verts.size(), &inds[0], (UINT)inds.size(), 1);
+	BenchReport("hash per instance", t.ElapsedMs(), instances);
+
+	// Stand-in for a cooked stream; the cache does not interpret the bytes.
+	const unsigned char* blob = (const unsigned char*)&inds[0];
+	UINT64 blobSize = inds.size()*sizeof(int);
+
+	CookedMeshCache cache("zeus_bench_cache");
+	t.Reset();
+	bool stored = cache.Store(hash, blob, blobSize);
+	BenchReport("store", t.ElapsedMs(), 1);
+
+	std::vector<unsigned char> loaded;
+	t.Reset();
+	bool found = cache.Load(hash, loaded);
+	BenchReport("load", t.ElapsedMs(), 1);
+
+	verts[0].x += 1.0f;
+	UINT64 editedHash = CookedMeshCache::HashMesh(&verts[0].x, (UINT)verts.size(), &inds[0], (UINT)inds.size(), 1);
+	UINT64 saltedHash = CookedMeshCache::HashMesh(&verts[0].x, (UINT)verts.size(), &inds[0], (UINT)inds.size(), 2);
+	std::vector<unsigned char> missing;
+
+	return BenchCheck(stored, "entry stored") &&
+		BenchCheck(found && loaded.size() == blobSize && memcmp(&loaded[0], blob, (size_t)blobSize) == 0, "entry round trips") &&
+		BenchCheck(editedHash != hash && saltedHash != editedHash, "hash covers geometry and salt") &&
+		BenchCheck(!cache.Load(editedHash, missing), "unknown hash misses");
+}
+
+namespace
+{
+	// Overwrites NumIndices in one entry of the submesh or LOD table, whose offset the
+	// mesh header holds tableField bytes in, the way a corrupt file would have it.
+	bool CorruptIndexCount(const std::string& path, long tableField, size_t entrySize, UINT entry, UINT numIndices)
+	{
+		FILE* file = fopen(path.c_str(), "r+b");
+		if(!file)
+			return false;
+
+		UINT64 tableOffset = 0;
+		bool written = fseek(file, tableField, SEEK_SET) == 0 && fread(&tableOffset, sizeof(tableOffset), 1, file) == 1 &&
+			fseek(file, (long)(tableOffset + entry*entrySize + sizeof(UINT)), SEEK_SET) == 0 &&
+			fwrite(&numIndices, sizeof(numIndices), 1, file) == 1;
+		fclose(file);
+		return written;
+	}
+}
+
+ZEUS_BENCH(MeshFileLoad)
+{
+	const int iterations = opts.Quick ? 2 : 20;
+	std::string objPath = opts.AssetPath("Models/cow.obj");
+	std::string meshPath = BenchScratchPath("cow.zmsh");
+
+	BenchTimer t;
+	bool converted = MeshFile::ConvertObj(objPath, meshPath);
+	BenchReport("convert cow.obj", t.ElapsedMs(), 1);
+
+	ObjLoader loader;
+	GeometryGenerator::MeshData cow;
+	t.Reset();
+	for(int i = 0; i < iterations; ++i)
+		loader.Load(objPath, cow);
+	BenchReport("parse cow.obj", t.ElapsedMs(), iterations);
+
+	// Open, then read every byte once, as CreateBuffer would.
+	MeshFile mesh;
+	bool opened = true;
+	float sum = 0.0f;
+	t.Reset();
+	for(int i = 0; i < iterations; ++i)
+	{
+		opened = mesh.Open(meshPath) && opened;
+		const float* v = (const float*)mesh.GetVertices();
+		for(UINT k = 0; k < mesh.GetNumVertices()*mesh.GetVertexStride()/4; ++k)
+			sum += v[k];
+		for(UINT k = 0; k < mesh.GetNumIndices(); ++k)
+			sum += (float)mesh.GetIndices()[k];
+	}
+	BenchReport("map cow.zmsh", t.ElapsedMs(), iterations);
+	printf("  %u vertices, %u indices, sum %g\n", mesh.GetNumVertices(), mesh.GetNumIndices(), sum);
+
+	// ConvertObj reorders the mesh as it writes it.
+	MeshOptimizer::OptimizeMesh(cow);
+
+	// Coarser LODs follow LOD 0 in the index buffer.
+	bool same = opened && converted && mesh.GetNumVertices() == cow.Vertices.size() &&
+		mesh.GetNumLods() > 0 && mesh.GetLods()[0].FirstIndex == 0 && mesh.GetLods()[0].NumIndices == cow.Indices.size() &&
+		mesh.GetNumIndices() >= cow.Indices.size() && mesh.GetVertexFormat() == MeshFile::FormatBasic32;
+	const MeshVertexBasic32* verts = (const MeshVertexBasic32*)mesh.GetVertices();
+	for(UINT i = 0; i < mesh.GetNumVertices() && same; ++i)
+	{
+		same = memcmp(&verts[i].Pos, &cow.Vertices[i].Position, sizeof(XMFLOAT3)) == 0 &&
+			memcmp(&verts[i].Normal, &cow.Vertices[i].Normal, sizeof(XMFLOAT3)) == 0;
+	}
+	same = same && memcmp(mesh.GetIndices(), &cow.Indices[0], cow.Indices.size()*sizeof(UINT)) == 0;
+
+	// The same box ZeusApp computed from the parsed vertices.
+	XNA::AxisAlignedBox box;
+	XNA::ComputeBoundingAxisAlignedBoxFromPoints(&box, (UINT)cow.Vertices.size(), &cow.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+	XNA::AxisAlignedBox fileBox = mesh.GetBounds();
+	bool bounds = opened && memcmp(&box.Center, &fileBox.Center, sizeof(XMFLOAT3)) == 0 &&
+		memcmp(&box.Extents, &fileBox.Extents, sizeof(XMFLOAT3)) == 0;
+	bool wholeSubmesh = opened && mesh.GetNumSubmeshes() == 1 && mesh.GetSubmeshes()[0].NumIndices == mesh.GetLods()[0].NumIndices &&
+		mesh.GetSubmeshes()[0].NumVertices == mesh.GetNumVertices();
+	mesh.Close();
+
+	// Two submeshes of tangent-frame vertices, as the FBX path writes them.
+	std::vector<MeshVertexPosNormalTexTan> quads(8, MeshVertexPosNormalTexTan());
+	for(UINT i = 0; i < 8; ++i)
+	{
+		quads[i].Pos = XMFLOAT3((float)(i & 1), (float)((i >> 1) & 1), i < 4 ? 0.0f : 5.0f);
+		quads[i].TexNum = i < 4 ? 0 : 1;
+	}
+	UINT quadIndices[12] = { 0, 1, 2, 2, 1, 3, 4, 5, 6, 6, 5, 7 };
+	MeshSubmesh parts[2] = { MeshSubmesh(), MeshSubmesh() };
+	parts[0].NumIndices = 6;
+	parts[1].FirstIndex = 6;
+	parts[1].NumIndices = 6;
+	parts[1].Material = 1;
+	std::string quadPath = BenchScratchPath("quads.zmsh");
+	bool submeshes = MeshFile::Write(quadPath, MeshFile::FormatPosNormalTexTan, &quads[0], 8, quadIndices, 12, parts, 2) &&
+		mesh.Open(quadPath) && mesh.GetVertexStride() == 48 && mesh.GetNumSubmeshes() == 2;
+	if(submeshes)
+	{
+		const MeshSubmesh& s = mesh.GetSubmeshes()[1];
+		submeshes = s.FirstVertex == 4 && s.NumVertices == 4 && s.Material == 1 &&
+			s.BoundsCenter.z == 5.0f && s.BoundsExtents.x == 0.5f && mesh.GetPosition(7).z == 5.0f &&
+			((UINT64)mesh.GetVertices() & 15) == 0 && ((UINT64)mesh.GetIndices() & 15) == 0;
+	}
+	mesh.Close();
+
+	// Submesh and LOD ranges past the end of the index stream are refused.  Both tables
+	// start FirstIndex, NumIndices; the header holds their offsets 72 and 80 bytes in.
+	bool badRanges = true;
+	const long tableFields[2] = { 72, 80 };
+	const size_t entrySizes[2] = { sizeof(MeshSubmesh), sizeof(MeshLod) };
+	for(UINT i = 0; i < 2 && badRanges; ++i)
+	{
+		badRanges = MeshFile::Write(quadPath, MeshFile::FormatPosNormalTexTan, &quads[0], 8, quadIndices, 12, parts, 2) &&
+			mesh.Open(quadPath);
+		mesh.Close();
+		badRanges = badRanges && CorruptIndexCount(quadPath, tableFields[i], entrySizes[i], 1 - i, 13) && !mesh.Open(quadPath);
+	}
+
+	bool badIndex = !MeshFile::Write(quadPath, MeshFile::FormatPosNormalTexTan, &quads[0], 7, quadIndices, 12, 0, 0);
+
+	// A truncated file is refused rather than read past its end.
+	FILE* file = fopen(meshPath.c_str(), "r+b");
+	bool truncated = false;
+	if(file)
+	{
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		std::vector<unsigned char> bytes((size_t)size);
+		fseek(file, 0, SEEK_SET);
+		truncated = fread(&bytes[0], bytes.size(), 1, file) == 1;
+		fclose(file);
+
+		std::string cutPath = BenchScratchPath("cut.zmsh");
+		file = fopen(cutPath.c_str(), "wb");
+		truncated = truncated && file && fwrite(&bytes[0], bytes.size() - 100, 1, file) == 1;
+		if(file)
+			fclose(file);
+		truncated = truncated && !mesh.Open(cutPath);
+		remove(cutPath.c_str());
+	}
+
+	bool stale = !MeshFile::IsStale(meshPath, objPath) && MeshFile::IsStale(BenchScratchPath("none.zmsh"), objPath);
+
+	remove(meshPath.c_str());
+	remove(quadPath.c_str());
+
+	return BenchCheck(same, "mapped cow matches the parsed OBJ") &&
+		BenchCheck(bounds, "header bounds match XNA's") &&
+		BenchCheck(wholeSubmesh, "one submesh covers an OBJ") &&
+		BenchCheck(submeshes, "submesh ranges, bounds and stream alignment") &&
+		BenchCheck(badIndex, "out of range indices are refused") &&
+		BenchCheck(badRanges, "out of range submeshes and LODs are refused") &&
+		BenchCheck(truncated, "truncated files are refused") &&
+		BenchCheck(stale, "staleness follows file times");
+}
+
+ZEUS_BENCH(MeshOptimize)
+{
+	const int iterations = opts.Quick ? 1 : 5;
+	const char* models[] = { "cow.obj", "tree1.obj", "bug.obj", "largetree.obj", "building.obj" };
+
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData meshes[8];
+	ObjLoader loader;
+	bool loaded = true;
+	for(UINT m = 0; m < 5; ++m)
+		loaded = loader.Load(opts.AssetPath(std::string("Models/") + models[m]), meshes[m]) && loaded;
+	geoGen.CreateSphere(1.0f, 20, 20, meshes[5]);
+	geoGen.CreateCylinder(0.5f, 0.5f, 3.0f, 15, 15, meshes[6]);
+	geoGen.CreateGeosphere(1.0f, 3, meshes[7]);
+	const char* names[8] = { models[0], models[1], models[2], models[3], models[4], "sphere", "cylinder", "geosphere" };
+
+	bool better = loaded;
+	bool sameTriangles = loaded;
+	bool fetchOrder = loaded;
+	bool overdrawCost = loaded;
+	double totalMs = 0.0;
+	for(UINT m = 0; m < 8; ++m)
+	{
+		GeometryGenerator::MeshData& mesh = meshes[m];
+		UINT numVertices = (UINT)mesh.Vertices.size();
+		UINT numIndices = (UINT)mesh.Indices.size();
+		if(numIndices == 0)
+		{
+			better = false;
+			continue;
+		}
+
+		// Each triangle as its positions, rotated to start at the smallest, so the
+		// optimized list can be checked to hold the same triangles facing the same way.
+		std::vector<std::string> expected;
+		for(UINT t = 0; t < numIndices; t += 3)
+		{
+			XMFLOAT3 p[3];
+			for(UINT k = 0; k < 3; ++k)
+				p[k] = mesh.Vertices[mesh.Indices[t + k]].Position;
+			UINT first = 0;
+			for(UINT k = 1; k < 3; ++k)
+				first = memcmp(&p[k], &p[first], sizeof(XMFLOAT3)) < 0 ? k : first;
+			std::string key;
+			for(UINT k = 0; k < 3; ++k)
+				key.append((const char*)&p[(first + k) % 3], sizeof(XMFLOAT3));
+			expected.push_back(key);
+		}
+		std::sort(expected.begin(), expected.end());
+
+		// Tipsify alone, to see what the overdraw clustering gives up.
+		std::vector<UINT> tipsified(numIndices);
+		MeshOptimizer::OptimizeVertexCache(&tipsified[0], &mesh.Indices[0], numIndices, numVertices);
+		VertexCacheStats tipsify = MeshOptimizer::AnalyzeVertexCache(&tipsified[0], numIndices, numVertices);
+
+		GeometryGenerator::MeshData optimized;
+		VertexCacheStats before, after;
+		BenchTimer t;
+		for(int i = 0; i < iterations; ++i)
+		{
+			optimized = mesh;
+			MeshOptimizer::OptimizeMesh(optimized, &before, &after);
+		}
+		totalMs += t.ElapsedMs();
+		printf("  %-14s ACMR %.3f -> %.3f (Tipsify %.3f)  ATVR %.3f -> %.3f\n",
+			names[m], before.ACMR, after.ACMR, tipsify.ACMR, before.ATVR, after.ATVR);
+
+		better = better && after.ACMR <= before.ACMR && after.ATVR <= before.ATVR;
+		overdrawCost = overdrawCost && after.ACMR <= tipsify.ACMR*1.1f;
+
+		std::vector<std::string> result;
+		UINT highest = 0;
+		for(UINT t = 0; t < numIndices && fetchOrder; t += 3)
+		{
+			XMFLOAT3 p[3];
+			for(UINT k = 0; k < 3; ++k)
+			{
+				UINT v = optimized.Indices[t + k];
+				fetchOrder = v <= highest && v < optimized.Vertices.size();
+				highest = MathHelper::Max(highest, v + 1);
+				if(!fetchOrder)
+					break;
+				p[k] = optimized.Vertices[v].Position;
+			}
+			if(!fetchOrder)
+				break;
+
+			UINT first = 0;
+			for(UINT k = 1; k < 3; ++k)
+				first = memcmp(&p[k], &p[first], sizeof(XMFLOAT3)) < 0 ? k : first;
+			std::string key;
+			for(UINT k = 0; k < 3; ++k)
+				key.append((const char*)&p[(first + k) % 3], sizeof(XMFLOAT3));
+			result.push_back(key);
+		}
+		std::sort(result.begin(), result.end());
+		sameTriangles = sameTriangles && fetchOrder && result == expected;
+	}
+	BenchReport("optimize all", totalMs, iterations);
+
+	return BenchCheck(loaded, "Models/*.obj load") &&
+		BenchCheck(better, "ACMR and ATVR never get worse") &&
+		BenchCheck(overdrawCost, "overdraw clustering costs under 10% ACMR") &&
+		BenchCheck(fetchOrder, "vertices are numbered in first use order") &&
+		BenchCheck(sameTriangles, "the same triangles, wound the same way");
+}
+
+namespace
+{
+	float DistanceSq(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+		return dx*dx + dy*dy + dz*dz;
+	}
+
+	// Squared distance from p to triangle abc, by the closest point of Real-Time
+	// Collision Detection 5.1.5.
+	float DistanceSqToTriangle(const XMFLOAT3& p, const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+	{
+		XMVECTOR P = XMLoadFloat3(&p), A = XMLoadFloat3(&a), B = XMLoadFloat3(&b), C = XMLoadFloat3(&c);
+		XMVECTOR ab = B - A, ac = C - A, ap = P - A;
+		float d1 = XMVectorGetX(XMVector3Dot(ab, ap)), d2 = XMVectorGetX(XMVector3Dot(ac, ap));
+		XMVECTOR closest;
+		if(d1 <= 0.0f && d2 <= 0.0f)
+			closest = A;
+		else
+		{
+			XMVECTOR bp = P - B;
+			float d3 = XMVectorGetX(XMVector3Dot(ab, bp)), d4 = XMVectorGetX(XMVector3Dot(ac, bp));
+			XMVECTOR cp = P - C;
+			float d5 = XMVectorGetX(XMVector3Dot(ab, cp)), d6 = XMVectorGetX(XMVector3Dot(ac, cp));
+			float vc = d1*d4 - d3*d2, vb = d5*d2 - d1*d6, va = d3*d6 - d5*d4;
+			if(d3 >= 0.0f && d4 <= d3)
+				closest = B;
+			else if(d6 >= 0.0f && d5 <= d6)
+				closest = C;
+			else if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+				closest = A + ab*(d1 / (d1 - d3));
+			else if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+				closest = A + ac*(d2 / (d2 - d6));
+			else if(va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+				closest = B + (C - B)*((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+			else
+			{
+				float denom = 1.0f / (va + vb + vc);
+				closest = A + ab*(vb*denom) + ac*(vc*denom);
+			}
+		}
+		return XMVectorGetX(XMVector3LengthSq(P - closest));
+	}
+
+	// Edges used by exactly one triangle of the range.
+	UINT CountBorderEdges(const UINT* indices, UINT numIndices)
+	{
+		std::map<std::pair<UINT, UINT>, int> edges;
+		for(UINT t = 0; t < numIndices; t += 3)
+		{
+			for(UINT k = 0; k < 3; ++k)
+			{
+				UINT a = indices[t + k], b = indices[t + (k + 1) % 3];
+				++edges[std::make_pair(MathHelper::Min(a, b), MathHelper::Max(a, b))];
+			}
+		}
+
+		UINT border = 0;
+		for(std::map<std::pair<UINT, UINT>, int>::const_iterator i = edges.begin(); i != edges.end(); ++i)
+			border += i->second == 1 ? 1 : 0;
+		return border;
+	}
+}
+
+ZEUS_BENCH(MeshLod)
+{
+	const int iterations = opts.Quick ? 1 : 3;
+	const char* models[] = { "cow.obj", "tree1.obj", "bug.obj", "largetree.obj", "building.obj" };
+
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData meshes[8];
+	ObjLoader loader;
+	bool loaded = true;
+	for(UINT m = 0; m < 5; ++m)
+		loaded = loader.Load(opts.AssetPath(std::string("Models/") + models[m]), meshes[m]) && loaded;
+	geoGen.CreateSphere(1.0f, 20, 20, meshes[5]);
+	geoGen.CreateGeosphere(1.0f, 4, meshes[6]);
+	geoGen.CreateGrid(10.0f, 10.0f, 20, 20, meshes[7]);
+	const char* names[8] = { models[0], models[1], models[2], models[3], models[4], "sphere", "geosphere", "grid" };
+
+	bool chains = loaded;
+	bool valid = loaded;
+	bool bounded = loaded;
+	bool seams = true;
+	bool closed = true;
+	bool flat = true;
+	double totalMs = 0.0;
+	std::vector<UINT> cowIndices;
+	std::vector<MeshLod> cowLods;
+	for(UINT m = 0; m < 8; ++m)
+	{
+		GeometryGenerator::MeshData& mesh = meshes[m];
+		MeshOptimizer::OptimizeMesh(mesh);
+		UINT numVertices = (UINT)mesh.Vertices.size();
+		UINT numIndices = (UINT)mesh.Indices.size();
+		if(numIndices == 0)
+		{
+			chains = false;
+			continue;
+		}
+
+		std::vector<UINT> indices;
+		std::vector<MeshLod> lods;
+		BenchTimer t;
+		for(int i = 0; i < iterations; ++i)
+		{
+			indices = mesh.Indices;
+			MeshSimplifier::BuildLodChain(indices, numIndices, &mesh.Vertices[0], sizeof(GeometryGenerator::Vertex),
+				numVertices, MeshSimplifier::DefaultMaxLods, lods);
+		}
+		totalMs += t.ElapsedMs();
+		if(m == 0)
+		{
+			cowIndices = indices;
+			cowLods = lods;
+		}
+
+		XNA::AxisAlignedBox box;
+		XNA::ComputeBoundingAxisAlignedBoxFromPoints(&box, numVertices, &mesh.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+		float size = 2.0f*XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)));
+
+		printf("  %-14s", names[m]);
+		for(size_t l = 0; l < lods.size(); ++l)
+			printf(" %6u", lods[l].NumIndices / 3);
+		printf("  triangles, error");
+		for(size_t l = 1; l < lods.size(); ++l)
+			printf(" %.4f", lods[l].Error / size);
+		printf(" of the diagonal\n");
+
+		// At least two levels for anything but the box-like grid, each a tenth smaller,
+		// no less accurate than the one before, and all in the index buffer.
+		chains = chains && lods.size() >= 2 && lods[0].FirstIndex == 0 && lods[0].NumIndices == numIndices &&
+			lods[0].Error == 0.0f && memcmp(&indices[0], &mesh.Indices[0], numIndices*sizeof(UINT)) == 0;
+		for(size_t l = 1; l < lods.size(); ++l)
+		{
+			chains = chains && lods[l].NumIndices % 3 == 0 && lods[l].NumIndices*10 <= lods[l - 1].NumIndices*9 &&
+				lods[l].Error >= lods[l - 1].Error && lods[l].FirstIndex + lods[l].NumIndices <= indices.size();
+		}
+
+		// No index out of range and no triangle collapsed to an edge.
+		for(size_t l = 1; l < lods.size() && valid; ++l)
+		{
+			const UINT* lod = &indices[lods[l].FirstIndex];
+			for(UINT i = 0; i < lods[l].NumIndices && valid; i += 3)
+			{
+				valid = lod[i] < numVertices && lod[i + 1] < numVertices && lod[i + 2] < numVertices &&
+					lod[i] != lod[i + 1] && lod[i + 1] != lod[i + 2] && lod[i] != lod[i + 2];
+			}
+		}
+		if(!valid)
+			break;
+
+		// The coarsest level stays near every vertex of the original, and the error
+		// reported is of the same order as the distance.
+		const MeshLod& coarsest = lods.back();
+		const UINT* lod = &indices[coarsest.FirstIndex];
+		UINT step = MathHelper::Max(1u, numVertices / (opts.Quick ? 200 : 2000));
+		float maxDistance = 0.0f;
+		for(UINT v = 0; v < numVertices; v += step)
+		{
+			float nearest = MathHelper::Infinity;
+			for(UINT i = 0; i < coarsest.NumIndices; i += 3)
+			{
+				nearest = MathHelper::Min(nearest, DistanceSqToTriangle(mesh.Vertices[v].Position,
+					mesh.Vertices[lod[i]].Position, mesh.Vertices[lod[i + 1]].Position, mesh.Vertices[lod[i + 2]].Position));
+			}
+			maxDistance = MathHelper::Max(maxDistance, sqrtf(nearest));
+		}
+		printf("  %-14s coarsest within %.4f of the original's vertices\n", "", maxDistance / size);
+		bounded = bounded && maxDistance <= 4.0f*coarsest.Error + 1e-4f*size;
+
+		// Every position where attributes split (vertices there differ) is still drawn
+		// at every level.
+		typedef GeometryGenerator::Vertex Vertex;
+		std::vector<UINT> order(numVertices);
+		for(UINT v = 0; v < numVertices; ++v)
+			order[v] = v;
+		std::sort(order.begin(), order.end(), [&](UINT a, UINT b)
+			{ return memcmp(&mesh.Vertices[a], &mesh.Vertices[b], sizeof(Vertex)) < 0; });
+		std::vector<UINT> copyOf(numVertices), positionOf(numVertices);
+		std::vector<bool> seam(numVertices, false);
+		for(UINT i = 0; i < numVertices; ++i)
+		{
+			const Vertex& v = mesh.Vertices[order[i]];
+			const Vertex* last = i > 0 ? &mesh.Vertices[order[i - 1]] : 0;
+			bool samePosition = last && memcmp(&v.Position, &last->Position, sizeof(XMFLOAT3)) == 0;
+			copyOf[order[i]] = last && memcmp(&v, last, sizeof(Vertex)) == 0 ? copyOf[order[i - 1]] : order[i];
+			positionOf[order[i]] = samePosition ? positionOf[order[i - 1]] : order[i];
+			if(samePosition && copyOf[order[i]] != copyOf[order[i - 1]])
+				seam[positionOf[order[i]]] = true;
+		}
+		for(size_t l = 1; l < lods.size(); ++l)
+		{
+			std::vector<bool> used(numVertices, false);
+			for(UINT i = 0; i < lods[l].NumIndices; ++i)
+				used[positionOf[indices[lods[l].FirstIndex + i]]] = true;
+			for(UINT v = 0; v < numVertices; ++v)
+				seams = seams && (!seam[v] || used[v]);
+		}
+
+		if(m == 6)
+		{
+			// With identical copies taken as one vertex.
+			for(size_t l = 0; l < lods.size(); ++l)
+			{
+				std::vector<UINT> welded(lods[l].NumIndices);
+				for(UINT i = 0; i < lods[l].NumIndices; ++i)
+					welded[i] = copyOf[indices[lods[l].FirstIndex + i]];
+				closed = closed && CountBorderEdges(&welded[0], lods[l].NumIndices) == 0;
+			}
+		}
+		if(m == 7)
+		{
+			// A flat grid loses nothing: its corners stay and its area is the same.
+			for(size_t l = 1; l < lods.size(); ++l)
+			{
+				float area = 0.0f;
+				for(UINT i = 0; i < lods[l].NumIndices; i += 3)
+				{
+					const UINT* tri = &indices[lods[l].FirstIndex + i];
+					XMVECTOR a = XMLoadFloat3(&mesh.Vertices[tri[0]].Position);
+					XMVECTOR e1 = XMLoadFloat3(&mesh.Vertices[tri[1]].Position) - a;
+					XMVECTOR e2 = XMLoadFloat3(&mesh.Vertices[tri[2]].Position) - a;
+					area += 0.5f*XMVectorGetX(XMVector3Length(XMVector3Cross(e1, e2)));
+				}
+				flat = flat && lods[l].Error <= 1e-4f && fabsf(area - 100.0f) <= 1e-2f;
+			}
+			flat = flat && lods.back().NumIndices <= numIndices / 8;
+		}
+	}
+	BenchReport("build LOD chains", totalMs, iterations);
+
+	// Levels chosen for one cow per step away from the eye.
+	LodSelector selector;
+	selector.SetView(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.25f*MathHelper::Pi, 1.0f, 1080.0f);
+	LodSelector coarse;
+	coarse.SetView(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.25f*MathHelper::Pi, 1.0f, 1080.0f, 4.0f);
+	bool selection = !cowLods.empty();
+	UINT last = 0, nearest = ~0u, farthest = 0;
+	for(int d = 0; d < 2000 && selection; ++d)
+	{
+		XNA::Sphere bounds;
+		bounds.Center = XMFLOAT3(0.0f, 0.0f, 2.0f + 0.5f*d);
+		bounds.Radius = 1.0f;
+		UINT lod = selector.Select(&cowLods[0], (UINT)cowLods.size(), bounds);
+		UINT biased = coarse.Select(&cowLods[0], (UINT)cowLods.size(), bounds);
+		selection = lod >= last && biased >= lod && lod < cowLods.size();
+		nearest = MathHelper::Min(nearest, lod);
+		farthest = MathHelper::Max(farthest, lod);
+		last = lod;
+	}
+	selection = selection && nearest == 0 && farthest + 1 == cowLods.size();
+
+	// Instances: a scaled instance keeps a finer level than an unscaled one as far off,
+	// and unscaled ones agree with Select.
+	XNA::AxisAlignedBox cowBox;
+	XNA::ComputeBoundingAxisAlignedBoxFromPoints(&cowBox, (UINT)meshes[0].Vertices.size(), &meshes[0].Vertices[0].Position,
+		sizeof(GeometryGenerator::Vertex));
+	const int numInstances = opts.Quick ? 10000 : 100000;
+	std::vector<XMFLOAT4X4> worlds(numInstances);
+	std::vector<UINT> visible(numInstances);
+	for(int i = 0; i < numInstances; ++i)
+	{
+		float scale = (i & 1) ? 3.0f : 1.0f;
+		XMStoreFloat4x4(&worlds[i], XMMatrixScaling(scale, scale, scale)*XMMatrixTranslation(0.0f, 0.0f, 5.0f + 0.01f*(i / 2)));
+		visible[i] = i;
+	}
+	std::vector<UINT> lodOfEach;
+	BenchTimer st;
+	for(int i = 0; i < iterations; ++i)
+		selector.SelectInstances(&cowLods[0], (UINT)cowLods.size(), cowBox, &worlds[0], visible, lodOfEach);
+	BenchReport("select instance LODs", st.ElapsedMs(), iterations);
+
+	bool instances = selection;
+	float cowRadius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&cowBox.Extents)));
+	for(int i = 0; i + 1 < numInstances && instances; i += 2)
+	{
+		XNA::Sphere bounds;
+		XMStoreFloat3(&bounds.Center, XMVector3TransformCoord(XMLoadFloat3(&cowBox.Center), XMLoadFloat4x4(&worlds[i])));
+		bounds.Radius = cowRadius;
+		instances = lodOfEach[i + 1] <= lodOfEach[i] &&
+			lodOfEach[i] == selector.Select(&cowLods[0], (UINT)cowLods.size(), bounds);
+	}
+
+	// ConvertObj stores the same chain.
+	std::string path = BenchScratchPath("lod.zmsh");
+	MeshFile file;
+	bool stored = MeshFile::ConvertObj(opts.AssetPath("Models/cow.obj"), path) && file.Open(path) &&
+		file.GetNumLods() == cowLods.size() && file.GetNumIndices() == cowIndices.size() &&
+		memcmp(file.GetLods(), &cowLods[0], cowLods.size()*sizeof(MeshLod)) == 0 &&
+		memcmp(file.GetIndices(), &cowIndices[0], cowIndices.size()*sizeof(UINT)) == 0;
+	file.Close();
+	remove(path.c_str());
+
+	return BenchCheck(loaded, "Models/*.obj load") &&
+		BenchCheck(chains, "each level a tenth smaller and no more accurate") &&
+		BenchCheck(valid, "levels index valid vertices without degenerate triangles") &&
+		BenchCheck(bounded, "coarsest level within 5% of the diagonal and its reported error") &&
+		BenchCheck(seams, "attribute seams stay where they were") &&
+		BenchCheck(closed, "closed meshes stay closed") &&
+		BenchCheck(flat, "a flat grid simplifies without error") &&
+		BenchCheck(selection, "finer levels near, coarser far and under a bias") &&
+		BenchCheck(instances, "instances agree with Select and scale keeps detail") &&
+		BenchCheck(stored, "ConvertObj stores the chain");
+}
+
+ZEUS_BENCH(MeshWeld)
+{
+	// A grid of quads given corner by corner, as the FBX importer extracts a mesh: a
+	// smooth surface whose corners repeat across the polygons sharing them, with a
+	// material per row of quads.
+	const int n = opts.Quick ? 64 : 512;
+	const int iterations = opts.Quick ? 2 : 10;
+
+	std::vector<WeldVertex> corners;
+	std::vector<int> sizes(n*n, 4);
+	for(int i = 0; i < n; ++i)
+	{
+		for(int j = 0; j < n; ++j)
+		{
+			const int quad[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+			for(int k = 0; k < 4; ++k)
+			{
+				int r = i + quad[k][0];
+				int c = j + quad[k][1];
+				WeldVertex v;
+				v.Position = XMFLOAT3((float)c, sinf(0.1f*r)*cosf(0.1f*c), (float)r);
+				v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+				v.TexC = XMFLOAT2((float)c / n, (float)r / n);
+				v.Material = i / 16;
+				corners.push_back(v);
+			}
+		}
+	}
+
+	std::vector<WeldVertex> vertices;
+	std::vector<UINT> indices;
+	BenchTimer t;
+	for(int i = 0; i < iterations; ++i)
+		MeshWelder::Weld(&corners[0], &sizes[0], (UINT)sizes.size(), vertices, indices);
+	BenchReport("weld grid", t.ElapsedMs(), iterations);
+
+	// An ordered map over the corner bytes, for the expected first use numbering.
+	std::map<std::string, UINT> seen;
+	std::vector<UINT> expected(corners.size());
+	t.Reset();
+	for(size_t c = 0; c < corners.size(); ++c)
+	{
+		std::string key((const char*)&corners[c], sizeof(WeldVertex));
+		std::map<std::string, UINT>::iterator it = seen.find(key);
+		if(it == seen.end())
+			it = seen.insert(std::make_pair(key, (UINT)seen.size())).first;
+		expected[c] = it->second;
+	}
+	BenchReport("std::map reference", t.ElapsedMs(), 1);
+
+	// Rows on either side of a material change keep their own copies of the shared
+	// corners.
+	UINT rowsOfVertices = n + 1 + (n - 1) / 16;
+	bool counts = vertices.size() == seen.size() && vertices.size() == rowsOfVertices*(n + 1) &&
+		indices.size() == (size_t)n*n*6;
+	bool same = counts;
+	for(size_t q = 0; q < sizes.size() && same; ++q)
+	{
+		const UINT* tri = &indices[q*6];
+		const UINT* quad = &expected[q*4];
+		same = tri[0] == quad[0] && tri[1] == quad[1] && tri[2] == quad[2] &&
+			tri[3] == quad[0] && tri[4] == quad[2] && tri[5] == quad[3];
+	}
+
+	// A pentagon fans into three triangles and a two corner polygon into none; a
+	// corner sharing a position but not a normal keeps its own vertex.
+	std::vector<WeldVertex> shape(7);
+	for(int k = 0; k < 7; ++k)
+		shape[k].Position.x = (float)(k % 5);
+	shape[5].Normal.y = 1.0f;
+	int shapeSizes[2] = { 5, 2 };
+	MeshWelder::Weld(&shape[0], shapeSizes, 2, vertices, indices);
+	bool fanned = indices.size() == 9 && indices[6] == 0 && indices[7] == 3 && indices[8] == 4 && vertices.size() == 6;
+
+	return BenchCheck(counts, "welded vertex and index counts") &&
+		BenchCheck(same, "welding matches the std::map reference") &&
+		BenchCheck(fanned, "polygons fan and differing normals stay apart");
+}
+
+namespace
+{
+	// Largest error of a decoded direction, as the chord to the unit source, which
+	// holds its precision where the angle's cosine would not; a zero source should
+	// decode as +Z.
+	float DirectionError(const XMFLOAT3& source, const XMFLOAT3& decoded)
+	{
+		XMVECTOR n = XMLoadFloat3(&source);
+		if(XMVectorGetX(XMVector3LengthSq(n)) == 0.0f)
+			n = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		return XMVectorGetX(XMVector3Length(XMVector3Normalize(n) - XMLoadFloat3(&decoded)));
+	}
+
+	bool TexCoordWithin(float source, float decoded)
+	{
+		return fabsf(decoded - source) <= MathHelper::Max(fabsf(source)*VertexPacker::MaxTexCoordError, 1e-7f);
+	}
+}
+
+ZEUS_BENCH(VertexPack)
+{
+	const int iterations = opts.Quick ? 2 : 20;
+	const char* models[] = { "cow.obj", "tree1.obj", "bug.obj", "largetree.obj", "building.obj" };
+
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData meshes[8];
+	ObjLoader loader;
+	bool loaded = true;
+	for(UINT m = 0; m < 5; ++m)
+		loaded = loader.Load(opts.AssetPath(std::string("Models/") + models[m]), meshes[m]) && loaded;
+	geoGen.CreateSphere(1.0f, 20, 20, meshes[5]);
+	geoGen.CreateCylinder(0.5f, 0.5f, 3.0f, 15, 15, meshes[6]);
+	geoGen.CreateGrid(160.0f, 160.0f, 50, 50, meshes[7]);
+	const char* names[8] = { models[0], models[1], models[2], models[3], models[4], "sphere", "cylinder", "grid" };
+
+	bool positions = loaded;
+	bool directions = loaded;
+	bool texCoords = loaded;
+	bool materials = loaded;
+	double packMs = 0.0;
+	UINT64 floatBytes = 0, packedBytes = 0, floatFetched = 0, packedFetched = 0;
+	printf("  %-14s %8s %9s %9s %8s %8s\n", "", "vertices", "48 B", "20 B", "pos err", "dir err");
+	for(UINT m = 0; m < 8; ++m)
+	{
+		GeometryGenerator::MeshData& mesh = meshes[m];
+		MeshOptimizer::OptimizeMesh(mesh);
+		UINT numVertices = (UINT)mesh.Vertices.size();
+		if(numVertices == 0)
+		{
+			positions = false;
+			continue;
+		}
+
+		// Materials cycle through the lane's range, its ends included.
+		std::vector<MeshVertexPosNormalTexTan> source(numVertices);
+		std::vector<XMFLOAT3> points(numVertices);
+		for(UINT i = 0; i < numVertices; ++i)
+		{
+			const GeometryGenerator::Vertex& v = mesh.Vertices[i];
+			source[i].Pos = points[i] = v.Position;
+			source[i].Normal = v.Normal;
+			source[i].Tex = v.TexC;
+			source[i].TexNum = (int)((i*257) % (VertexPacker::MaxMaterial + 1)) | (i & 1 ? TexNumMirrored : 0);
+			source[i].TangentU = v.TangentU;
+		}
+		XNA::AxisAlignedBox bounds;
+		XNA::ComputeBoundingAxisAlignedBoxFromPoints(&bounds, numVertices, &points[0], sizeof(XMFLOAT3));
+		VertexQuantization q = VertexPacker::GetQuantization(bounds);
+
+		std::vector<PackedVertexPosNormalTexTan> packed(numVertices);
+		BenchTimer t;
+		for(int i = 0; i < iterations; ++i)
+			VertexPacker::Pack(&packed[0], &source[0], numVertices, q);
+		packMs += t.ElapsedMs();
+
+		std::vector<MeshVertexPosNormalTexTan> decoded(numVertices);
+		VertexPacker::Unpack(&decoded[0], &packed[0], numVertices, q);
+
+		float posError = 0.0f, dirError = 0.0f;
+		for(UINT i = 0; i < numVertices; ++i)
+		{
+			const MeshVertexPosNormalTexTan& a = source[i];
+			const MeshVertexPosNormalTexTan& b = decoded[i];
+			const float* pa = &a.Pos.x;
+			const float* pb = &b.Pos.x;
+			const float* offset = &q.Offset.x;
+			const float* scale = &q.Scale.x;
+			for(int k = 0; k < 3; ++k)
+			{
+				float e = fabsf(pb[k] - pa[k]);
+				positions = positions && e <= 0.5f*scale[k] + 1e-6f*(fabsf(pa[k]) + fabsf(offset[k]));
+				posError = MathHelper::Max(posError, scale[k] > 0.0f ? e / scale[k] : 0.0f);
+			}
+
+			float e = MathHelper::Max(DirectionError(a.Normal, b.Normal), DirectionError(a.TangentU, b.TangentU));
+			directions = directions && e <= VertexPacker::MaxDirectionError;
+			dirError = MathHelper::Max(dirError, e);
+
+			texCoords = texCoords && TexCoordWithin(a.Tex.x, b.Tex.x) && TexCoordWithin(a.Tex.y, b.Tex.y);
+			materials = materials && a.TexNum == b.TexNum;
+		}
+
+		// Vertex fetch per draw: the vertices the post-transform cache misses.
+		VertexCacheStats stats = MeshOptimizer::AnalyzeVertexCache(&mesh.Indices[0], (UINT)mesh.Indices.size(), numVertices);
+		UINT64 fetched = (UINT64)(stats.ACMR*mesh.Indices.size() / 3.0f + 0.5f);
+		floatBytes += (UINT64)numVertices*sizeof(MeshVertexPosNormalTexTan);
+		packedBytes += (UINT64)numVertices*sizeof(PackedVertexPosNormalTexTan);
+		floatFetched += fetched*sizeof(MeshVertexPosNormalTexTan);
+		packedFetched += fetched*sizeof(PackedVertexPosNormalTexTan);
+		printf("  %-14s %8u %8.1fK %8.1fK %7.3fq %8.2g\n", names[m], numVertices,
+			numVertices*sizeof(MeshVertexPosNormalTexTan) / 1024.0, numVertices*sizeof(PackedVertexPosNormalTexTan) / 1024.0,
+			posError, dirError);
+	}
+	BenchReport("pack PosNormalTexTan", packMs, iterations);
+	printf("  buffers %.1fK -> %.1fK, fetched per draw of each %.1fK -> %.1fK; Basic32 %u -> %u bytes a vertex\n",
+		floatBytes / 1024.0, packedBytes / 1024.0, floatFetched / 1024.0, packedFetched / 1024.0,
+		(UINT)sizeof(MeshVertexBasic32), (UINT)sizeof(PackedVertexBasic));
+
+	// The axes and their diagonals encode exactly, and the lane clamps materials.
+	bool exact = true;
+	const float axes[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	for(int i = 0; i < 6; ++i)
+	{
+		XMFLOAT3 n(axes[i][0], axes[i][1], axes[i][2]);
+		XMFLOAT3 d = VertexPacker::DecodeOctahedral(VertexPacker::EncodeOctahedral(n));
+		exact = exact && d.x == n.x && d.y == n.y && d.z == n.z;
+	}
+	XMFLOAT3 zero = VertexPacker::DecodeOctahedral(VertexPacker::EncodeOctahedral(XMFLOAT3(0.0f, 0.0f, 0.0f)));
+	exact = exact && zero.z == 1.0f && VertexPacker::EncodePosition(XMFLOAT3(0.0f, 0.0f, 0.0f), 70000, VertexQuantization()).w == VertexPacker::MaxMaterial &&
+		VertexPacker::EncodePosition(XMFLOAT3(0.0f, 0.0f, 0.0f), 70000 | TexNumMirrored, VertexQuantization()).w == 0xffff &&
+		VertexPacker::EncodePosition(XMFLOAT3(0.0f, 0.0f, 0.0f), -1, VertexQuantization()).w == 0;
+
+	// ConvertObj packs the same mesh it writes unpacked.
+	std::string floatPath = BenchScratchPath("unpacked.zmsh");
+	std::string packedPath = BenchScratchPath("packed.zmsh");
+	MeshFile floatFile, packedFile;
+	bool stored = MeshFile::ConvertObj(opts.AssetPath("Models/cow.obj"), floatPath) &&
+		MeshFile::ConvertObj(opts.AssetPath("Models/cow.obj"), packedPath, MeshFile::FormatPackedBasic) &&
+		floatFile.Open(floatPath) && packedFile.Open(packedPath) &&
+		packedFile.GetVertexStride() == sizeof(PackedVertexBasic) &&
+		packedFile.GetNumVertices() == floatFile.GetNumVertices() &&
+		packedFile.GetNumIndices() == floatFile.GetNumIndices() &&
+		memcmp(packedFile.GetIndices(), floatFile.GetIndices(), floatFile.GetNumIndices()*sizeof(UINT)) == 0 &&
+		DistanceSq(packedFile.GetBounds().Center, floatFile.GetBounds().Center) == 0.0f &&
+		DistanceSq(packedFile.GetBounds().Extents, floatFile.GetBounds().Extents) == 0.0f;
+	if(stored)
+	{
+		VertexQuantization q = packedFile.GetQuantization();
+		float tolerance = 0.5f*MathHelper::Max(q.Scale.x, MathHelper::Max(q.Scale.y, q.Scale.z)) + 1e-5f;
+		std::vector<MeshVertexBasic32> decoded(packedFile.GetNumVertices());
+		VertexPacker::Unpack(&decoded[0], (const PackedVertexBasic*)packedFile.GetVertices(), packedFile.GetNumVertices(), q);
+		const MeshVertexBasic32* original = (const MeshVertexBasic32*)floatFile.GetVertices();
+		for(UINT i = 0; i < packedFile.GetNumVertices() && stored; ++i)
+		{
+			XMFLOAT3 p = packedFile.GetPosition(i);
+			stored = sqrtf(DistanceSq(p, original[i].Pos)) <= 2.0f*tolerance &&
+				memcmp(&p, &decoded[i].Pos, sizeof(XMFLOAT3)) == 0 &&
+				DirectionError(original[i].Normal, decoded[i].Normal) <= VertexPacker::MaxDirectionError;
+		}
+	}
+	floatFile.Close();
+	packedFile.Close();
+	remove(floatPath.c_str());
+	remove(packedPath.c_str());
+
+	return BenchCheck(loaded, "Models/*.obj load") &&
+		BenchCheck(positions, "positions within half a quantization step") &&
+		BenchCheck(directions, "normals and tangents within MaxDirectionError") &&
+		BenchCheck(texCoords, "texture coordinates within half precision") &&
+		BenchCheck(materials, "materials survive exactly") &&
+		BenchCheck(exact, "axes encode exactly, zero as +Z, materials clamp") &&
+		BenchCheck(stored, "ConvertObj packs what it writes unpacked");
+}
+
+namespace
+{
+	// Whether every generated tangent is unit length, perpendicular to its normal and
+	// handed like the triangles around it, and every split vertex copies its source.
+	bool TangentFramesValid(const GeometryGenerator::MeshData& mesh, const std::vector<UINT>& indices,
+		const std::vector<UINT>& sources, const std::vector<XMFLOAT4>& tangents)
+	{
+		if(tangents.size() != sources.size() || sources.size() < mesh.Vertices.size())
+			return false;
+
+		for(size_t i = 0; i < tangents.size(); ++i)
+		{
+			if(sources[i] >= mesh.Vertices.size() || (i < mesh.Vertices.size() && sources[i] != i))
+				return false;
+
+			XMVECTOR t = XMLoadFloat4(&tangents[i]);
+			XMVECTOR n = XMLoadFloat3(&mesh.Vertices[sources[i]].Normal);
+			float nLengthSq = XMVectorGetX(XMVector3LengthSq(n));
+			if(fabsf(XMVectorGetX(XMVector3Length(t)) - 1.0f) > 1e-4f || fabsf(tangents[i].w) != 1.0f ||
+				(nLengthSq > 0.0f && fabsf(XMVectorGetX(XMVector3Dot(t, n))) > 1e-3f*sqrtf(nLengthSq)))
+				return false;
+		}
+
+		for(size_t c = 0; c + 2 < indices.size(); c += 3)
+		{
+			const GeometryGenerator::Vertex* v[3];
+			for(UINT k = 0; k < 3; ++k)
+			{
+				if(indices[c + k] >= sources.size())
+					return false;
+				v[k] = &mesh.Vertices[sources[indices[c + k]]];
+			}
+
+			XMVECTOR d1 = XMLoadFloat3(&v[1]->Position) - XMLoadFloat3(&v[0]->Position);
+			XMVECTOR d2 = XMLoadFloat3(&v[2]->Position) - XMLoadFloat3(&v[0]->Position);
+			float s1 = v[1]->TexC.x - v[0]->TexC.x, t1 = v[1]->TexC.y - v[0]->TexC.y;
+			float s2 = v[2]->TexC.x - v[0]->TexC.x, t2 = v[2]->TexC.y - v[0]->TexC.y;
+			float area = s1*t2 - s2*t1;
+			if(area == 0.0f)
+				continue;
+
+			XMVECTOR faceTangent = area*(t2*d1 - t1*d2);
+			XMVECTOR faceBitangent = area*(s1*d2 - s2*d1);
+			for(UINT k = 0; k < 3; ++k)
+			{
+				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&v[k]->Normal));
+				XMVECTOR t = faceTangent - XMVector3Dot(n, faceTangent)*n;
+				float tLength = XMVectorGetX(XMVector3Length(t));
+				float side = XMVectorGetX(XMVector3Dot(XMVector3Cross(n, t), faceBitangent));
+				float bLength = XMVectorGetX(XMVector3Length(faceBitangent));
+
+				// Only where the face's handedness is clear of rounding.
+				if(tLength > 0.0f && fabsf(side) > 1e-3f*tLength*bLength &&
+					(side < 0.0f) != (tangents[indices[c + k]].w < 0.0f))
+					return false;
+			}
+		}
+		return true;
+	}
+}
+
+ZEUS_BENCH(TangentGenerate)
+{
+	const int iterations = opts.Quick ? 1 : 10;
+	const char* models[] = { "cow.obj", "tree1.obj", "bug.obj", "largetree.obj", "building.obj" };
+
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData meshes[9];
+	ObjLoader loader;
+	bool loaded = true;
+	for(UINT m = 0; m < 5; ++m)
+		loaded = loader.Load(opts.AssetPath(std::string("Models/") + models[m]), meshes[m]) && loaded;
+	geoGen.CreateBox(1.0f, 1.0f, 1.0f, meshes[5]);
+	geoGen.CreateCylinder(0.5f, 0.5f, 3.0f, 15, 15, meshes[6]);
+	geoGen.CreateGrid(160.0f, 160.0f, 50, 50, meshes[7]);
+	UINT big = opts.Quick ? 400 : 1000;
+	geoGen.CreateGrid(160.0f, 160.0f, big, big, meshes[8]);
+	const char* names[9] = { models[0], models[1], models[2], models[3], models[4], "box", "cylinder", "grid", "big grid" };
+
+	// GeometryGenerator's shapes have analytic tangents along u, and the effects' right
+	// handed frame everywhere but the cylinder's top cap, whose v runs along +z.
+	bool valid = loaded;
+	bool analytic = true;
+	bool deterministic = true;
+	double serialMs = 0.0, parallelMs = 0.0;
+	printf("  %-14s %9s %9s %7s %9s %9s\n", "", "vertices", "triangles", "split", "1 thread", "threads");
+	for(UINT m = 0; m < 9; ++m)
+	{
+		const GeometryGenerator::MeshData& mesh = meshes[m];
+		if(mesh.Vertices.empty() || mesh.Indices.empty())
+		{
+			valid = false;
+			continue;
+		}
+
+		std::vector<UINT> serialIndices, indices;
+		std::vector<UINT> serialSources, sources;
+		std::vector<XMFLOAT4> serialTangents, tangents;
+
+		BenchTimer t;
+		for(int i = 0; i < iterations; ++i)
+		{
+			serialIndices = mesh.Indices;
+			TangentGenerator::Generate(&mesh.Vertices[0], sizeof(GeometryGenerator::Vertex), (UINT)mesh.Vertices.size(),
+				offsetof(GeometryGenerator::Vertex, Normal), offsetof(GeometryGenerator::Vertex, TexC),
+				&serialIndices[0], (UINT)serialIndices.size(), serialSources, serialTangents, 1);
+		}
+		double ms1 = t.ElapsedMs() / iterations;
+
+		t.Reset();
+		for(int i = 0; i < iterations; ++i)
+		{
+			indices = mesh.Indices;
+			TangentGenerator::Generate(&mesh.Vertices[0], sizeof(GeometryGenerator::Vertex), (UINT)mesh.Vertices.size(),
+				offsetof(GeometryGenerator::Vertex, Normal), offsetof(GeometryGenerator::Vertex, TexC),
+				&indices[0], (UINT)indices.size(), sources, tangents);
+		}
+		double msN = t.ElapsedMs() / iterations;
+		serialMs += ms1;
+		parallelMs += msN;
+
+		printf("  %-14s %9u %9u %7u %7.2fms %7.2fms\n", names[m], (UINT)mesh.Vertices.size(), (UINT)mesh.Indices.size() / 3,
+			(UINT)(sources.size() - mesh.Vertices.size()), ms1, msN);
+
+		valid = valid && TangentFramesValid(mesh, indices, sources, tangents);
+		deterministic = deterministic && serialIndices == indices && serialSources == sources &&
+			memcmp(&serialTangents[0], &tangents[0], tangents.size()*sizeof(XMFLOAT4)) == 0;
+
+		// More bands than this machine may have threads.
+		indices = mesh.Indices;
+		TangentGenerator::Generate(&mesh.Vertices[0], sizeof(GeometryGenerator::Vertex), (UINT)mesh.Vertices.size(),
+			offsetof(GeometryGenerator::Vertex, Normal), offsetof(GeometryGenerator::Vertex, TexC),
+			&indices[0], (UINT)indices.size(), sources, tangents, 7);
+		deterministic = deterministic && serialIndices == indices && serialSources == sources &&
+			memcmp(&serialTangents[0], &tangents[0], tangents.size()*sizeof(XMFLOAT4)) == 0;
+
+		if(m >= 5)
+		{
+			analytic = analytic && sources.size() == mesh.Vertices.size();
+			for(size_t i = 0; i < mesh.Vertices.size() && analytic; ++i)
+			{
+				XMVECTOR expected = XMLoadFloat3(&mesh.Vertices[i].TangentU);
+				if(XMVectorGetX(XMVector3LengthSq(expected)) == 0.0f)
+					continue;
+
+				bool capped = m == 6 && mesh.Vertices[i].Normal.y > 0.0f;
+				analytic = tangents[i].w == (capped ? -1.0f : 1.0f) &&
+					XMVectorGetX(XMVector3Dot(XMVector3Normalize(expected), XMLoadFloat4(&tangents[i]))) > 0.999f;
+			}
+		}
+	}
+	BenchReport("all meshes, 1 thread", serialMs, 1);
+	BenchReport("all meshes, hardware threads", parallelMs, 1);
+
+	// Two quads sharing the edge at x = 1, the texture mirrored across it: the shared
+	// vertices split, and each side gets its own tangent and handedness.
+	GeometryGenerator::MeshData mirror;
+	for(UINT i = 0; i < 6; ++i)
+	{
+		float x = (float)(i % 3), y = (float)(i / 3);
+		mirror.Vertices.push_back(GeometryGenerator::Vertex(x, y, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+			i % 3 == 1 ? 1.0f : 0.0f, 1.0f - y));
+	}
+	UINT quads[12] = { 0, 3, 4, 0, 4, 1, 1, 4, 5, 1, 5, 2 };
+	mirror.Indices.assign(quads, quads + 12);
+	std::vector<UINT> mirrorIndices = mirror.Indices, mirrorSources;
+	std::vector<XMFLOAT4> mirrorTangents;
+	TangentGenerator::Generate(&mirror.Vertices[0], sizeof(GeometryGenerator::Vertex), 6,
+		offsetof(GeometryGenerator::Vertex, Normal), offsetof(GeometryGenerator::Vertex, TexC),
+		&mirrorIndices[0], 12, mirrorSources, mirrorTangents);
+	bool mirrored = mirrorTangents.size() == 8 && TangentFramesValid(mirror, mirrorIndices, mirrorSources, mirrorTangents) &&
+		mirrorTangents[0].x == 1.0f && mirrorTangents[0].w == 1.0f && mirrorTangents[2].x == -1.0f && mirrorTangents[2].w == -1.0f &&
+		mirrorTangents[1].x == 1.0f && mirrorTangents[6].x == -1.0f && mirrorTangents[6].w == -1.0f &&
+		mirrorSources[6] == 1 && mirrorSources[7] == 4 && mirrorIndices[6] == 6 && mirrorIndices[3] == 0 && mirrorIndices[5] == 1;
+
+	// The mesh vertices keep the handedness in TexNum beside their material.
+	std::vector<MeshVertexPosNormalTexTan> mirrorVertices(6);
+	for(UINT i = 0; i < 6; ++i)
+	{
+		mirrorVertices[i].Pos = mirror.Vertices[i].Position;
+		mirrorVertices[i].Normal = mirror.Vertices[i].Normal;
+		mirrorVertices[i].Tex = mirror.Vertices[i].TexC;
+		mirrorVertices[i].TexNum = 3;
+		mirrorVertices[i].TangentU = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	}
+	mirrorIndices = mirror.Indices;
+	TangentGenerator::Generate(mirrorVertices, mirrorIndices);
+	mirrored = mirrored && mirrorVertices.size() == mirrorTangents.size();
+	for(size_t i = 0; i < mirrorVertices.size() && mirrored; ++i)
+		mirrored = mirrorVertices[i].TexNum == (3 | (mirrorTangents[i].w < 0.0f ? TexNumMirrored : 0));
+
+	// Without texture coordinates every vertex still gets a unit perpendicular.
+	GeometryGenerator::MeshData flat = meshes[5];
+	for(size_t i = 0; i < flat.Vertices.size(); ++i)
+		flat.Vertices[i].TexC = XMFLOAT2(0.0f, 0.0f);
+	TangentGenerator::Generate(flat);
+	bool degenerate = flat.Vertices.size() == meshes[5].Vertices.size();
+	for(size_t i = 0; i < flat.Vertices.size() && degenerate; ++i)
+	{
+		XMVECTOR t = XMLoadFloat3(&flat.Vertices[i].TangentU);
+		degenerate = fabsf(XMVectorGetX(XMVector3Length(t)) - 1.0f) <= 1e-4f &&
+			fabsf(XMVectorGetX(XMVector3Dot(t, XMLoadFloat3(&flat.Vertices[i].Normal)))) <= 1e-4f;
+	}
+
+	// ConvertObj keeps the file's texture coordinates and these tangents.
+	std::string path = BenchScratchPath("tangents.zmsh");
+	MeshFile file;
+	bool converted = MeshFile::ConvertObj(opts.AssetPath("Models/tree1.obj"), path, MeshFile::FormatPosNormalTexTan) &&
+		file.Open(path) && file.GetVertexFormat() == MeshFile::FormatPosNormalTexTan && file.GetNumVertices() >= meshes[1].Vertices.size();
+	for(UINT i = 0; converted && i < file.GetNumVertices(); ++i)
+	{
+		const MeshVertexPosNormalTexTan& v = ((const MeshVertexPosNormalTexTan*)file.GetVertices())[i];
+		XMVECTOR t = XMLoadFloat3(&v.TangentU);
+		XMVECTOR n = XMLoadFloat3(&v.Normal);
+		converted = fabsf(XMVectorGetX(XMVector3Length(t)) - 1.0f) <= 1e-4f &&
+			fabsf(XMVectorGetX(XMVector3Dot(t, n))) <= 1e-3f*XMVectorGetX(XMVector3Length(n)) + 1e-6f;
+	}
+	file.Close();
+	remove(path.c_str());
+
+	return BenchCheck(loaded, "Models/*.obj load") &&
+		BenchCheck(valid, "unit, perpendicular and handed like their triangles") &&
+		BenchCheck(analytic, "GeometryGenerator's tangents, right handed, unsplit") &&
+		BenchCheck(deterministic, "threads match one thread exactly") &&
+		BenchCheck(mirrored, "mirrored texture coordinates split vertices") &&
+		BenchCheck(degenerate, "degenerate texture coordinates get a perpendicular") &&
+		BenchCheck(converted, "ConvertObj writes the tangents");
+}
+
+ZEUS_BENCH(FixedStepper)
+{
+	const float step = 1.0f / 60.0f;
+
+	// Steady 60 Hz pays out one step per frame.
+	FixedStepper steady(step, 4);
+	bool oneEach = true;
+	for(int i = 0; i < 600; ++i)
+		oneEach = oneEach && steady.Advance(step) == 1;
+
+	// 20 Hz catches up with three steps a frame; 144 Hz mostly skips.
+	FixedStepper slow(step, 4);
+	UINT slowSteps = 0;
+	for(int i = 0; i < 200; ++i)
+		slowSteps += slow.Advance(1.0f / 20.0f);
+
+	FixedStepper fast(step, 4);
+	UINT fastSteps = 0;
+	for(int i = 0; i < 1440; ++i)
+		fastSteps += fast.Advance(1.0f / 144.0f);
+
+	// A half second hitch is capped and the rest dropped.
+	FixedStepper hitch(step, 4);
+	UINT hitchSteps = hitch.Advance(0.5f);
+	UINT nextSteps = hitch.Advance(step);
+
+	printf("  20 Hz: %u steps/200 frames, 144 Hz: %u steps/1440 frames, hitch %u then %u, dropped %.3f s\n",
+		slowSteps, fastSteps, hitchSteps, nextSteps, hitch.GetDroppedTime());
+
+	return BenchCheck(oneEach, "one step per 60 Hz frame") &&
+		BenchCheck(slowSteps == 600, "20 Hz catches up") &&
+		BenchCheck(fastSteps >= 599 && fastSteps <= 600, "144 Hz keeps real time") &&
+		BenchCheck(hitchSteps == 4 && nextSteps == 1, "substeps capped after a hitch") &&
+		BenchCheck(hitch.GetAlpha() >= 0.0f && hitch.GetAlpha() < 1.0f, "alpha in range");
+}
+
+ZEUS_BENCH(PoseReadback)
+{
+	// PhysX::fetchStep writes one matrix per active box straight into its array.
+	const int count = 1000;
+	const int frames = opts.Quick ? 10 : 1000;
+
+	std::vector<XMFLOAT4> rots(count);
+	std::vector<XMFLOAT3> positions(count);
+	for(int i = 0; i < count; ++i)
+	{
+		XMVECTOR axis = MathHelper::RandUnitVec3();
+		XMStoreFloat4(&rots[i], XMQuaternionRotationAxis(axis, MathHelper::RandF(-MathHelper::Pi, MathHelper::Pi)));
+		positions[i] = XMFLOAT3(MathHelper::RandF(-100.0f, 100.0f), MathHelper::RandF(0.0f, 50.0f), MathHelper::RandF(-100.0f, 100.0f));
+	}
+
+	std::vector<XMFLOAT4X4> worlds(count);
+	BenchTimer t;
+	for(int f = 0; f < frames; ++f)
+		for(int i = 0; i < count; ++i)
+			MathHelper::StoreRigidTransform(&worlds[i], &rots[i].x, &positions[i].x);
+	BenchReport("StoreRigidTransform", t.ElapsedMs(), frames*count);
+
+	float maxError = 0.0f;
+	for(int i = 0; i < count; ++i)
+	{
+		XMFLOAT4X4 expected;
+		XMStoreFloat4x4(&expected, XMMatrixMultiply(XMMatrixRotationQuaternion(XMLoadFloat4(&rots[i])),
+			XMMatrixTranslation(positions[i].x, positions[i].y, positions[i].z)));
+		for(int r = 0; r < 4; ++r)
+			for(int c = 0; c < 4; ++c)
+				maxError = MathHelper::Max(maxError, fabsf(expected.m[r][c] - worlds[i].m[r][c]));
+	}
+
+	return BenchCheck(maxError < 1e-4f, "matches XMMatrixRotationQuaternion * XMMatrixTranslation");
+}
+
+ZEUS_BENCH(InstanceFrustumCull)
+{
+	// Mirrors the per-instance culling loop in ZeusApp::UpdateScene.
+	const int n = opts.Quick ? 10 : 40;
+
+	Camera cam;
+	cam.SetLens(0.25f*MathHelper::Pi, 16.0f/9.0f, 1.0f, 1000.0f);
+	cam.SetPosition(0.0f, 0.5f, -14.0f);
+	cam.UpdateViewMatrix();
+
+	XNA::Frustum camFrustum;
+	XMMATRIX proj = cam.Proj();
+	XNA::ComputeFrustumFromProjection(&camFrustum, &proj);
+
+	XNA::AxisAlignedBox box;
+	box.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	box.Extents = XMFLOAT3(1.0f, 0.6f, 0.3f);
+
+	std::vector<XMFLOAT4X4> worlds(n*n*n);
+	float spacing = 200.0f / (n-1);
+	for(int k = 0; k < n; ++k)
+		for(int i = 0; i < n; ++i)
+			for(int j = 0; j < n; ++j)
+				XMStoreFloat4x4(&worlds[k*n*n + i*n + j],
+					XMMatrixTranslation(-100.0f + j*spacing, -100.0f + i*spacing, -100.0f + k*spacing));
+
+	BenchTimer t;
+	XMVECTOR detView = XMMatrixDeterminant(cam.View());
+	XMMATRIX invView = XMMatrixInverse(&detView, cam.View());
+
+	UINT visible = 0;
+	for(size_t i = 0; i < worlds.size(); ++i)
+	{
+		XMMATRIX W = XMLoadFloat4x4(&worlds[i]);
+		XMVECTOR detWorld = XMMatrixDeterminant(W);
+		XMMATRIX invWorld = XMMatrixInverse(&detWorld, W);
+		XMMATRIX toLocal = XMMatrixMultiply(invView, invWorld);
+
+		XMVECTOR scale;
+		XMVECTOR rotQuat;
+		XMVECTOR translation;
+		XMMatrixDecompose(&scale, &rotQuat, &translation, toLocal);
+
+		XNA::Frustum localspaceFrustum;
+		XNA::TransformFrustum(&localspaceFrustum, &camFrustum, XMVectorGetX(scale), rotQuat, translation);
+
+		if(XNA::IntersectAxisAlignedBoxFrustum(&box, &localspaceFrustum) != 0)
+			++visible;
+	}
+	BenchReport("decompose + TransformFrustum", t.ElapsedMs(), (int)worlds.size());
+	printf("  %u of %u visible\n", visible, (UINT)worlds.size());
+
+	return BenchCheck(visible > 0 && visible < worlds.size(), "some but not all instances visible");
+}
+
+ZEUS_BENCH(InstanceBufferBuild)
+{
+	// The per-frame fill in ZeusApp::UpdateInstancedBuffer: visible skulls, every box,
+	// the cylinders and the trees.
+	const int frames = opts.Quick ? 100 : 10000;
+	const UINT counts[4] = { 125, 1000, 5, 29 };
+
+	std::vector<XMFLOAT4X4> worlds(counts[1]);
+	for(UINT i = 0; i < counts[1]; ++i)
+		XMStoreFloat4x4(&worlds[i], XMMatrixTranslation((float)i, 0.0f, 0.0f));
+
+	UINT capacity = counts[0] + counts[1] + counts[2] + counts[3];
+	std::vector<InstancedData> buffer(capacity);
+	InstanceBufferBuilder builder(4);
+	XMFLOAT4 white(1.0f, 1.0f, 1.0f, 1.0f);
+
+	UINT written = 0;
+	BenchTimer t;
+	for(int f = 0; f < frames; ++f)
+	{
+		builder.Reset();
+		for(UINT b = 0; b < 4; ++b)
+			builder.AddRange(b, &worlds[0], counts[b], white);
+		written = builder.Build(&buffer[0], capacity);
+	}
+	BenchReport("queue + build", t.ElapsedMs(), frames);
+
+	bool contiguous = true;
+	bool copied = true;
+	UINT next = 0;
+	for(UINT b = 0; b < 4; ++b)
+	{
+		const InstanceBatch& range = builder.GetBatch(b);
+		contiguous = contiguous && range.StartInstance == next && range.InstanceCount == counts[b];
+		for(UINT i = 0; i < range.InstanceCount; ++i)
+			copied = copied && buffer[range.StartInstance + i].World._41 == (float)i;
+		next += range.InstanceCount;
+	}
+
+	// A full buffer truncates instead of overrunning.
+	UINT truncated = builder.Build(&buffer[0], 200);
+
+	return BenchCheck(written == capacity && builder.GetNumQueued() == capacity, "every instance written") &&
+		BenchCheck(contiguous, "batches packed back to back") &&
+		BenchCheck(copied, "instance data copied in order") &&
+		BenchCheck(truncated == 200 && builder.GetBatch(1).InstanceCount == 75 && builder.GetBatch(3).InstanceCount == 0,
+			"capacity respected");
+}
+
+namespace
+{
+	// Counts what a D3D sink would be asked to do.
+	class CountingSink : public RenderQueueSink
+	{
+	public:
+		CountingSink() : Binds(0), Draws(0) {}
+
+		void BindTechnique(UINT /*technique*/) { ++Binds; }
+		void BindMaterial(UINT /*material*/) { ++Binds; }
+		void BindMesh(UINT /*mesh*/) { ++Binds; }
+		void Draw(const DrawPacket& /*packet*/) { ++Draws; }
+
+		UINT Binds;
+		UINT Draws;
+	};
+}
+
+ZEUS_BENCH(RenderQueueSort)
+{
+	// The per-object main pass of ZeusApp::DrawScene with instancing off: trees, cloth,
+	// grid, boxes, cylinders and spheres over three techniques, submitted in scene order
+	// with random depths.
+	const int frames = opts.Quick ? 20 : 2000;
+	const UINT counts[6]    = { 29, 1, 1, 1000, 5, 5 };
+	const UINT techs[6]     = { 0, 0, 0, 0, 0, 2 };
+	const UINT materials[6] = { 3, 4, 0, 1, 2, 5 };
+	const UINT meshes[6]    = { 1, 2, 0, 0, 0, 0 };
+
+	std::vector<DrawPacket> packets;
+	std::vector<float> depths;
+	for(UINT g = 0; g < 6; ++g)
+	{
+		for(UINT i = 0; i < counts[g]; ++i)
+		{
+			DrawPacket packet = DrawPacket();
+			packet.Technique = techs[g];
+			packet.Material = materials[g];
+			packet.Mesh = meshes[g];
+			packet.InstanceBatch = RenderQueue::NotInstanced;
+			packets.push_back(packet);
+			depths.push_back(MathHelper::RandF());
+		}
+	}
+
+	// Interleave the groups the way an unsorted, data-driven submission would.
+	std::vector<UINT> shuffled(packets.size());
+	for(UINT i = 0; i < shuffled.size(); ++i)
+		shuffled[i] = i;
+	for(UINT i = (UINT)shuffled.size() - 1; i > 0; --i)
+		std::swap(shuffled[i], shuffled[rand() % (i + 1)]);
+
+	RenderQueue queue;
+	CountingSink sink;
+	BenchTimer t;
+	for(int f = 0; f < frames; ++f)
+	{
+		queue.Clear();
+		for(UINT i = 0; i < shuffled.size(); ++i)
+			queue.Submit(packets[shuffled[i]], depths[shuffled[i]]);
+		queue.Sort();
+		queue.Execute(sink);
+	}
+	BenchReport("submit + sort + execute", t.ElapsedMs(), frames);
+
+	// What the same stream costs unsorted.
+	UINT unsortedChanges = 0;
+	for(UINT i = 0; i < shuffled.size(); ++i)
+	{
+		const DrawPacket& p = packets[shuffled[i]];
+		const DrawPacket* last = i > 0 ? &packets[shuffled[i-1]] : 0;
+		if(!last || last->Technique != p.Technique) unsortedChanges += 3;
+		else unsortedChanges += (last->Material != p.Material) + (last->Mesh != p.Mesh);
+	}
+
+	const RenderQueueStats& stats = queue.GetStats();
+	UINT sortedChanges = stats.TechniqueChanges + stats.MaterialChanges + stats.MeshChanges;
+	printf("  %u packets: %u technique, %u material, %u mesh binds (unsorted %u)\n", stats.Packets,
+		stats.TechniqueChanges, stats.MaterialChanges, stats.MeshChanges, unsortedChanges);
+
+	bool ordered = true;
+	for(UINT i = 1; i < queue.GetNumPackets(); ++i)
+		ordered = ordered && queue.GetSortedKey(i - 1) <= queue.GetSortedKey(i);
+
+	// Radix sort throughput against std::sort on random keys.
+	const UINT numKeys = opts.Quick ? 1 << 16 : 1 << 20;
+	std::vector<UINT64> keys(numKeys);
+	std::vector<UINT> values(numKeys);
+	std::vector<UINT64> keyScratch(numKeys);
+	std::vector<UINT> valueScratch(numKeys);
+	for(UINT i = 0; i < numKeys; ++i)
+	{
+		keys[i] = RenderQueue::MakeKey(rand() % 4, rand() % 64, rand() % 16, MathHelper::RandF());
+		values[i] = i;
+	}
+	std::vector<UINT64> expected(keys);
+
+	t.Reset();
+	RenderQueue::RadixSort(&keys[0], &values[0], &keyScratch[0], &valueScratch[0], numKeys);
+	BenchReport("RadixSort 64-bit keys", t.ElapsedMs(), (int)numKeys);
+
+	t.Reset();
+	std::sort(expected.begin(), expected.end());
+	BenchReport("std::sort 64-bit keys", t.ElapsedMs(), (int)numKeys);
+
+	bool stable = true;
+	for(UINT i = 1; i < numKeys; ++i)
+		stable = stable && (keys[i-1] < keys[i] || (keys[i-1] == keys[i] && values[i-1] < values[i]));
+
+	// Nothing to sort, nothing read.
+	UINT64 oneKey = 42;
+	UINT oneValue = 7;
+	RenderQueue::RadixSort(0, 0, 0, 0, 0);
+	RenderQueue::RadixSort(&oneKey, &oneValue, 0, 0, 1);
+	stable = stable && oneKey == 42 && oneValue == 7;
+
+	return BenchCheck(stats.Draws == packets.size() && sink.Draws == frames*packets.size(), "every packet drawn") &&
+		BenchCheck(ordered, "packets replayed in key order") &&
+		BenchCheck(stats.TechniqueChanges == 2 && stats.MaterialChanges == 6 && stats.MeshChanges == 4,
+			"one bind per technique, material and mesh run") &&
+		BenchCheck(sortedChanges < unsortedChanges, "sorting removes state changes") &&
+		BenchCheck(keys == expected, "radix sort matches std::sort") &&
+		BenchCheck(stable, "radix sort is stable");
+}
+
+ZEUS_BENCH(PassCacheDirty)
+{
+	// ZeusApp's cached passes: a directional shadow map and the six sphere cube faces,
+	// with boxes resting in the scene and one falling through a single face.
+	const int frames = opts.Quick ? 20 : 2000;
+	const UINT numBoxes = 1000;
+	const UINT shadow = 0;
+	const UINT firstFace = 1;
+
+	Camera faces[6];
+	XMFLOAT3 center(-5.0f, 4.0f, 5.0f);
+	XMFLOAT3 targets[6] = { XMFLOAT3(-4.0f, 4.0f, 5.0f), XMFLOAT3(-6.0f, 4.0f, 5.0f), XMFLOAT3(-5.0f, 5.0f, 5.0f),
+		XMFLOAT3(-5.0f, 3.0f, 5.0f), XMFLOAT3(-5.0f, 4.0f, 6.0f), XMFLOAT3(-5.0f, 4.0f, 4.0f) };
+	XMFLOAT3 ups[6] = { XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, -1.0f),
+		XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f) };
+	for(int i = 0; i < 6; ++i)
+	{
+		faces[i].LookAt(center, targets[i], ups[i]);
+		faces[i].SetLens(0.5f*XM_PI, 1.0f, 0.1f, 1000.0f);
+		faces[i].UpdateViewMatrix();
+	}
+
+	// Looking straight down on a 200x200 area.
+	XMMATRIX lightView = XMMatrixLookAtLH(XMVectorSet(0.0f, 100.0f, 0.0f, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f));
+	XMMATRIX lightViewProj = lightView*XMMatrixOrthographicOffCenterLH(-100.0f, 100.0f, -100.0f, 100.0f, 0.0f, 200.0f);
+
+	PassCache cache(7);
+	std::vector<UINT> updates;
+
+	// Frame 0 draws everything regardless of budget.
+	cache.BeginFrame();
+	cache.SetViewProj(shadow, lightViewProj);
+	for(int i = 0; i < 6; ++i)
+		cache.SetViewProj(firstFace + i, faces[i].ViewProj());
+	cache.SelectUpdates(firstFace, 6, 2, updates);
+	bool firstFull = updates.size() == 6 && cache.NeedsUpdate(shadow);
+	for(UINT i = 0; i < 7; ++i)
+		cache.MarkDrawn(i);
+
+	XNA::AxisAlignedBox unitBox;
+	unitBox.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	unitBox.Extents = XMFLOAT3(0.5f, 0.5f, 0.5f);
+
+	std::vector<XMFLOAT4X4> worlds(numBoxes);
+	std::vector<XNA::AxisAlignedBox> bounds(numBoxes);
+	for(UINT i = 0; i < numBoxes; ++i)
+	{
+		XMStoreFloat4x4(&worlds[i], XMMatrixTranslation(MathHelper::RandF(-90.0f, 90.0f), 0.5f, MathHelper::RandF(-90.0f, 90.0f)));
+		PassCache::TransformBounds(bounds[i], unitBox, worlds[i]);
+	}
+	XMStoreFloat4x4(&worlds[0], XMMatrixTranslation(0.0f, 4.0f, 5.0f));
+
+	// Resting boxes: nothing moved, nothing redrawn.
+	cache.BeginFrame();
+	cache.SelectUpdates(firstFace, 6, 2, updates);
+	bool staticClean = updates.empty() && !cache.NeedsUpdate(shadow);
+
+	// A box falling along +x of the sphere, seen only by the +X face and the shadow map.
+	BenchTimer t;
+	UINT faceRedraws = 0;
+	UINT shadowRedraws = 0;
+	for(int f = 0; f < frames; ++f)
+	{
+		cache.BeginFrame();
+
+		XMFLOAT4X4 falling;
+		XMStoreFloat4x4(&falling, XMMatrixTranslation(0.0f, 4.0f + 0.01f*(f % 100), 5.0f));
+		XNA::AxisAlignedBox before;
+		XNA::AxisAlignedBox after;
+		PassCache::TransformBounds(before, unitBox, worlds[0]);
+		PassCache::TransformBounds(after, unitBox, falling);
+		worlds[0] = falling;
+		cache.NotifyMoved(before, after);
+
+		// The per-frame bounds comparison ZeusApp::UpdatePassCache does for every box.
+		for(UINT i = 1; i < numBoxes; ++i)
+		{
+			XNA::AxisAlignedBox b;
+			PassCache::TransformBounds(b, unitBox, worlds[i]);
+			if(memcmp(&b, &bounds[i], sizeof(XMFLOAT3)*2) != 0)
+				cache.NotifyMoved(bounds[i], b);
+		}
+
+		cache.SelectUpdates(firstFace, 6, 2, updates);
+		for(UINT i = 0; i < updates.size(); ++i)
+			cache.MarkDrawn(updates[i]);
+		faceRedraws += (UINT)updates.size();
+
+		if(cache.NeedsUpdate(shadow))
+		{
+			cache.MarkDrawn(shadow);
+			++shadowRedraws;
+		}
+	}
+	BenchReport("track 1000 boxes, 7 passes", t.ElapsedMs(), frames);
+	printf("  %u face redraws of %u, %u shadow redraws of %d\n", faceRedraws, 6*frames, shadowRedraws, frames);
+
+	// A light change dirties everything; the budget spreads the faces over three frames.
+	cache.InvalidateAll();
+	UINT perFrame[3];
+	for(int f = 0; f < 3; ++f)
+	{
+		cache.BeginFrame();
+		cache.SelectUpdates(firstFace, 6, 2, updates);
+		perFrame[f] = (UINT)updates.size();
+		for(UINT i = 0; i < updates.size(); ++i)
+			cache.MarkDrawn(updates[i]);
+	}
+
+	// Clean faces still refresh once they reach MaxAge.
+	cache.SetMaxAge(10);
+	UINT aged = 0;
+	for(int f = 0; f < 10; ++f)
+	{
+		cache.BeginFrame();
+		cache.SelectUpdates(firstFace, 6, 0, updates);
+		aged += (UINT)updates.size();
+		for(UINT i = 0; i < updates.size(); ++i)
+			cache.MarkDrawn(updates[i]);
+	}
+
+	return BenchCheck(firstFull, "first frame draws every pass") &&
+		BenchCheck(staticClean, "static scene reuses every pass") &&
+		BenchCheck(faceRedraws == (UINT)frames && shadowRedraws == (UINT)frames, "moving box dirties one face and the shadow map") &&
+		BenchCheck(perFrame[0] == 2 && perFrame[1] == 2 && perFrame[2] == 2, "budget spreads face updates") &&
+		BenchCheck(aged == 6, "expired faces refresh");
+}
+
+ZEUS_BENCH(PassFrustumCull)
+{
+	// ZeusApp::CullPass: every shadow map and cube face culls the scene against its own
+	// frustum and appends the survivors to the shared instance buffer.
+	const int iterations = opts.Quick ? 20 : 2000;
+	const UINT numBoxes = 1000;
+
+	XNA::AxisAlignedBox unitBox;
+	unitBox.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	unitBox.Extents = XMFLOAT3(0.5f, 0.5f, 0.5f);
+
+	// A light looking straight down on a 20x20 area.
+	XMMATRIX lightView = XMMatrixLookAtLH(XMVectorSet(0.0f, 100.0f, 0.0f, 1.0f), XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f));
+	FrustumCuller light(lightView*XMMatrixOrthographicOffCenterLH(-10.0f, 10.0f, -10.0f, 10.0f, 0.0f, 200.0f));
+
+	// Inside, far outside, overlapping the x = 10 edge, just past it.
+	XMFLOAT4X4 known[4];
+	XMStoreFloat4x4(&known[0], XMMatrixTranslation(0.0f, 0.5f, 0.0f));
+	XMStoreFloat4x4(&known[1], XMMatrixTranslation(50.0f, 0.5f, 0.0f));
+	XMStoreFloat4x4(&known[2], XMMatrixTranslation(10.4f, 0.5f, 0.0f));
+	XMStoreFloat4x4(&known[3], XMMatrixTranslation(10.6f, 0.5f, 0.0f));
+	std::vector<UINT> visible;
+	light.CullInstances(unitBox, known, 4, visible);
+	bool lightKnown = visible.size() == 2 && visible[0] == 0 && visible[1] == 2;
+
+	// The +X face of the sphere cube map at (-5, 4, 5).
+	Camera face;
+	face.LookAt(XMFLOAT3(-5.0f, 4.0f, 5.0f), XMFLOAT3(-4.0f, 4.0f, 5.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+	face.SetLens(0.5f*XM_PI, 1.0f, 0.1f, 1000.0f);
+	face.UpdateViewMatrix();
+	FrustumCuller faceCuller(face.ViewProj());
+
+	// In front, behind, off to +z, and straddling the face's +z side plane.
+	XMFLOAT3 centers[4] = { XMFLOAT3(-2.0f, 4.0f, 5.0f), XMFLOAT3(-8.0f, 4.0f, 5.0f),
+		XMFLOAT3(-5.0f, 4.0f, 8.0f), XMFLOAT3(-3.0f, 4.0f, 7.5f) };
+	bool expected[4] = { true, false, false, true };
+	bool faceKnown = true;
+	for(int i = 0; i < 4; ++i)
+	{
+		XNA::Sphere sphere;
+		sphere.Center = centers[i];
+		sphere.Radius = 1.0f;
+		faceKnown = faceKnown && faceCuller.IsVisible(sphere) == expected[i];
+	}
+
+	// Boxes scattered over 200x200; about 1% fall in the light's 20x20.
+	std::vector<XMFLOAT4X4> worlds(numBoxes);
+	for(UINT i = 0; i < numBoxes; ++i)
+		XMStoreFloat4x4(&worlds[i], XMMatrixTranslation(MathHelper::RandF(-100.0f, 100.0f), 0.5f, MathHelper::RandF(-100.0f, 100.0f)));
+
+	BenchTimer t;
+	UINT culled = 0;
+	for(int i = 0; i < iterations; ++i)
+		culled += light.CullInstances(unitBox, &worlds[0], numBoxes, visible);
+	BenchReport("cull 1000 boxes, light frustum", t.ElapsedMs(), iterations);
+	printf("  %u of %u boxes visible\n", culled / iterations, numBoxes);
+
+	bool allInside = true;
+	for(size_t i = 0; i < visible.size(); ++i)
+	{
+		const XMFLOAT4X4& w = worlds[visible[i]];
+		allInside = allInside && fabsf(w._41) <= 10.5f && fabsf(w._43) <= 10.5f;
+	}
+
+	// Two passes appended back to back: the second's ranges start after the first's.
+	XMFLOAT4 white(1.0f, 1.0f, 1.0f, 1.0f);
+	std::vector<InstancedData> buffer(2*numBoxes);
+	InstanceBufferBuilder builder(1);
+	builder.AddSelected(0, &worlds[0], visible, white);
+	UINT used = builder.Build(&buffer[0], (UINT)buffer.size());
+
+	std::vector<UINT> faceVisible;
+	faceCuller.CullInstances(unitBox, known, 4, faceVisible);
+	builder.Reset();
+	builder.AddSelected(0, known, faceVisible, white);
+	UINT second = builder.Build(&buffer[used], (UINT)buffer.size() - used, used);
+	const InstanceBatch& range = builder.GetBatch(0);
+	bool appended = range.StartInstance == used && range.InstanceCount == second &&
+		(second == 0 || memcmp(&buffer[used].World, &known[faceVisible[0]], sizeof(XMFLOAT4X4)) == 0);
+
+	return BenchCheck(lightKnown, "light frustum keeps the inside and edge boxes") &&
+		BenchCheck(faceKnown, "cube face keeps the spheres in front of it") &&
+		BenchCheck(allInside, "culled boxes lie under the light") &&
+		BenchCheck(appended, "second pass appends after the first");
+}
+
+ZEUS_BENCH(BatchFrustumCull)
+{
+	// The skull instance cull in ZeusApp::UpdateScene: the per-object path it replaced
+	// (inverse world, decompose, TransformFrustum, IntersectAxisAlignedBoxFrustum) against
+	// BatchCuller's SoA planes test, at growing instance counts.
+	const UINT quickSizes[] = { 10000 };
+	const UINT fullSizes[] = { 10000, 100000, 1000000 };
+	const UINT* sizes = opts.Quick ? quickSizes : fullSizes;
+	const UINT numSizes = opts.Quick ? 1 : 3;
+
+	Camera cam;
+	cam.SetLens(0.25f*MathHelper::Pi, 16.0f/9.0f, 1.0f, 1000.0f);
+	cam.LookAt(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.3f, 0.1f, 1.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+	cam.UpdateViewMatrix();
+
+	XNA::Frustum camFrustum;
+	XMMATRIX proj = cam.Proj();
+	XNA::ComputeFrustumFromProjection(&camFrustum, &proj);
+	XMVECTOR detView = XMMatrixDeterminant(cam.View());
+	XMMATRIX invView = XMMatrixInverse(&detView, cam.View());
+
+	XNA::AxisAlignedBox localBox;
+	localBox.Center = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	localBox.Extents = XMFLOAT3(2.0f, 1.5f, 3.0f);
+
+	bool matches = true;
+	bool conservative = true;
+	for(UINT s = 0; s < numSizes; ++s)
+	{
+		UINT count = sizes[s];
+		std::vector<XMFLOAT4X4> worlds(count);
+		BatchCuller culler;
+		culler.Resize(count);
+		for(UINT i = 0; i < count; ++i)
+		{
+			XMStoreFloat4x4(&worlds[i], XMMatrixTranslation(MathHelper::RandF(-500.0f, 500.0f),
+				MathHelper::RandF(-500.0f, 500.0f), MathHelper::RandF(-500.0f, 500.0f)));
+
+			XNA::AxisAlignedBox box;
+			PassCache::TransformBounds(box, localBox, worlds[i]);
+			culler.Set(i, box);
+		}
+
+		// The old path is slow enough that a slice of the instances stands in for all.
+		UINT oldCount = count < 100000 ? count : 100000;
+		std::vector<UINT> oldVisible;
+		BenchTimer t;
+		for(UINT i = 0; i < oldCount; ++i)
+		{
+			XMMATRIX W = XMLoadFloat4x4(&worlds[i]);
+			XMVECTOR detWorld = XMMatrixDeterminant(W);
+			XMMATRIX toLocal = XMMatrixMultiply(invView, XMMatrixInverse(&detWorld, W));
+
+			XMVECTOR scale;
+			XMVECTOR rotQuat;
+			XMVECTOR translation;
+			XMMatrixDecompose(&scale, &rotQuat, &translation, toLocal);
+
+			XNA::Frustum localFrustum;
+			XNA::TransformFrustum(&localFrustum, &camFrustum, XMVectorGetX(scale), rotQuat, translation);
+			if(XNA::IntersectAxisAlignedBoxFrustum(&localBox, &localFrustum) != 0)
+				oldVisible.push_back(i);
+		}
+		double oldMs = t.ElapsedMs();
+
+		char label[64];
+		sprintf(label, "per-object decompose, %u%s", count, oldCount < count ? " (est.)" : "");
+		BenchReport(label, oldMs*count/oldCount, count);
+
+		const int iterations = count >= 1000000 ? 10 : 100;
+		std::vector<UINT> visible;
+		t.Reset();
+		for(int i = 0; i < (opts.Quick ? 10 : iterations); ++i)
+			culler.Cull(cam.ViewProj(), visible);
+		sprintf(label, "SoA SSE planes, %u", count);
+		BenchReport(label, t.ElapsedMs()/(opts.Quick ? 10 : iterations), count);
+		printf("  %u of %u visible\n", (UINT)visible.size(), count);
+
+		XMFLOAT4 planes[6];
+		ExtractFrustumPlanes(planes, cam.ViewProj());
+		std::vector<UINT> scalarVisible;
+		culler.CullScalar(planes, scalarVisible);
+		matches = matches && visible == scalarVisible;
+
+		// The planes test never rejects what the exact box/frustum test keeps.
+		for(size_t i = 0; i < oldVisible.size() && conservative; ++i)
+			conservative = std::binary_search(visible.begin(), visible.end(), oldVisible[i]);
+	}
+
+	// Mixed boxes and spheres, with a count that leaves padding in the last group.
+	BatchCuller mixed;
+	XNA::Sphere front = { XMFLOAT3(0.0f, 0.0f, 10.0f), 1.0f };
+	XNA::Sphere behind = { XMFLOAT3(0.0f, 0.0f, -10.0f), 1.0f };
+	XNA::Sphere nearPlane = { XMFLOAT3(0.0f, 0.0f, 0.5f), 0.6f };
+	XNA::AxisAlignedBox farBox;
+	farBox.Center = XMFLOAT3(0.0f, 0.0f, 1001.0f);
+	farBox.Extents = XMFLOAT3(1.0f, 1.0f, 0.5f);
+	XNA::AxisAlignedBox farEdgeBox;
+	farEdgeBox.Center = XMFLOAT3(0.0f, 0.0f, 1000.4f);
+	farEdgeBox.Extents = XMFLOAT3(1.0f, 1.0f, 0.5f);
+	mixed.Add(front);
+	mixed.Add(behind);
+	mixed.Add(farBox);
+	mixed.Add(nearPlane);
+	mixed.Add(farEdgeBox);
+
+	Camera straight;
+	straight.SetLens(0.25f*MathHelper::Pi, 1.0f, 1.0f, 1000.0f);
+	straight.UpdateViewMatrix();
+	std::vector<UINT> mixedVisible;
+	mixed.Cull(straight.ViewProj(), mixedVisible);
+	bool mixedKnown = mixedVisible.size() == 3 && mixedVisible[0] == 0 && mixedVisible[1] == 3 && mixedVisible[2] == 4;
+
+	return BenchCheck(matches, "SSE and scalar culls agree") &&
+		BenchCheck(conservative, "planes test keeps every exactly visible box") &&
+		BenchCheck(mixedKnown, "mixed boxes and spheres");
+}
+
+ZEUS_BENCH(CameraUpdate)
+{
+	const int iterations = opts.Quick ? 10000 : 1000000;
+
+	Camera cam;
+	cam.SetLens(0.25f*MathHelper::Pi, 16.0f/9.0f, 1.0f, 1000.0f);
+
+	BenchTimer t;
+	for(int i = 0; i < iterations; ++i)
+	{
+		cam.Walk(0.01f);
+		cam.Strafe(0.005f);
+		cam.Pitch(0.0001f);
+		cam.RotateY(0.0002f);
+		cam.UpdateViewMatrix();
+	}
+	BenchReport("walk/strafe/rotate + view", t.ElapsedMs(), iterations);
+
+	XMFLOAT4 planes[6];
+	ExtractFrustumPlanes(planes, cam.ViewProj());
+
+	XMFLOAT3 p = cam.GetPosition();
+	return BenchCheck(p.x == p.x && p.z == p.z, "camera position finite");
+}
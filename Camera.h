@@ -12,7 +12,8 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
-#include "d3dUtil.h"
+#include "MathHelper.h"
+#include <vector>
 
 class Camera
 {
@@ -0,0 +1,136 @@
+//***************************************************************************************
+// CookedMeshCache.cpp
+//***************************************************************************************
+
+#include "CookedMeshCache.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeDirectory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MakeDirectory(path) mkdir(path, 0755)
+#endif
+
+namespace
+{
+	const char CacheMagic[4] = { 'Z', 'P', 'X', 'M' };
+	const UINT CacheVersion = 1;
+
+	struct CacheHeader
+	{
+		char  Magic[4];
+		UINT  Version;
+		UINT64 Hash;
+		UINT64 Size;
+	};
+
+	const UINT64 FnvOffset = 14695981039346656037ULL;
+	const UINT64 FnvPrime  = 1099511628211ULL;
+
+	// FNV-1a taken a 32-bit word at a time rather than per byte; mesh data is all floats
+	// and ints, and this is four times fewer multiplies.
+	UINT64 Fnv1a(UINT64 h, const void* data, size_t size)
+	{
+		const unsigned char* p = (const unsigned char*)data;
+		size_t words = size / 4;
+		for(size_t i = 0; i < words; ++i, p += 4)
+		{
+			UINT w;
+			memcpy(&w, p, 4);
+			h ^= w;
+			h *= FnvPrime;
+		}
+		for(size_t i = words*4; i < size; ++i, ++p)
+		{
+			h ^= *p;
+			h *= FnvPrime;
+		}
+		return h;
+	}
+}
+
+CookedMeshCache::CookedMeshCache(const std::string& directory) :
+	mDirectory(directory)
+{
+}
+
+UINT64 CookedMeshCache::HashMesh(const float* verts, UINT numVerts, const int* inds, UINT numInds, UINT64 salt)
+{
+	UINT64 h = Fnv1a(FnvOffset, &salt, sizeof(salt));
+
+	// Fold in the counts so a vertex/index split of the same bytes hashes differently.
+	h = Fnv1a(h, &numVerts, sizeof(numVerts));
+	h = Fnv1a(h, &numInds, sizeof(numInds));
+
+	h = Fnv1a(h, verts, sizeof(float)*3*numVerts);
+	h = Fnv1a(h, inds, sizeof(int)*numInds);
+	return h;
+}
+
+std::string CookedMeshCache::EntryPath(UINT64 hash)const
+{
+	char name[32];
+	sprintf(name, "%016llx.pxm", (unsigned long long)hash);
+	return mDirectory + "/" + name;
+}
+
+bool CookedMeshCache::Load(UINT64 hash, std::vector<unsigned char>& cooked)const
+{
+	FILE* file = fopen(EntryPath(hash).c_str(), "rb");
+	if(!file)
+		return false;
+
+	CacheHeader header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.Magic, CacheMagic, sizeof(CacheMagic)) == 0 &&
+		header.Version == CacheVersion &&
+		header.Hash == hash;
+
+	if(ok)
+	{
+		cooked.resize((size_t)header.Size);
+		ok = header.Size == 0 || fread(&cooked[0], (size_t)header.Size, 1, file) == 1;
+	}
+
+	fclose(file);
+
+	if(!ok)
+		cooked.clear();
+	return ok;
+}
+
+bool CookedMeshCache::Store(UINT64 hash, const void* cooked, UINT64 size)const
+{
+	MakeDirectory(mDirectory.c_str());
+
+	std::string path = EntryPath(hash);
+	std::string tempPath = path + ".tmp";
+
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if(!file)
+		return false;
+
+	CacheHeader header;
+	memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+	header.Version = CacheVersion;
+	header.Hash = hash;
+	header.Size = size;
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		(size == 0 || fwrite(cooked, (size_t)size, 1, file) == 1);
+	ok = fclose(file) == 0 && ok;
+
+	if(ok)
+	{
+		// rename() does not replace an existing file on Windows.
+		remove(path.c_str());
+		ok = rename(tempPath.c_str(), path.c_str()) == 0;
+	}
+
+	if(!ok)
+		remove(tempPath.c_str());
+	return ok;
+}
@@ -0,0 +1,41 @@
+//***************************************************************************************
+// CookedMeshCache.h
+//
+// Content-addressed disk cache for cooked collision meshes.  A mesh is identified by a
+// 64-bit hash of its vertices, indices and a caller supplied salt (the physics SDK
+// version), so the cooked stream survives restarts and is rebuilt only when the
+// geometry or the cooker changes.  Knows nothing about PhysX; PhysX.cpp stores the
+// bytes PxCooking produces and feeds them back to createTriangleMesh.
+//***************************************************************************************
+
+#ifndef COOKEDMESHCACHE_H
+#define COOKEDMESHCACHE_H
+
+#include "Platform.h"
+#include <string>
+#include <vector>
+
+class CookedMeshCache
+{
+public:
+	explicit CookedMeshCache(const std::string& directory);
+
+	// FNV-1a over the raw vertex and index words.  numVerts float3 positions.
+	static UINT64 HashMesh(const float* verts, UINT numVerts, const int* inds, UINT numInds, UINT64 salt);
+
+	// Returns false when there is no entry, or the entry is truncated or was
+	// written for a different hash.
+	bool Load(UINT64 hash, std::vector<unsigned char>& cooked)const;
+
+	// Writes the entry through a temporary file so a crash never leaves a torn one.
+	bool Store(UINT64 hash, const void* cooked, UINT64 size)const;
+
+	std::string EntryPath(UINT64 hash)const;
+
+	const std::string& GetDirectory()const { return mDirectory; }
+
+private:
+	std::string mDirectory;
+};
+
+#endif // COOKEDMESHCACHE_H
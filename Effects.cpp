@@ -47,6 +47,9 @@ BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
 	Light1TexTech = mFX->GetTechniqueByName("Light1Tex");
 	Light2TexTech = mFX->GetTechniqueByName("Light2Tex");
 	Light3TexTech = mFX->GetTechniqueByName("Light3Tex");
+	Light3TexInstancedTech = mFX->GetTechniqueByName("Light3TexInstanced");
+	Light3TexPackedTech = mFX->GetTechniqueByName("Light3TexPacked");
+	Light3TexInstancedPackedTech = mFX->GetTechniqueByName("Light3TexInstancedPacked");
 
 	Light0TexAlphaClipTech = mFX->GetTechniqueByName("Light0TexAlphaClip");
 	Light1TexAlphaClipTech = mFX->GetTechniqueByName("Light1TexAlphaClip");
@@ -70,6 +73,7 @@ BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
 	Light1ReflectTech    = mFX->GetTechniqueByName("Light1Reflect");
 	Light2ReflectTech    = mFX->GetTechniqueByName("Light2Reflect");
 	Light3ReflectTech    = mFX->GetTechniqueByName("Light3Reflect");
+	Light3ReflectPackedTech = mFX->GetTechniqueByName("Light3ReflectPacked");
 
 	Light0TexReflectTech = mFX->GetTechniqueByName("Light0TexReflect");
 	Light1TexReflectTech = mFX->GetTechniqueByName("Light1TexReflect");
@@ -102,6 +106,8 @@ BasicEffect::BasicEffect(ID3D11Device* device, const std::wstring& filename)
 	ShadowTransform   = mFX->GetVariableByName("gShadowTransform")->AsMatrix();
 	ShadowTransform2   = mFX->GetVariableByName("gShadowTransform2")->AsMatrix();
 	EyePosW           = mFX->GetVariableByName("gEyePosW")->AsVector();
+	PosOffset         = mFX->GetVariableByName("gPosOffset");
+	PosScale          = mFX->GetVariableByName("gPosScale");
 	FogColor          = mFX->GetVariableByName("gFogColor")->AsVector();
 	FogStart          = mFX->GetVariableByName("gFogStart")->AsScalar();
 	FogRange          = mFX->GetVariableByName("gFogRange")->AsScalar();
@@ -147,6 +153,9 @@ NormalMapEffect::NormalMapEffect(ID3D11Device* device, const std::wstring& filen
 	Light1TexTech = mFX->GetTechniqueByName("Light1Tex");
 	Light2TexTech = mFX->GetTechniqueByName("Light2Tex");
 	Light3TexTech = mFX->GetTechniqueByName("Light3Tex");
+	Light3TexInstancedTech = mFX->GetTechniqueByName("Light3TexInstanced");
+	Light3TexPackedTech = mFX->GetTechniqueByName("Light3TexPacked");
+	Light3TexInstancedPackedTech = mFX->GetTechniqueByName("Light3TexInstancedPacked");
 
 	Light0TexAlphaClipTech = mFX->GetTechniqueByName("Light0TexAlphaClip");
 	Light1TexAlphaClipTech = mFX->GetTechniqueByName("Light1TexAlphaClip");
@@ -202,6 +211,8 @@ NormalMapEffect::NormalMapEffect(ID3D11Device* device, const std::wstring& filen
 	ShadowTransform2  = mFX->GetVariableByName("gShadowTransform2")->AsMatrix();
 	TexTransform      = mFX->GetVariableByName("gTexTransform")->AsMatrix();
 	EyePosW           = mFX->GetVariableByName("gEyePosW")->AsVector();
+	PosOffset         = mFX->GetVariableByName("gPosOffset");
+	PosScale          = mFX->GetVariableByName("gPosScale");
 	FogColor          = mFX->GetVariableByName("gFogColor")->AsVector();
 	FogStart          = mFX->GetVariableByName("gFogStart")->AsScalar();
 	FogRange          = mFX->GetVariableByName("gFogRange")->AsScalar();
@@ -249,6 +260,9 @@ DisplacementMapEffect::DisplacementMapEffect(ID3D11Device* device, const std::ws
 	Light1TexTech = mFX->GetTechniqueByName("Light1Tex");
 	Light2TexTech = mFX->GetTechniqueByName("Light2Tex");
 	Light3TexTech = mFX->GetTechniqueByName("Light3Tex");
+	Light3TexInstancedTech = mFX->GetTechniqueByName("Light3TexInstanced");
+	Light3TexPackedTech = mFX->GetTechniqueByName("Light3TexPacked");
+	Light3TexInstancedPackedTech = mFX->GetTechniqueByName("Light3TexInstancedPacked");
 
 	Light0TexAlphaClipTech = mFX->GetTechniqueByName("Light0TexAlphaClip");
 	Light1TexAlphaClipTech = mFX->GetTechniqueByName("Light1TexAlphaClip");
@@ -305,6 +319,8 @@ DisplacementMapEffect::DisplacementMapEffect(ID3D11Device* device, const std::ws
 	ShadowTransform2  = mFX->GetVariableByName("gShadowTransform2")->AsMatrix();
 	TexTransform      = mFX->GetVariableByName("gTexTransform")->AsMatrix();
 	EyePosW           = mFX->GetVariableByName("gEyePosW")->AsVector();
+	PosOffset         = mFX->GetVariableByName("gPosOffset");
+	PosScale          = mFX->GetVariableByName("gPosScale");
 	FogColor          = mFX->GetVariableByName("gFogColor")->AsVector();
 	FogStart          = mFX->GetVariableByName("gFogStart")->AsScalar();
 	FogRange          = mFX->GetVariableByName("gFogRange")->AsScalar();
@@ -351,6 +367,14 @@ BuildShadowMapEffect::BuildShadowMapEffect(ID3D11Device* device, const std::wstr
 
 	TessBuildShadowMapTech           = mFX->GetTechniqueByName("TessBuildShadowMapTech");
 	TessBuildShadowMapAlphaClipTech  = mFX->GetTechniqueByName("TessBuildShadowMapAlphaClipTech");
+
+	BuildShadowMapInstancedTech      = mFX->GetTechniqueByName("BuildShadowMapInstancedTech");
+	TessBuildShadowMapInstancedTech  = mFX->GetTechniqueByName("TessBuildShadowMapInstancedTech");
+
+	BuildShadowMapPackedTech              = mFX->GetTechniqueByName("BuildShadowMapPackedTech");
+	TessBuildShadowMapPackedTech          = mFX->GetTechniqueByName("TessBuildShadowMapPackedTech");
+	BuildShadowMapInstancedPackedTech     = mFX->GetTechniqueByName("BuildShadowMapInstancedPackedTech");
+	TessBuildShadowMapInstancedPackedTech = mFX->GetTechniqueByName("TessBuildShadowMapInstancedPackedTech");
 	
 	ViewProj          = mFX->GetVariableByName("gViewProj")->AsMatrix();
 	WorldViewProj     = mFX->GetVariableByName("gWorldViewProj")->AsMatrix();
@@ -358,6 +382,8 @@ BuildShadowMapEffect::BuildShadowMapEffect(ID3D11Device* device, const std::wstr
 	WorldInvTranspose = mFX->GetVariableByName("gWorldInvTranspose")->AsMatrix();
 	TexTransform      = mFX->GetVariableByName("gTexTransform")->AsMatrix();
 	EyePosW           = mFX->GetVariableByName("gEyePosW")->AsVector();
+	PosOffset         = mFX->GetVariableByName("gPosOffset");
+	PosScale          = mFX->GetVariableByName("gPosScale");
 	HeightScale       = mFX->GetVariableByName("gHeightScale")->AsScalar();
 	MaxTessDistance   = mFX->GetVariableByName("gMaxTessDistance")->AsScalar();
 	MinTessDistance   = mFX->GetVariableByName("gMinTessDistance")->AsScalar();
@@ -406,8 +432,9 @@ TerrainEffect::TerrainEffect(ID3D11Device* device, const std::wstring& filename)
 	PointLights		   = mFX->GetVariableByName("gPointLights");
 	Mat                = mFX->GetVariableByName("gMaterial");
 
-	MinDist            = mFX->GetVariableByName("gMinDist")->AsScalar();
-	MaxDist            = mFX->GetVariableByName("gMaxDist")->AsScalar();
+	LodRange0          = mFX->GetVariableByName("gLodRange0")->AsScalar();
+	LodMorphRatio      = mFX->GetVariableByName("gLodMorphRatio")->AsScalar();
+	NumLods            = mFX->GetVariableByName("gNumLods")->AsScalar();
 	MinTess            = mFX->GetVariableByName("gMinTess")->AsScalar();
 	MaxTess            = mFX->GetVariableByName("gMaxTess")->AsScalar();
 	TexelCellSpaceU    = mFX->GetVariableByName("gTexelCellSpaceU")->AsScalar();
@@ -421,6 +448,7 @@ TerrainEffect::TerrainEffect(ID3D11Device* device, const std::wstring& filename)
 	LayerMapArray      = mFX->GetVariableByName("gLayerMapArray")->AsShaderResource();
 	BlendMap           = mFX->GetVariableByName("gBlendMap")->AsShaderResource();
 	HeightMap          = mFX->GetVariableByName("gHeightMap")->AsShaderResource();
+	PatchLods          = mFX->GetVariableByName("gPatchLods")->AsShaderResource();
 	ShadowMap          = mFX->GetVariableByName("gShadowMap")->AsShaderResource();
 	ShadowMap2         = mFX->GetVariableByName("gShadowMap2")->AsShaderResource();
 
@@ -46,6 +46,9 @@ public:
 	void SetShadowTransform2(CXMMATRIX M)               { ShadowTransform2->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetTexTransform(CXMMATRIX M)                   { TexTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetEyePosW(const XMFLOAT3& v)                  { EyePosW->SetRawValue(&v, 0, sizeof(XMFLOAT3)); }
+	void SetVertexQuantization(const XMFLOAT3& offset, const XMFLOAT3& scale)
+	                                                    { PosOffset->SetRawValue(&offset, 0, sizeof(XMFLOAT3));
+	                                                      PosScale->SetRawValue(&scale, 0, sizeof(XMFLOAT3)); }
 	void SetFogColor(const FXMVECTOR v)                 { FogColor->SetFloatVector(reinterpret_cast<const float*>(&v)); }
 	void SetFogStart(float f)                           { FogStart->SetFloat(f); }
 	void SetFogRange(float f)                           { FogRange->SetFloat(f); }
@@ -83,6 +86,9 @@ public:
 	ID3DX11EffectTechnique* Light1TexTech;
 	ID3DX11EffectTechnique* Light2TexTech;
 	ID3DX11EffectTechnique* Light3TexTech;
+	ID3DX11EffectTechnique* Light3TexInstancedTech;
+	ID3DX11EffectTechnique* Light3TexPackedTech;
+	ID3DX11EffectTechnique* Light3TexInstancedPackedTech;
 
 	ID3DX11EffectTechnique* Light0TexAlphaClipTech;
 	ID3DX11EffectTechnique* Light1TexAlphaClipTech;
@@ -106,6 +112,7 @@ public:
 	ID3DX11EffectTechnique* Light1ReflectTech;
 	ID3DX11EffectTechnique* Light2ReflectTech;
 	ID3DX11EffectTechnique* Light3ReflectTech;
+	ID3DX11EffectTechnique* Light3ReflectPackedTech;
 
 	ID3DX11EffectTechnique* Light0TexReflectTech;
 	ID3DX11EffectTechnique* Light1TexReflectTech;
@@ -138,6 +145,8 @@ public:
 	ID3DX11EffectMatrixVariable* ShadowTransform2;
 	ID3DX11EffectMatrixVariable* TexTransform;
 	ID3DX11EffectVectorVariable* EyePosW;
+	ID3DX11EffectVariable* PosOffset;
+	ID3DX11EffectVariable* PosScale;
 	ID3DX11EffectVectorVariable* FogColor;
 	ID3DX11EffectScalarVariable* FogStart;
 	ID3DX11EffectScalarVariable* FogRange;
@@ -181,6 +190,9 @@ public:
 	void SetShadowTransform2(CXMMATRIX M)               { ShadowTransform2->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetTexTransform(CXMMATRIX M)                   { TexTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetEyePosW(const XMFLOAT3& v)                  { EyePosW->SetRawValue(&v, 0, sizeof(XMFLOAT3)); }
+	void SetVertexQuantization(const XMFLOAT3& offset, const XMFLOAT3& scale)
+	                                                    { PosOffset->SetRawValue(&offset, 0, sizeof(XMFLOAT3));
+	                                                      PosScale->SetRawValue(&scale, 0, sizeof(XMFLOAT3)); }
 	void SetFogColor(const FXMVECTOR v)                 { FogColor->SetFloatVector(reinterpret_cast<const float*>(&v)); }
 	void SetFogStart(float f)                           { FogStart->SetFloat(f); }
 	void SetFogRange(float f)                           { FogRange->SetFloat(f); }
@@ -220,6 +232,9 @@ public:
 	ID3DX11EffectTechnique* Light1TexTech;
 	ID3DX11EffectTechnique* Light2TexTech;
 	ID3DX11EffectTechnique* Light3TexTech;
+	ID3DX11EffectTechnique* Light3TexInstancedTech;
+	ID3DX11EffectTechnique* Light3TexPackedTech;
+	ID3DX11EffectTechnique* Light3TexInstancedPackedTech;
 
 	ID3DX11EffectTechnique* Light0TexAlphaClipTech;
 	ID3DX11EffectTechnique* Light1TexAlphaClipTech;
@@ -275,6 +290,8 @@ public:
 	ID3DX11EffectMatrixVariable* ShadowTransform2;
 	ID3DX11EffectMatrixVariable* TexTransform;
 	ID3DX11EffectVectorVariable* EyePosW;
+	ID3DX11EffectVariable* PosOffset;
+	ID3DX11EffectVariable* PosScale;
 	ID3DX11EffectVectorVariable* FogColor;
 	ID3DX11EffectScalarVariable* FogStart;
 	ID3DX11EffectScalarVariable* FogRange;
@@ -321,6 +338,9 @@ public:
 	void SetShadowTransform2(CXMMATRIX M)               { ShadowTransform2->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetTexTransform(CXMMATRIX M)                   { TexTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetEyePosW(const XMFLOAT3& v)                  { EyePosW->SetRawValue(&v, 0, sizeof(XMFLOAT3)); }
+	void SetVertexQuantization(const XMFLOAT3& offset, const XMFLOAT3& scale)
+	                                                    { PosOffset->SetRawValue(&offset, 0, sizeof(XMFLOAT3));
+	                                                      PosScale->SetRawValue(&scale, 0, sizeof(XMFLOAT3)); }
 	void SetFogColor(const FXMVECTOR v)                 { FogColor->SetFloatVector(reinterpret_cast<const float*>(&v)); }
 	void SetFogStart(float f)                           { FogStart->SetFloat(f); }
 	void SetFogRange(float f)                           { FogRange->SetFloat(f); }
@@ -364,6 +384,9 @@ public:
 	ID3DX11EffectTechnique* Light1TexTech;
 	ID3DX11EffectTechnique* Light2TexTech;
 	ID3DX11EffectTechnique* Light3TexTech;
+	ID3DX11EffectTechnique* Light3TexInstancedTech;
+	ID3DX11EffectTechnique* Light3TexPackedTech;
+	ID3DX11EffectTechnique* Light3TexInstancedPackedTech;
 
 	ID3DX11EffectTechnique* Light0TexAlphaClipTech;
 	ID3DX11EffectTechnique* Light1TexAlphaClipTech;
@@ -420,6 +443,8 @@ public:
 	ID3DX11EffectMatrixVariable* ShadowTransform2;
 	ID3DX11EffectMatrixVariable* TexTransform;
 	ID3DX11EffectVectorVariable* EyePosW;
+	ID3DX11EffectVariable* PosOffset;
+	ID3DX11EffectVariable* PosScale;
 	ID3DX11EffectVectorVariable* FogColor;
 	ID3DX11EffectScalarVariable* FogStart;
 	ID3DX11EffectScalarVariable* FogRange;
@@ -466,6 +491,9 @@ public:
 	void SetWorldInvTranspose(CXMMATRIX M)              { WorldInvTranspose->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetTexTransform(CXMMATRIX M)                   { TexTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetEyePosW(const XMFLOAT3& v)                  { EyePosW->SetRawValue(&v, 0, sizeof(XMFLOAT3)); }
+	void SetVertexQuantization(const XMFLOAT3& offset, const XMFLOAT3& scale)
+	                                                    { PosOffset->SetRawValue(&offset, 0, sizeof(XMFLOAT3));
+	                                                      PosScale->SetRawValue(&scale, 0, sizeof(XMFLOAT3)); }
 	
 	void SetHeightScale(float f)                        { HeightScale->SetFloat(f); }
 	void SetMaxTessDistance(float f)                    { MaxTessDistance->SetFloat(f); }
@@ -480,6 +508,14 @@ public:
 	ID3DX11EffectTechnique* BuildShadowMapAlphaClipTech;
 	ID3DX11EffectTechnique* TessBuildShadowMapTech;
 	ID3DX11EffectTechnique* TessBuildShadowMapAlphaClipTech;
+	ID3DX11EffectTechnique* BuildShadowMapInstancedTech;
+	ID3DX11EffectTechnique* TessBuildShadowMapInstancedTech;
+
+	// For VertexPacker's layouts; invalid until the .fxo is rebuilt.
+	ID3DX11EffectTechnique* BuildShadowMapPackedTech;
+	ID3DX11EffectTechnique* TessBuildShadowMapPackedTech;
+	ID3DX11EffectTechnique* BuildShadowMapInstancedPackedTech;
+	ID3DX11EffectTechnique* TessBuildShadowMapInstancedPackedTech;
 
 	ID3DX11EffectMatrixVariable* ViewProj;
 	ID3DX11EffectMatrixVariable* WorldViewProj;
@@ -487,6 +523,8 @@ public:
 	ID3DX11EffectMatrixVariable* WorldInvTranspose;
 	ID3DX11EffectMatrixVariable* TexTransform;
 	ID3DX11EffectVectorVariable* EyePosW;
+	ID3DX11EffectVariable* PosOffset;
+	ID3DX11EffectVariable* PosScale;
 	ID3DX11EffectScalarVariable* HeightScale;
 	ID3DX11EffectScalarVariable* MaxTessDistance;
 	ID3DX11EffectScalarVariable* MinTessDistance;
@@ -534,8 +572,10 @@ public:
 	void SetShadowTransform(CXMMATRIX M)                { ShadowTransform->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	void SetShadowTransform2(CXMMATRIX M)               { ShadowTransform2->SetMatrix(reinterpret_cast<const float*>(&M)); }
 
-	void SetMinDist(float f)                            { MinDist->SetFloat(f); }
-	void SetMaxDist(float f)                            { MaxDist->SetFloat(f); }
+	// TerrainQuadtree's LOD ranges; with SetPatchLods, unused until Terrain.fxo is rebuilt.
+	void SetLodRange0(float f)                          { LodRange0->SetFloat(f); }
+	void SetLodMorphRatio(float f)                      { LodMorphRatio->SetFloat(f); }
+	void SetNumLods(float f)                            { NumLods->SetFloat(f); }
 	void SetMinTess(float f)                            { MinTess->SetFloat(f); }
 	void SetMaxTess(float f)                            { MaxTess->SetFloat(f); }
 	void SetTexelCellSpaceU(float f)                    { TexelCellSpaceU->SetFloat(f); }
@@ -546,6 +586,7 @@ public:
 	void SetLayerMapArray(ID3D11ShaderResourceView* tex)   { LayerMapArray->SetResource(tex); }
 	void SetBlendMap(ID3D11ShaderResourceView* tex)        { BlendMap->SetResource(tex); }
 	void SetHeightMap(ID3D11ShaderResourceView* tex)       { HeightMap->SetResource(tex); }
+	void SetPatchLods(ID3D11ShaderResourceView* buffer)    { PatchLods->SetResource(buffer); }
 	void SetShadowMap(ID3D11ShaderResourceView* tex)       { ShadowMap->SetResource(tex); }
 	void SetShadowMap2(ID3D11ShaderResourceView* tex)      { ShadowMap2->SetResource(tex); }
 
@@ -588,8 +629,9 @@ public:
 	ID3DX11EffectVariable* Mat;
 	ID3DX11EffectScalarVariable* ScreenWidth;
 	ID3DX11EffectScalarVariable* ScreenHeight;
-	ID3DX11EffectScalarVariable* MinDist;
-	ID3DX11EffectScalarVariable* MaxDist;
+	ID3DX11EffectScalarVariable* LodRange0;
+	ID3DX11EffectScalarVariable* LodMorphRatio;
+	ID3DX11EffectScalarVariable* NumLods;
 	ID3DX11EffectScalarVariable* MinTess;
 	ID3DX11EffectScalarVariable* MaxTess;
 	ID3DX11EffectScalarVariable* TexelCellSpaceU;
@@ -600,6 +642,7 @@ public:
 	ID3DX11EffectShaderResourceVariable* LayerMapArray;
 	ID3DX11EffectShaderResourceVariable* BlendMap;
 	ID3DX11EffectShaderResourceVariable* HeightMap;
+	ID3DX11EffectShaderResourceVariable* PatchLods;
 	ID3DX11EffectShaderResourceVariable* ShadowMap;
 	ID3DX11EffectShaderResourceVariable* ShadowMap2;
 
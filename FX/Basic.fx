@@ -10,6 +10,7 @@
 //***************************************************************************************
 
 #include "LightHelper.fx"
+#include "PackedVertex.fx"
  
 cbuffer cbPerFrame
 {
@@ -113,7 +114,7 @@ VertexOut VS(VertexIn vin)
 {
 	VertexOut vout;
 	
-	vout.TexNum = vin.TexNum;
+	vout.TexNum = vin.TexNum & TEXNUM_MATERIAL;
 
 	// Transform to world space space.
 	vout.PosW    = mul(float4(vin.PosL, 1.0f), gWorld).xyz;
@@ -140,6 +141,56 @@ VertexOut VS(VertexIn vin)
 	return vout;
 }
  
+struct InstancedVertexIn
+{
+	float3 PosL    : POSITION;
+	float3 NormalL : NORMAL;
+	float2 Tex     : TEXCOORD;
+	int  TexNum  : TEXNUM;
+	row_major float4x4 World : WORLD;
+	float4 Color   : COLOR;
+};
+
+// Instanced draws set the per-object matrices as for an identity world (world-view-proj
+// is just view-proj and the shadow transforms are not premultiplied), so moving each
+// vertex into world space here lets the regular vertex shader do the rest.  Instances
+// are rigid or uniformly scaled, so World transforms the normal too; PS renormalizes.
+VertexOut InstancedVS(InstancedVertexIn vin)
+{
+	VertexIn v;
+	v.PosL    = mul(float4(vin.PosL, 1.0f), vin.World).xyz;
+	v.NormalL = mul(vin.NormalL, (float3x3)vin.World);
+	v.Tex     = vin.Tex;
+	v.TexNum  = vin.TexNum;
+
+	return VS(v);
+}
+
+// VertexPacker's layouts, decoded into the regular inputs.
+VertexOut PackedVS(PackedVertexIn vin)
+{
+	VertexIn v;
+	v.PosL    = DecodePosition(vin.PosL);
+	v.NormalL = DecodeOctahedral(vin.NormalL);
+	v.Tex     = vin.Tex;
+	v.TexNum  = vin.PosL.w;
+
+	return VS(v);
+}
+
+VertexOut InstancedPackedVS(InstancedPackedTanVertexIn vin)
+{
+	InstancedVertexIn v;
+	v.PosL    = DecodePosition(vin.PosL);
+	v.NormalL = DecodeOctahedral(vin.NormalL);
+	v.Tex     = vin.Tex;
+	v.TexNum  = vin.PosL.w;
+	v.World   = vin.World;
+	v.Color   = vin.Color;
+
+	return InstancedVS(v);
+}
+ 
 float4 PS(VertexOut pin, 
           uniform int gLightCount, 
 		  uniform bool gUseTexure, 
@@ -701,4 +752,44 @@ technique11 Light3TexAlphaClipFogReflect
 		SetGeometryShader( NULL );
         SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, true, true) ) ); 
     }
-}
\ No newline at end of file
+}
+
+technique11 Light3TexInstanced
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
+
+technique11 Light3TexPacked
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, PackedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
+
+technique11 Light3TexInstancedPacked
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedPackedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
+
+technique11 Light3ReflectPacked
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, PackedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, false, false, false, true) ) );
+    }
+}
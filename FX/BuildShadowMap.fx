@@ -9,6 +9,8 @@
 //
 //***************************************************************************************
 
+#include "PackedVertex.fx"
+
 cbuffer cbPerFrame
 {
 	float3 gEyePosW;
@@ -93,6 +95,81 @@ TessVertexOut TessVS(VertexIn vin)
 	return vout;
 }
 
+struct InstancedVertexIn
+{
+	float3 PosL     : POSITION;
+	float3 NormalL  : NORMAL;
+	float2 Tex      : TEXCOORD;
+	row_major float4x4 World : WORLD;
+	float4 Color    : COLOR;
+};
+
+// Instanced draws set gWorld and gWorldInvTranspose to identity and gWorldViewProj to
+// the light's view-proj, so moving each vertex into world space here lets the regular
+// vertex shaders do the rest.
+VertexOut InstancedVS(InstancedVertexIn vin)
+{
+	VertexIn v;
+	v.PosL    = mul(float4(vin.PosL, 1.0f), vin.World).xyz;
+	v.NormalL = mul(vin.NormalL, (float3x3)vin.World);
+	v.Tex     = vin.Tex;
+
+	return VS(v);
+}
+
+TessVertexOut InstancedTessVS(InstancedVertexIn vin)
+{
+	VertexIn v;
+	v.PosL    = mul(float4(vin.PosL, 1.0f), vin.World).xyz;
+	v.NormalL = mul(vin.NormalL, (float3x3)vin.World);
+	v.Tex     = vin.Tex;
+
+	return TessVS(v);
+}
+
+// VertexPacker's layouts, decoded into the regular inputs.
+VertexIn DecodePacked(PackedVertexIn vin)
+{
+	VertexIn v;
+	v.PosL    = DecodePosition(vin.PosL);
+	v.NormalL = DecodeOctahedral(vin.NormalL);
+	v.Tex     = vin.Tex;
+
+	return v;
+}
+
+InstancedVertexIn DecodeInstancedPacked(InstancedPackedTanVertexIn vin)
+{
+	InstancedVertexIn v;
+	v.PosL    = DecodePosition(vin.PosL);
+	v.NormalL = DecodeOctahedral(vin.NormalL);
+	v.Tex     = vin.Tex;
+	v.World   = vin.World;
+	v.Color   = vin.Color;
+
+	return v;
+}
+
+VertexOut PackedVS(PackedVertexIn vin)
+{
+	return VS(DecodePacked(vin));
+}
+
+TessVertexOut PackedTessVS(PackedVertexIn vin)
+{
+	return TessVS(DecodePacked(vin));
+}
+
+VertexOut InstancedPackedVS(InstancedPackedTanVertexIn vin)
+{
+	return InstancedVS(DecodeInstancedPacked(vin));
+}
+
+TessVertexOut InstancedPackedTessVS(InstancedPackedTanVertexIn vin)
+{
+	return InstancedTessVS(DecodeInstancedPacked(vin));
+}
+
 struct PatchTess
 {
 	float EdgeTess[3] : SV_TessFactor;
@@ -278,4 +355,82 @@ technique11 TessBuildShadowMapAlphaClipTech
         SetGeometryShader( NULL );
         SetPixelShader( CompileShader( ps_5_0, TessPS() ) );
     }
-}
\ No newline at end of file
+}
+
+technique11 BuildShadowMapInstancedTech
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedVS() ) );
+        SetGeometryShader( NULL );
+        SetPixelShader( NULL );
+
+		SetRasterizerState(Depth);
+    }
+}
+
+technique11 TessBuildShadowMapInstancedTech
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedTessVS() ) );
+		SetHullShader( CompileShader( hs_5_0, HS() ) );
+        SetDomainShader( CompileShader( ds_5_0, DS() ) );
+        SetGeometryShader( NULL );
+        SetPixelShader( NULL );
+
+		SetRasterizerState(Depth);
+    }
+}
+
+technique11 BuildShadowMapPackedTech
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, PackedVS() ) );
+        SetGeometryShader( NULL );
+        SetPixelShader( NULL );
+
+		SetRasterizerState(Depth);
+    }
+}
+
+technique11 TessBuildShadowMapPackedTech
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, PackedTessVS() ) );
+		SetHullShader( CompileShader( hs_5_0, HS() ) );
+        SetDomainShader( CompileShader( ds_5_0, DS() ) );
+        SetGeometryShader( NULL );
+        SetPixelShader( NULL );
+
+		SetRasterizerState(Depth);
+    }
+}
+
+technique11 BuildShadowMapInstancedPackedTech
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedPackedVS() ) );
+        SetGeometryShader( NULL );
+        SetPixelShader( NULL );
+
+		SetRasterizerState(Depth);
+    }
+}
+
+technique11 TessBuildShadowMapInstancedPackedTech
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedPackedTessVS() ) );
+		SetHullShader( CompileShader( hs_5_0, HS() ) );
+        SetDomainShader( CompileShader( ds_5_0, DS() ) );
+        SetGeometryShader( NULL );
+        SetPixelShader( NULL );
+
+		SetRasterizerState(Depth);
+    }
+}
@@ -10,6 +10,7 @@
 //***************************************************************************************
 
 #include "LightHelper.fx"
+#include "PackedVertex.fx"
  
 cbuffer cbPerFrame
 {
@@ -84,6 +85,7 @@ struct VertexIn
 	float3 PosL     : POSITION;
 	float3 NormalL  : NORMAL;
 	float2 Tex      : TEXCOORD;
+	int    TexNum   : TEXNUM;
 	float3 TangentL : TANGENT;
 };
 
@@ -94,6 +96,7 @@ struct VertexOut
 	float3 TangentW   : TANGENT;
 	float2 Tex        : TEXCOORD0;
 	float  TessFactor : TESS;
+	float  TangentSign : TANGENTSIGN;
 };
 
 VertexOut VS(VertexIn vin)
@@ -104,6 +107,7 @@ VertexOut VS(VertexIn vin)
 	vout.PosW     = mul(float4(vin.PosL, 1.0f), gWorld).xyz;
 	vout.NormalW  = mul(vin.NormalL, (float3x3)gWorldInvTranspose);
 	vout.TangentW = mul(vin.TangentL, (float3x3)gWorld);
+	vout.TangentSign = TexNumTangentSign(vin.TexNum);
 
 	// Output vertex attributes for interpolation across triangle.
 	vout.Tex = mul(float4(vin.Tex, 0.0f, 1.0f), gTexTransform).xy;
@@ -122,6 +126,59 @@ VertexOut VS(VertexIn vin)
 	return vout;
 }
 
+struct InstancedVertexIn
+{
+	float3 PosL     : POSITION;
+	float3 NormalL  : NORMAL;
+	float2 Tex      : TEXCOORD;
+	int    TexNum   : TEXNUM;
+	float3 TangentL : TANGENT;
+	row_major float4x4 World : WORLD;
+	float4 Color    : COLOR;
+};
+
+// Instanced draws set gWorld and gWorldInvTranspose to identity, so moving each vertex
+// into world space here lets the regular vertex shader do the rest.  Instances are
+// rigid or uniformly scaled, so World transforms the normal too; DS renormalizes.
+VertexOut InstancedVS(InstancedVertexIn vin)
+{
+	VertexIn v;
+	v.PosL     = mul(float4(vin.PosL, 1.0f), vin.World).xyz;
+	v.NormalL  = mul(vin.NormalL, (float3x3)vin.World);
+	v.Tex      = vin.Tex;
+	v.TexNum   = vin.TexNum;
+	v.TangentL = mul(vin.TangentL, (float3x3)vin.World);
+
+	return VS(v);
+}
+
+// VertexPacker's layouts, decoded into the regular inputs.
+VertexOut PackedVS(PackedTanVertexIn vin)
+{
+	VertexIn v;
+	v.PosL     = DecodePosition(vin.PosL);
+	v.NormalL  = DecodeOctahedral(vin.NormalL);
+	v.Tex      = vin.Tex;
+	v.TexNum   = vin.PosL.w;
+	v.TangentL = DecodeOctahedral(vin.TangentL);
+
+	return VS(v);
+}
+
+VertexOut InstancedPackedVS(InstancedPackedTanVertexIn vin)
+{
+	InstancedVertexIn v;
+	v.PosL     = DecodePosition(vin.PosL);
+	v.NormalL  = DecodeOctahedral(vin.NormalL);
+	v.Tex      = vin.Tex;
+	v.TexNum   = vin.PosL.w;
+	v.TangentL = DecodeOctahedral(vin.TangentL);
+	v.World    = vin.World;
+	v.Color    = vin.Color;
+
+	return InstancedVS(v);
+}
+
 struct PatchTess
 {
 	float EdgeTess[3] : SV_TessFactor;
@@ -152,6 +209,7 @@ struct HullOut
     float3 NormalW  : NORMAL;
 	float3 TangentW : TANGENT;
 	float2 Tex      : TEXCOORD;
+	float  TangentSign : TANGENTSIGN;
 };
 
 [domain("tri")]
@@ -170,6 +228,7 @@ HullOut HS(InputPatch<VertexOut,3> p,
 	hout.NormalW  = p[i].NormalW;
 	hout.TangentW = p[i].TangentW;
 	hout.Tex      = p[i].Tex;
+	hout.TangentSign = p[i].TangentSign;
 	
 	return hout;
 }
@@ -189,6 +248,7 @@ struct DomainOut
 	float4 ShadowPosCube3 : TEXCOORD6;
 	float4 ShadowPosCube4 : TEXCOORD7;
 	float4 ShadowPosCube5 : TEXCOORD8;
+	nointerpolation float TangentSign : TANGENTSIGN;
 };
 
 // The domain shader is called for every vertex created by the tessellator.  
@@ -205,6 +265,7 @@ DomainOut DS(PatchTess patchTess,
 	dout.NormalW  = bary.x*tri[0].NormalW  + bary.y*tri[1].NormalW  + bary.z*tri[2].NormalW;
 	dout.TangentW = bary.x*tri[0].TangentW + bary.y*tri[1].TangentW + bary.z*tri[2].TangentW;
 	dout.Tex      = bary.x*tri[0].Tex      + bary.y*tri[1].Tex      + bary.z*tri[2].Tex;
+	dout.TangentSign = tri[0].TangentSign;
 	
 	// Interpolating normal can unnormalize it, so normalize it.
 	dout.NormalW = normalize(dout.NormalW);
@@ -282,7 +343,7 @@ float4 PS(DomainOut pin,
 	//
 
 	float3 normalMapSample = gNormalMap.Sample(samLinear, pin.Tex).rgb;
-	float3 bumpedNormalW = NormalSampleToWorldSpace(normalMapSample, pin.NormalW, pin.TangentW);
+	float3 bumpedNormalW = NormalSampleToWorldSpace(normalMapSample, pin.NormalW, pin.TangentW, pin.TangentSign);
 	 
 	//
 	// Lighting.
@@ -887,4 +948,40 @@ technique11 Light3TexAlphaClipFogReflect
 		SetGeometryShader( NULL );
         SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, true, true) ) ); 
     }
-}
\ No newline at end of file
+}
+
+technique11 Light3TexInstanced
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedVS() ) );
+        SetHullShader( CompileShader( hs_5_0, HS() ) );
+        SetDomainShader( CompileShader( ds_5_0, DS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
+
+technique11 Light3TexPacked
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, PackedVS() ) );
+        SetHullShader( CompileShader( hs_5_0, HS() ) );
+        SetDomainShader( CompileShader( ds_5_0, DS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
+
+technique11 Light3TexInstancedPacked
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedPackedVS() ) );
+        SetHullShader( CompileShader( hs_5_0, HS() ) );
+        SetDomainShader( CompileShader( ds_5_0, DS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
@@ -213,10 +213,23 @@ void ComputeSpotLight(Material mat, SpotLight L, float3 pos, float3 normal, floa
 	spec    *= att;
 }
 
+//---------------------------------------------------------------------------------------
+// A vertex's TexNum holds its material in the low bits, and TEXNUM_MIRRORED where
+// TangentGenerator found the texture mirrored (TexNumMirrored in MeshFile.h).
+//---------------------------------------------------------------------------------------
+#define TEXNUM_MIRRORED 0x8000
+#define TEXNUM_MATERIAL 0x7fff
+
+// The bitangent is tangentSign*cross(normal, tangent).
+float TexNumTangentSign(int texNum)
+{
+	return (texNum & TEXNUM_MIRRORED) ? -1.0f : 1.0f;
+}
+
 //---------------------------------------------------------------------------------------
 // Transforms a normal map sample to world space.
 //---------------------------------------------------------------------------------------
-float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, float3 tangentW)
+float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, float3 tangentW, float tangentSign)
 {
 	// Uncompress each component from [0,1] to [-1,1].
 	float3 normalT = 2.0f*normalMapSample - 1.0f;
@@ -224,7 +237,7 @@ float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, floa
 	// Build orthonormal basis.
 	float3 N = unitNormalW;
 	float3 T = normalize(tangentW - dot(tangentW, N)*N);
-	float3 B = cross(N, T);
+	float3 B = tangentSign*cross(N, T);
 
 	float3x3 TBN = float3x3(T, B, N);
 
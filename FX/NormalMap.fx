@@ -10,6 +10,7 @@
 //***************************************************************************************
 
 #include "LightHelper.fx"
+#include "PackedVertex.fx"
  
 cbuffer cbPerFrame
 {
@@ -102,13 +103,15 @@ struct VertexOut
 	float4 ShadowPosCube4 : TEXCOORD7;
 	float4 ShadowPosCube5 : TEXCOORD8;
 	int	   TexNum	: TEXNUM;
+	nointerpolation float TangentSign : TANGENTSIGN;
 };
 
 VertexOut VS(VertexIn vin)
 {
 	VertexOut vout;
 	
-	vout.TexNum = vin.TexNum;
+	vout.TexNum = vin.TexNum & TEXNUM_MATERIAL;
+	vout.TangentSign = TexNumTangentSign(vin.TexNum);
 
 	// Transform to world space space.
 	vout.PosW     = mul(float4(vin.PosL, 1.0f), gWorld).xyz;
@@ -136,6 +139,60 @@ VertexOut VS(VertexIn vin)
 	return vout;
 }
  
+struct InstancedVertexIn
+{
+	float3 PosL     : POSITION;
+	float3 NormalL  : NORMAL;
+	float2 Tex      : TEXCOORD;
+	int	   TexNum	: TEXNUM;
+	float3 TangentL : TANGENT;
+	row_major float4x4 World : WORLD;
+	float4 Color    : COLOR;
+};
+
+// Instanced draws set the per-object matrices as for an identity world (world-view-proj
+// is just view-proj and the shadow transforms are not premultiplied), so moving each
+// vertex into world space here lets the regular vertex shader do the rest.  Instances
+// are rigid or uniformly scaled, so World transforms the normal too; PS renormalizes.
+VertexOut InstancedVS(InstancedVertexIn vin)
+{
+	VertexIn v;
+	v.PosL     = mul(float4(vin.PosL, 1.0f), vin.World).xyz;
+	v.NormalL  = mul(vin.NormalL, (float3x3)vin.World);
+	v.Tex      = vin.Tex;
+	v.TexNum   = vin.TexNum;
+	v.TangentL = mul(vin.TangentL, (float3x3)vin.World);
+
+	return VS(v);
+}
+
+// VertexPacker's layouts, decoded into the regular inputs.
+VertexOut PackedVS(PackedTanVertexIn vin)
+{
+	VertexIn v;
+	v.PosL     = DecodePosition(vin.PosL);
+	v.NormalL  = DecodeOctahedral(vin.NormalL);
+	v.Tex      = vin.Tex;
+	v.TexNum   = vin.PosL.w;
+	v.TangentL = DecodeOctahedral(vin.TangentL);
+
+	return VS(v);
+}
+
+VertexOut InstancedPackedVS(InstancedPackedTanVertexIn vin)
+{
+	InstancedVertexIn v;
+	v.PosL     = DecodePosition(vin.PosL);
+	v.NormalL  = DecodeOctahedral(vin.NormalL);
+	v.Tex      = vin.Tex;
+	v.TexNum   = vin.PosL.w;
+	v.TangentL = DecodeOctahedral(vin.TangentL);
+	v.World    = vin.World;
+	v.Color    = vin.Color;
+
+	return InstancedVS(v);
+}
+ 
 float4 PS(VertexOut pin, 
           uniform int gLightCount, 
 		  uniform bool gUseTexure, 
@@ -204,7 +261,7 @@ float4 PS(VertexOut pin,
 
 	//normalMapSample = pin.NormalW;
 
-	float3 bumpedNormalW = NormalSampleToWorldSpace(normalMapSample, pin.NormalW, pin.TangentW);
+	float3 bumpedNormalW = NormalSampleToWorldSpace(normalMapSample, pin.NormalW, pin.TangentW, pin.TangentSign);
 
 	//
 	// Lighting.
@@ -722,4 +779,34 @@ technique11 Light3TexAlphaClipFogReflect
 		SetGeometryShader( NULL );
         SetPixelShader( CompileShader( ps_5_0, PS(3, true, true, true, true) ) ); 
     }
-}
\ No newline at end of file
+}
+
+technique11 Light3TexInstanced
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
+
+technique11 Light3TexPacked
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, PackedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
+
+technique11 Light3TexInstancedPacked
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, InstancedPackedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3, true, false, false, false) ) );
+    }
+}
@@ -0,0 +1,54 @@
+//***************************************************************************************
+// PackedVertex.fx
+//
+// Decodes VertexPacker's layouts: positions quantized to the mesh's bounds, with
+// TexNum, material and TEXNUM_MIRRORED, in the fourth lane, octahedral normals and
+// tangents, and half float texture coordinates, which the input assembler has
+// already widened.
+//***************************************************************************************
+
+cbuffer cbPerMesh
+{
+	// p = gPosOffset + q*gPosScale, as VertexQuantization gives them.
+	float3 gPosOffset;
+	float3 gPosScale;
+};
+
+struct PackedVertexIn
+{
+	uint4  PosL     : POSITION;
+	float2 NormalL  : NORMAL;
+	float2 Tex      : TEXCOORD;
+};
+
+struct PackedTanVertexIn
+{
+	uint4  PosL     : POSITION;
+	float2 NormalL  : NORMAL;
+	float2 TangentL : TANGENT;
+	float2 Tex      : TEXCOORD;
+};
+
+struct InstancedPackedTanVertexIn
+{
+	uint4  PosL     : POSITION;
+	float2 NormalL  : NORMAL;
+	float2 TangentL : TANGENT;
+	float2 Tex      : TEXCOORD;
+	row_major float4x4 World : WORLD;
+	float4 Color    : COLOR;
+};
+
+float3 DecodePosition(uint4 q)
+{
+	return gPosOffset + (float3)q.xyz*gPosScale;
+}
+
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	if(n.z < 0.0f)
+		n.xy = (1.0f - abs(n.yx))*(n.xy >= 0.0f ? 1.0f : -1.0f);
+
+	return normalize(n);
+}
@@ -21,15 +21,17 @@ cbuffer cbPerFrame
 	float  gFogRange;
 	float4 gFogColor;
 	
-	// When distance is minimum, the tessellation is maximum.
-	// When distance is maximum, the tessellation is minimum.
-	float gMinDist;
-	float gMaxDist;
+	// The CPU quadtree's LOD ranges: LOD k reaches gLodRange0*2^k from the eye, and
+	// morphs toward k+1 from gLodMorphRatio of the way through its range.
+	float gLodRange0;
+	float gLodMorphRatio;
+	float gNumLods;
 
 	// Exponents for power of 2 tessellation.  The tessellation
 	// range is [2^(gMinTess), 2^(gMaxTess)].  Since the maximum
 	// tessellation is 64, this means gMaxTess can be at most 6
-	// since 2^6 = 64.
+	// since 2^6 = 64.  LOD 0 gets 2^(gMaxTess), and each LOD
+	// halves it.
 	float gMinTess;
 	float gMaxTess;
 	
@@ -64,6 +66,10 @@ Texture2DArray gLayerMapArray;
 Texture2D gBlendMap;
 Texture2D gHeightMap;
 Texture2D gShadowMap;
+
+// One per patch of the draw, indexed by SV_PrimitiveID: the LOD of the quadtree node
+// the patch was selected in, and the node's morph start and end distances.
+Buffer<float4> gPatchLods;
 Texture2D gShadowMap2;
 
 Texture2D gOmniShadowMap0;
@@ -132,16 +138,28 @@ VertexOut VS(VertexIn vin)
 	return vout;
 }
  
-float CalcTessFactor(float3 p)
+// A LOD plus how far it has morphed toward the next; fractional_even partitioning
+// then slides the vertices continuously from one LOD to the next.
+float MorphLod(float d, float lod, float morphStart, float morphEnd)
+{
+	return lod + saturate( (d - morphStart) / (morphEnd - morphStart) );
+}
+
+// The LOD whose range reaches p, as TerrainQuadtree::GetMorphLod finds it.  This
+// depends on p alone, so edges shared by patches of different nodes agree.
+float CalcEdgeLod(float3 p)
 {
 	float d = distance(p, gEyePosW);
 
-	// max norm in xz plane (useful to see detail levels from a bird's eye).
-	//float d = max( abs(p.x-gEyePosW.x), abs(p.z-gEyePosW.z) );
-	
-	float s = saturate( (d - gMinDist) / (gMaxDist - gMinDist) );
-	
-	return pow(2, (lerp(gMaxTess, gMinTess, s)) );
+	float lod = clamp( ceil(log2(d / gLodRange0)), 0.0f, gNumLods - 1.0f );
+	float range = gLodRange0*exp2(lod);
+	float prevRange = lod > 0.0f ? 0.5f*range : 0.0f;
+	return MorphLod(d, lod, prevRange + (range - prevRange)*gLodMorphRatio, range);
+}
+
+float CalcTessFactor(float lod)
+{
+	return pow(2, clamp(gMaxTess - lod, gMinTess, gMaxTess));
 }
 
 // Returns true if the box is completely behind (in negative half space) of plane.
@@ -230,12 +248,14 @@ PatchTess ConstantHS(InputPatch<VertexOut, 4> patch, uint patchID : SV_Primitive
 		float3 e3 = 0.5f*(patch[2].PosW + patch[3].PosW);
 		float3  c = 0.25f*(patch[0].PosW + patch[1].PosW + patch[2].PosW + patch[3].PosW);
 		
-		pt.EdgeTess[0] = CalcTessFactor(e0);
-		pt.EdgeTess[1] = CalcTessFactor(e1);
-		pt.EdgeTess[2] = CalcTessFactor(e2);
-		pt.EdgeTess[3] = CalcTessFactor(e3);
+		pt.EdgeTess[0] = CalcTessFactor(CalcEdgeLod(e0));
+		pt.EdgeTess[1] = CalcTessFactor(CalcEdgeLod(e1));
+		pt.EdgeTess[2] = CalcTessFactor(CalcEdgeLod(e2));
+		pt.EdgeTess[3] = CalcTessFactor(CalcEdgeLod(e3));
 		
-		pt.InsideTess[0] = CalcTessFactor(c);
+		// The inside follows the node the quadtree selected the patch in.
+		float4 node = gPatchLods[patchID];
+		pt.InsideTess[0] = CalcTessFactor(MorphLod(distance(c, gEyePosW), node.x, node.y, node.z));
 		pt.InsideTess[1] = pt.InsideTess[0];
 	
 		return pt;
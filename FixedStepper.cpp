@@ -0,0 +1,48 @@
+//***************************************************************************************
+// FixedStepper.cpp
+//***************************************************************************************
+
+#include "FixedStepper.h"
+
+FixedStepper::FixedStepper(float stepSize, UINT maxSubsteps) :
+	mStepSize(stepSize),
+	mMaxSubsteps(maxSubsteps > 0 ? maxSubsteps : 1),
+	mAccumulator(0.0f),
+	mDroppedTime(0.0f)
+{
+}
+
+void FixedStepper::SetMaxSubsteps(UINT maxSubsteps)
+{
+	mMaxSubsteps = maxSubsteps > 0 ? maxSubsteps : 1;
+}
+
+UINT FixedStepper::Advance(float dt)
+{
+	if(dt > 0.0f)
+		mAccumulator += dt;
+
+	// Frame times hover around the step size; absorb float drift so a steady
+	// 60 Hz frame pays out exactly one step instead of alternating 0 and 2.
+	const float slack = mStepSize*0.001f;
+
+	UINT steps = 0;
+	while(mAccumulator + slack >= mStepSize && steps < mMaxSubsteps)
+	{
+		mAccumulator -= mStepSize;
+		++steps;
+	}
+
+	if(mAccumulator + slack >= mStepSize)
+	{
+		// Over the cap: keep the fractional step so motion stays smooth, drop the rest.
+		float keep = mAccumulator - mStepSize*(int)((mAccumulator + slack) / mStepSize);
+		mDroppedTime += mAccumulator - keep;
+		mAccumulator = keep;
+	}
+
+	if(mAccumulator < 0.0f)
+		mAccumulator = 0.0f;
+
+	return steps;
+}
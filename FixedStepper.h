@@ -0,0 +1,40 @@
+//***************************************************************************************
+// FixedStepper.h
+//
+// Fixed-timestep accumulator for the physics simulation.  Each frame's dt is banked
+// and paid out in whole steps; when a long frame owes more than MaxSubsteps steps the
+// rest of the debt is dropped, so one hitch cannot snowball into ever longer frames.
+//***************************************************************************************
+
+#ifndef FIXEDSTEPPER_H
+#define FIXEDSTEPPER_H
+
+#include "Platform.h"
+
+class FixedStepper
+{
+public:
+	FixedStepper(float stepSize, UINT maxSubsteps);
+
+	// Banks dt and returns the number of steps to simulate this frame.
+	UINT Advance(float dt);
+
+	void SetMaxSubsteps(UINT maxSubsteps);
+
+	float GetStepSize()const { return mStepSize; }
+	UINT GetMaxSubsteps()const { return mMaxSubsteps; }
+
+	// Fraction of a step left in the accumulator, in [0, 1); for pose interpolation.
+	float GetAlpha()const { return mAccumulator / mStepSize; }
+
+	// Simulation time discarded by the substep cap since construction.
+	float GetDroppedTime()const { return mDroppedTime; }
+
+private:
+	float mStepSize;
+	UINT mMaxSubsteps;
+	float mAccumulator;
+	float mDroppedTime;
+};
+
+#endif // FIXEDSTEPPER_H
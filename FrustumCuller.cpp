@@ -0,0 +1,63 @@
+//***************************************************************************************
+// FrustumCuller.cpp
+//***************************************************************************************
+
+#include "FrustumCuller.h"
+#include "PassCache.h"
+
+FrustumCuller::FrustumCuller()
+{
+	SetViewProj(XMMatrixIdentity());
+}
+
+FrustumCuller::FrustumCuller(CXMMATRIX viewProj)
+{
+	SetViewProj(viewProj);
+}
+
+void FrustumCuller::SetViewProj(CXMMATRIX viewProj)
+{
+	// ExtractFrustumPlanes returns normalized planes facing into the frustum.
+	ExtractFrustumPlanes(mPlanes, viewProj);
+	for(int i = 0; i < 6; ++i)
+	{
+		mPlanes[i].x = -mPlanes[i].x;
+		mPlanes[i].y = -mPlanes[i].y;
+		mPlanes[i].z = -mPlanes[i].z;
+		mPlanes[i].w = -mPlanes[i].w;
+	}
+}
+
+bool FrustumCuller::IsVisible(const XNA::AxisAlignedBox& box)const
+{
+	return XNA::IntersectAxisAlignedBox6Planes(&box,
+		XMLoadFloat4(&mPlanes[0]), XMLoadFloat4(&mPlanes[1]), XMLoadFloat4(&mPlanes[2]),
+		XMLoadFloat4(&mPlanes[3]), XMLoadFloat4(&mPlanes[4]), XMLoadFloat4(&mPlanes[5])) != 0;
+}
+
+bool FrustumCuller::IsVisible(const XNA::Sphere& sphere)const
+{
+	return XNA::IntersectSphere6Planes(&sphere,
+		XMLoadFloat4(&mPlanes[0]), XMLoadFloat4(&mPlanes[1]), XMLoadFloat4(&mPlanes[2]),
+		XMLoadFloat4(&mPlanes[3]), XMLoadFloat4(&mPlanes[4]), XMLoadFloat4(&mPlanes[5])) != 0;
+}
+
+UINT FrustumCuller::CullInstances(const XNA::AxisAlignedBox& localBox, const XMFLOAT4X4* worlds, UINT count,
+	std::vector<UINT>& visible)const
+{
+	visible.clear();
+
+	XMVECTOR planes[6];
+	for(int i = 0; i < 6; ++i)
+		planes[i] = XMLoadFloat4(&mPlanes[i]);
+
+	for(UINT i = 0; i < count; ++i)
+	{
+		XNA::AxisAlignedBox box;
+		PassCache::TransformBounds(box, localBox, worlds[i]);
+
+		if(XNA::IntersectAxisAlignedBox6Planes(&box, planes[0], planes[1], planes[2], planes[3], planes[4], planes[5]) != 0)
+			visible.push_back(i);
+	}
+	return (UINT)visible.size();
+}
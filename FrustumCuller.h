@@ -0,0 +1,38 @@
+//***************************************************************************************
+// FrustumCuller.h
+//
+// Culls world space bounds against the six planes of one render pass (the camera, a
+// shadow map's light ortho, a cube map face).  The planes are taken from the pass's
+// view-projection, so perspective and orthographic passes are handled alike, and the
+// tests are XNA::IntersectAxisAlignedBox6Planes / IntersectSphere6Planes.
+//***************************************************************************************
+
+#ifndef FRUSTUMCULLER_H
+#define FRUSTUMCULLER_H
+
+#include "MathHelper.h"
+#include "xnacollision.h"
+#include <vector>
+
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+	explicit FrustumCuller(CXMMATRIX viewProj);
+
+	void SetViewProj(CXMMATRIX viewProj);
+
+	bool IsVisible(const XNA::AxisAlignedBox& box)const;
+	bool IsVisible(const XNA::Sphere& sphere)const;
+
+	// Instances sharing one local box; writes the indices of those whose world bounds
+	// touch the frustum and returns how many there are.
+	UINT CullInstances(const XNA::AxisAlignedBox& localBox, const XMFLOAT4X4* worlds, UINT count,
+		std::vector<UINT>& visible)const;
+
+private:
+	// Normalized and facing out of the frustum, as the XNA 6-plane tests expect.
+	XMFLOAT4 mPlanes[6];
+};
+
+#endif // FRUSTUMCULLER_H
@@ -12,7 +12,8 @@
 #ifndef GEOMETRYGENERATOR_H
 #define GEOMETRYGENERATOR_H
 
-#include "d3dUtil.h"
+#include "MathHelper.h"
+#include <vector>
 
 class GeometryGenerator
 {
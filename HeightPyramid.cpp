@@ -0,0 +1,274 @@
+//***************************************************************************************
+// HeightPyramid.cpp
+//***************************************************************************************
+
+#include "HeightPyramid.h"
+#include "ParallelFor.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define HEIGHTPYRAMID_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	// Fewer rows than this per worker is not worth a thread.
+	const UINT MinRowsPerBand = 64;
+
+	const XMFLOAT2 EmptyBounds(+MathHelper::Infinity, -MathHelper::Infinity);
+
+	void Merge(XMFLOAT2& bounds, const XMFLOAT2& other)
+	{
+		bounds.x = MathHelper::Min(bounds.x, other.x);
+		bounds.y = MathHelper::Max(bounds.y, other.y);
+	}
+}
+
+HeightPyramid::HeightPyramid() :
+	mHeightmap(0)
+{
+}
+
+void HeightPyramid::Build(const Heightmap& heightmap, UINT numThreads)
+{
+	mLevels.clear();
+	mHeightmap = &heightmap;
+	if(heightmap.GetNumRows() < 2 || heightmap.GetNumCols() < 2)
+		return;
+
+	UINT numRows = heightmap.GetNumRows() - 1;
+	UINT numCols = heightmap.GetNumCols() - 1;
+	for(;;)
+	{
+		mLevels.push_back(Level());
+		mLevels.back().NumRows = numRows;
+		mLevels.back().NumCols = numCols;
+		if(mLevels.size() > 1)
+			mLevels.back().Bounds.resize(numRows*numCols);
+		if(numRows == 1 && numCols == 1)
+			break;
+
+		numRows = (numRows + 1) / 2;
+		numCols = (numCols + 1) / 2;
+	}
+
+	// Each level needs the whole of the one below, so the bands sync between levels.
+	for(UINT k = 1; k < mLevels.size(); ++k)
+	{
+		numCols = mLevels[k].NumCols;
+		ParallelForRows(mLevels[k].NumRows, MinRowsPerBand, numThreads, [&](UINT row0, UINT row1)
+		{
+			if(k == 1)
+				BuildLevel1(row0, row1, 0, numCols);
+			else
+				BuildParents(k, row0, row1, 0, numCols);
+		});
+	}
+}
+
+void HeightPyramid::Clear()
+{
+	mLevels.clear();
+	mHeightmap = 0;
+}
+
+void HeightPyramid::Update(UINT row0, UINT col0, UINT row1, UINT col1)
+{
+	if(mLevels.size() < 2)
+		return;
+
+	// A sample is a corner of the cells up and to the left of it as well as its own.
+	UINT cellRow0 = row0 > 0 ? row0 - 1 : 0;
+	UINT cellCol0 = col0 > 0 ? col0 - 1 : 0;
+	UINT cellRow1 = MathHelper::Min(row1 + 1, mLevels[0].NumRows);
+	UINT cellCol1 = MathHelper::Min(col1 + 1, mLevels[0].NumCols);
+	if(cellRow0 >= cellRow1 || cellCol0 >= cellCol1)
+		return;
+
+	for(UINT k = 1; k < mLevels.size(); ++k)
+	{
+		cellRow0 /= 2;
+		cellCol0 /= 2;
+		cellRow1 = (cellRow1 + 1) / 2;
+		cellCol1 = (cellCol1 + 1) / 2;
+
+		if(k == 1)
+			BuildLevel1(cellRow0, cellRow1, cellCol0, cellCol1);
+		else
+			BuildParents(k, cellRow0, cellRow1, cellCol0, cellCol1);
+	}
+}
+
+XMFLOAT2 HeightPyramid::GetBoundsY()const
+{
+	if(mLevels.empty())
+		return EmptyBounds;
+
+	return GetBoundsY((UINT)mLevels.size() - 1, 0, 0);
+}
+
+XMFLOAT2 HeightPyramid::GetRegionBoundsY(UINT row0, UINT col0, UINT row1, UINT col1)const
+{
+	XMFLOAT2 bounds = EmptyBounds;
+	if(mLevels.empty())
+		return bounds;
+
+	row1 = MathHelper::Min(row1, mLevels[0].NumRows);
+	col1 = MathHelper::Min(col1, mLevels[0].NumCols);
+
+	// Peel off the odd rows and columns at each edge, which have no sibling inside the
+	// region at this level; what is left maps exactly onto the level above.
+	for(UINT k = 0; k < mLevels.size() && row0 < row1 && col0 < col1; ++k)
+	{
+		if(row0 & 1)
+		{
+			for(UINT j = col0; j < col1; ++j)
+				Merge(bounds, GetBoundsY(k, row0, j));
+			++row0;
+		}
+		if((row1 & 1) && row0 < row1)
+		{
+			--row1;
+			for(UINT j = col0; j < col1; ++j)
+				Merge(bounds, GetBoundsY(k, row1, j));
+		}
+		if((col0 & 1) && col0 < col1)
+		{
+			for(UINT i = row0; i < row1; ++i)
+				Merge(bounds, GetBoundsY(k, i, col0));
+			++col0;
+		}
+		if((col1 & 1) && col0 < col1)
+		{
+			--col1;
+			for(UINT i = row0; i < row1; ++i)
+				Merge(bounds, GetBoundsY(k, i, col1));
+		}
+
+		// Whatever is left at the top level is its single entry.
+		if(k + 1 == mLevels.size() && row0 < row1 && col0 < col1)
+			Merge(bounds, GetBoundsY(k, 0, 0));
+
+		row0 /= 2;
+		row1 /= 2;
+		col0 /= 2;
+		col1 /= 2;
+	}
+
+	return bounds;
+}
+
+void HeightPyramid::GetPatchBoundsY(UINT cellsPerPatch, std::vector<XMFLOAT2>& patchBoundsY)const
+{
+	patchBoundsY.clear();
+	if(mLevels.empty() || cellsPerPatch == 0)
+		return;
+
+	UINT numPatchRows = mLevels[0].NumRows / cellsPerPatch;
+	UINT numPatchCols = mLevels[0].NumCols / cellsPerPatch;
+	patchBoundsY.resize(numPatchRows*numPatchCols);
+
+	UINT level = 0;
+	while((1u << level) < cellsPerPatch)
+		++level;
+
+	for(UINT i = 0; i < numPatchRows; ++i)
+	{
+		for(UINT j = 0; j < numPatchCols; ++j)
+		{
+			if((1u << level) == cellsPerPatch)
+			{
+				patchBoundsY[i*numPatchCols + j] = GetBoundsY(level, i, j);
+			}
+			else
+			{
+				patchBoundsY[i*numPatchCols + j] = GetRegionBoundsY(i*cellsPerPatch, j*cellsPerPatch,
+					(i+1)*cellsPerPatch, (j+1)*cellsPerPatch);
+			}
+		}
+	}
+}
+
+XMFLOAT2 HeightPyramid::GetCellBoundsY(UINT row, UINT col)const
+{
+	float a = mHeightmap->At(row, col);
+	float b = mHeightmap->At(row, col+1);
+	float c = mHeightmap->At(row+1, col);
+	float d = mHeightmap->At(row+1, col+1);
+
+	return XMFLOAT2(MathHelper::Min(MathHelper::Min(a, b), MathHelper::Min(c, d)),
+		MathHelper::Max(MathHelper::Max(a, b), MathHelper::Max(c, d)));
+}
+
+void HeightPyramid::BuildLevel1(UINT row0, UINT row1, UINT col0, UINT col1)
+{
+	Level& level = mLevels[1];
+	const std::vector<float>& heights = mHeightmap->GetData();
+	UINT width = mHeightmap->GetNumCols();
+	UINT lastRow = mHeightmap->GetNumRows() - 1;
+
+	// Each entry covers up to 3x3 samples.  Reduce the three rows column by column
+	// first, then take each entry's three columns.
+	UINT sample0 = 2*col0;
+	UINT sample1 = MathHelper::Min(2*col1, width - 1);
+	UINT numSamples = sample1 - sample0 + 1;
+	std::vector<float> colMin(numSamples);
+	std::vector<float> colMax(numSamples);
+
+	for(UINT i = row0; i < row1; ++i)
+	{
+		const float* r0 = &heights[(2*i)*width + sample0];
+		const float* r1 = &heights[MathHelper::Min(2*i + 1, lastRow)*width + sample0];
+		const float* r2 = &heights[MathHelper::Min(2*i + 2, lastRow)*width + sample0];
+		UINT c = 0;
+
+#ifdef HEIGHTPYRAMID_SSE
+		for(; c + 4 <= numSamples; c += 4)
+		{
+			__m128 a = _mm_loadu_ps(r0 + c);
+			__m128 b = _mm_loadu_ps(r1 + c);
+			__m128 d = _mm_loadu_ps(r2 + c);
+			_mm_storeu_ps(&colMin[c], _mm_min_ps(_mm_min_ps(a, b), d));
+			_mm_storeu_ps(&colMax[c], _mm_max_ps(_mm_max_ps(a, b), d));
+		}
+#endif
+
+		for(; c < numSamples; ++c)
+		{
+			colMin[c] = MathHelper::Min(MathHelper::Min(r0[c], r1[c]), r2[c]);
+			colMax[c] = MathHelper::Max(MathHelper::Max(r0[c], r1[c]), r2[c]);
+		}
+
+		// An entry's first cell always exists, so its second sample column does.
+		XMFLOAT2* out = &level.Bounds[i*level.NumCols];
+		for(UINT j = col0; j < col1; ++j)
+		{
+			UINT c0 = 2*j - sample0;
+			UINT c2 = MathHelper::Min(2*j + 2, sample1) - sample0;
+			out[j].x = MathHelper::Min(MathHelper::Min(colMin[c0], colMin[c0+1]), colMin[c2]);
+			out[j].y = MathHelper::Max(MathHelper::Max(colMax[c0], colMax[c0+1]), colMax[c2]);
+		}
+	}
+}
+
+void HeightPyramid::BuildParents(UINT level, UINT row0, UINT row1, UINT col0, UINT col1)
+{
+	const Level& child = mLevels[level-1];
+	Level& parent = mLevels[level];
+
+	for(UINT i = row0; i < row1; ++i)
+	{
+		UINT childRow1 = MathHelper::Min(2*i + 2, child.NumRows);
+		for(UINT j = col0; j < col1; ++j)
+		{
+			UINT childCol1 = MathHelper::Min(2*j + 2, child.NumCols);
+
+			XMFLOAT2 bounds = EmptyBounds;
+			for(UINT ci = 2*i; ci < childRow1; ++ci)
+				for(UINT cj = 2*j; cj < childCol1; ++cj)
+					Merge(bounds, child.Bounds[ci*child.NumCols + cj]);
+
+			parent.Bounds[i*parent.NumCols + j] = bounds;
+		}
+	}
+}
@@ -0,0 +1,78 @@
+//***************************************************************************************
+// HeightPyramid.h
+//
+// Min/max mip pyramid over a Heightmap, so bounds over any area come from a handful of
+// entries instead of rescanning heights.  Level 0 has an entry per cell (the 2x2
+// samples around it); each level above halves the rows and columns, rounding up, so an
+// entry at level k covers a 2^k x 2^k block of cells, clipped to the map.  The top
+// level is a single entry for the whole map.
+//
+// Level 0 is read from the heightmap when asked for rather than stored, which would
+// take twice the heightmap's memory; the pyramid keeps a pointer to the heightmap it
+// was built from, which must outlive it.
+//
+// Rows and columns are Heightmap's, starting at the +z edge.  Bounds are XMFLOAT2s of
+// (min, max), as Heightmap::CalcPatchBoundsY returns them.
+//***************************************************************************************
+
+#ifndef HEIGHTPYRAMID_H
+#define HEIGHTPYRAMID_H
+
+#include "Heightmap.h"
+
+class HeightPyramid
+{
+public:
+	HeightPyramid();
+
+	// numThreads == 0 uses one worker per hardware thread.
+	void Build(const Heightmap& heightmap, UINT numThreads = 0);
+	void Clear();
+
+	// Re-derives only the entries that depend on samples [row0, row1] x [col0, col1]
+	// (inclusive), after those heights changed.
+	void Update(UINT row0, UINT col0, UINT row1, UINT col1);
+
+	UINT GetNumLevels()const { return (UINT)mLevels.size(); }
+	UINT GetNumRows(UINT level)const { return mLevels[level].NumRows; }
+	UINT GetNumCols(UINT level)const { return mLevels[level].NumCols; }
+
+	XMFLOAT2 GetBoundsY(UINT level, UINT row, UINT col)const
+	{
+		if(level == 0)
+			return GetCellBoundsY(row, col);
+
+		return mLevels[level].Bounds[row*mLevels[level].NumCols + col];
+	}
+
+	// The whole map.
+	XMFLOAT2 GetBoundsY()const;
+
+	// Cells [row0, row1) x [col0, col1), from at most a few entries per level along the
+	// region's edges.  An empty region gives (+Infinity, -Infinity).
+	XMFLOAT2 GetRegionBoundsY(UINT row0, UINT col0, UINT row1, UINT col1)const;
+
+	// Same layout and values as Heightmap::CalcPatchBoundsY.  Power of two patch sizes
+	// read one level directly.
+	void GetPatchBoundsY(UINT cellsPerPatch, std::vector<XMFLOAT2>& patchBoundsY)const;
+
+private:
+	struct Level
+	{
+		UINT NumRows;
+		UINT NumCols;
+		std::vector<XMFLOAT2> Bounds;
+	};
+
+	XMFLOAT2 GetCellBoundsY(UINT row, UINT col)const;
+	void BuildLevel1(UINT row0, UINT row1, UINT col0, UINT col1);
+	void BuildParents(UINT level, UINT row0, UINT row1, UINT col0, UINT col1);
+
+private:
+	const Heightmap* mHeightmap;
+
+	// mLevels[0] has its size but no Bounds.
+	std::vector<Level> mLevels;
+};
+
+#endif // HEIGHTPYRAMID_H
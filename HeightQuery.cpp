@@ -0,0 +1,265 @@
+//***************************************************************************************
+// HeightQuery.cpp
+//***************************************************************************************
+
+#include "HeightQuery.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define HEIGHTQUERY_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	// Heightmap::GetHeight's split of the cell.
+	// A*--*B
+	//  | /|
+	//  |/ |
+	// C*--*D
+	float Interpolate(float A, float B, float C, float D, float s, float t)
+	{
+		if(s + t <= 1.0f)
+			return A + s*(B - A) + t*(C - A);
+
+		return D + (1.0f-s)*(C - D) + (1.0f-t)*(B - D);
+	}
+}
+
+HeightQuery::HeightQuery() :
+	mHeightmap(0),
+	mCellSpacing(1.0f),
+	mOriginX(0.0f),
+	mOriginZ(0.0f)
+{
+}
+
+void HeightQuery::Init(const Heightmap& heightmap, float cellSpacing, float originX, float originZ)
+{
+	// A map needs at least one cell to interpolate over; without one, queries are flat.
+	bool hasCell = heightmap.GetNumRows() >= 2 && heightmap.GetNumCols() >= 2;
+	mHeightmap = hasCell ? &heightmap : 0;
+	mCellSpacing = cellSpacing;
+	mOriginX = originX;
+	mOriginZ = originZ;
+}
+
+void HeightQuery::Init(const Heightmap& heightmap, float cellSpacing)
+{
+	float width = (heightmap.GetNumCols()-1)*cellSpacing;
+	float depth = (heightmap.GetNumRows()-1)*cellSpacing;
+	Init(heightmap, cellSpacing, -(0.5f*width), 0.5f*depth);
+}
+
+void HeightQuery::GetHeights(const XMFLOAT3* positions, UINT count, float* heights, XMFLOAT3* normals)const
+{
+	if(count == 0)
+		return;
+
+	if(!mHeightmap)
+	{
+		GetHeightsScalar(positions, count, heights, normals);
+		return;
+	}
+
+#ifdef HEIGHTQUERY_SSE
+	const float* h = &mHeightmap->GetData()[0];
+	const UINT numCols = mHeightmap->GetNumCols();
+	const UINT numRows = mHeightmap->GetNumRows();
+
+	const __m128 originX = _mm_set1_ps(mOriginX);
+	const __m128 originZ = _mm_set1_ps(mOriginZ);
+	const __m128 spacing = _mm_set1_ps(mCellSpacing);
+	const __m128 negSpacing = _mm_set1_ps(-mCellSpacing);
+	const __m128 maxC = _mm_set1_ps((float)(numCols - 1));
+	const __m128 maxD = _mm_set1_ps((float)(numRows - 1));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 up = _mm_set1_ps(2.0f*mCellSpacing);
+
+	for(UINT k = 0; k < count; k += 4)
+	{
+		// A short last group repeats its final point.
+		UINT index[4];
+		for(UINT l = 0; l < 4; ++l)
+			index[l] = MathHelper::Min(k + l, count - 1);
+
+		const XMFLOAT3& p0 = positions[index[0]];
+		const XMFLOAT3& p1 = positions[index[1]];
+		const XMFLOAT3& p2 = positions[index[2]];
+		const XMFLOAT3& p3 = positions[index[3]];
+
+		// Same operations as Heightmap::GetHeight, so in-bounds heights match it exactly.
+		__m128 c = _mm_div_ps(_mm_sub_ps(_mm_setr_ps(p0.x, p1.x, p2.x, p3.x), originX), spacing);
+		__m128 d = _mm_div_ps(_mm_sub_ps(_mm_setr_ps(p0.z, p1.z, p2.z, p3.z), originZ), negSpacing);
+
+		// max first, so NaNs land on the edge too.
+		c = _mm_min_ps(_mm_max_ps(c, zero), maxC);
+		d = _mm_min_ps(_mm_max_ps(d, zero), maxD);
+
+		float cs[4];
+		float ds[4];
+		_mm_storeu_ps(cs, c);
+		_mm_storeu_ps(ds, d);
+
+		// Gather each lane's samples.  Only the normals need the ring around the cell.
+		float colF[4], rowF[4];
+		float A[4], B[4], C[4], D[4];
+		float left0[4], right0[4], left1[4], right1[4];
+		float above0[4], above1[4], below0[4], below1[4];
+		for(UINT l = 0; l < 4; ++l)
+		{
+			UINT col = MathHelper::Min((UINT)cs[l], numCols - 2);
+			UINT row = MathHelper::Min((UINT)ds[l], numRows - 2);
+			colF[l] = (float)col;
+			rowF[l] = (float)row;
+
+			const float* r0 = h + (size_t)row*numCols;
+			const float* r1 = r0 + numCols;
+			A[l] = r0[col];
+			B[l] = r0[col + 1];
+			C[l] = r1[col];
+			D[l] = r1[col + 1];
+
+			if(normals)
+			{
+				UINT colLeft = col > 0 ? col - 1 : 0;
+				UINT colRight = MathHelper::Min(col + 2, numCols - 1);
+				const float* rAbove = row > 0 ? r0 - numCols : r0;
+				const float* rBelow = row + 2 < numRows ? r1 + numCols : r1;
+
+				left0[l] = r0[colLeft];
+				right0[l] = r0[colRight];
+				left1[l] = r1[colLeft];
+				right1[l] = r1[colRight];
+				above0[l] = rAbove[col];
+				above1[l] = rAbove[col + 1];
+				below0[l] = rBelow[col];
+				below1[l] = rBelow[col + 1];
+			}
+		}
+
+		__m128 a = _mm_loadu_ps(A);
+		__m128 b = _mm_loadu_ps(B);
+		__m128 cc = _mm_loadu_ps(C);
+		__m128 dd = _mm_loadu_ps(D);
+		__m128 s = _mm_sub_ps(c, _mm_loadu_ps(colF));
+		__m128 t = _mm_sub_ps(d, _mm_loadu_ps(rowF));
+
+		__m128 upper = _mm_add_ps(_mm_add_ps(a, _mm_mul_ps(s, _mm_sub_ps(b, a))), _mm_mul_ps(t, _mm_sub_ps(cc, a)));
+		__m128 lower = _mm_add_ps(_mm_add_ps(dd, _mm_mul_ps(_mm_sub_ps(one, s), _mm_sub_ps(cc, dd))),
+			_mm_mul_ps(_mm_sub_ps(one, t), _mm_sub_ps(b, dd)));
+		__m128 inUpper = _mm_cmple_ps(_mm_add_ps(s, t), one);
+
+		float result[4];
+		_mm_storeu_ps(result, _mm_or_ps(_mm_and_ps(inUpper, upper), _mm_andnot_ps(inUpper, lower)));
+		for(UINT l = 0; l < 4 && k + l < count; ++l)
+			heights[k + l] = result[l];
+
+		if(!normals)
+			continue;
+
+		// Central differences at the four corners, blended bilinearly; Terrain.fx's
+		// sampler does the same when it filters its four height taps.
+		__m128 gxA = _mm_sub_ps(b, _mm_loadu_ps(left0));
+		__m128 gxB = _mm_sub_ps(_mm_loadu_ps(right0), a);
+		__m128 gxC = _mm_sub_ps(dd, _mm_loadu_ps(left1));
+		__m128 gxD = _mm_sub_ps(_mm_loadu_ps(right1), cc);
+		__m128 gzA = _mm_sub_ps(cc, _mm_loadu_ps(above0));
+		__m128 gzB = _mm_sub_ps(dd, _mm_loadu_ps(above1));
+		__m128 gzC = _mm_sub_ps(_mm_loadu_ps(below0), a);
+		__m128 gzD = _mm_sub_ps(_mm_loadu_ps(below1), b);
+
+		__m128 gxTop = _mm_add_ps(gxA, _mm_mul_ps(s, _mm_sub_ps(gxB, gxA)));
+		__m128 gxBottom = _mm_add_ps(gxC, _mm_mul_ps(s, _mm_sub_ps(gxD, gxC)));
+		__m128 gx = _mm_add_ps(gxTop, _mm_mul_ps(t, _mm_sub_ps(gxBottom, gxTop)));
+		__m128 gzTop = _mm_add_ps(gzA, _mm_mul_ps(s, _mm_sub_ps(gzB, gzA)));
+		__m128 gzBottom = _mm_add_ps(gzC, _mm_mul_ps(s, _mm_sub_ps(gzD, gzC)));
+		__m128 gz = _mm_add_ps(gzTop, _mm_mul_ps(t, _mm_sub_ps(gzBottom, gzTop)));
+
+		// (-gx, 2*spacing, gz), as the shader's cross(tangent, bitangent) comes out.
+		__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(up, up)), _mm_mul_ps(gz, gz));
+		__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+		float nx[4], ny[4], nz[4];
+		_mm_storeu_ps(nx, _mm_sub_ps(zero, _mm_mul_ps(gx, invLength)));
+		_mm_storeu_ps(ny, _mm_mul_ps(up, invLength));
+		_mm_storeu_ps(nz, _mm_mul_ps(gz, invLength));
+		for(UINT l = 0; l < 4 && k + l < count; ++l)
+			normals[k + l] = XMFLOAT3(nx[l], ny[l], nz[l]);
+	}
+#else
+	GetHeightsScalar(positions, count, heights, normals);
+#endif
+}
+
+void HeightQuery::GetHeightsScalar(const XMFLOAT3* positions, UINT count, float* heights, XMFLOAT3* normals)const
+{
+	for(UINT i = 0; i < count; ++i)
+		GetPoint(positions[i], heights[i], normals ? &normals[i] : 0);
+}
+
+void HeightQuery::GetCell(float x, float z, float& c, float& d, UINT& row, UINT& col)const
+{
+	UINT numCols = mHeightmap->GetNumCols();
+	UINT numRows = mHeightmap->GetNumRows();
+
+	c = (x - mOriginX) / mCellSpacing;
+	d = (z - mOriginZ) / -mCellSpacing;
+
+	// Written so NaNs clamp to the edge as well.
+	c = c > 0.0f ? c : 0.0f;
+	d = d > 0.0f ? d : 0.0f;
+	c = MathHelper::Min(c, (float)(numCols - 1));
+	d = MathHelper::Min(d, (float)(numRows - 1));
+
+	col = MathHelper::Min((UINT)c, numCols - 2);
+	row = MathHelper::Min((UINT)d, numRows - 2);
+}
+
+void HeightQuery::GetPoint(const XMFLOAT3& position, float& height, XMFLOAT3* normal)const
+{
+	if(!mHeightmap)
+	{
+		height = 0.0f;
+		if(normal)
+			*normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		return;
+	}
+
+	float c, d;
+	UINT row, col;
+	GetCell(position.x, position.z, c, d, row, col);
+
+	float s = c - (float)col;
+	float t = d - (float)row;
+	height = Interpolate(mHeightmap->At(row, col), mHeightmap->At(row, col + 1),
+		mHeightmap->At(row + 1, col), mHeightmap->At(row + 1, col + 1), s, t);
+
+	if(!normal)
+		return;
+
+	// Central differences at the cell's corners, clamped at the map's edges as the
+	// shader's sampler clamps.
+	UINT lastCol = mHeightmap->GetNumCols() - 1;
+	UINT lastRow = mHeightmap->GetNumRows() - 1;
+	float gx[2][2];
+	float gz[2][2];
+	for(UINT i = 0; i < 2; ++i)
+	{
+		for(UINT j = 0; j < 2; ++j)
+		{
+			UINT r = row + i;
+			UINT q = col + j;
+			gx[i][j] = mHeightmap->At(r, MathHelper::Min(q + 1, lastCol)) - mHeightmap->At(r, q > 0 ? q - 1 : 0);
+			gz[i][j] = mHeightmap->At(MathHelper::Min(r + 1, lastRow), q) - mHeightmap->At(r > 0 ? r - 1 : 0, q);
+		}
+	}
+
+	float gxTop = gx[0][0] + s*(gx[0][1] - gx[0][0]);
+	float gxBottom = gx[1][0] + s*(gx[1][1] - gx[1][0]);
+	float gzTop = gz[0][0] + s*(gz[0][1] - gz[0][0]);
+	float gzBottom = gz[1][0] + s*(gz[1][1] - gz[1][0]);
+
+	XMVECTOR n = XMVectorSet(-(gxTop + t*(gxBottom - gxTop)), 2.0f*mCellSpacing, gzTop + t*(gzBottom - gzTop), 0.0f);
+	XMStoreFloat3(normal, XMVector3Normalize(n));
+}
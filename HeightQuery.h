@@ -0,0 +1,54 @@
+//***************************************************************************************
+// HeightQuery.h
+//
+// Terrain heights and normals for many points at once, for agents, projectiles and
+// particles that all need the ground under them each frame.  Heights are
+// Heightmap::GetHeight's, triangle for triangle; normals are the ones Terrain.fx
+// shades with, central differences interpolated bilinearly across the cell.  Points
+// off the map read its nearest edge.
+//
+// Points go through four at a time: their cells' samples are gathered lane by lane and
+// the interpolation and normalization run in SSE.  Points are taken in the order given,
+// so callers that keep them grouped by area (particles of one emitter, a squad of
+// agents) get the cache hits that grouping brings.
+//
+// Holds no per-call state, so one HeightQuery can serve several threads.
+//***************************************************************************************
+
+#ifndef HEIGHTQUERY_H
+#define HEIGHTQUERY_H
+
+#include "Heightmap.h"
+
+class HeightQuery
+{
+public:
+	HeightQuery();
+
+	// Sample (row, col) of heightmap sits at (originX + col*cellSpacing, originZ -
+	// row*cellSpacing).  The heightmap must outlive the query.
+	void Init(const Heightmap& heightmap, float cellSpacing, float originX, float originZ);
+
+	// A map centered on the origin, as Heightmap::GetHeight assumes.
+	void Init(const Heightmap& heightmap, float cellSpacing);
+
+	// Heights (and unit normals, if normals is not null) under the (x, z) of each
+	// position; y is ignored.
+	void GetHeights(const XMFLOAT3* positions, UINT count, float* heights, XMFLOAT3* normals)const;
+
+	// The same one point at a time, for machines without SSE and for checking.
+	void GetHeightsScalar(const XMFLOAT3* positions, UINT count, float* heights, XMFLOAT3* normals)const;
+
+private:
+	// Cell space position clamped to the map, and the cell it falls in.
+	void GetCell(float x, float z, float& c, float& d, UINT& row, UINT& col)const;
+	void GetPoint(const XMFLOAT3& position, float& height, XMFLOAT3* normal)const;
+
+private:
+	const Heightmap* mHeightmap;
+	float mCellSpacing;
+	float mOriginX;
+	float mOriginZ;
+};
+
+#endif // HEIGHTQUERY_H
@@ -0,0 +1,98 @@
+//***************************************************************************************
+// HeightfieldBuilder.cpp
+//***************************************************************************************
+
+#include "HeightfieldBuilder.h"
+#include <cmath>
+
+HeightfieldBuilder::HeightfieldBuilder(const Heightmap& heightmap, float cellSpacing) :
+	mHeightmap(heightmap),
+	mCellSpacing(cellSpacing),
+	mHeightUnit(1.0f)
+{
+	// Spread the largest magnitude over the full signed 16-bit range.
+	const std::vector<float>& heights = mHeightmap.GetData();
+	float maxAbs = 0.0f;
+	for(size_t i = 0; i < heights.size(); ++i)
+		maxAbs = MathHelper::Max(maxAbs, fabsf(heights[i]));
+
+	if(maxAbs > 0.0f)
+		mHeightUnit = maxAbs / 32767.0f;
+}
+
+UINT HeightfieldBuilder::GetNumTilesX(UINT tileCells)const
+{
+	UINT cells = mHeightmap.GetNumCols() - 1;
+	if(tileCells == 0 || tileCells >= cells)
+		return 1;
+	return (cells + tileCells - 1) / tileCells;
+}
+
+UINT HeightfieldBuilder::GetNumTilesZ(UINT tileCells)const
+{
+	UINT cells = mHeightmap.GetNumRows() - 1;
+	if(tileCells == 0 || tileCells >= cells)
+		return 1;
+	return (cells + tileCells - 1) / tileCells;
+}
+
+void HeightfieldBuilder::BuildTile(UINT tileCells, UINT tileX, UINT tileZ, HeightfieldTile& tile)const
+{
+	UINT cellsX = mHeightmap.GetNumCols() - 1;
+	UINT cellsZ = mHeightmap.GetNumRows() - 1;
+	UINT stepX = (tileCells == 0 || tileCells >= cellsX) ? cellsX : tileCells;
+	UINT stepZ = (tileCells == 0 || tileCells >= cellsZ) ? cellsZ : tileCells;
+
+	// First heightmap column (x) and first cell counted from the -z edge.
+	UINT x0 = tileX*stepX;
+	UINT z0 = tileZ*stepZ;
+
+	tile.TileX = tileX;
+	tile.TileZ = tileZ;
+	tile.NumRows = MathHelper::Min(stepX, cellsX - x0) + 1;
+	tile.NumCols = MathHelper::Min(stepZ, cellsZ - z0) + 1;
+
+	float halfWidth = 0.5f*cellsX*mCellSpacing;
+	float halfDepth = 0.5f*cellsZ*mCellSpacing;
+	tile.Origin = XMFLOAT3(-halfWidth + x0*mCellSpacing, 0.0f, -halfDepth + z0*mCellSpacing);
+
+	float invUnit = 1.0f / mHeightUnit;
+	tile.Heights.resize(tile.NumRows*tile.NumCols);
+	for(UINT r = 0; r < tile.NumRows; ++r)
+	{
+		for(UINT c = 0; c < tile.NumCols; ++c)
+		{
+			// Heightmap row 0 is the +z edge.
+			float h = mHeightmap.At(cellsZ - (z0 + c), x0 + r);
+			float q = floorf(h*invUnit + 0.5f);
+			tile.Heights[r*tile.NumCols + c] = (short)MathHelper::Clamp(q, -32767.0f, 32767.0f);
+		}
+	}
+}
+
+void HeightfieldBuilder::GetTilesInRadius(UINT tileCells, float x, float z, float radius, std::vector<UINT>& tiles)const
+{
+	tiles.clear();
+
+	UINT numTilesX = GetNumTilesX(tileCells);
+	UINT numTilesZ = GetNumTilesZ(tileCells);
+	float tileWidth = (tileCells == 0 ? (mHeightmap.GetNumCols() - 1) : tileCells)*mCellSpacing;
+	float tileDepth = (tileCells == 0 ? (mHeightmap.GetNumRows() - 1) : tileCells)*mCellSpacing;
+	float minX = -0.5f*(mHeightmap.GetNumCols() - 1)*mCellSpacing;
+	float minZ = -0.5f*(mHeightmap.GetNumRows() - 1)*mCellSpacing;
+
+	for(UINT tz = 0; tz < numTilesZ; ++tz)
+	{
+		for(UINT tx = 0; tx < numTilesX; ++tx)
+		{
+			// Distance from (x, z) to the tile rectangle.
+			float x0 = minX + tx*tileWidth;
+			float z0 = minZ + tz*tileDepth;
+			float dx = MathHelper::Max(MathHelper::Max(x0 - x, x - (x0 + tileWidth)), 0.0f);
+			float dz = MathHelper::Max(MathHelper::Max(z0 - z, z - (z0 + tileDepth)), 0.0f);
+
+			if(dx*dx + dz*dz <= radius*radius)
+				tiles.push_back(tz*numTilesX + tx);
+		}
+	}
+}
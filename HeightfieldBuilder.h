@@ -0,0 +1,59 @@
+//***************************************************************************************
+// HeightfieldBuilder.h
+//
+// Converts a Heightmap into the 16-bit sample grids a physics heightfield consumes,
+// either whole or as square tiles that can be paged in around the camera.
+//
+// Physics heightfields index samples by (row, column) with rows running along +x and
+// columns along +z, whereas Heightmap rows run from +z to -z.  Tiles are emitted in
+// the physics layout with an origin at their -x/-z corner, so placing a heightfield
+// actor at Origin with row/column scale = cell spacing reproduces Terrain::GetHeight.
+//***************************************************************************************
+
+#ifndef HEIGHTFIELDBUILDER_H
+#define HEIGHTFIELDBUILDER_H
+
+#include "Heightmap.h"
+#include <vector>
+
+struct HeightfieldTile
+{
+	UINT TileX;
+	UINT TileZ;
+
+	// Samples along x (physics rows) and along z (physics columns).
+	UINT NumRows;
+	UINT NumCols;
+
+	XMFLOAT3 Origin;
+
+	// NumRows*NumCols quantized heights; world height = sample * height unit.
+	std::vector<short> Heights;
+};
+
+class HeightfieldBuilder
+{
+public:
+	HeightfieldBuilder(const Heightmap& heightmap, float cellSpacing);
+
+	// World units per quantization step, shared by every tile.
+	float GetHeightUnit()const { return mHeightUnit; }
+	float GetCellSpacing()const { return mCellSpacing; }
+
+	// tileCells == 0 means a single tile covering the whole heightmap.
+	UINT GetNumTilesX(UINT tileCells)const;
+	UINT GetNumTilesZ(UINT tileCells)const;
+
+	// Neighboring tiles share their border samples so there are no seams.
+	void BuildTile(UINT tileCells, UINT tileX, UINT tileZ, HeightfieldTile& tile)const;
+
+	// Tiles whose xz bounds come within radius of (x, z), as TileZ*numTilesX + TileX.
+	void GetTilesInRadius(UINT tileCells, float x, float z, float radius, std::vector<UINT>& tiles)const;
+
+private:
+	const Heightmap& mHeightmap;
+	float mCellSpacing;
+	float mHeightUnit;
+};
+
+#endif // HEIGHTFIELDBUILDER_H
@@ -0,0 +1,179 @@
+//***************************************************************************************
+// Heightmap.cpp
+//***************************************************************************************
+
+#include "Heightmap.h"
+#include "HeightmapFilter.h"
+#include <fstream>
+
+Heightmap::Heightmap() :
+	mWidth(0),
+	mHeight(0),
+	mHeightScale(1.0f)
+{
+}
+
+bool Heightmap::LoadRaw(const std::string& filename, UINT width, UINT height, float heightScale)
+{
+	// A height for each vertex
+	std::vector<unsigned char> in( width * height );
+	bool found = ReadRaw(filename, in);
+
+	BuildFromRaw(in, width, height, heightScale);
+	return found;
+}
+
+bool Heightmap::LoadRawSmoothed(const std::string& filename, UINT width, UINT height, float heightScale,
+	std::vector<HALF>* halfHeights)
+{
+	std::vector<unsigned char> in( width * height );
+	bool found = ReadRaw(filename, in);
+
+	mWidth = width;
+	mHeight = height;
+	mHeightScale = heightScale;
+	mHeights.resize(mHeight * mWidth);
+
+	HALF* halfDest = 0;
+	if(halfHeights)
+	{
+		halfHeights->resize(mHeights.size());
+		halfDest = &(*halfHeights)[0];
+	}
+
+	HeightmapFilter::ExpandAndSmoothRaw8(&in[0], mHeightScale, &mHeights[0], halfDest, mWidth, mHeight);
+	return found;
+}
+
+bool Heightmap::ReadRaw(const std::string& filename, std::vector<unsigned char>& in)
+{
+	// Open the file.
+	std::ifstream inFile;
+	inFile.open(filename.c_str(), std::ios_base::binary);
+	if(!inFile)
+		return false;
+
+	// Read the RAW bytes.
+	inFile.read((char*)&in[0], (std::streamsize)in.size());
+
+	// Done with file.
+	inFile.close();
+	return true;
+}
+
+void Heightmap::BuildFromRaw(const std::vector<unsigned char>& in, UINT width, UINT height, float heightScale)
+{
+	mWidth = width;
+	mHeight = height;
+	mHeightScale = heightScale;
+
+	// Copy the array data into a float array and scale it.
+	mHeights.resize(mHeight * mWidth, 0);
+	for(UINT i = 0; i < mHeight * mWidth; ++i)
+	{
+		mHeights[i] = (in[i] / 255.0f)*mHeightScale;
+	}
+}
+
+void Heightmap::Resize(UINT width, UINT height, float heightScale)
+{
+	mWidth = width;
+	mHeight = height;
+	mHeightScale = heightScale;
+	mHeights.assign(mHeight * mWidth, 0.0f);
+}
+
+void Heightmap::Smooth()
+{
+	std::vector<float> dest( mHeights.size() );
+
+	HeightmapFilter::Smooth(&mHeights[0], &dest[0], mWidth, mHeight);
+
+	// Replace the old heightmap with the filtered one.
+	mHeights.swap(dest);
+}
+
+void Heightmap::CalcPatchBoundsY(UINT cellsPerPatch, std::vector<XMFLOAT2>& patchBoundsY)const
+{
+	UINT numPatchRows = (mHeight-1) / cellsPerPatch;
+	UINT numPatchCols = (mWidth-1) / cellsPerPatch;
+
+	patchBoundsY.resize(numPatchRows*numPatchCols);
+
+	// For each patch
+	for(UINT i = 0; i < numPatchRows; ++i)
+	{
+		for(UINT j = 0; j < numPatchCols; ++j)
+		{
+			patchBoundsY[i*numPatchCols+j] = CalcPatchBoundsY(cellsPerPatch, i, j);
+		}
+	}
+}
+
+XMFLOAT2 Heightmap::CalcPatchBoundsY(UINT cellsPerPatch, UINT i, UINT j)const
+{
+	// Scan the heightmap values this patch covers and compute the min/max height.
+
+	UINT x0 = j*cellsPerPatch;
+	UINT x1 = (j+1)*cellsPerPatch;
+
+	UINT y0 = i*cellsPerPatch;
+	UINT y1 = (i+1)*cellsPerPatch;
+
+	float minY = +MathHelper::Infinity;
+	float maxY = -MathHelper::Infinity;
+	for(UINT y = y0; y <= y1; ++y)
+	{
+		for(UINT x = x0; x <= x1; ++x)
+		{
+			UINT k = y*mWidth + x;
+			minY = MathHelper::Min(minY, mHeights[k]);
+			maxY = MathHelper::Max(maxY, mHeights[k]);
+		}
+	}
+
+	return XMFLOAT2(minY, maxY);
+}
+
+float Heightmap::GetHeight(float x, float z, float cellSpacing)const
+{
+	float width = (mWidth-1)*cellSpacing;
+	float depth = (mHeight-1)*cellSpacing;
+
+	// Transform from terrain local space to "cell" space.
+	float c = (x + 0.5f*width) /  cellSpacing;
+	float d = (z - 0.5f*depth) / -cellSpacing;
+
+	// Get the row and column we are in, clamped so queries off the map read its edge
+	// cells rather than past the heights.
+	int row = MathHelper::Clamp((int)floorf(d), 0, (int)mHeight - 2);
+	int col = MathHelper::Clamp((int)floorf(c), 0, (int)mWidth - 2);
+
+	// Grab the heights of the cell we are in.
+	// A*--*B
+	//  | /|
+	//  |/ |
+	// C*--*D
+	float A = mHeights[row*mWidth + col];
+	float B = mHeights[row*mWidth + col + 1];
+	float C = mHeights[(row+1)*mWidth + col];
+	float D = mHeights[(row+1)*mWidth + col + 1];
+
+	// Where we are relative to the cell.
+	float s = c - (float)col;
+	float t = d - (float)row;
+
+	// If upper triangle ABC.
+	if( s + t <= 1.0f)
+	{
+		float uy = B - A;
+		float vy = C - A;
+		return A + s*uy + t*vy;
+	}
+	else // lower triangle DCB.
+	{
+		float uy = C - D;
+		float vy = B - D;
+		return D + (1.0f-s)*uy + (1.0f-t)*vy;
+	}
+}
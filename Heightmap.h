@@ -0,0 +1,66 @@
+//***************************************************************************************
+// Heightmap.h
+//
+// CPU-side terrain height data: loading, smoothing, patch bounds and height queries.
+// Has no D3D dependency so it can be driven headless; Terrain owns one and uploads it.
+//***************************************************************************************
+
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include "MathHelper.h"
+#include <string>
+#include <vector>
+
+class Heightmap
+{
+public:
+	Heightmap();
+
+	// Reads an 8-bit RAW file.  A missing file leaves a flat heightmap, as before.
+	bool LoadRaw(const std::string& filename, UINT width, UINT height, float heightScale);
+
+	// LoadRaw followed by Smooth, in one pass.  halfHeights, if not null, receives the
+	// smoothed heights as 16-bit floats.
+	bool LoadRawSmoothed(const std::string& filename, UINT width, UINT height, float heightScale,
+		std::vector<HALF>* halfHeights);
+
+	// Expands 8-bit heights into floats scaled to [0, heightScale].
+	void BuildFromRaw(const std::vector<unsigned char>& in, UINT width, UINT height, float heightScale);
+
+	// A flat width x height map, for callers that fill GetData() themselves.
+	void Resize(UINT width, UINT height, float heightScale);
+
+	// 3x3 box filter; edge texels average only their in-bounds neighbors.  Multithreaded;
+	// see HeightmapFilter.
+	void Smooth();
+
+	// Min/max height of each cellsPerPatch x cellsPerPatch patch, row major.
+	void CalcPatchBoundsY(UINT cellsPerPatch, std::vector<XMFLOAT2>& patchBoundsY)const;
+	XMFLOAT2 CalcPatchBoundsY(UINT cellsPerPatch, UINT i, UINT j)const;
+
+	// Bilinear height at a terrain local space (x, z) for the given cell spacing.  Off
+	// the map, the nearest edge cell's plane is extended.  HeightQuery answers batches.
+	float GetHeight(float x, float z, float cellSpacing)const;
+
+	UINT GetNumCols()const { return mWidth; }
+	UINT GetNumRows()const { return mHeight; }
+	float GetHeightScale()const { return mHeightScale; }
+
+	float At(UINT row, UINT col)const { return mHeights[row*mWidth + col]; }
+
+	const std::vector<float>& GetData()const { return mHeights; }
+	std::vector<float>& GetData() { return mHeights; }
+
+private:
+	static bool ReadRaw(const std::string& filename, std::vector<unsigned char>& in);
+
+private:
+	UINT mWidth;
+	UINT mHeight;
+	float mHeightScale;
+
+	std::vector<float> mHeights;
+};
+
+#endif // HEIGHTMAP_H
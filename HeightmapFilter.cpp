@@ -0,0 +1,152 @@
+//***************************************************************************************
+// HeightmapFilter.cpp
+//***************************************************************************************
+
+#include "HeightmapFilter.h"
+#include "ParallelFor.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define HEIGHTMAPFILTER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	// Fewer rows than this per worker is not worth a thread.
+	const UINT MinRowsPerBand = 128;
+
+	// Heightmap::Average, for texels with missing neighbors or no SSE.
+	float AverageTexel(const float* const rows[3], UINT width, int j)
+	{
+		float avg = 0.0f;
+		float num = 0.0f;
+
+		for(int m = 0; m < 3; ++m)
+		{
+			if(!rows[m])
+				continue;
+
+			for(int n = j-1; n <= j+1; ++n)
+			{
+				if(n >= 0 && n < (int)width)
+				{
+					avg += rows[m][n];
+					num += 1.0f;
+				}
+			}
+		}
+
+		return avg / num;
+	}
+
+	// (in / 255.0f)*heightScale, as Heightmap::BuildFromRaw computes it.
+	void ExpandRow(const unsigned char* src, float heightScale, float* dest, UINT width)
+	{
+		UINT j = 0;
+
+#ifdef HEIGHTMAPFILTER_SSE
+		__m128 scale = _mm_set1_ps(heightScale);
+		__m128 maxByte = _mm_set1_ps(255.0f);
+		for(; j + 4 <= width; j += 4)
+		{
+			__m128 h = _mm_set_ps((float)src[j+3], (float)src[j+2], (float)src[j+1], (float)src[j]);
+			_mm_storeu_ps(dest + j, _mm_mul_ps(_mm_div_ps(h, maxByte), scale));
+		}
+#endif
+
+		for(; j < width; ++j)
+			dest[j] = (src[j] / 255.0f)*heightScale;
+	}
+}
+
+void HeightmapFilter::SmoothRow(const float* above, const float* row, const float* below, float* dest, UINT width)
+{
+	const float* rows[3] = { above, row, below };
+
+	if(width < 3)
+	{
+		for(UINT j = 0; j < width; ++j)
+			dest[j] = AverageTexel(rows, width, (int)j);
+		return;
+	}
+
+	dest[0] = AverageTexel(rows, width, 0);
+
+	UINT j = 1;
+
+#ifdef HEIGHTMAPFILTER_SSE
+	// Interior columns, four at a time.  The taps go in Average's order, row by row and
+	// left to right, so each lane rounds exactly as the scalar loop does.
+	float count = 3.0f*((above ? 1 : 0) + 1 + (below ? 1 : 0));
+	__m128 num = _mm_set1_ps(count);
+	for(; j + 4 <= width - 1; j += 4)
+	{
+		__m128 avg = _mm_setzero_ps();
+		for(int m = 0; m < 3; ++m)
+		{
+			if(!rows[m])
+				continue;
+
+			const float* r = rows[m] + j;
+			avg = _mm_add_ps(avg, _mm_loadu_ps(r - 1));
+			avg = _mm_add_ps(avg, _mm_loadu_ps(r));
+			avg = _mm_add_ps(avg, _mm_loadu_ps(r + 1));
+		}
+		_mm_storeu_ps(dest + j, _mm_div_ps(avg, num));
+	}
+#endif
+
+	for(; j < width; ++j)
+		dest[j] = AverageTexel(rows, width, (int)j);
+}
+
+void HeightmapFilter::Smooth(const float* src, float* dest, UINT width, UINT height, UINT numThreads)
+{
+	ParallelForRows(height, MinRowsPerBand, numThreads, [=](UINT firstRow, UINT endRow)
+	{
+		for(UINT i = firstRow; i < endRow; ++i)
+		{
+			const float* row = src + (size_t)i*width;
+			const float* above = i > 0 ? row - width : 0;
+			const float* below = i + 1 < height ? row + width : 0;
+			SmoothRow(above, row, below, dest + (size_t)i*width, width);
+		}
+	});
+}
+
+void HeightmapFilter::ExpandAndSmoothRaw8(const unsigned char* src, float heightScale, float* dest, HALF* halfDest,
+	UINT width, UINT height, UINT numThreads)
+{
+	ParallelForRows(height, MinRowsPerBand, numThreads, [=](UINT firstRow, UINT endRow)
+	{
+		if(firstRow >= endRow)
+			return;
+
+		// Three expanded rows rolling down the band.  Rows either side of it are expanded
+		// by both neighboring bands, which costs two rows per band and no locking.
+		std::vector<float> expanded(3*(size_t)width);
+		float* above = &expanded[0];
+		float* row = above + width;
+		float* below = row + width;
+
+		if(firstRow > 0)
+			ExpandRow(src + (size_t)(firstRow-1)*width, heightScale, above, width);
+		ExpandRow(src + (size_t)firstRow*width, heightScale, row, width);
+
+		for(UINT i = firstRow; i < endRow; ++i)
+		{
+			if(i + 1 < height)
+				ExpandRow(src + (size_t)(i+1)*width, heightScale, below, width);
+
+			float* out = dest + (size_t)i*width;
+			SmoothRow(i > 0 ? above : 0, row, i + 1 < height ? below : 0, out, width);
+			if(halfDest)
+				XMConvertFloatToHalfStream(halfDest + (size_t)i*width, sizeof(HALF), out, sizeof(float), width);
+
+			float* recycled = above;
+			above = row;
+			row = below;
+			below = recycled;
+		}
+	});
+}
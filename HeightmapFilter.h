@@ -0,0 +1,32 @@
+//***************************************************************************************
+// HeightmapFilter.h
+//
+// The heightmap preprocessing passes behind Heightmap::Smooth and the fused RAW loader:
+// the 3x3 box filter with SSE interior rows and scalar borders, spread over worker
+// threads a band of rows each.  Every lane adds its nine taps in the same order as the
+// original per-texel loop, so results match it bit for bit.
+//***************************************************************************************
+
+#ifndef HEIGHTMAPFILTER_H
+#define HEIGHTMAPFILTER_H
+
+#include "MathHelper.h"
+
+namespace HeightmapFilter
+{
+	// One filtered row.  above and below are the neighboring rows, or null at the edges
+	// of the map, whose texels then average only their in-bounds neighbors.
+	void SmoothRow(const float* above, const float* row, const float* below, float* dest, UINT width);
+
+	// The whole map, src to dest; they must not overlap.  numThreads == 0 uses one worker
+	// per hardware thread; small maps run on the calling thread.
+	void Smooth(const float* src, float* dest, UINT width, UINT height, UINT numThreads = 0);
+
+	// Expands 8-bit heights to [0, heightScale] as Heightmap::BuildFromRaw does and
+	// smooths them in the same pass, without a full-size unfiltered copy.  halfDest, if
+	// not null, also receives the results as 16-bit floats for a height texture.
+	void ExpandAndSmoothRaw8(const unsigned char* src, float heightScale, float* dest, HALF* halfDest,
+		UINT width, UINT height, UINT numThreads = 0);
+}
+
+#endif // HEIGHTMAPFILTER_H
@@ -0,0 +1,19 @@
+//***************************************************************************************
+// sal.h
+//
+// Empty stand-ins for the Microsoft source annotation macros used by xnamath.h.  Only
+// put on the include path by non-Windows builds; MSVC uses its own sal.h.
+//***************************************************************************************
+
+#ifndef ZEUS_POSIX_SAL_H
+#define ZEUS_POSIX_SAL_H
+
+#define _In_
+#define _In_z_
+#define _Out_
+#define _In_count_c_(size)
+#define _Out_cap_c_(size)
+#define _In_bytecount_x_(size)
+#define _Out_bytecap_x_(size)
+
+#endif // ZEUS_POSIX_SAL_H
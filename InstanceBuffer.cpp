@@ -0,0 +1,87 @@
+//***************************************************************************************
+// InstanceBuffer.cpp
+//***************************************************************************************
+
+#include "InstanceBuffer.h"
+#include <algorithm>
+
+InstanceBufferBuilder::InstanceBufferBuilder(UINT numBatches) :
+	mBatches(numBatches),
+	mRanges(numBatches)
+{
+	Reset();
+}
+
+void InstanceBufferBuilder::Reset()
+{
+	for(size_t i = 0; i < mBatches.size(); ++i)
+	{
+		mBatches[i].clear();
+		mRanges[i].StartInstance = 0;
+		mRanges[i].InstanceCount = 0;
+	}
+}
+
+void InstanceBufferBuilder::Add(UINT batch, const InstancedData& instance)
+{
+	mBatches[batch].push_back(instance);
+}
+
+void InstanceBufferBuilder::Add(UINT batch, const XMFLOAT4X4& world, const XMFLOAT4& color)
+{
+	InstancedData instance;
+	instance.World = world;
+	instance.Color = color;
+	mBatches[batch].push_back(instance);
+}
+
+void InstanceBufferBuilder::AddRange(UINT batch, const XMFLOAT4X4* worlds, UINT count, const XMFLOAT4& color)
+{
+	std::vector<InstancedData>& instances = mBatches[batch];
+	size_t first = instances.size();
+	instances.resize(first + count);
+	for(UINT i = 0; i < count; ++i)
+	{
+		instances[first + i].World = worlds[i];
+		instances[first + i].Color = color;
+	}
+}
+
+void InstanceBufferBuilder::AddSelected(UINT batch, const XMFLOAT4X4* worlds, const std::vector<UINT>& selected,
+	const XMFLOAT4& color)
+{
+	std::vector<InstancedData>& instances = mBatches[batch];
+	size_t first = instances.size();
+	instances.resize(first + selected.size());
+	for(size_t i = 0; i < selected.size(); ++i)
+	{
+		instances[first + i].World = worlds[selected[i]];
+		instances[first + i].Color = color;
+	}
+}
+
+UINT InstanceBufferBuilder::Build(InstancedData* dest, UINT capacity, UINT firstInstance)
+{
+	UINT written = 0;
+	for(size_t i = 0; i < mBatches.size(); ++i)
+	{
+		UINT count = (UINT)mBatches[i].size();
+		if(count > capacity - written)
+			count = capacity - written;
+
+		mRanges[i].StartInstance = firstInstance + written;
+		mRanges[i].InstanceCount = count;
+
+		std::copy(mBatches[i].begin(), mBatches[i].begin() + count, dest + written);
+		written += count;
+	}
+	return written;
+}
+
+UINT InstanceBufferBuilder::GetNumQueued()const
+{
+	UINT total = 0;
+	for(size_t i = 0; i < mBatches.size(); ++i)
+		total += (UINT)mBatches[i].size();
+	return total;
+}
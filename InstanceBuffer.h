@@ -0,0 +1,59 @@
+//***************************************************************************************
+// InstanceBuffer.h
+//
+// CPU side of the instanced draw path.  Instances are queued per batch (one mesh and
+// material pair) during the frame, then written batch after batch into a single
+// dynamic vertex buffer so each batch is one DrawIndexedInstanced call.
+//***************************************************************************************
+
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include "Platform.h"
+#include <vector>
+
+// Per-instance vertex data; matches the WORLD/COLOR elements of
+// InputLayoutDesc::InstancedPosNormalTexTan.
+struct InstancedData
+{
+	XMFLOAT4X4 World;
+	XMFLOAT4 Color;
+};
+
+struct InstanceBatch
+{
+	UINT StartInstance;
+	UINT InstanceCount;
+};
+
+class InstanceBufferBuilder
+{
+public:
+	explicit InstanceBufferBuilder(UINT numBatches);
+
+	// Empties every batch; capacity is kept between frames.
+	void Reset();
+
+	void Add(UINT batch, const InstancedData& instance);
+	void Add(UINT batch, const XMFLOAT4X4& world, const XMFLOAT4& color);
+	void AddRange(UINT batch, const XMFLOAT4X4* worlds, UINT count, const XMFLOAT4& color);
+	// Only worlds[selected[i]], such as the survivors of a frustum cull.
+	void AddSelected(UINT batch, const XMFLOAT4X4* worlds, const std::vector<UINT>& selected, const XMFLOAT4& color);
+
+	// Copies the batches back to back into dest, usually a mapped D3D11_USAGE_DYNAMIC
+	// buffer, and fills in their instance ranges.  Writes are sequential, which is what
+	// write-combined memory wants.  Instances past capacity are dropped.  dest is
+	// firstInstance elements into the buffer when appending after earlier passes; the
+	// ranges count from the start of the buffer.  Returns the number of instances written.
+	UINT Build(InstancedData* dest, UINT capacity, UINT firstInstance = 0);
+
+	const InstanceBatch& GetBatch(UINT batch)const { return mRanges[batch]; }
+	UINT GetNumBatches()const { return (UINT)mBatches.size(); }
+	UINT GetNumQueued()const;
+
+private:
+	std::vector< std::vector<InstancedData> > mBatches;
+	std::vector<InstanceBatch> mRanges;
+};
+
+#endif // INSTANCEBUFFER_H
@@ -12,8 +12,7 @@
 #ifndef LIGHTHELPER_H
 #define LIGHTHELPER_H
 
-#include <Windows.h>
-#include <xnamath.h>
+#include "Platform.h"
 
 // Note: Make sure structure alignment agrees with HLSL structure padding rules. 
 //   Elements are packed into 4D vectors with the restriction that an element
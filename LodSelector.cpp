@@ -0,0 +1,80 @@
+//***************************************************************************************
+// LodSelector.cpp
+//***************************************************************************************
+
+#include "LodSelector.h"
+#include <algorithm>
+
+const float LodSelector::DefaultPixelError = 1.0f;
+
+LodSelector::LodSelector() :
+	mEye(0.0f, 0.0f, 0.0f),
+	mNearZ(1.0f),
+	mPixelsPerUnit(1.0f),
+	mPixelError(DefaultPixelError),
+	mBias(1.0f)
+{
+}
+
+void LodSelector::SetView(const Camera& camera, float viewportHeight, float bias)
+{
+	SetView(camera.GetPosition(), camera.GetFovY(), camera.GetNearZ(), viewportHeight, bias);
+}
+
+void LodSelector::SetView(const XMFLOAT3& eye, float fovY, float nearZ, float viewportHeight, float bias)
+{
+	mEye = eye;
+	mNearZ = nearZ;
+	mPixelsPerUnit = 0.5f*viewportHeight / tanf(0.5f*fovY);
+	mBias = bias;
+}
+
+float LodSelector::GetDistance(const XNA::Sphere& worldBounds)const
+{
+	float dx = worldBounds.Center.x - mEye.x;
+	float dy = worldBounds.Center.y - mEye.y;
+	float dz = worldBounds.Center.z - mEye.z;
+	return MathHelper::Max(sqrtf(dx*dx + dy*dy + dz*dz) - worldBounds.Radius, mNearZ);
+}
+
+UINT LodSelector::SelectAt(const MeshLod* lods, UINT numLods, float distance, float scale)const
+{
+	// Errors only grow down the chain, so the first level over budget ends the search.
+	float maxError = mPixelError*mBias*distance / (mPixelsPerUnit*scale);
+	UINT lod = 0;
+	while(lod + 1 < numLods && lods[lod + 1].Error <= maxError)
+		++lod;
+	return lod;
+}
+
+UINT LodSelector::Select(const MeshLod* lods, UINT numLods, const XNA::Sphere& worldBounds)const
+{
+	return SelectAt(lods, numLods, GetDistance(worldBounds), 1.0f);
+}
+
+void LodSelector::SelectInstances(const MeshLod* lods, UINT numLods, const XNA::AxisAlignedBox& localBox,
+	const XMFLOAT4X4* worlds, const std::vector<UINT>& visible, std::vector<UINT>& lodOfEach)const
+{
+	lodOfEach.resize(visible.size());
+	if(numLods <= 1)
+	{
+		std::fill(lodOfEach.begin(), lodOfEach.end(), 0u);
+		return;
+	}
+
+	XMVECTOR center = XMLoadFloat3(&localBox.Center);
+	float localRadius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&localBox.Extents)));
+	for(size_t i = 0; i < visible.size(); ++i)
+	{
+		XMMATRIX world = XMLoadFloat4x4(&worlds[visible[i]]);
+
+		// The mesh's errors grow with the largest scale of its world.
+		float scale = MathHelper::Max(XMVectorGetX(XMVector3Length(world.r[0])),
+			MathHelper::Max(XMVectorGetX(XMVector3Length(world.r[1])), XMVectorGetX(XMVector3Length(world.r[2]))));
+
+		XNA::Sphere bounds;
+		XMStoreFloat3(&bounds.Center, XMVector3TransformCoord(center, world));
+		bounds.Radius = localRadius*scale;
+		lodOfEach[i] = SelectAt(lods, numLods, GetDistance(bounds), scale);
+	}
+}
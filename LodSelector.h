@@ -0,0 +1,54 @@
+//***************************************************************************************
+// LodSelector.h
+//
+// Picks a level of a MeshLod chain per instance for one view: the coarsest level whose
+// error, projected at the instance's nearest distance to the eye, stays under a pixel
+// threshold.  Passes whose detail matters less (shadow maps, cube map faces) scale the
+// threshold by a bias greater than one.
+//***************************************************************************************
+
+#ifndef LODSELECTOR_H
+#define LODSELECTOR_H
+
+#include "Camera.h"
+#include "MeshFile.h"
+#include <vector>
+
+class LodSelector
+{
+public:
+	// Error allowed on screen, in pixels, at a bias of one.
+	static const float DefaultPixelError;
+
+	LodSelector();
+
+	// A perspective view from camera into a viewport viewportHeight pixels high.
+	void SetView(const Camera& camera, float viewportHeight, float bias = 1.0f);
+	void SetView(const XMFLOAT3& eye, float fovY, float nearZ, float viewportHeight, float bias = 1.0f);
+
+	void SetPixelError(float pixels) { mPixelError = pixels; }
+
+	// Instances nearer than the near plane are measured at it.
+	UINT Select(const MeshLod* lods, UINT numLods, const XNA::Sphere& worldBounds)const;
+
+	// Instances sharing one local box, scaled by their worlds; lodOfEach[i] is the level
+	// for worlds[visible[i]].
+	void SelectInstances(const MeshLod* lods, UINT numLods, const XNA::AxisAlignedBox& localBox,
+		const XMFLOAT4X4* worlds, const std::vector<UINT>& visible, std::vector<UINT>& lodOfEach)const;
+
+private:
+	float GetDistance(const XNA::Sphere& worldBounds)const;
+	UINT SelectAt(const MeshLod* lods, UINT numLods, float distance, float scale)const;
+
+private:
+	XMFLOAT3 mEye;
+	float mNearZ;
+
+	// Pixels one unit of error covers one unit in front of the eye.
+	float mPixelsPerUnit;
+
+	float mPixelError;
+	float mBias;
+};
+
+#endif // LODSELECTOR_H
@@ -0,0 +1,180 @@
+//***************************************************************************************
+// MappedFile.cpp
+//***************************************************************************************
+
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	const UINT64 PageSize = 4096;
+
+	// Widens [offset, offset + size) to whole pages inside a file of fileSize bytes.
+	bool PageRange(UINT64 offset, UINT64 size, UINT64 fileSize, UINT64& first, UINT64& length)
+	{
+		if(offset >= fileSize || size == 0)
+			return false;
+
+		UINT64 end = offset + size < fileSize ? offset + size : fileSize;
+		first = offset & ~(PageSize - 1);
+		length = end - first;
+		return true;
+	}
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() :
+	mData(0),
+	mSize(0),
+	mFile(INVALID_HANDLE_VALUE),
+	mMapping(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, 0);
+	if(mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(mFile, 0, PAGE_READONLY, 0, 0, 0);
+	if(mMapping)
+		mData = (unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(!mData)
+	{
+		Close();
+		return false;
+	}
+
+	mSize = (UINT64)size.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if(mData)
+		UnmapViewOfFile(mData);
+	if(mMapping)
+		CloseHandle(mMapping);
+	if(mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mData = 0;
+	mSize = 0;
+	mMapping = 0;
+	mFile = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::Prefetch(UINT64 offset, UINT64 size)const
+{
+	// PrefetchVirtualMemory needs Windows 8; touching a byte per page does the same job.
+	UINT64 first, length;
+	if(!PageRange(offset, size, mSize, first, length))
+		return;
+
+	volatile unsigned char sink = 0;
+	for(UINT64 p = first; p < first + length; p += PageSize)
+		sink ^= mData[p];
+}
+
+void MappedFile::Release(UINT64 offset, UINT64 size)const
+{
+	// Unlocking pages that were never locked drops them from the working set; they
+	// stay in the standby list and come back cheaply if touched again.
+	UINT64 first, length;
+	if(PageRange(offset, size, mSize, first, length))
+		VirtualUnlock(mData + first, (SIZE_T)length);
+}
+
+#else
+
+MappedFile::MappedFile() :
+	mData(0),
+	mSize(0),
+	mFile(-1)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	mFile = open(filename.c_str(), O_RDONLY);
+	if(mFile < 0)
+		return false;
+
+	struct stat st;
+	if(fstat(mFile, &st) != 0 || st.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, mFile, 0);
+	if(data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	mData = (unsigned char*)data;
+	mSize = (UINT64)st.st_size;
+	madvise(mData, (size_t)mSize, MADV_RANDOM);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if(mData)
+		munmap(mData, (size_t)mSize);
+	if(mFile >= 0)
+		close(mFile);
+
+	mData = 0;
+	mSize = 0;
+	mFile = -1;
+}
+
+void MappedFile::Prefetch(UINT64 offset, UINT64 size)const
+{
+	UINT64 first, length;
+	if(PageRange(offset, size, mSize, first, length))
+		madvise(mData + first, (size_t)length, MADV_WILLNEED);
+}
+
+void MappedFile::Release(UINT64 offset, UINT64 size)const
+{
+	// The mapping is read-only and file backed, so dropped pages are simply re-read.
+	UINT64 first, length;
+	if(PageRange(offset, size, mSize, first, length))
+		madvise(mData + first, (size_t)length, MADV_DONTNEED);
+}
+
+#endif
@@ -0,0 +1,49 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// Read-only memory mapping of a whole file.  Pages are read in by the OS on first
+// touch, so opening a large file costs nothing until its data is used, and Release
+// hands untouched-again ranges back so the working set tracks what is in use rather
+// than the file size.
+//***************************************************************************************
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "Platform.h"
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const std::string& filename);
+	void Close();
+
+	bool IsOpen()const { return mData != 0; }
+	const unsigned char* GetData()const { return mData; }
+	UINT64 GetSize()const { return mSize; }
+
+	// Hints that [offset, offset + size) will be read soon, or is not needed for now.
+	// Both are advisory; the data stays readable either way.
+	void Prefetch(UINT64 offset, UINT64 size)const;
+	void Release(UINT64 offset, UINT64 size)const;
+
+private:
+	MappedFile(const MappedFile& rhs);
+	MappedFile& operator=(const MappedFile& rhs);
+
+	unsigned char* mData;
+	UINT64 mSize;
+
+#ifdef _WIN32
+	HANDLE mFile;
+	HANDLE mMapping;
+#else
+	int mFile;
+#endif
+};
+
+#endif // MAPPEDFILE_H
@@ -84,4 +84,91 @@ XMVECTOR MathHelper::RandHemisphereUnitVec3(XMVECTOR n)
 
 		return XMVector3Normalize(v);
 	}
-}
\ No newline at end of file
+}
+
+void ExtractFrustumPlanes(XMFLOAT4 planes[6], CXMMATRIX M)
+{
+	//
+	// Left
+	//
+	planes[0].x = M(0,3) + M(0,0);
+	planes[0].y = M(1,3) + M(1,0);
+	planes[0].z = M(2,3) + M(2,0);
+	planes[0].w = M(3,3) + M(3,0);
+
+	//
+	// Right
+	//
+	planes[1].x = M(0,3) - M(0,0);
+	planes[1].y = M(1,3) - M(1,0);
+	planes[1].z = M(2,3) - M(2,0);
+	planes[1].w = M(3,3) - M(3,0);
+
+	//
+	// Bottom
+	//
+	planes[2].x = M(0,3) + M(0,1);
+	planes[2].y = M(1,3) + M(1,1);
+	planes[2].z = M(2,3) + M(2,1);
+	planes[2].w = M(3,3) + M(3,1);
+
+	//
+	// Top
+	//
+	planes[3].x = M(0,3) - M(0,1);
+	planes[3].y = M(1,3) - M(1,1);
+	planes[3].z = M(2,3) - M(2,1);
+	planes[3].w = M(3,3) - M(3,1);
+
+	//
+	// Near
+	//
+	planes[4].x = M(0,2);
+	planes[4].y = M(1,2);
+	planes[4].z = M(2,2);
+	planes[4].w = M(3,2);
+
+	//
+	// Far
+	//
+	planes[5].x = M(0,3) - M(0,2);
+	planes[5].y = M(1,3) - M(1,2);
+	planes[5].z = M(2,3) - M(2,2);
+	planes[5].w = M(3,3) - M(3,2);
+
+	// Normalize the plane equations.
+	for(int i = 0; i < 6; ++i)
+	{
+		XMVECTOR v = XMPlaneNormalize(XMLoadFloat4(&planes[i]));
+		XMStoreFloat4(&planes[i], v);
+	}
+}
+
+void MathHelper::StoreRigidTransform(XMFLOAT4X4* out, const float rotQuat[4], const float translation[3])
+{
+	float x = rotQuat[0], y = rotQuat[1], z = rotQuat[2], w = rotQuat[3];
+
+	float xx = x*x, yy = y*y, zz = z*z;
+	float xy = x*y, xz = x*z, yz = y*z;
+	float xw = x*w, yw = y*w, zw = z*w;
+
+	out->_11 = 1.0f - 2.0f*(yy + zz);
+	out->_12 = 2.0f*(xy + zw);
+	out->_13 = 2.0f*(xz - yw);
+	out->_14 = 0.0f;
+
+	out->_21 = 2.0f*(xy - zw);
+	out->_22 = 1.0f - 2.0f*(xx + zz);
+	out->_23 = 2.0f*(yz + xw);
+	out->_24 = 0.0f;
+
+	out->_31 = 2.0f*(xz + yw);
+	out->_32 = 2.0f*(yz - xw);
+	out->_33 = 1.0f - 2.0f*(xx + yy);
+	out->_34 = 0.0f;
+
+	out->_41 = translation[0];
+	out->_42 = translation[1];
+	out->_43 = translation[2];
+	out->_44 = 1.0f;
+}
@@ -12,8 +12,8 @@
 #ifndef MATHHELPER_H
 #define MATHHELPER_H
 
-#include <Windows.h>
-#include <xnamath.h>
+#include "Platform.h"
+#include <stdlib.h>
 
 class MathHelper
 {
@@ -72,10 +72,17 @@ public:
 	static XMVECTOR RandUnitVec3();
 	static XMVECTOR RandHemisphereUnitVec3(XMVECTOR n);
 
+	// Writes the world matrix of a unit quaternion (x, y, z, w) rotation followed by a
+	// translation; same result as XMMatrixRotationQuaternion(q)*XMMatrixTranslation(p).
+	static void StoreRigidTransform(XMFLOAT4X4* out, const float rotQuat[4], const float translation[3]);
+
 	static const float Infinity;
 	static const float Pi;
 
 
 };
 
+// Order: left, right, bottom, top, near, far.
+void ExtractFrustumPlanes(XMFLOAT4 planes[6], CXMMATRIX M);
+
 #endif // MATHHELPER_H
\ No newline at end of file
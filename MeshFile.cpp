@@ -0,0 +1,412 @@
+//***************************************************************************************
+// MeshFile.cpp
+//***************************************************************************************
+
+#include "MeshFile.h"
+#include "ObjLoader.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "VertexPacker.h"
+#include "TangentGenerator.h"
+#include "MathHelper.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+
+namespace
+{
+	const char MeshMagic[4] = { 'Z', 'M', 'S', 'H' };
+	// 2: converters reorder meshes with MeshOptimizer.  3: LOD table.  4: tangents from
+	// TangentGenerator.  5: tangent handedness in TexNum.
+	const UINT MeshVersion = 5;
+	const UINT64 StreamAlignment = 16;
+
+	struct MeshHeader
+	{
+		char   Magic[4];
+		UINT   Version;
+		UINT   VertexFormat;
+		UINT   VertexStride;
+		UINT   NumVertices;
+		UINT   NumIndices;
+		UINT   NumSubmeshes;
+		UINT   NumLods;
+		float  BoundsCenter[3];
+		float  BoundsExtents[3];
+		UINT64 VertexOffset;
+		UINT64 IndexOffset;
+		UINT64 SubmeshOffset;
+		UINT64 LodOffset;
+	};
+
+	UINT64 AlignUp(UINT64 n)
+	{
+		return (n + StreamAlignment - 1) & ~(StreamAlignment - 1);
+	}
+
+	bool WritePadded(FILE* file, const void* data, UINT64 size, UINT64 paddedSize)
+	{
+		static const unsigned char zeros[StreamAlignment] = { 0 };
+		return (size == 0 || fwrite(data, (size_t)size, 1, file) == 1) &&
+			(paddedSize == size || fwrite(zeros, (size_t)(paddedSize - size), 1, file) == 1);
+	}
+
+	// Bounds of the vertices the indices use, as XNA computes them over a point list.
+	void GetIndexedBounds(const unsigned char* vertices, UINT stride, const UINT* indices, UINT numIndices,
+		UINT& firstVertex, UINT& numVertices, XMFLOAT3& center, XMFLOAT3& extents)
+	{
+		if(numIndices == 0)
+		{
+			firstVertex = numVertices = 0;
+			center = extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			return;
+		}
+
+		UINT lo = indices[0];
+		UINT hi = indices[0];
+		XMVECTOR vMin = XMLoadFloat3((const XMFLOAT3*)(vertices + (size_t)indices[0]*stride));
+		XMVECTOR vMax = vMin;
+		for(UINT i = 1; i < numIndices; ++i)
+		{
+			UINT v = indices[i];
+			lo = MathHelper::Min(lo, v);
+			hi = MathHelper::Max(hi, v);
+
+			XMVECTOR p = XMLoadFloat3((const XMFLOAT3*)(vertices + (size_t)v*stride));
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+
+		firstVertex = lo;
+		numVertices = hi - lo + 1;
+		XMStoreFloat3(&center, XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f));
+		XMStoreFloat3(&extents, XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f));
+	}
+}
+
+MeshFile::MeshFile() :
+	mFormat(FormatBasic32),
+	mNumVertices(0),
+	mNumIndices(0),
+	mNumSubmeshes(0),
+	mNumLods(0),
+	mVertices(0),
+	mIndices(0),
+	mSubmeshes(0),
+	mLods(0)
+{
+	mBounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	mBounds.Extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+}
+
+UINT MeshFile::GetVertexStride(VertexFormat format)
+{
+	switch(format)
+	{
+	case FormatPosNormalTexTan:       return sizeof(MeshVertexPosNormalTexTan);
+	case FormatPackedBasic:           return sizeof(PackedVertexBasic);
+	case FormatPackedPosNormalTexTan: return sizeof(PackedVertexPosNormalTexTan);
+	default:                          return sizeof(MeshVertexBasic32);
+	}
+}
+
+MeshFile::VertexFormat MeshFile::GetSourceFormat(VertexFormat format)
+{
+	switch(format)
+	{
+	case FormatPackedBasic:           return FormatBasic32;
+	case FormatPackedPosNormalTexTan: return FormatPosNormalTexTan;
+	default:                          return format;
+	}
+}
+
+XMFLOAT3 MeshFile::GetPosition(UINT vertex)const
+{
+	// Every vertex format starts with the position.
+	const unsigned char* v = (const unsigned char*)mVertices + (size_t)vertex*GetVertexStride();
+	if(IsPacked(mFormat))
+		return VertexPacker::DecodePosition(*(const XMUSHORT4*)v, GetQuantization());
+
+	return *(const XMFLOAT3*)v;
+}
+
+VertexQuantization MeshFile::GetQuantization()const
+{
+	return VertexPacker::GetQuantization(mBounds);
+}
+
+bool MeshFile::Open(const std::string& filename)
+{
+	Close();
+
+	if(!mFile.Open(filename) || mFile.GetSize() < sizeof(MeshHeader))
+	{
+		Close();
+		return false;
+	}
+
+	MeshHeader header;
+	memcpy(&header, mFile.GetData(), sizeof(header));
+
+	// Checks the streams lie in the file and the submesh and LOD ranges in the streams,
+	// and nothing more; the data is used as it is.
+	UINT64 size = mFile.GetSize();
+	bool ok = memcmp(header.Magic, MeshMagic, sizeof(MeshMagic)) == 0 &&
+		header.Version == MeshVersion &&
+		header.VertexFormat <= FormatPackedPosNormalTexTan &&
+		header.VertexStride == GetVertexStride((VertexFormat)header.VertexFormat) &&
+		header.VertexOffset % StreamAlignment == 0 &&
+		header.IndexOffset % StreamAlignment == 0 &&
+		header.SubmeshOffset % StreamAlignment == 0 &&
+		header.LodOffset % StreamAlignment == 0 &&
+		header.VertexOffset >= sizeof(MeshHeader) &&
+		header.VertexOffset <= size && (UINT64)header.NumVertices*header.VertexStride <= size - header.VertexOffset &&
+		header.IndexOffset <= size && (UINT64)header.NumIndices*sizeof(UINT) <= size - header.IndexOffset &&
+		header.SubmeshOffset <= size && (UINT64)header.NumSubmeshes*sizeof(MeshSubmesh) <= size - header.SubmeshOffset &&
+		header.NumLods > 0 &&
+		header.LodOffset <= size && (UINT64)header.NumLods*sizeof(MeshLod) <= size - header.LodOffset;
+
+	const MeshSubmesh* submeshes = (const MeshSubmesh*)(mFile.GetData() + header.SubmeshOffset);
+	for(UINT i = 0; ok && i < header.NumSubmeshes; ++i)
+	{
+		const MeshSubmesh& s = submeshes[i];
+		ok = s.FirstIndex <= header.NumIndices && s.NumIndices <= header.NumIndices - s.FirstIndex &&
+			s.FirstVertex <= header.NumVertices && s.NumVertices <= header.NumVertices - s.FirstVertex;
+	}
+
+	const MeshLod* lods = (const MeshLod*)(mFile.GetData() + header.LodOffset);
+	for(UINT i = 0; ok && i < header.NumLods; ++i)
+		ok = lods[i].FirstIndex <= header.NumIndices && lods[i].NumIndices <= header.NumIndices - lods[i].FirstIndex;
+
+	if(!ok)
+	{
+		Close();
+		return false;
+	}
+
+	const unsigned char* data = mFile.GetData();
+	mFormat = (VertexFormat)header.VertexFormat;
+	mNumVertices = header.NumVertices;
+	mNumIndices = header.NumIndices;
+	mNumSubmeshes = header.NumSubmeshes;
+	mNumLods = header.NumLods;
+	mVertices = data + header.VertexOffset;
+	mIndices = (const UINT*)(data + header.IndexOffset);
+	mSubmeshes = submeshes;
+	mLods = lods;
+	mBounds.Center = XMFLOAT3(header.BoundsCenter);
+	mBounds.Extents = XMFLOAT3(header.BoundsExtents);
+	return true;
+}
+
+void MeshFile::Close()
+{
+	mFile.Close();
+	mNumVertices = mNumIndices = mNumSubmeshes = mNumLods = 0;
+	mVertices = 0;
+	mIndices = 0;
+	mSubmeshes = 0;
+	mLods = 0;
+}
+
+bool MeshFile::Write(const std::string& filename, VertexFormat format, const void* vertices, UINT numVertices,
+	const UINT* indices, UINT numIndices, const MeshSubmesh* submeshes, UINT numSubmeshes,
+	const MeshLod* lods, UINT numLods)
+{
+	if(numVertices == 0 || numIndices == 0)
+		return false;
+
+	for(UINT i = 0; i < numIndices; ++i)
+	{
+		if(indices[i] >= numVertices)
+			return false;
+	}
+
+	// Bounds come from the unpacked positions, and the packed ones are quantized to them.
+	const unsigned char* verts = (const unsigned char*)vertices;
+	UINT stride = GetVertexStride(GetSourceFormat(format));
+
+	std::vector<MeshLod> lodTable;
+	if(numLods == 0)
+	{
+		MeshLod all = { 0, numIndices, 0.0f };
+		lodTable.push_back(all);
+	}
+	else
+	{
+		lodTable.assign(lods, lods + numLods);
+	}
+
+	for(size_t i = 0; i < lodTable.size(); ++i)
+	{
+		if(lodTable[i].FirstIndex > numIndices || lodTable[i].NumIndices > numIndices - lodTable[i].FirstIndex)
+			return false;
+	}
+
+	std::vector<MeshSubmesh> table;
+	if(numSubmeshes == 0)
+	{
+		MeshSubmesh all = MeshSubmesh();
+		all.FirstIndex = lodTable[0].FirstIndex;
+		all.NumIndices = lodTable[0].NumIndices;
+		table.push_back(all);
+	}
+	else
+	{
+		table.assign(submeshes, submeshes + numSubmeshes);
+	}
+
+	for(size_t i = 0; i < table.size(); ++i)
+	{
+		MeshSubmesh& s = table[i];
+		if(s.FirstIndex > numIndices || s.NumIndices > numIndices - s.FirstIndex)
+			return false;
+
+		GetIndexedBounds(verts, stride, indices + s.FirstIndex, s.NumIndices,
+			s.FirstVertex, s.NumVertices, s.BoundsCenter, s.BoundsExtents);
+	}
+
+	MeshHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, MeshMagic, sizeof(MeshMagic));
+	header.Version = MeshVersion;
+	header.VertexFormat = format;
+	header.VertexStride = GetVertexStride(format);
+	header.NumVertices = numVertices;
+	header.NumIndices = numIndices;
+	header.NumSubmeshes = (UINT)table.size();
+	header.NumLods = (UINT)lodTable.size();
+
+	XNA::AxisAlignedBox bounds;
+	XNA::ComputeBoundingAxisAlignedBoxFromPoints(&bounds, numVertices, (const XMFLOAT3*)verts, stride);
+	memcpy(header.BoundsCenter, &bounds.Center, sizeof(header.BoundsCenter));
+	memcpy(header.BoundsExtents, &bounds.Extents, sizeof(header.BoundsExtents));
+
+	std::vector<unsigned char> packed;
+	if(format == FormatPackedBasic)
+	{
+		packed.resize((size_t)numVertices*sizeof(PackedVertexBasic));
+		VertexPacker::Pack((PackedVertexBasic*)&packed[0], (const MeshVertexBasic32*)vertices, numVertices,
+			VertexPacker::GetQuantization(bounds));
+		vertices = &packed[0];
+	}
+	else if(format == FormatPackedPosNormalTexTan)
+	{
+		packed.resize((size_t)numVertices*sizeof(PackedVertexPosNormalTexTan));
+		VertexPacker::Pack((PackedVertexPosNormalTexTan*)&packed[0], (const MeshVertexPosNormalTexTan*)vertices, numVertices,
+			VertexPacker::GetQuantization(bounds));
+		vertices = &packed[0];
+	}
+
+	UINT64 vertexBytes = (UINT64)numVertices*header.VertexStride;
+	UINT64 indexBytes = (UINT64)numIndices*sizeof(UINT);
+	UINT64 submeshBytes = (UINT64)table.size()*sizeof(MeshSubmesh);
+	UINT64 lodBytes = (UINT64)lodTable.size()*sizeof(MeshLod);
+	header.VertexOffset = AlignUp(sizeof(MeshHeader));
+	header.IndexOffset = header.VertexOffset + AlignUp(vertexBytes);
+	header.SubmeshOffset = header.IndexOffset + AlignUp(indexBytes);
+	header.LodOffset = header.SubmeshOffset + AlignUp(submeshBytes);
+
+	std::string tempPath = filename + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if(!file)
+		return false;
+
+	bool ok = WritePadded(file, &header, sizeof(header), header.VertexOffset) &&
+		WritePadded(file, vertices, vertexBytes, AlignUp(vertexBytes)) &&
+		WritePadded(file, indices, indexBytes, AlignUp(indexBytes)) &&
+		WritePadded(file, &table[0], submeshBytes, AlignUp(submeshBytes)) &&
+		WritePadded(file, &lodTable[0], lodBytes, lodBytes);
+	ok = fclose(file) == 0 && ok;
+
+	if(ok)
+	{
+		// rename() does not replace an existing file on Windows.
+		remove(filename.c_str());
+		ok = rename(tempPath.c_str(), filename.c_str()) == 0;
+	}
+
+	if(!ok)
+		remove(tempPath.c_str());
+	return ok;
+}
+
+bool MeshFile::ConvertObj(const std::string& objFilename, const std::string& filename, VertexFormat format)
+{
+	VertexFormat source = GetSourceFormat(format);
+	if(source != FormatBasic32 && source != FormatPosNormalTexTan)
+		return false;
+
+	ObjLoader loader;
+	GeometryGenerator::MeshData mesh;
+	if(!loader.Load(objFilename, mesh) || mesh.Vertices.empty())
+		return false;
+
+	UINT stride = GetVertexStride(source);
+	std::vector<unsigned char> vertices;
+	if(source == FormatPosNormalTexTan)
+	{
+		std::vector<MeshVertexPosNormalTexTan> tanVertices(mesh.Vertices.size());
+		for(size_t i = 0; i < mesh.Vertices.size(); ++i)
+		{
+			tanVertices[i].Pos = mesh.Vertices[i].Position;
+			tanVertices[i].Normal = mesh.Vertices[i].Normal;
+			tanVertices[i].Tex = mesh.Vertices[i].TexC;
+			tanVertices[i].TexNum = 0;
+			tanVertices[i].TangentU = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		}
+
+		// Splits vertices where the texture is mirrored and marks their handedness.
+		TangentGenerator::Generate(tanVertices, mesh.Indices);
+
+		const unsigned char* first = (const unsigned char*)&tanVertices[0];
+		vertices.assign(first, first + tanVertices.size()*stride);
+	}
+	else
+	{
+		vertices.resize(mesh.Vertices.size()*stride);
+		MeshVertexBasic32* v = (MeshVertexBasic32*)&vertices[0];
+		for(size_t i = 0; i < mesh.Vertices.size(); ++i)
+		{
+			v[i].Pos = mesh.Vertices[i].Position;
+			v[i].Normal = mesh.Vertices[i].Normal;
+			v[i].Tex = XMFLOAT2(0.0f, 0.0f);
+			v[i].TexNum = 0;
+		}
+	}
+
+	UINT numVertices = (UINT)(vertices.size() / stride);
+	std::vector<MeshLod> lods;
+	if(!mesh.Indices.empty())
+	{
+		MeshOptimizer::OptimizeMesh(&vertices[0], stride, numVertices,
+			&mesh.Indices[0], (UINT)mesh.Indices.size(), 0, 0);
+		MeshSimplifier::BuildLodChain(mesh.Indices, (UINT)mesh.Indices.size(), &vertices[0], stride,
+			numVertices, MeshSimplifier::DefaultMaxLods, lods);
+	}
+
+	return Write(filename, format, &vertices[0], numVertices,
+		mesh.Indices.empty() ? 0 : &mesh.Indices[0], (UINT)mesh.Indices.size(), 0, 0,
+		lods.empty() ? 0 : &lods[0], (UINT)lods.size());
+}
+
+bool MeshFile::IsStale(const std::string& filename, const std::string& sourceFilename)
+{
+	struct stat converted, source;
+	if(stat(filename.c_str(), &converted) != 0)
+		return true;
+
+	// Files from an older converter are redone whatever their age.
+	MeshHeader header;
+	FILE* file = fopen(filename.c_str(), "rb");
+	bool current = file && fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.Magic, MeshMagic, sizeof(MeshMagic)) == 0 && header.Version == MeshVersion;
+	if(file)
+		fclose(file);
+	if(!current)
+		return true;
+
+	// With the source gone, the converted file is all there is.
+	return stat(sourceFilename.c_str(), &source) == 0 && source.st_mtime > converted.st_mtime;
+}
@@ -0,0 +1,160 @@
+//***************************************************************************************
+// MeshFile.h
+//
+// Binary mesh container loaded by memory mapping, with nothing to parse: a header, the
+// vertex stream in the exact layout of a Vertex struct (Basic32, PosNormalTexTan or
+// one of their packed forms from VertexPacker), 32-bit indices, a submesh table and a
+// LOD table, each starting on a 16-byte boundary.  Vertex and index
+// buffers are created straight from the mapping, and bounds come from the header
+// rather than a pass over the positions.
+//
+// Models are converted offline, or on the first run after their source changes, from
+// OBJ with ConvertObj and from anything else (the FBX importer) with Write.
+//***************************************************************************************
+
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include "MappedFile.h"
+#include "xnacollision.h"
+#include <string>
+
+struct VertexQuantization;
+
+// A vertex's TexNum is its material in the low bits, with TexNumMirrored set where
+// TangentGenerator found the texture mirrored: the bitangent is then
+// -cross(normal, tangent) rather than cross(normal, tangent).
+const int TexNumMirrored = 0x8000;
+const int TexNumMaterial = 0x7fff;
+
+// Vertex::Basic32 and Vertex::PosNormalTexTan, byte for byte; Vertex.cpp checks that
+// the two stay in step.
+struct MeshVertexBasic32
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT2 Tex;
+	int TexNum;
+};
+
+struct MeshVertexPosNormalTexTan
+{
+	XMFLOAT3 Pos;
+	XMFLOAT3 Normal;
+	XMFLOAT2 Tex;
+	int TexNum;
+	XMFLOAT3 TangentU;
+};
+
+struct MeshSubmesh
+{
+	UINT FirstIndex;
+	UINT NumIndices;
+
+	// The range of vertices the indices use, and their bounds; filled in by Write.
+	UINT FirstVertex;
+	UINT NumVertices;
+	XMFLOAT3 BoundsCenter;
+	XMFLOAT3 BoundsExtents;
+
+	// Texture or material slot, as the importer numbers them.
+	UINT Material;
+};
+
+// A level of detail: the range of the index stream to draw instead of LOD 0, and how
+// far (in the mesh's units) its surface may lie from the original.
+struct MeshLod
+{
+	UINT FirstIndex;
+	UINT NumIndices;
+	float Error;
+};
+
+class MeshFile
+{
+public:
+	enum VertexFormat
+	{
+		FormatBasic32 = 0,
+		FormatPosNormalTexTan = 1,
+
+		// VertexPacker's layouts, quantized to the bounds in the header.
+		FormatPackedBasic = 2,
+		FormatPackedPosNormalTexTan = 3
+	};
+
+	MeshFile();
+
+	bool Open(const std::string& filename);
+	void Close();
+	bool IsOpen()const { return mFile.IsOpen(); }
+
+	VertexFormat GetVertexFormat()const { return mFormat; }
+	UINT GetVertexStride()const { return GetVertexStride(mFormat); }
+	UINT GetNumVertices()const { return mNumVertices; }
+	UINT GetNumIndices()const { return mNumIndices; }
+	UINT GetNumSubmeshes()const { return mNumSubmeshes; }
+	UINT GetNumLods()const { return mNumLods; }
+
+	// Into the mapping; valid until Close.
+	const void* GetVertices()const { return mVertices; }
+	const UINT* GetIndices()const { return mIndices; }
+	const MeshSubmesh* GetSubmeshes()const { return mSubmeshes; }
+
+	// At least one; LOD 0 is the full mesh the submeshes describe, and the coarser
+	// levels follow it in the index stream.
+	const MeshLod* GetLods()const { return mLods; }
+
+	// Decoded, for the packed formats.
+	XMFLOAT3 GetPosition(UINT vertex)const;
+
+	// Of every vertex, as XNA::ComputeBoundingAxisAlignedBoxFromPoints gives it; for
+	// the packed formats, of the vertices before packing.
+	XNA::AxisAlignedBox GetBounds()const { return mBounds; }
+
+	// What decodes the positions of the packed formats.
+	VertexQuantization GetQuantization()const;
+
+	static UINT GetVertexStride(VertexFormat format);
+
+	// The unpacked format a packed one is written from; the others are their own.
+	static VertexFormat GetSourceFormat(VertexFormat format);
+
+	static bool IsPacked(VertexFormat format) { return GetSourceFormat(format) != format; }
+
+	// vertices are in GetSourceFormat(format), and packed on the way out.  submeshes
+	// need only FirstIndex, NumIndices and Material; the rest is computed.  With none,
+	// the file gets one submesh of every index of LOD 0.  With no lods, LOD 0 is every
+	// index.  Fails on indices past numVertices or ranges past the indices.
+	static bool Write(const std::string& filename, VertexFormat format, const void* vertices, UINT numVertices,
+		const UINT* indices, UINT numIndices, const MeshSubmesh* submeshes, UINT numSubmeshes,
+		const MeshLod* lods = 0, UINT numLods = 0);
+
+	// An OBJ read with ObjLoader, reordered by MeshOptimizer, with a LOD chain from
+	// MeshSimplifier.  Basic32 vertices get zero texture coordinates; PosNormalTexTan
+	// ones keep the file's, with tangents from TangentGenerator.  Either may be packed.
+	static bool ConvertObj(const std::string& objFilename, const std::string& filename,
+		VertexFormat format = FormatBasic32);
+
+	// Whether filename is missing, older than sourceFilename or from an older version
+	// of the format, and so needs converting.
+	static bool IsStale(const std::string& filename, const std::string& sourceFilename);
+
+private:
+	MeshFile(const MeshFile& rhs);
+	MeshFile& operator=(const MeshFile& rhs);
+
+	MappedFile mFile;
+	VertexFormat mFormat;
+	UINT mNumVertices;
+	UINT mNumIndices;
+	UINT mNumSubmeshes;
+	UINT mNumLods;
+	const void* mVertices;
+	const UINT* mIndices;
+	const MeshSubmesh* mSubmeshes;
+	const MeshLod* mLods;
+	XNA::AxisAlignedBox mBounds;
+};
+
+#endif // MESHFILE_H
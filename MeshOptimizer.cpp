@@ -0,0 +1,385 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// For each vertex, the triangles using it: Triangles[Offsets[v]] to
+	// Triangles[Offsets[v+1]].
+	struct Adjacency
+	{
+		std::vector<UINT> Offsets;
+		std::vector<UINT> Triangles;
+	};
+
+	void BuildAdjacency(const UINT* indices, UINT numIndices, UINT numVertices, Adjacency& adjacency)
+	{
+		std::vector<UINT>& offsets = adjacency.Offsets;
+		offsets.assign(numVertices + 1, 0);
+		for(UINT i = 0; i < numIndices; ++i)
+			++offsets[indices[i] + 1];
+		for(UINT v = 0; v < numVertices; ++v)
+			offsets[v + 1] += offsets[v];
+
+		std::vector<UINT> fill(offsets.begin(), offsets.end() - 1);
+		adjacency.Triangles.resize(numIndices);
+		for(UINT i = 0; i < numIndices; ++i)
+			adjacency.Triangles[fill[indices[i]]++] = i / 3;
+	}
+
+	// FIFO cache by timestamps: a vertex is cached if it was last loaded less than
+	// cacheSize loads ago.
+	class CacheSimulator
+	{
+	public:
+		CacheSimulator(UINT numVertices, UINT cacheSize) :
+			mStamps(numVertices, 0), mCacheSize(cacheSize), mTime(cacheSize + 1) {}
+
+		// Starts over with an empty cache.
+		void Flush() { mTime += mCacheSize + 1; }
+
+		// Whether v missed, and was loaded.
+		bool Touch(UINT v)
+		{
+			if(mTime - mStamps[v] > mCacheSize)
+			{
+				mStamps[v] = mTime++;
+				return true;
+			}
+			return false;
+		}
+
+	private:
+		std::vector<UINT> mStamps;
+		UINT mCacheSize;
+		UINT mTime;
+	};
+
+	UINT CountMisses(CacheSimulator& cache, const UINT* indices, UINT first, UINT end)
+	{
+		UINT misses = 0;
+		for(UINT i = first; i < end; ++i)
+			misses += cache.Touch(indices[i]);
+		return misses;
+	}
+
+	// Subdivides each cluster where its ACMR so far is within threshold of the whole
+	// cluster's; returns the new cluster starts, in triangles.
+	void SplitClusters(const UINT* indices, UINT numTriangles, UINT numVertices, const std::vector<UINT>& clusters,
+		UINT cacheSize, float threshold, std::vector<UINT>& split)
+	{
+		CacheSimulator cache(numVertices, cacheSize);
+		split.clear();
+		for(size_t c = 0; c < clusters.size(); ++c)
+		{
+			UINT first = clusters[c];
+			UINT end = c + 1 < clusters.size() ? clusters[c + 1] : numTriangles;
+
+			cache.Flush();
+			float clusterACMR = (float)CountMisses(cache, indices, first*3, end*3) / (end - first);
+
+			cache.Flush();
+			split.push_back(first);
+			UINT start = first;
+			UINT misses = 0;
+			for(UINT t = first; t < end; ++t)
+			{
+				misses += CountMisses(cache, indices, t*3, t*3 + 3);
+				if(t + 1 < end && (float)misses / (t + 1 - start) <= clusterACMR*threshold)
+				{
+					cache.Flush();
+					split.push_back(t + 1);
+					start = t + 1;
+					misses = 0;
+				}
+			}
+
+			// A tail that never got down to the threshold stays with the piece before it.
+			if(start > first && (float)misses / (end - start) > clusterACMR*threshold)
+				split.pop_back();
+		}
+	}
+
+	struct ClusterKey
+	{
+		float Key;
+		UINT First;
+		UINT End;
+
+		bool operator<(const ClusterKey& rhs)const { return Key > rhs.Key; }
+	};
+
+	inline XMVECTOR LoadPosition(const unsigned char* vertices, UINT stride, UINT v)
+	{
+		return XMLoadFloat3((const XMFLOAT3*)(vertices + (size_t)v*stride));
+	}
+
+	void ReorderTriangles(UINT* indices, UINT numIndices, UINT numVertices, UINT cacheSize,
+		const void* vertices, UINT stride)
+	{
+		std::vector<UINT> tipsified(numIndices);
+		std::vector<UINT> clusters;
+		MeshOptimizer::OptimizeVertexCache(&tipsified[0], indices, numIndices, numVertices, cacheSize, &clusters);
+		MeshOptimizer::OptimizeOverdraw(indices, &tipsified[0], numIndices, vertices, stride, numVertices, clusters, cacheSize);
+	}
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const UINT* indices, UINT numIndices, UINT numVertices, UINT cacheSize)
+{
+	VertexCacheStats stats = { 0.0f, 0.0f };
+	if(numIndices < 3)
+		return stats;
+
+	CacheSimulator cache(numVertices, cacheSize);
+	UINT misses = CountMisses(cache, indices, 0, numIndices);
+
+	std::vector<bool> used(numVertices, false);
+	UINT numUsed = 0;
+	for(UINT i = 0; i < numIndices; ++i)
+	{
+		if(!used[indices[i]])
+		{
+			used[indices[i]] = true;
+			++numUsed;
+		}
+	}
+
+	stats.ACMR = (float)misses / (numIndices / 3);
+	stats.ATVR = (float)misses / numUsed;
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(UINT* destination, const UINT* indices, UINT numIndices, UINT numVertices,
+	UINT cacheSize, std::vector<UINT>* clusters)
+{
+	UINT numTriangles = numIndices / 3;
+	if(clusters)
+		clusters->clear();
+	if(numTriangles == 0)
+		return;
+
+	Adjacency adjacency;
+	BuildAdjacency(indices, numTriangles*3, numVertices, adjacency);
+
+	// Live triangles per vertex, cache timestamps and the dead-end stack.
+	std::vector<UINT> live(numVertices);
+	for(UINT v = 0; v < numVertices; ++v)
+		live[v] = adjacency.Offsets[v + 1] - adjacency.Offsets[v];
+
+	std::vector<UINT> stamps(numVertices, 0);
+	std::vector<bool> emitted(numTriangles, false);
+	std::vector<UINT> deadEnd;
+	std::vector<UINT> candidates;
+
+	UINT time = cacheSize + 1;
+	UINT cursor = 0;
+	UINT out = 0;
+	bool restart = true;
+
+	int fan = 0;
+	while(fan >= 0)
+	{
+		candidates.clear();
+		for(UINT a = adjacency.Offsets[fan]; a < adjacency.Offsets[fan + 1]; ++a)
+		{
+			UINT t = adjacency.Triangles[a];
+			if(emitted[t])
+				continue;
+
+			if(restart && clusters)
+				clusters->push_back(out / 3);
+			restart = false;
+
+			for(UINT k = 0; k < 3; ++k)
+			{
+				UINT v = indices[t*3 + k];
+				destination[out++] = v;
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if(time - stamps[v] > cacheSize)
+					stamps[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// The candidate that stays in the cache after its remaining triangles are
+		// emitted and has been there longest; failing that, a dead end.
+		int next = -1;
+		int best = -1;
+		for(size_t c = 0; c < candidates.size(); ++c)
+		{
+			UINT v = candidates[c];
+			if(live[v] == 0)
+				continue;
+
+			int priority = 0;
+			if(time - stamps[v] + 2*live[v] <= cacheSize)
+				priority = (int)(time - stamps[v]);
+			if(priority > best)
+			{
+				best = priority;
+				next = (int)v;
+			}
+		}
+
+		if(next < 0)
+		{
+			while(!deadEnd.empty() && next < 0)
+			{
+				UINT v = deadEnd.back();
+				deadEnd.pop_back();
+				if(live[v] > 0)
+					next = (int)v;
+			}
+
+			// Nothing recent is left; continue from the next vertex in order, with
+			// what is effectively a cold cache.
+			while(next < 0 && cursor < numVertices)
+			{
+				if(live[cursor] > 0)
+				{
+					next = (int)cursor;
+					restart = true;
+				}
+				++cursor;
+			}
+		}
+
+		fan = next;
+	}
+}
+
+void MeshOptimizer::OptimizeOverdraw(UINT* destination, const UINT* indices, UINT numIndices,
+	const void* vertices, UINT stride, UINT numVertices, const std::vector<UINT>& clusters,
+	UINT cacheSize, float threshold)
+{
+	UINT numTriangles = numIndices / 3;
+	if(numTriangles == 0)
+		return;
+
+	std::vector<UINT> split;
+	SplitClusters(indices, numTriangles, numVertices, clusters.empty() ? std::vector<UINT>(1, 0) : clusters,
+		cacheSize, threshold, split);
+
+	// Area weighted centroid and normal of each cluster, and of the mesh.
+	const unsigned char* verts = (const unsigned char*)vertices;
+	std::vector<ClusterKey> keys(split.size());
+	std::vector<XMFLOAT3> centroids(split.size());
+	std::vector<XMFLOAT3> normals(split.size());
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0.0f;
+	for(size_t c = 0; c < split.size(); ++c)
+	{
+		keys[c].First = split[c];
+		keys[c].End = c + 1 < split.size() ? split[c + 1] : numTriangles;
+
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+		for(UINT t = keys[c].First; t < keys[c].End; ++t)
+		{
+			XMVECTOR p0 = LoadPosition(verts, stride, indices[t*3 + 0]);
+			XMVECTOR p1 = LoadPosition(verts, stride, indices[t*3 + 1]);
+			XMVECTOR p2 = LoadPosition(verts, stride, indices[t*3 + 2]);
+
+			// Twice the area, along the face normal.
+			XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+			float a = XMVectorGetX(XMVector3Length(n));
+
+			centroid += (p0 + p1 + p2)*(a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+		XMStoreFloat3(&centroids[c], area > 0.0f ? centroid / area : centroid);
+		XMStoreFloat3(&normals[c], XMVector3Normalize(normal));
+	}
+
+	if(meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// How far out along its own normal a cluster faces; the outermost go first.
+	for(size_t c = 0; c < keys.size(); ++c)
+	{
+		XMVECTOR offset = XMLoadFloat3(&centroids[c]) - meshCentroid;
+		keys[c].Key = XMVectorGetX(XMVector3Dot(offset, XMLoadFloat3(&normals[c])));
+	}
+	std::stable_sort(keys.begin(), keys.end());
+
+	UINT out = 0;
+	for(size_t c = 0; c < keys.size(); ++c)
+	{
+		UINT count = (keys[c].End - keys[c].First)*3;
+		memcpy(destination + out, indices + keys[c].First*3, count*sizeof(UINT));
+		out += count;
+	}
+}
+
+UINT MeshOptimizer::OptimizeVertexFetch(void* destination, UINT* indices, UINT numIndices,
+	const void* vertices, UINT stride, UINT numVertices)
+{
+	const UINT Unused = 0xffffffff;
+	std::vector<UINT> remap(numVertices, Unused);
+
+	UINT next = 0;
+	for(UINT i = 0; i < numIndices; ++i)
+	{
+		UINT& index = remap[indices[i]];
+		if(index == Unused)
+		{
+			index = next++;
+			memcpy((unsigned char*)destination + (size_t)index*stride,
+				(const unsigned char*)vertices + (size_t)indices[i]*stride, stride);
+		}
+		indices[i] = index;
+	}
+
+	return next;
+}
+
+void MeshOptimizer::OptimizeMesh(void* vertices, UINT stride, UINT& numVertices, UINT* indices, UINT numIndices,
+	const MeshSubmesh* submeshes, UINT numSubmeshes, VertexCacheStats* before, VertexCacheStats* after)
+{
+	if(before)
+		*before = AnalyzeVertexCache(indices, numIndices, numVertices);
+
+	if(numSubmeshes == 0)
+	{
+		ReorderTriangles(indices, numIndices, numVertices, DefaultCacheSize, vertices, stride);
+	}
+	else
+	{
+		for(UINT s = 0; s < numSubmeshes; ++s)
+		{
+			const MeshSubmesh& submesh = submeshes[s];
+			if(submesh.FirstIndex < numIndices && submesh.NumIndices <= numIndices - submesh.FirstIndex)
+				ReorderTriangles(indices + submesh.FirstIndex, submesh.NumIndices, numVertices, DefaultCacheSize, vertices, stride);
+		}
+	}
+
+	std::vector<unsigned char> fetched((size_t)numVertices*stride);
+	numVertices = OptimizeVertexFetch(fetched.empty() ? 0 : &fetched[0], indices, numIndices, vertices, stride, numVertices);
+	if(numVertices > 0)
+		memcpy(vertices, &fetched[0], (size_t)numVertices*stride);
+
+	if(after)
+		*after = AnalyzeVertexCache(indices, numIndices, numVertices);
+}
+
+void MeshOptimizer::OptimizeMesh(GeometryGenerator::MeshData& mesh, VertexCacheStats* before, VertexCacheStats* after)
+{
+	if(mesh.Vertices.empty() || mesh.Indices.empty())
+		return;
+
+	UINT numVertices = (UINT)mesh.Vertices.size();
+	OptimizeMesh(&mesh.Vertices[0], sizeof(GeometryGenerator::Vertex), numVertices,
+		&mesh.Indices[0], (UINT)mesh.Indices.size(), 0, 0, before, after);
+	mesh.Vertices.resize(numVertices);
+}
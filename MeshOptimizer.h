@@ -0,0 +1,81 @@
+//***************************************************************************************
+// MeshOptimizer.h
+//
+// Reorders indexed triangle lists for the GPU, once, when a mesh is converted or
+// loaded:
+//
+//   1. Tipsify (Sander, Nehab and Barczak 2007) orders triangles for the post-transform
+//      vertex cache.
+//   2. The result is split into clusters wherever the cache starts over, and again
+//      wherever a cluster's cache efficiency is already within a threshold, and the
+//      clusters are sorted outermost first so nearer surfaces tend to be drawn before
+//      the ones they hide.
+//   3. Vertices are renumbered in the order the indices first use them, and unused
+//      ones dropped, so vertex fetch walks the buffer forwards.
+//
+// Cache figures are for a FIFO of the given size: ACMR is transformed vertices per
+// triangle, ATVR transformed vertices per vertex used, 1.0 at best.
+//***************************************************************************************
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "GeometryGenerator.h"
+#include "MeshFile.h"
+#include <vector>
+
+struct VertexCacheStats
+{
+	float ACMR;
+	float ATVR;
+};
+
+class MeshOptimizer
+{
+public:
+	// A conservative size for the post-transform cache of D3D11 class hardware.
+	static const UINT DefaultCacheSize = 16;
+
+	static VertexCacheStats AnalyzeVertexCache(const UINT* indices, UINT numIndices, UINT numVertices,
+		UINT cacheSize = DefaultCacheSize);
+
+	///<summary>
+	/// Tipsify into destination, which must not alias indices.  If clusters is given it
+	/// receives the first triangle of each run that begins with an empty cache, the
+	/// first being triangle 0.
+	///</summary>
+	static void OptimizeVertexCache(UINT* destination, const UINT* indices, UINT numIndices, UINT numVertices,
+		UINT cacheSize = DefaultCacheSize, std::vector<UINT>* clusters = 0);
+
+	///<summary>
+	/// Sorts the clusters of a vertex cache optimized list (as OptimizeVertexCache gave
+	/// them) into destination, which must not alias indices.  Clusters are first split
+	/// wherever the running ACMR falls to threshold times the whole cluster's, so a
+	/// threshold of 1.05 gives up at most about 5% of the cache efficiency.  Each vertex
+	/// starts with its position.
+	///</summary>
+	static void OptimizeOverdraw(UINT* destination, const UINT* indices, UINT numIndices,
+		const void* vertices, UINT stride, UINT numVertices, const std::vector<UINT>& clusters,
+		UINT cacheSize = DefaultCacheSize, float threshold = 1.05f);
+
+	///<summary>
+	/// Copies vertices into destination in the order the indices first use them,
+	/// renumbers the indices in place and returns how many vertices were used.
+	/// destination must not alias vertices.
+	///</summary>
+	static UINT OptimizeVertexFetch(void* destination, UINT* indices, UINT numIndices,
+		const void* vertices, UINT stride, UINT numVertices);
+
+	///<summary>
+	/// All three passes in place.  Triangles are reordered only within each submesh
+	/// (the whole list if there are none), so submesh index ranges stay valid; their
+	/// vertex ranges are left for MeshFile::Write to recompute.  numVertices drops to
+	/// the number used.  before and after, if given, receive the cache figures.
+	///</summary>
+	static void OptimizeMesh(void* vertices, UINT stride, UINT& numVertices, UINT* indices, UINT numIndices,
+		const MeshSubmesh* submeshes, UINT numSubmeshes, VertexCacheStats* before = 0, VertexCacheStats* after = 0);
+
+	static void OptimizeMesh(GeometryGenerator::MeshData& mesh, VertexCacheStats* before = 0, VertexCacheStats* after = 0);
+};
+
+#endif // MESHOPTIMIZER_H
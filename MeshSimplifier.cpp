@@ -0,0 +1,520 @@
+//***************************************************************************************
+// MeshSimplifier.cpp
+//***************************************************************************************
+
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Border planes count this much more than the same area of surface, so outlines
+	// go last.
+	const double BorderWeight = 10.0;
+
+	// A level must save at least this fraction of the triangles of the one before.
+	const float MinLodReduction = 0.1f;
+
+	// Symmetric 3x3 A, vector b and constant c of sum w*(n.p + d)^2, and the sum of w.
+	struct Quadric
+	{
+		double A00, A01, A02, A11, A12, A22;
+		double B0, B1, B2;
+		double C;
+		double W;
+	};
+
+	void AddPlane(Quadric& q, double nx, double ny, double nz, double d, double w)
+	{
+		q.A00 += w*nx*nx; q.A01 += w*nx*ny; q.A02 += w*nx*nz;
+		q.A11 += w*ny*ny; q.A12 += w*ny*nz; q.A22 += w*nz*nz;
+		q.B0 += w*nx*d; q.B1 += w*ny*d; q.B2 += w*nz*d;
+		q.C += w*d*d;
+		q.W += w;
+	}
+
+	void Accumulate(Quadric& q, const Quadric& r)
+	{
+		q.A00 += r.A00; q.A01 += r.A01; q.A02 += r.A02;
+		q.A11 += r.A11; q.A12 += r.A12; q.A22 += r.A22;
+		q.B0 += r.B0; q.B1 += r.B1; q.B2 += r.B2;
+		q.C += r.C;
+		q.W += r.W;
+	}
+
+	// Mean squared distance to the planes.
+	double Evaluate(const Quadric& q, const XMFLOAT3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double e = q.A00*x*x + q.A11*y*y + q.A22*z*z +
+			2.0*(q.A01*x*y + q.A02*x*z + q.A12*y*z) +
+			2.0*(q.B0*x + q.B1*y + q.B2*z) + q.C;
+		return q.W > 0.0 ? MathHelper::Max(e, 0.0) / q.W : 0.0;
+	}
+
+	struct Vec3
+	{
+		double X, Y, Z;
+	};
+
+	Vec3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		Vec3 r = { (double)a.x - b.x, (double)a.y - b.y, (double)a.z - b.z };
+		return r;
+	}
+
+	Vec3 Cross(const Vec3& a, const Vec3& b)
+	{
+		Vec3 r = { a.Y*b.Z - a.Z*b.Y, a.Z*b.X - a.X*b.Z, a.X*b.Y - a.Y*b.X };
+		return r;
+	}
+
+	double Dot(const Vec3& a, const Vec3& b)
+	{
+		return a.X*b.X + a.Y*b.Y + a.Z*b.Z;
+	}
+
+	UINT64 EdgeKey(UINT a, UINT b)
+	{
+		return a < b ? ((UINT64)a << 32) | b : ((UINT64)b << 32) | a;
+	}
+
+	struct Collapse
+	{
+		UINT From;
+		UINT To;
+		double Cost;
+
+		bool operator<(const Collapse& rhs)const
+		{
+			return Cost < rhs.Cost || (Cost == rhs.Cost && (From < rhs.From || (From == rhs.From && To < rhs.To)));
+		}
+	};
+
+	class Simplifier
+	{
+	public:
+		Simplifier(const void* vertices, UINT stride, UINT numVertices) :
+			mVertices((const unsigned char*)vertices), mStride(stride), mNumVertices(numVertices) {}
+
+		const XMFLOAT3& Position(UINT v)const
+		{
+			return *(const XMFLOAT3*)(mVertices + (size_t)v*mStride);
+		}
+
+		UINT Run(std::vector<UINT>& indices, UINT targetNumIndices, float targetError, float& maxError);
+
+	private:
+		void FindCanonical(std::vector<UINT>& indices);
+		void BuildTopology(const std::vector<UINT>& indices);
+		void BuildQuadrics(const std::vector<UINT>& indices);
+		UINT CountEdge(UINT a, UINT b)const;
+		bool LinkConditionHolds(UINT v, UINT u);
+		bool RemovesVertex(UINT v, UINT u)const;
+		bool FlipsTriangle(UINT v, UINT u, const std::vector<UINT>& indices)const;
+
+	private:
+		const unsigned char* mVertices;
+		UINT mStride;
+		UINT mNumVertices;
+
+		// First vertex at each position, and whether vertices with other attributes
+		// share it.
+		std::vector<UINT> mCanonical;
+		std::vector<bool> mSeam;
+
+		// Per pass, in canonical vertices: sorted edge keys with how many triangles use
+		// each, and for each vertex the triangles around it.
+		std::vector<UINT64> mEdgeKeys;
+		std::vector<UINT> mEdgeCounts;
+		std::vector<UINT> mTriangleOffsets;
+		std::vector<UINT> mTriangles;
+		std::vector<UINT> mCanonicalIndices;
+
+		std::vector<Quadric> mQuadrics;
+		std::vector<UINT> mMark;
+		UINT mMarkStamp;
+	};
+
+	void Simplifier::FindCanonical(std::vector<UINT>& indices)
+	{
+		std::vector<UINT> used;
+		std::vector<bool> seen(mNumVertices, false);
+		for(size_t i = 0; i < indices.size(); ++i)
+		{
+			if(!seen[indices[i]])
+			{
+				seen[indices[i]] = true;
+				used.push_back(indices[i]);
+			}
+		}
+
+		// By position, then by the whole vertex, so identical vertices sit together
+		// inside each position's run.
+		struct ByPosition
+		{
+			const Simplifier* S;
+			bool operator()(UINT a, UINT b)const
+			{
+				int c = memcmp(&S->Position(a), &S->Position(b), sizeof(XMFLOAT3));
+				if(c == 0)
+					c = memcmp(S->mVertices + (size_t)a*S->mStride, S->mVertices + (size_t)b*S->mStride, S->mStride);
+				return c < 0 || (c == 0 && a < b);
+			}
+		};
+		ByPosition byPosition = { this };
+		std::sort(used.begin(), used.end(), byPosition);
+
+		std::vector<UINT> weld(mNumVertices);
+		mCanonical.resize(mNumVertices);
+		mSeam.assign(mNumVertices, false);
+		for(UINT v = 0; v < mNumVertices; ++v)
+			weld[v] = mCanonical[v] = v;
+
+		for(size_t i = 0; i < used.size(); )
+		{
+			size_t end = i + 1;
+			bool split = false;
+			while(end < used.size() && memcmp(&Position(used[i]), &Position(used[end]), sizeof(XMFLOAT3)) == 0)
+			{
+				if(memcmp(mVertices + (size_t)used[end - 1]*mStride, mVertices + (size_t)used[end]*mStride, mStride) == 0)
+					weld[used[end]] = weld[used[end - 1]];
+				else
+					split = true;
+				++end;
+			}
+
+			for(size_t k = i; k < end; ++k)
+			{
+				mCanonical[used[k]] = used[i];
+				mSeam[used[k]] = split;
+			}
+			i = end;
+		}
+
+		// Copies of one vertex are the same vertex, not a seam.
+		for(size_t i = 0; i < indices.size(); ++i)
+			indices[i] = weld[indices[i]];
+	}
+
+	void Simplifier::BuildTopology(const std::vector<UINT>& indices)
+	{
+		UINT numIndices = (UINT)indices.size();
+		mCanonicalIndices.resize(numIndices);
+		for(UINT i = 0; i < numIndices; ++i)
+			mCanonicalIndices[i] = mCanonical[indices[i]];
+
+		std::vector<UINT64> keys(numIndices);
+		for(UINT t = 0; t < numIndices; t += 3)
+		{
+			for(UINT k = 0; k < 3; ++k)
+				keys[t + k] = EdgeKey(mCanonicalIndices[t + k], mCanonicalIndices[t + (k + 1) % 3]);
+		}
+		std::sort(keys.begin(), keys.end());
+
+		mEdgeKeys.clear();
+		mEdgeCounts.clear();
+		for(size_t i = 0; i < keys.size(); ++i)
+		{
+			if(mEdgeKeys.empty() || mEdgeKeys.back() != keys[i])
+			{
+				mEdgeKeys.push_back(keys[i]);
+				mEdgeCounts.push_back(0);
+			}
+			++mEdgeCounts.back();
+		}
+
+		mTriangleOffsets.assign(mNumVertices + 1, 0);
+		for(UINT i = 0; i < numIndices; ++i)
+			++mTriangleOffsets[mCanonicalIndices[i] + 1];
+		for(UINT v = 0; v < mNumVertices; ++v)
+			mTriangleOffsets[v + 1] += mTriangleOffsets[v];
+
+		std::vector<UINT> fill(mTriangleOffsets.begin(), mTriangleOffsets.end() - 1);
+		mTriangles.resize(numIndices);
+		for(UINT i = 0; i < numIndices; ++i)
+			mTriangles[fill[mCanonicalIndices[i]]++] = i / 3;
+	}
+
+	void Simplifier::BuildQuadrics(const std::vector<UINT>& indices)
+	{
+		Quadric zero;
+		memset(&zero, 0, sizeof(zero));
+		mQuadrics.assign(mNumVertices, zero);
+
+		for(size_t t = 0; t < indices.size(); t += 3)
+		{
+			const XMFLOAT3& p0 = Position(indices[t]);
+			Vec3 n = Cross(Sub(Position(indices[t + 1]), p0), Sub(Position(indices[t + 2]), p0));
+			double length = sqrt(Dot(n, n));
+			if(length == 0.0)
+				continue;
+
+			n.X /= length; n.Y /= length; n.Z /= length;
+			double d = -(n.X*p0.x + n.Y*p0.y + n.Z*p0.z);
+			for(UINT k = 0; k < 3; ++k)
+				AddPlane(mQuadrics[indices[t + k]], n.X, n.Y, n.Z, d, 0.5*length);
+
+			// A plane through each open edge, at right angles to the triangle.
+			for(UINT k = 0; k < 3; ++k)
+			{
+				UINT a = indices[t + k];
+				UINT b = indices[t + (k + 1) % 3];
+				if(CountEdge(mCanonical[a], mCanonical[b]) != 1)
+					continue;
+
+				Vec3 edge = Sub(Position(b), Position(a));
+				Vec3 e = Cross(edge, n);
+				double edgeLength = sqrt(Dot(e, e));
+				if(edgeLength == 0.0)
+					continue;
+
+				e.X /= edgeLength; e.Y /= edgeLength; e.Z /= edgeLength;
+				const XMFLOAT3& pa = Position(a);
+				double ed = -(e.X*pa.x + e.Y*pa.y + e.Z*pa.z);
+				double w = BorderWeight*Dot(edge, edge);
+				AddPlane(mQuadrics[a], e.X, e.Y, e.Z, ed, w);
+				AddPlane(mQuadrics[b], e.X, e.Y, e.Z, ed, w);
+			}
+		}
+	}
+
+	UINT Simplifier::CountEdge(UINT a, UINT b)const
+	{
+		UINT64 key = EdgeKey(a, b);
+		std::vector<UINT64>::const_iterator it = std::lower_bound(mEdgeKeys.begin(), mEdgeKeys.end(), key);
+		return it != mEdgeKeys.end() && *it == key ? mEdgeCounts[it - mEdgeKeys.begin()] : 0;
+	}
+
+	// The vertices adjacent to both v and u must be just the ones opposite their shared
+	// edge; otherwise the collapse pinches the surface.
+	bool Simplifier::LinkConditionHolds(UINT v, UINT u)
+	{
+		++mMarkStamp;
+		for(UINT a = mTriangleOffsets[v]; a < mTriangleOffsets[v + 1]; ++a)
+		{
+			const UINT* tri = &mCanonicalIndices[mTriangles[a]*3];
+			for(UINT k = 0; k < 3; ++k)
+				mMark[tri[k]] = mMarkStamp;
+		}
+
+		UINT shared = 0;
+		++mMarkStamp;
+		for(UINT a = mTriangleOffsets[u]; a < mTriangleOffsets[u + 1]; ++a)
+		{
+			const UINT* tri = &mCanonicalIndices[mTriangles[a]*3];
+			for(UINT k = 0; k < 3; ++k)
+			{
+				UINT w = tri[k];
+				if(w != v && w != u && mMark[w] == mMarkStamp - 1)
+				{
+					mMark[w] = mMarkStamp;
+					++shared;
+				}
+			}
+		}
+
+		return shared == CountEdge(v, u);
+	}
+
+	// Whether a vertex opposite the edge has no triangles but the ones the collapse
+	// removes, so it would vanish without its quadric having a say.
+	bool Simplifier::RemovesVertex(UINT v, UINT u)const
+	{
+		for(UINT a = mTriangleOffsets[v]; a < mTriangleOffsets[v + 1]; ++a)
+		{
+			const UINT* tri = &mCanonicalIndices[mTriangles[a]*3];
+			if(tri[0] != u && tri[1] != u && tri[2] != u)
+				continue;
+
+			UINT w = tri[0] != v && tri[0] != u ? tri[0] : (tri[1] != v && tri[1] != u ? tri[1] : tri[2]);
+			UINT removed = 0;
+			for(UINT b = mTriangleOffsets[w]; b < mTriangleOffsets[w + 1]; ++b)
+			{
+				const UINT* other = &mCanonicalIndices[mTriangles[b]*3];
+				bool hasV = other[0] == v || other[1] == v || other[2] == v;
+				bool hasU = other[0] == u || other[1] == u || other[2] == u;
+				removed += hasV && hasU ? 1 : 0;
+			}
+			if(removed == mTriangleOffsets[w + 1] - mTriangleOffsets[w])
+				return true;
+		}
+		return false;
+	}
+
+	bool Simplifier::FlipsTriangle(UINT v, UINT u, const std::vector<UINT>& indices)const
+	{
+		const XMFLOAT3& target = Position(u);
+		for(UINT a = mTriangleOffsets[v]; a < mTriangleOffsets[v + 1]; ++a)
+		{
+			UINT t = mTriangles[a];
+			const UINT* tri = &mCanonicalIndices[t*3];
+			if(tri[0] == u || tri[1] == u || tri[2] == u)
+				continue;
+
+			XMFLOAT3 p[3], q[3];
+			for(UINT k = 0; k < 3; ++k)
+			{
+				p[k] = Position(indices[t*3 + k]);
+				q[k] = tri[k] == v ? target : p[k];
+			}
+
+			Vec3 before = Cross(Sub(p[1], p[0]), Sub(p[2], p[0]));
+			Vec3 after = Cross(Sub(q[1], q[0]), Sub(q[2], q[0]));
+			if(Dot(before, after) <= 0.0)
+				return true;
+		}
+		return false;
+	}
+
+	UINT Simplifier::Run(std::vector<UINT>& indices, UINT targetNumIndices, float targetError, float& maxError)
+	{
+		FindCanonical(indices);
+		BuildTopology(indices);
+		BuildQuadrics(indices);
+		mMark.assign(mNumVertices, 0);
+		mMarkStamp = 0;
+
+		std::vector<UINT> remap(mNumVertices);
+		std::vector<bool> locked(mNumVertices);
+		std::vector<Collapse> collapses;
+		double limit = (double)targetError*targetError;
+
+		while(indices.size() > targetNumIndices)
+		{
+			// Vertices touching an edge used more than twice stay put.
+			std::vector<bool> border(mNumVertices, false);
+			std::vector<bool> stuck(mNumVertices, false);
+			for(size_t e = 0; e < mEdgeKeys.size(); ++e)
+			{
+				UINT a = (UINT)(mEdgeKeys[e] >> 32);
+				UINT b = (UINT)(mEdgeKeys[e] & 0xffffffff);
+				if(mEdgeCounts[e] == 1)
+					border[a] = border[b] = true;
+				else if(mEdgeCounts[e] > 2)
+					stuck[a] = stuck[b] = true;
+			}
+
+			// Every collapse of a vertex that may move onto a neighbour, cheapest first;
+			// when one is refused below the vertex's next one may still go.
+			collapses.clear();
+			for(size_t t = 0; t < indices.size(); t += 3)
+			{
+				for(UINT k = 0; k < 6; ++k)
+				{
+					UINT v = indices[t + k % 3];
+					UINT u = indices[t + (k % 3 + 1 + k / 3) % 3];
+					if(mSeam[v] || stuck[v] || mCanonical[u] == v)
+						continue;
+					if(border[v] && CountEdge(v, mCanonical[u]) != 1)
+						continue;
+
+					Collapse c = { v, u, Evaluate(mQuadrics[v], Position(u)) };
+					if(c.Cost <= limit)
+						collapses.push_back(c);
+				}
+			}
+			std::sort(collapses.begin(), collapses.end());
+
+			// Each collapse locks the vertices around it for the rest of the pass, so
+			// the checks above stay true for the ones that follow.
+			for(UINT v = 0; v < mNumVertices; ++v)
+				remap[v] = v;
+			std::fill(locked.begin(), locked.end(), false);
+
+			UINT numIndices = (UINT)indices.size();
+			UINT numCollapsed = 0;
+			for(size_t c = 0; c < collapses.size() && numIndices > targetNumIndices; ++c)
+			{
+				UINT v = collapses[c].From;
+				UINT u = collapses[c].To;
+				UINT cu = mCanonical[u];
+				if(locked[v] || locked[cu] || !LinkConditionHolds(v, cu) || RemovesVertex(v, cu) || FlipsTriangle(v, cu, indices))
+					continue;
+
+				remap[v] = u;
+				Accumulate(mQuadrics[u], mQuadrics[v]);
+				maxError = MathHelper::Max(maxError, (float)sqrt(collapses[c].Cost));
+				numIndices -= 3*CountEdge(v, cu);
+				++numCollapsed;
+
+				locked[v] = locked[cu] = true;
+				for(UINT a = mTriangleOffsets[v]; a < mTriangleOffsets[v + 1]; ++a)
+				{
+					const UINT* tri = &mCanonicalIndices[mTriangles[a]*3];
+					for(UINT k = 0; k < 3; ++k)
+						locked[tri[k]] = true;
+				}
+			}
+
+			if(numCollapsed == 0)
+				break;
+
+			// Move the collapsed vertices and drop the triangles that lost their area.
+			UINT out = 0;
+			for(size_t t = 0; t < indices.size(); t += 3)
+			{
+				UINT a = remap[indices[t]];
+				UINT b = remap[indices[t + 1]];
+				UINT c = remap[indices[t + 2]];
+				UINT ca = mCanonical[a], cb = mCanonical[b], cc = mCanonical[c];
+				if(ca == cb || cb == cc || cc == ca)
+					continue;
+
+				indices[out++] = a;
+				indices[out++] = b;
+				indices[out++] = c;
+			}
+			indices.resize(out);
+			BuildTopology(indices);
+		}
+
+		return (UINT)indices.size();
+	}
+}
+
+UINT MeshSimplifier::Simplify(UINT* destination, const UINT* indices, UINT numIndices,
+	const void* vertices, UINT stride, UINT numVertices,
+	UINT targetNumIndices, float targetError, float* error)
+{
+	std::vector<UINT> result(indices, indices + numIndices / 3*3);
+	float maxError = 0.0f;
+
+	Simplifier simplifier(vertices, stride, numVertices);
+	UINT count = simplifier.Run(result, targetNumIndices, targetError, maxError);
+
+	if(count > 0)
+		memmove(destination, &result[0], count*sizeof(UINT));
+	if(error)
+		*error = maxError;
+	return count;
+}
+
+void MeshSimplifier::BuildLodChain(std::vector<UINT>& indices, UINT lod0NumIndices,
+	const void* vertices, UINT stride, UINT numVertices, UINT maxLods, std::vector<MeshLod>& lods)
+{
+	lods.clear();
+	MeshLod lod0 = { 0, lod0NumIndices, 0.0f };
+	lods.push_back(lod0);
+
+	std::vector<UINT> original(indices.begin(), indices.begin() + lod0NumIndices);
+	std::vector<UINT> simplified(lod0NumIndices);
+	UINT last = lod0NumIndices;
+	for(UINT level = 1; level < maxLods && last >= 6; ++level)
+	{
+		UINT target = last / 6*3;
+		float error = 0.0f;
+		UINT count = Simplify(&simplified[0], &original[0], lod0NumIndices, vertices, stride, numVertices,
+			target, MathHelper::Infinity, &error);
+		if(count == 0 || count > last - last*MinLodReduction)
+			break;
+
+		MeshLod lod = { (UINT)indices.size(), count, MathHelper::Max(error, lods.back().Error) };
+		indices.resize(indices.size() + count);
+		MeshOptimizer::OptimizeVertexCache(&indices[lod.FirstIndex], &simplified[0], count, numVertices);
+		lods.push_back(lod);
+		last = count;
+	}
+}
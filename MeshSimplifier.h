@@ -0,0 +1,50 @@
+//***************************************************************************************
+// MeshSimplifier.h
+//
+// Quadric error metric simplification (Garland and Heckbert 1997) by half-edge
+// collapse: a vertex moves onto a neighbour, so simplified index lists draw from the
+// original vertex buffer and a whole LOD chain shares one.  Each vertex accumulates
+// the planes of its triangles, weighted by area, and the collapse that moves a vertex
+// least far from them goes first.
+//
+// Vertices where attributes split (several vertices at one position, such as UV or
+// material seams) and non-manifold vertices are kept; open borders only collapse
+// along themselves, held in place by planes perpendicular to their triangles.
+// Collapses that would fold a triangle over or pinch the surface are skipped.
+//***************************************************************************************
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include "MeshFile.h"
+#include <vector>
+
+class MeshSimplifier
+{
+public:
+	// Levels in a chain the converters build, LOD 0 included.
+	static const UINT DefaultMaxLods = 4;
+
+	///<summary>
+	/// Simplifies toward targetNumIndices without any collapse moving a vertex further
+	/// than targetError (in the mesh's units) from the original surface, and writes the
+	/// result to destination, which may alias indices.  Returns the number of indices
+	/// written; error, if given, receives the largest distance moved.  Each vertex
+	/// starts with its position.
+	///</summary>
+	static UINT Simplify(UINT* destination, const UINT* indices, UINT numIndices,
+		const void* vertices, UINT stride, UINT numVertices,
+		UINT targetNumIndices, float targetError, float* error = 0);
+
+	///<summary>
+	/// Appends up to maxLods - 1 coarser versions of the first lod0NumIndices indices,
+	/// each about half the triangles of the last and simplified from the original, and
+	/// each ordered for the vertex cache.  lods gets LOD 0 (those first indices, with
+	/// no error) and one entry per level appended.  The chain stops early when a level
+	/// would save less than a tenth of the triangles.
+	///</summary>
+	static void BuildLodChain(std::vector<UINT>& indices, UINT lod0NumIndices,
+		const void* vertices, UINT stride, UINT numVertices, UINT maxLods, std::vector<MeshLod>& lods);
+};
+
+#endif // MESHSIMPLIFIER_H
@@ -0,0 +1,80 @@
+//***************************************************************************************
+// MeshWelder.cpp
+//***************************************************************************************
+
+#include "MeshWelder.h"
+#include <cstring>
+
+namespace
+{
+	UINT HashVertex(const WeldVertex& v)
+	{
+		// FNV-1a over the words of the vertex.
+		UINT words[sizeof(WeldVertex) / 4];
+		memcpy(words, &v, sizeof(words));
+
+		UINT h = 2166136261u;
+		for(UINT i = 0; i < sizeof(words) / 4; ++i)
+			h = (h ^ words[i])*16777619u;
+		return h ^ (h >> 16);
+	}
+}
+
+void MeshWelder::Weld(const WeldVertex* corners, const int* polygonSizes, UINT numPolygons,
+	std::vector<WeldVertex>& vertices, std::vector<UINT>& indices)
+{
+	vertices.clear();
+	indices.clear();
+
+	size_t numCorners = 0;
+	for(UINT i = 0; i < numPolygons; ++i)
+		numCorners += polygonSizes[i];
+
+	// Open addressed, at most half full.
+	UINT capacity = 16;
+	while(capacity < 2*numCorners)
+		capacity *= 2;
+
+	const UINT Empty = 0xffffffff;
+	std::vector<UINT> table(capacity, Empty);
+	std::vector<UINT> remap(numCorners);
+
+	for(size_t c = 0; c < numCorners; ++c)
+	{
+		const WeldVertex& v = corners[c];
+		UINT slot = HashVertex(v) & (capacity - 1);
+		for(;;)
+		{
+			UINT index = table[slot];
+			if(index == Empty)
+			{
+				index = (UINT)vertices.size();
+				table[slot] = index;
+				vertices.push_back(v);
+				remap[c] = index;
+				break;
+			}
+
+			if(memcmp(&vertices[index], &v, sizeof(WeldVertex)) == 0)
+			{
+				remap[c] = index;
+				break;
+			}
+
+			slot = (slot + 1) & (capacity - 1);
+		}
+	}
+
+	// Fan around each polygon's first corner.
+	size_t first = 0;
+	for(UINT i = 0; i < numPolygons; ++i)
+	{
+		for(int j = 1; j + 1 < polygonSizes[i]; ++j)
+		{
+			indices.push_back(remap[first]);
+			indices.push_back(remap[first + j]);
+			indices.push_back(remap[first + j + 1]);
+		}
+		first += polygonSizes[i];
+	}
+}
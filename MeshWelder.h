@@ -0,0 +1,36 @@
+//***************************************************************************************
+// MeshWelder.h
+//
+// Turns polygons given corner by corner, with attributes per polygon vertex as FBX and
+// most DCC formats store them, into an indexed triangle list.  Corners identical in
+// every attribute share one vertex, in the order they first appear, and polygons are
+// fanned into triangles.
+//***************************************************************************************
+
+#ifndef MESHWELDER_H
+#define MESHWELDER_H
+
+#include "MathHelper.h"
+#include <vector>
+
+struct WeldVertex
+{
+	XMFLOAT3 Position;
+	XMFLOAT3 Normal;
+	XMFLOAT2 TexC;
+	int Material;
+};
+
+class MeshWelder
+{
+public:
+	///<summary>
+	/// corners holds every polygon's corners in turn, polygonSizes how many each has.
+	/// Corners are compared bit for bit, so -0 and 0 stay apart.  Polygons of fewer
+	/// than three corners are skipped; vertices and indices are replaced.
+	///</summary>
+	static void Weld(const WeldVertex* corners, const int* polygonSizes, UINT numPolygons,
+		std::vector<WeldVertex>& vertices, std::vector<UINT>& indices);
+};
+
+#endif // MESHWELDER_H
@@ -0,0 +1,425 @@
+//***************************************************************************************
+// ObjLoader.cpp
+//***************************************************************************************
+
+#include "ObjLoader.h"
+#include "ParallelFor.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	// Below this a file is not worth splitting.
+	const size_t MinChunkBytes = 256*1024;
+
+	// Exactly representable as doubles.
+	const double Pow10[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	// 1-based element numbers; 0 where the corner has no vt or vn.
+	struct Corner
+	{
+		int V;
+		int T;
+		int N;
+	};
+
+	struct Chunk
+	{
+		std::vector<XMFLOAT3> Positions;
+		std::vector<XMFLOAT2> TexCoords;
+		std::vector<XMFLOAT3> Normals;
+
+		// Three per triangle.
+		std::vector<Corner> Corners;
+
+		// Corners with a field given as a negative (relative) number, which counts back
+		// from the end of this chunk's elements so far and needs the chunk's base added.
+		std::vector<size_t> Relative[3];
+	};
+
+	inline bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool IsDigit(char c)
+	{
+		return (unsigned)(c - '0') < 10;
+	}
+
+	inline void SkipBlanks(const char*& p, const char* end)
+	{
+		while(p < end && IsBlank(*p))
+			++p;
+	}
+
+	// [sign] digits [. digits] [e [sign] digits], as OBJ writers print them.  The first
+	// 19 significant digits are exact in a UINT64, and scaling by an exact power of ten
+	// is one correctly rounded operation, so results match strtof but for the rare
+	// double rounding on the way to float.
+	bool ParseFloat(const char*& p, const char* end, float& out)
+	{
+		SkipBlanks(p, end);
+
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		UINT64 mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		const char* start = p;
+		for(; p < end && IsDigit(*p); ++p)
+		{
+			if(digits < 19)
+			{
+				mantissa = mantissa*10 + (*p - '0');
+				digits += mantissa != 0;
+			}
+			else
+			{
+				++exponent;
+			}
+		}
+
+		if(p < end && *p == '.')
+		{
+			for(++p; p < end && IsDigit(*p); ++p)
+			{
+				if(digits < 19)
+				{
+					mantissa = mantissa*10 + (*p - '0');
+					digits += mantissa != 0;
+					--exponent;
+				}
+			}
+		}
+
+		if(p == start || (p == start + 1 && *start == '.'))
+			return false;
+
+		if(p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* q = p + 1;
+			bool negativeExp = false;
+			if(q < end && (*q == '-' || *q == '+'))
+				negativeExp = *q++ == '-';
+
+			if(q < end && IsDigit(*q))
+			{
+				int e = 0;
+				for(; q < end && IsDigit(*q); ++q)
+					e = MathHelper::Min(e*10 + (*q - '0'), 100000);
+				exponent += negativeExp ? -e : e;
+				p = q;
+			}
+		}
+
+		double value = (double)mantissa;
+		if(mantissa != 0)
+		{
+			// Anything past the table is beyond float range either way.
+			while(exponent > 22)
+			{
+				value *= Pow10[22];
+				exponent -= 22;
+			}
+			while(exponent < -22)
+			{
+				value /= Pow10[22];
+				exponent += 22;
+			}
+			value = exponent >= 0 ? value*Pow10[exponent] : value / Pow10[-exponent];
+		}
+
+		out = (float)(negative ? -value : value);
+		return true;
+	}
+
+	bool ParseInt(const char*& p, const char* end, int& out)
+	{
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		if(p == end || !IsDigit(*p))
+			return false;
+
+		// Saturates rather than overflowing; no file has that many elements anyway.
+		const int maxValue = 0x3fffffff;
+		int value = 0;
+		for(; p < end && IsDigit(*p); ++p)
+		{
+			int d = *p - '0';
+			value = value > (maxValue - d) / 10 ? maxValue : value*10 + d;
+		}
+
+		out = negative ? -value : value;
+		return true;
+	}
+
+	// Turns a relative number into one counting from the start of the chunk (1-based,
+	// possibly not positive, reaching back into earlier chunks) and notes it for fixing.
+	void ResolveRelative(int& number, size_t count, size_t corner, std::vector<size_t>& relative)
+	{
+		if(number < 0)
+		{
+			number = (int)count + number + 1;
+			relative.push_back(corner);
+		}
+	}
+
+	bool ParseFace(const char* p, const char* end, Chunk& chunk, std::vector<Corner>& polygon)
+	{
+		polygon.clear();
+		for(;;)
+		{
+			SkipBlanks(p, end);
+			if(p == end)
+				break;
+
+			Corner c = { 0, 0, 0 };
+			if(!ParseInt(p, end, c.V) || c.V == 0)
+				return false;
+
+			if(p < end && *p == '/')
+			{
+				++p;
+				if(p < end && *p != '/' && !ParseInt(p, end, c.T))
+					return false;
+
+				if(p < end && *p == '/')
+				{
+					++p;
+					if(!ParseInt(p, end, c.N))
+						return false;
+				}
+			}
+
+			if(p < end && !IsBlank(*p))
+				return false;
+
+			polygon.push_back(c);
+		}
+
+		if(polygon.size() < 3)
+			return polygon.empty();
+
+		// Fan around the first corner.
+		for(size_t i = 1; i + 1 < polygon.size(); ++i)
+		{
+			chunk.Corners.push_back(polygon[0]);
+			chunk.Corners.push_back(polygon[i]);
+			chunk.Corners.push_back(polygon[i + 1]);
+		}
+		return true;
+	}
+
+	bool ParseChunk(const char* p, const char* end, Chunk& chunk)
+	{
+		std::vector<Corner> polygon;
+		while(p < end)
+		{
+			const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+			if(!lineEnd)
+				lineEnd = end;
+
+			// The keyword, then at least one blank.
+			SkipBlanks(p, lineEnd);
+			const char* keyword = p;
+			while(p < lineEnd && !IsBlank(*p))
+				++p;
+			size_t length = p - keyword;
+
+			bool ok = true;
+			if(p == lineEnd)
+			{
+				// Blank, or a keyword with nothing after it.
+			}
+			else if(length == 1 && keyword[0] == 'v')
+			{
+				XMFLOAT3 v;
+				ok = ParseFloat(p, lineEnd, v.x) && ParseFloat(p, lineEnd, v.y) && ParseFloat(p, lineEnd, v.z);
+				chunk.Positions.push_back(v);
+			}
+			else if(length == 2 && keyword[0] == 'v' && keyword[1] == 't')
+			{
+				// A third (w) coordinate, if any, is ignored.
+				XMFLOAT2 t;
+				ok = ParseFloat(p, lineEnd, t.x) && ParseFloat(p, lineEnd, t.y);
+				chunk.TexCoords.push_back(t);
+			}
+			else if(length == 2 && keyword[0] == 'v' && keyword[1] == 'n')
+			{
+				XMFLOAT3 n;
+				ok = ParseFloat(p, lineEnd, n.x) && ParseFloat(p, lineEnd, n.y) && ParseFloat(p, lineEnd, n.z);
+				chunk.Normals.push_back(n);
+			}
+			else if(length == 1 && keyword[0] == 'f')
+			{
+				size_t first = chunk.Corners.size();
+				ok = ParseFace(p, lineEnd, chunk, polygon);
+				for(size_t i = first; i < chunk.Corners.size() && ok; ++i)
+				{
+					Corner& c = chunk.Corners[i];
+					ResolveRelative(c.V, chunk.Positions.size(), i, chunk.Relative[0]);
+					ResolveRelative(c.T, chunk.TexCoords.size(), i, chunk.Relative[1]);
+					ResolveRelative(c.N, chunk.Normals.size(), i, chunk.Relative[2]);
+				}
+			}
+
+			// Comments, groups, objects, smoothing groups and materials are skipped.
+			if(!ok)
+				return false;
+
+			p = lineEnd + 1;
+		}
+
+		return true;
+	}
+
+	inline UINT HashCorner(const Corner& c)
+	{
+		return (UINT)c.V*73856093u ^ (UINT)c.T*19349663u ^ (UINT)c.N*83492791u;
+	}
+}
+
+bool ObjLoader::Load(const std::string& filename, GeometryGenerator::MeshData& meshData, UINT numThreads)
+{
+	FILE* file = fopen(filename.c_str(), "rb");
+	if(!file)
+		return false;
+
+	std::vector<char> text;
+	bool read = fseek(file, 0, SEEK_END) == 0;
+	long size = read ? ftell(file) : -1;
+	read = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+	if(read && size > 0)
+	{
+		text.resize((size_t)size);
+		read = fread(&text[0], text.size(), 1, file) == 1;
+	}
+	fclose(file);
+
+	return read && Parse(text.empty() ? "" : &text[0], text.size(), meshData, numThreads);
+}
+
+bool ObjLoader::Parse(const char* text, size_t size, GeometryGenerator::MeshData& meshData, UINT numThreads)
+{
+	meshData.Vertices.clear();
+	meshData.Indices.clear();
+
+	if(numThreads == 0)
+		numThreads = GetHardwareThreadCount();
+	UINT numChunks = (UINT)MathHelper::Min((size_t)numThreads, MathHelper::Max(size / MinChunkBytes, (size_t)1));
+
+	// Chunks start just past a newline.
+	std::vector<const char*> bounds(numChunks + 1);
+	bounds[0] = text;
+	bounds[numChunks] = text + size;
+	for(UINT i = 1; i < numChunks; ++i)
+	{
+		const char* p = MathHelper::Max(text + (size_t)i*(size / numChunks), bounds[i - 1]);
+		const char* newline = (const char*)memchr(p, '\n', text + size - p);
+		bounds[i] = newline ? newline + 1 : text + size;
+	}
+
+	std::vector<Chunk> chunks(numChunks);
+	std::vector<char> parsed(numChunks, 0);
+	ParallelForRows(numChunks, 1, numChunks, [&](UINT first, UINT end)
+	{
+		for(UINT i = first; i < end; ++i)
+			parsed[i] = ParseChunk(bounds[i], bounds[i + 1], chunks[i]);
+	});
+
+	// Gather the elements and make every number absolute.
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT2> texCoords;
+	std::vector<XMFLOAT3> normals;
+	size_t numCorners = 0;
+	for(UINT i = 0; i < numChunks; ++i)
+	{
+		if(!parsed[i])
+			return false;
+
+		Chunk& chunk = chunks[i];
+		for(size_t j = 0; j < chunk.Relative[0].size(); ++j)
+			chunk.Corners[chunk.Relative[0][j]].V += (int)positions.size();
+		for(size_t j = 0; j < chunk.Relative[1].size(); ++j)
+			chunk.Corners[chunk.Relative[1][j]].T += (int)texCoords.size();
+		for(size_t j = 0; j < chunk.Relative[2].size(); ++j)
+			chunk.Corners[chunk.Relative[2][j]].N += (int)normals.size();
+
+		positions.insert(positions.end(), chunk.Positions.begin(), chunk.Positions.end());
+		texCoords.insert(texCoords.end(), chunk.TexCoords.begin(), chunk.TexCoords.end());
+		normals.insert(normals.end(), chunk.Normals.begin(), chunk.Normals.end());
+		numCorners += chunk.Corners.size();
+	}
+
+	// One vertex per distinct triple, through an open addressed table at most half full.
+	UINT capacity = 16;
+	while(capacity < 2*numCorners)
+		capacity *= 2;
+
+	const UINT Empty = 0xffffffff;
+	std::vector<UINT> table(capacity, Empty);
+	std::vector<Corner> unique;
+	meshData.Indices.reserve(numCorners);
+
+	for(UINT i = 0; i < numChunks; ++i)
+	{
+		const std::vector<Corner>& corners = chunks[i].Corners;
+		for(size_t j = 0; j < corners.size(); ++j)
+		{
+			const Corner& c = corners[j];
+			if(c.V < 1 || c.V > (int)positions.size() ||
+				c.T < 0 || c.T > (int)texCoords.size() ||
+				c.N < 0 || c.N > (int)normals.size())
+			{
+				meshData.Indices.clear();
+				return false;
+			}
+
+			UINT slot = HashCorner(c) & (capacity - 1);
+			for(;;)
+			{
+				UINT index = table[slot];
+				if(index == Empty)
+				{
+					index = (UINT)unique.size();
+					table[slot] = index;
+					unique.push_back(c);
+					meshData.Indices.push_back(index);
+					break;
+				}
+
+				const Corner& u = unique[index];
+				if(u.V == c.V && u.T == c.T && u.N == c.N)
+				{
+					meshData.Indices.push_back(index);
+					break;
+				}
+
+				slot = (slot + 1) & (capacity - 1);
+			}
+		}
+	}
+
+	meshData.Vertices.resize(unique.size());
+	for(size_t i = 0; i < unique.size(); ++i)
+	{
+		const Corner& c = unique[i];
+		GeometryGenerator::Vertex& v = meshData.Vertices[i];
+		v.Position = positions[c.V - 1];
+		v.TexC = c.T ? texCoords[c.T - 1] : XMFLOAT2(0.0f, 0.0f);
+		v.Normal = c.N ? normals[c.N - 1] : XMFLOAT3(0.0f, 0.0f, 0.0f);
+		v.TangentU = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	}
+
+	return true;
+}
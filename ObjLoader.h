@@ -0,0 +1,34 @@
+//***************************************************************************************
+// ObjLoader.h
+//
+// Loads Wavefront OBJ files into GeometryGenerator::MeshData.  CPU only.
+//
+// The file is read in one go and split at line boundaries into chunks parsed on
+// worker threads, with a locale-free number parser.  Each distinct v/vt/vn triple the
+// faces use becomes one vertex, in the order the faces first use it, and polygons are
+// fanned into triangles.
+//***************************************************************************************
+
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include "GeometryGenerator.h"
+#include <string>
+
+class ObjLoader
+{
+public:
+	///<summary>
+	/// Reads positions, texture coordinates (as in the file) and normals.  Corners
+	/// without vt or vn get zeros; tangents are left zero, for TangentGenerator.  Fails
+	/// if the file cannot be read or a face refers to an element that does not exist.
+	/// numThreads == 0 uses one per hardware thread; small files are parsed on the
+	/// calling thread.
+	///</summary>
+	bool Load(const std::string& filename, GeometryGenerator::MeshData& meshData, UINT numThreads = 0);
+
+	// The same for OBJ text already in memory.
+	bool Parse(const char* text, size_t size, GeometryGenerator::MeshData& meshData, UINT numThreads = 0);
+};
+
+#endif // OBJLOADER_H
@@ -0,0 +1,37 @@
+//***************************************************************************************
+// ParallelFor.h
+//
+// Splits a range of rows into contiguous bands and runs a job on each, one per worker
+// thread, the last band on the calling thread.  For the CPU preprocessing passes that
+// run once at load and are not worth a persistent pool.
+//***************************************************************************************
+
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include "MathHelper.h"
+#include <thread>
+#include <vector>
+
+// job(firstRow, endRow) for bands covering [0, numRows).  numThreads == 0 uses one
+// worker per hardware thread; no band is smaller than minRowsPerBand unless the whole
+// range is.
+template<typename Job>
+void ParallelForRows(UINT numRows, UINT minRowsPerBand, UINT numThreads, Job job)
+{
+	if(numThreads == 0)
+		numThreads = MathHelper::Max(std::thread::hardware_concurrency(), 1u);
+	numThreads = MathHelper::Min(numThreads, MathHelper::Max(numRows / minRowsPerBand, 1u));
+
+	std::vector<std::thread> workers;
+	UINT rowsPerBand = (numRows + numThreads - 1) / numThreads;
+	for(UINT t = 0; t + 1 < numThreads; ++t)
+		workers.push_back(std::thread(job, t*rowsPerBand, MathHelper::Min((t+1)*rowsPerBand, numRows)));
+
+	job(MathHelper::Min((numThreads-1)*rowsPerBand, numRows), numRows);
+
+	for(size_t t = 0; t < workers.size(); ++t)
+		workers[t].join();
+}
+
+#endif // PARALLELFOR_H
@@ -0,0 +1,145 @@
+//***************************************************************************************
+// PassCache.cpp
+//***************************************************************************************
+
+#include "PassCache.h"
+#include <algorithm>
+#include <cmath>
+
+PassCache::PassCache(UINT numPasses) :
+	mPasses(numPasses),
+	mMaxAge(0)
+{
+	for(size_t i = 0; i < mPasses.size(); ++i)
+	{
+		mPasses[i].Age = 0;
+		mPasses[i].HasView = false;
+		mPasses[i].Drawn = false;
+		mPasses[i].Dirty = true;
+	}
+}
+
+void PassCache::BeginFrame()
+{
+	for(size_t i = 0; i < mPasses.size(); ++i)
+		++mPasses[i].Age;
+}
+
+void PassCache::Invalidate(UINT pass)
+{
+	mPasses[pass].Dirty = true;
+}
+
+void PassCache::InvalidateAll()
+{
+	for(size_t i = 0; i < mPasses.size(); ++i)
+		mPasses[i].Dirty = true;
+}
+
+void PassCache::SetViewProj(UINT pass, CXMMATRIX viewProj, float epsilon)
+{
+	Pass& p = mPasses[pass];
+
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, viewProj);
+
+	if(p.HasView)
+	{
+		bool changed = false;
+		for(int r = 0; r < 4 && !changed; ++r)
+			for(int c = 0; c < 4 && !changed; ++c)
+				changed = fabsf(m.m[r][c] - p.ViewProj.m[r][c]) > epsilon;
+
+		if(!changed)
+			return;
+	}
+
+	p.ViewProj = m;
+	p.HasView = true;
+	p.Dirty = true;
+	ExtractFrustumPlanes(p.Planes, viewProj);
+}
+
+bool PassCache::Overlaps(const Pass& pass, const XNA::AxisAlignedBox& box)const
+{
+	// Without a view yet the pass is drawn regardless.
+	if(!pass.HasView)
+		return false;
+
+	const XMFLOAT3& c = box.Center;
+	const XMFLOAT3& e = box.Extents;
+	for(int i = 0; i < 6; ++i)
+	{
+		// Planes face inward; the box is outside if even its furthest corner along the
+		// plane normal is behind it.
+		const XMFLOAT4& p = pass.Planes[i];
+		float r = e.x*fabsf(p.x) + e.y*fabsf(p.y) + e.z*fabsf(p.z);
+		if(p.x*c.x + p.y*c.y + p.z*c.z + p.w + r < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+void PassCache::NotifyMoved(const XNA::AxisAlignedBox& before, const XNA::AxisAlignedBox& after)
+{
+	for(size_t i = 0; i < mPasses.size(); ++i)
+	{
+		Pass& p = mPasses[i];
+		if(!p.Dirty && (Overlaps(p, before) || Overlaps(p, after)))
+			p.Dirty = true;
+	}
+}
+
+bool PassCache::NeedsUpdate(UINT pass)const
+{
+	const Pass& p = mPasses[pass];
+	return !p.Drawn || p.Dirty || (mMaxAge != 0 && p.Age >= mMaxAge);
+}
+
+void PassCache::MarkDrawn(UINT pass)
+{
+	Pass& p = mPasses[pass];
+	p.Drawn = true;
+	p.Dirty = false;
+	p.Age = 0;
+}
+
+void PassCache::SelectUpdates(UINT first, UINT count, UINT budget, std::vector<UINT>& passes)const
+{
+	passes.clear();
+
+	// Sort key: never drawn, then dirty, then expired; oldest first within each.
+	std::vector< std::pair<UINT64, UINT> > candidates;
+	for(UINT i = first; i < first + count; ++i)
+	{
+		const Pass& p = mPasses[i];
+		if(!NeedsUpdate(i))
+			continue;
+
+		UINT rank = !p.Drawn ? 0 : (p.Dirty ? 1 : 2);
+		candidates.push_back(std::make_pair(((UINT64)rank << 32) | (UINT64)(0xffffffff - p.Age), i));
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	for(size_t i = 0; i < candidates.size(); ++i)
+	{
+		bool neverDrawn = (candidates[i].first >> 32) == 0;
+		if(budget != 0 && passes.size() >= budget && !neverDrawn)
+			break;
+		passes.push_back(candidates[i].second);
+	}
+}
+
+void PassCache::TransformBounds(XNA::AxisAlignedBox& out, const XNA::AxisAlignedBox& local, const XMFLOAT4X4& world)
+{
+	const XMFLOAT3& c = local.Center;
+	const XMFLOAT3& e = local.Extents;
+
+	out.Center.x = c.x*world._11 + c.y*world._21 + c.z*world._31 + world._41;
+	out.Center.y = c.x*world._12 + c.y*world._22 + c.z*world._32 + world._42;
+	out.Center.z = c.x*world._13 + c.y*world._23 + c.z*world._33 + world._43;
+
+	out.Extents.x = e.x*fabsf(world._11) + e.y*fabsf(world._21) + e.z*fabsf(world._31);
+	out.Extents.y = e.x*fabsf(world._12) + e.y*fabsf(world._22) + e.z*fabsf(world._32);
+	out.Extents.z = e.x*fabsf(world._13) + e.y*fabsf(world._23) + e.z*fabsf(world._33);
+}
@@ -0,0 +1,71 @@
+//***************************************************************************************
+// PassCache.h
+//
+// Dirty tracking for render passes whose output can be reused between frames, such as
+// shadow maps and dynamic cube map faces.  Each pass remembers the view-projection it
+// was last drawn with; it needs redrawing when that changes, when something that moved
+// overlaps its frustum, when it is invalidated outright, or when it has gone MaxAge
+// frames without a redraw.  SelectUpdates hands out dirty passes a few at a time so
+// their cost can be spread over several frames.
+//***************************************************************************************
+
+#ifndef PASSCACHE_H
+#define PASSCACHE_H
+
+#include "MathHelper.h"
+#include "xnacollision.h"
+#include <vector>
+
+class PassCache
+{
+public:
+	explicit PassCache(UINT numPasses);
+
+	// Frames after which a clean pass is redrawn anyway; 0 means never.  Lets slowly
+	// animating content the cache does not track (particles) catch up.
+	void SetMaxAge(UINT frames) { mMaxAge = frames; }
+
+	// Call once per frame, before any NotifyMoved.
+	void BeginFrame();
+
+	void Invalidate(UINT pass);
+	void InvalidateAll();
+
+	// The view-projection the pass will be drawn with this frame.  Any element moving by
+	// more than epsilon dirties it.
+	void SetViewProj(UINT pass, CXMMATRIX viewProj, float epsilon = 1e-5f);
+
+	// An object's bounds changed from before to after.  Dirties every pass whose frustum
+	// overlaps either box; pass the same box twice for objects that just appeared.
+	void NotifyMoved(const XNA::AxisAlignedBox& before, const XNA::AxisAlignedBox& after);
+
+	// Never drawn, dirty, or expired.
+	bool NeedsUpdate(UINT pass)const;
+	void MarkDrawn(UINT pass);
+
+	// Picks passes in [first, first + count) to redraw this frame.  Passes never drawn
+	// are always picked; after them come dirty passes, then expired ones, each longest
+	// waiting first, up to budget passes in all (0 means no limit).
+	void SelectUpdates(UINT first, UINT count, UINT budget, std::vector<UINT>& passes)const;
+
+	// World space bounds of a local box under an affine world matrix.
+	static void TransformBounds(XNA::AxisAlignedBox& out, const XNA::AxisAlignedBox& local, const XMFLOAT4X4& world);
+
+private:
+	struct Pass
+	{
+		XMFLOAT4X4 ViewProj;
+		XMFLOAT4 Planes[6];
+		UINT Age;
+		bool HasView;
+		bool Drawn;
+		bool Dirty;
+	};
+
+	bool Overlaps(const Pass& pass, const XNA::AxisAlignedBox& box)const;
+
+	std::vector<Pass> mPasses;
+	UINT mMaxAge;
+};
+
+#endif // PASSCACHE_H
@@ -8,6 +8,8 @@
 //***************************************************************************************
 
 #include "PhysX.h"
+#include "MathHelper.h"
+#include <algorithm>
 
 PhysX::PhysX() :
     mFoundation(NULL),
@@ -16,9 +18,16 @@ PhysX::PhysX() :
 	mMaterial(NULL),
 	mCpuDispatcher(NULL),
 	//mCudaContextManager(NULL),
-	mNbThreads(1)
+	mNbThreads(1),
+	mStepper(1.0f / 60.0f, 4),
+	mOverlapRendering(false),
+	mSimulating(false),
+	mStepPending(false),
+	mPosesUpdated(0),
+	mCookedMeshCache("PhysXCache")
 {
-	
+	for(int i = 0; i < Last; i++)
+		mObjectMeshes[i] = NULL;
 }
 	
 	PxFoundation*				pxFoundation;
@@ -35,23 +44,38 @@ PhysX::PhysX() :
 	
 PhysX::~PhysX()
 {
-    mPhysics->release();
-    mFoundation->release();
-	mScene->release();
-	mCpuDispatcher->release();
-	mMaterial->release();
-
-	pxFoundation->release();
-	pxScene->release();
-	pxPhysics->release();
-	pxCpuDispatcher->release();
-	defaultMaterial->release();
-	blockMaterial->release();
-
-	particleSys->releaseParticles();
+	if(mSimulating)
+		pxScene->fetchResults(true);
+
+	for(std::map<UINT64, PxTriangleMesh*>::iterator it = mTriangleMeshes.begin(); it != mTriangleMeshes.end(); ++it)
+		it->second->release();
+	mTriangleMeshes.clear();
+
+	// The scene and everything made by the SDK go before the SDK itself, the foundation
+	// last.  Init may have stopped early, so anything may still be NULL.
+	if(particleSys)
+		particleSys->releaseParticles();
+	if(pxScene)
+		pxScene->release();
+	if(pxCpuDispatcher)
+		pxCpuDispatcher->release();
+	if(defaultMaterial)
+		defaultMaterial->release();
+	if(blockMaterial)
+		blockMaterial->release();
+	if(pxCooking)
+		pxCooking->release();
+	delete[] objectsLoaded;
+	if(pxPhysics)
+	{
+		PxCloseExtensions();
+		pxPhysics->release();
+	}
+	if(pxFoundation)
+		pxFoundation->release();
 }
 
-void PhysX::Init()
+void PhysX::Init(PxU32 numThreads)
 {
     static PxDefaultErrorCallback gDefaultErrorCallback;
     static PxDefaultAllocator	  gDefaultAllocatorCallback;
@@ -78,13 +102,17 @@ void PhysX::Init()
 	//customizeSceneDesc(sceneDesc);
 
 
-	pxCpuDispatcher = PxDefaultCpuDispatcherCreate(1);
+	mNbThreads = numThreads > 0 ? numThreads : GetHardwareThreadCount();
+	pxCpuDispatcher = PxDefaultCpuDispatcherCreate(mNbThreads);
 	sceneDesc.cpuDispatcher	= pxCpuDispatcher;
 
 	//sceneDesc.gpuDispatcher = mCudaContextManager->getGpuDispatcher();
 	
 	sceneDesc.filterShader	= PxDefaultSimulationFilterShader;
 
+	// Lets fetchStep() visit only the bodies that moved.
+	sceneDesc.flags |= PxSceneFlag::eENABLE_ACTIVETRANSFORMS;
+
 	pxScene = pxPhysics->createScene(sceneDesc);
 
 	defaultMaterial = pxPhysics->createMaterial(0.5f, 0.5f, 0.1f);    //static friction, dynamic friction, restitution
@@ -110,142 +138,270 @@ void PhysX::Init()
 	
 }
 
-float mAccumulator = 0.0f;
-float mStepSize = 1.0f / 60.0f;
 float mCooldown = 0.0f;
 
 bool PhysX::advance(float dt)
 {
-	mAccumulator  += dt;
-    if(mAccumulator < mStepSize)
-        return false;
+	mPosesUpdated = 0;
+
+	// Overlap mode: the step started last frame has been running during the draw.
+	if(mSimulating)
+	{
+		fetchStep();
+		mSimulating = false;
+	}
 
-    mAccumulator -= mStepSize;
+	UINT steps = mStepper.Advance(dt);
+	if(steps == 0)
+		return false;
 
+	float stepSize = mStepper.GetStepSize();
 	if(mCooldown > 0.0f)
-		mCooldown -= mStepSize;
+		mCooldown -= steps*stepSize;
+
+	// Catch-up steps have to finish before the next one can start.
+	for(UINT i = 0; i + 1 < steps; i++)
+	{
+		pxScene->simulate(stepSize);
+		fetchStep();
+	}
 
-    pxScene->simulate(mStepSize);
-    return true;
+	if(mOverlapRendering)
+	{
+		mStepPending = true;
+		return false;
+	}
+
+	pxScene->simulate(stepSize);
+	mSimulating = true;
+	return true;
 }
 
 void PhysX::fetch()
 {
-    pxScene->fetchResults(true);
+	if(!mSimulating)
+		return;
+
+    fetchStep();
+	mSimulating = false;
 }
 
-void PhysX::CreateTerrain( int numVerts, PxVec3* verts, int numInds, int* inds)
+void PhysX::fetchStep()
 {
-	PxRigidStatic* meshActor = pxPhysics->createRigidStatic(PxTransform::createIdentity());
-	PxShape* meshShape;
-	if(meshActor)
+	pxScene->fetchResults(true);
+
+	// Sleeping bodies are not reported, so their matrices stay as last written.
+	// Box actors carry their index + 1 in userData; everything else has NULL.
+	PxU32 numActive = 0;
+	const PxActiveTransform* active = pxScene->getActiveTransforms(numActive);
+	for(PxU32 i = 0; i < numActive; i++)
 	{
-			
-			PxTriangleMeshDesc meshDesc;
-			meshDesc.points.count           = numVerts;
-			meshDesc.points.stride          = sizeof(PxVec3);
-			meshDesc.points.data            = verts;
-
-			meshDesc.triangles.count        = numInds/3.;
-			meshDesc.triangles.stride       = 3*sizeof(int);
-			meshDesc.triangles.data         = inds;
-
-			PxToolkit::MemoryOutputStream writeBuffer;
-			bool status = pxCooking->cookTriangleMesh(meshDesc, writeBuffer);
-			if(!status)
-				return;
-
-			PxToolkit::MemoryInputData readBuffer(writeBuffer.getData(), writeBuffer.getSize());
-			
-			PxTriangleMeshGeometry triGeom;
-			triGeom.triangleMesh = pxPhysics->createTriangleMesh(readBuffer);
+		size_t id = (size_t)active[i].userData;
+		if(id == 0)
+			continue;
 
-			meshShape = meshActor->createShape(triGeom, *defaultMaterial);
+		const PxTransform& pose = active[i].actor2World;
+		MathHelper::StoreRigidTransform(&mBoxWorlds[id - 1], &pose.q.x, &pose.p.x);
+		mPosesUpdated++;
+	}
+}
 
-			pxScene->addActor(*meshActor);
+void PhysX::beginOverlappedStep()
+{
+	if(!mStepPending)
+		return;
+
+	pxScene->simulate(mStepper.GetStepSize());
+	mSimulating = true;
+	mStepPending = false;
+}
+
+void PhysX::SetOverlapRendering(bool overlap)
+{
+	// A held-back step runs now rather than being lost.
+	if(!overlap && mStepPending)
+	{
+		pxScene->simulate(mStepper.GetStepSize());
+		fetchStep();
+		mStepPending = false;
 	}
+	mOverlapRendering = overlap;
 }
 
-int nv,ni;
-int* indes;
-PxVec3* vertas;
+void PhysX::SetMaxSubsteps(UINT maxSubsteps)
+{
+	mStepper.SetMaxSubsteps(maxSubsteps);
+}
 
-void PhysX::SetupTriangleMesh(	ObjectNumbers objnum, int numVerts, PxVec3* verts,
-							int numInds, int* inds, float x, float y, float z)
+PxRigidStatic* PhysX::CreateTerrainHeightField( const HeightfieldTile& tile, float heightUnit, float cellSpacing )
 {
-	PxRigidStatic* meshActor = pxPhysics->createRigidStatic(PxTransform::createIdentity());
-	PxShape* meshShape;
-	if(meshActor)
+	std::vector<PxHeightFieldSample> samples(tile.Heights.size());
+	for(size_t i = 0; i < samples.size(); i++)
 	{
-			
+		samples[i].height = tile.Heights[i];
+		samples[i].materialIndex0 = 0;
+		samples[i].materialIndex1 = 0;
+
+		// Heightmap::GetHeight splits each cell from B to C, which in the tile's layout
+		// runs from sample (row, col) to (row+1, col+1): the tess flag's diagonal.  It
+		// shares a bit with materialIndex0, so it is set after.
+		samples[i].setTessFlag();
+	}
 
-			PxTriangleMeshDesc meshDesc;
-			meshDesc.points.count           = numVerts;
-			meshDesc.points.stride          = sizeof(PxVec3);
-			meshDesc.points.data            = verts;
+	PxHeightFieldDesc hfDesc;
+	hfDesc.format             = PxHeightFieldFormat::eS16_TM;
+	hfDesc.nbRows             = tile.NumRows;
+	hfDesc.nbColumns          = tile.NumCols;
+	hfDesc.samples.data       = &samples[0];
+	hfDesc.samples.stride     = sizeof(PxHeightFieldSample);
 
-			meshDesc.triangles.count        = numInds/3.;
-			meshDesc.triangles.stride       = 3*sizeof(int);
-			meshDesc.triangles.data         = inds;
+	PxHeightField* heightField = pxPhysics->createHeightField(hfDesc);
+	if(!heightField)
+		return NULL;
 
-			PxToolkit::MemoryOutputStream writeBuffer;
-			bool status = pxCooking->cookTriangleMesh(meshDesc, writeBuffer);
-			if(!status)
-				return;
+	PxRigidStatic* hfActor = pxPhysics->createRigidStatic(PxTransform(PxVec3(tile.Origin.x, tile.Origin.y, tile.Origin.z)));
+	if(hfActor)
+	{
+		PxHeightFieldGeometry hfGeom(heightField, PxMeshGeometryFlags(), heightUnit, cellSpacing, cellSpacing);
+		hfActor->createShape(hfGeom, *defaultMaterial);
+		pxScene->addActor(*hfActor);
+	}
 
-			PxToolkit::MemoryInputData readBuffer(writeBuffer.getData(), writeBuffer.getSize());
-			
-			PxTriangleMeshGeometry triGeom;
-			triGeom.triangleMesh = pxPhysics->createTriangleMesh(readBuffer);
-			triGeom.scale = PxMeshScale(PxVec3(8.0,8.0,8.0),PxQuat());
+	// The shape keeps its own reference.
+	heightField->release();
+	return hfActor;
+}
 
-			meshShape = meshActor->createShape(triGeom, *defaultMaterial);
-			meshShape->setLocalPose(PxTransform(PxVec3(x,y,z)));
+void PhysX::StreamTerrainTiles( const HeightfieldBuilder& builder, UINT tileCells, float x, float z, float radius )
+{
+	builder.GetTilesInRadius(tileCells, x, z, radius, mWantedTerrainTiles);
 
-			pxScene->addActor(*meshActor);
+	// Drop tiles that fell out of range.
+	std::map<UINT, PxRigidStatic*>::iterator it = mTerrainTiles.begin();
+	while(it != mTerrainTiles.end())
+	{
+		if(std::find(mWantedTerrainTiles.begin(), mWantedTerrainTiles.end(), it->first) == mWantedTerrainTiles.end())
+		{
+			if(it->second)
+				it->second->release();
+			mTerrainTiles.erase(it++);
+		}
+		else
+			++it;
+	}
+
+	UINT numTilesX = builder.GetNumTilesX(tileCells);
+	HeightfieldTile tile;
+	for(size_t i = 0; i < mWantedTerrainTiles.size(); i++)
+	{
+		UINT index = mWantedTerrainTiles[i];
+		if(mTerrainTiles.find(index) != mTerrainTiles.end())
+			continue;
 
-			nv = numVerts;
-			ni = numInds;
-			indes = inds;
-			vertas = verts;
+		builder.BuildTile(tileCells, index % numTilesX, index / numTilesX, tile);
+		mTerrainTiles[index] = CreateTerrainHeightField(tile, builder.GetHeightUnit(), builder.GetCellSpacing());
 	}
 }
 
-void PhysX::PlaceTriangleMesh( ObjectNumbers objnum, float x, float y, float z, float scale, bool statc )
+PxTriangleMesh* PhysX::GetTriangleMesh( int numVerts, const PxVec3* verts, int numInds, const int* inds )
 {
-	PxRigidDynamic* meshActor = pxPhysics->createRigidDynamic(PxTransform::createIdentity());
-	PxShape* meshShape;
-	if(meshActor)
+	UINT64 hash = CookedMeshCache::HashMesh(&verts[0].x, numVerts, inds, numInds, PX_PHYSICS_VERSION);
+
+	std::map<UINT64, PxTriangleMesh*>::iterator it = mTriangleMeshes.find(hash);
+	if(it != mTriangleMeshes.end())
+		return it->second;
+
+	PxTriangleMesh* mesh = NULL;
+
+	std::vector<unsigned char> cooked;
+	if(mCookedMeshCache.Load(hash, cooked) && !cooked.empty())
+	{
+		PxToolkit::MemoryInputData readBuffer(&cooked[0], (PxU32)cooked.size());
+		mesh = pxPhysics->createTriangleMesh(readBuffer);
+	}
+
+	// Missing or stale entry (e.g. written by another PhysX build): cook and replace it.
+	if(!mesh)
 	{
-			meshActor->setRigidDynamicFlag(PxRigidDynamicFlag::eKINEMATIC, true);
+		PxTriangleMeshDesc meshDesc;
+		meshDesc.points.count           = numVerts;
+		meshDesc.points.stride          = sizeof(PxVec3);
+		meshDesc.points.data            = verts;
+
+		meshDesc.triangles.count        = numInds/3;
+		meshDesc.triangles.stride       = 3*sizeof(int);
+		meshDesc.triangles.data         = inds;
+
+		PxToolkit::MemoryOutputStream writeBuffer;
+		bool status = pxCooking->cookTriangleMesh(meshDesc, writeBuffer);
+		if(!status)
+			return NULL;
+
+		PxToolkit::MemoryInputData readBuffer(writeBuffer.getData(), writeBuffer.getSize());
+		mesh = pxPhysics->createTriangleMesh(readBuffer);
+		if(!mesh)
+			return NULL;
+
+		mCookedMeshCache.Store(hash, writeBuffer.getData(), writeBuffer.getSize());
+	}
 
-			PxTriangleMeshDesc meshDesc;
-			meshDesc.points.count           = nv;
-			meshDesc.points.stride          = sizeof(PxVec3);
-			meshDesc.points.data            = vertas;
+	mTriangleMeshes[hash] = mesh;
+	return mesh;
+}
 
-			meshDesc.triangles.count        = ni/3.;
-			meshDesc.triangles.stride       = 3*sizeof(int);
-			meshDesc.triangles.data         = indes;
+void PhysX::SetupTriangleMesh(	ObjectNumbers objnum, int numVerts, const PxVec3* verts,
+							int numInds, const int* inds, float x, float y, float z, float scale )
+{
+	PxTriangleMesh* mesh = GetTriangleMesh(numVerts, verts, numInds, inds);
+	if(!mesh)
+		return;
 
-			PxToolkit::MemoryOutputStream writeBuffer;
-			/*bool status = pxCooking->cookTriangleMesh(meshDesc, writeBuffer);
-			if(!status)
-				return;
+	mObjectMeshes[objnum] = mesh;
 
-			PxToolkit::MemoryInputData readBuffer(writeBuffer.getData(), writeBuffer.getSize());
-			
+	PxRigidStatic* meshActor = pxPhysics->createRigidStatic(PxTransform(PxVec3(x,y,z)));
+	PxShape* meshShape;
+	if(meshActor)
+	{
 			PxTriangleMeshGeometry triGeom;
-			triGeom.triangleMesh = pxPhysics->createTriangleMesh(readBuffer);
-			triGeom.scale = PxMeshScale(PxVec3(scale,scale,scale),PxQuat());
+			triGeom.triangleMesh = mesh;
+			triGeom.scale = PxMeshScale(PxVec3(scale,scale,scale),PxQuat::createIdentity());
 
-			meshShape = meshActor->createShape(triGeom, *pxMaterial);
-			meshShape->setLocalPose(PxTransform(PxVec3(x, y, z)));
+			meshShape = meshActor->createShape(triGeom, *defaultMaterial);
 
-			pxScene->addActor(*meshActor);*/
+			pxScene->addActor(*meshActor);
 	}
 }
 
+void PhysX::PlaceTriangleMesh( ObjectNumbers objnum, float x, float y, float z, float scale, bool statc )
+{
+	// Places another instance of a mesh previously registered with SetupTriangleMesh.
+	PxTriangleMesh* mesh = mObjectMeshes[objnum];
+	if(!mesh)
+		return;
+
+	PxTriangleMeshGeometry triGeom;
+	triGeom.triangleMesh = mesh;
+	triGeom.scale = PxMeshScale(PxVec3(scale,scale,scale),PxQuat::createIdentity());
+
+	PxTransform pose(PxVec3(x, y, z));
+	if(statc)
+	{
+		PxRigidStatic* meshActor = pxPhysics->createRigidStatic(pose);
+		if(!meshActor)
+			return;
+		meshActor->createShape(triGeom, *defaultMaterial);
+		pxScene->addActor(*meshActor);
+	}
+	else
+	{
+		PxRigidDynamic* meshActor = pxPhysics->createRigidDynamic(pose);
+		if(!meshActor)
+			return;
+		meshActor->setRigidDynamicFlag(PxRigidDynamicFlag::eKINEMATIC, true);
+		meshActor->createShape(triGeom, *defaultMaterial);
+		pxScene->addActor(*meshActor);
+	}
+}
 
 //PxShape* aSphereShape;
 //PxRigidDynamic *boxActor;
@@ -276,8 +432,10 @@ void PhysX::CreateBox(float x, float y, float z, float lookx, float looky, float
 	boxActor->setAngularDamping(0.95);
 	boxActor->setLinearDamping(0.8);
 	PxRigidBodyExt::updateMassAndInertia(*boxActor, density);
+	boxActor->userData = (void*)(size_t)(numbox + 1);
 	pxScene->addActor(*boxActor);
 	boxes[numbox] = boxActor;
+	MathHelper::StoreRigidTransform(&mBoxWorlds[numbox], &transform.q.x, &transform.p.x);
 
 	mCooldown = 0.1f;
 	numbox++;
@@ -288,25 +446,14 @@ int PhysX::GetNumBoxes()
     return numbox;
 } 
 
-PxTransform PhysX::GetBoxWorld(int boxnum)
+const XMFLOAT4X4* PhysX::GetBoxWorlds() const
 {
-	PxU32 nShapes = 0;
-	if(boxes[boxnum])
-		nShapes = boxes[boxnum]->getNbShapes();
-	else	
-		return PxTransform(PxVec3(0, -100., 0));
-
-	if(numbox-1 < boxnum)
-		return PxTransform(PxVec3(0, -100., 0));
-
-	PxShape** shapes = new PxShape*[nShapes];
- 
-	boxes[boxnum]->getShapes(shapes, nShapes);     
-	PxTransform pt = PxShapeExt::getGlobalPose(*shapes[0]);
+	return mBoxWorlds;
+}
 
-	delete [] shapes;
-	
-	return pt;
+UINT PhysX::GetNumPosesUpdated() const
+{
+	return mPosesUpdated;
 }
 
 void PhysX::InitParticles(int count, float x, float y, float z, float vx, float vy, float vz, bool gravity)
@@ -11,6 +11,10 @@
 #include < extensions/PxDefaultErrorCallback.h >
 #include < extensions/PxDefaultAllocator.h > 
 #include < PxToolkit.h >
+#include <map>
+#include "CookedMeshCache.h"
+#include "HeightfieldBuilder.h"
+#include "FixedStepper.h"
 
 using namespace physx;
 
@@ -40,23 +44,55 @@ class PhysX
 public:
     PhysX();
     ~PhysX();
-    void Init();
+	// numThreads == 0 uses one dispatcher worker per hardware thread.
+    void Init(PxU32 numThreads = 0);
+
+	// Runs every fixed step owed for dt (up to the substep cap).  All but the last step
+	// complete here; returns true when the last one is still simulating and fetch()
+	// must be called.  In overlap mode the last step is instead held back for
+	// beginOverlappedStep() and advance() first collects the previous frame's step.
 	bool advance(float dt);
     void fetch();
 
-	void CreateTerrain( int numVerts, PxVec3* verts, int numInds, int* inds);
+	// Overlap mode: starts the held-back step so it simulates while the frame is drawn
+	// from the poses read during update.
+	void beginOverlappedStep();
+
+	void SetOverlapRendering(bool overlap);
+	void SetMaxSubsteps(UINT maxSubsteps);
+
+	// Static heightfield actor for one tile of the terrain; the whole terrain is one tile
+	// built with tileCells == 0.
+	PxRigidStatic* CreateTerrainHeightField( const HeightfieldTile& tile, float heightUnit, float cellSpacing );
 
-	void SetupTriangleMesh(	ObjectNumbers objnum, int numVerts, PxVec3* verts,
-							int numInds, int* inds, float x, float y, float z);
+	// Keeps the terrain tiles within radius of (x, z) in the scene and releases the rest.
+	void StreamTerrainTiles( const HeightfieldBuilder& builder, UINT tileCells, float x, float z, float radius );
+
+	void SetupTriangleMesh(	ObjectNumbers objnum, int numVerts, const PxVec3* verts,
+							int numInds, const int* inds, float x, float y, float z, float scale );
+
+	// Cooks each unique mesh once.  Instances share the returned mesh and differ only by
+	// actor pose and PxMeshScale; cooked streams are kept on disk for the next run.
+	PxTriangleMesh* GetTriangleMesh( int numVerts, const PxVec3* verts, int numInds, const int* inds );
 
 	void PlaceTriangleMesh( ObjectNumbers objnum, float x, float y, float z, float scale, bool statc );
 	
 	void CreateBox(float x, float y, float z, float vx, float vy, float vz, float speed);
-	PxTransform GetBoxWorld(int boxnum);
     int GetNumBoxes();
 
+	// World matrices of the boxes, indexed like CreateBox calls; refreshed from the
+	// scene's active transforms each time a step is fetched.
+	const XMFLOAT4X4* GetBoxWorlds() const;
+
+	// Box matrices rewritten by the last advance()/fetch(); sleeping boxes cost nothing.
+	UINT GetNumPosesUpdated() const;
+
 	void InitParticles(int count, float x, float y, float z, float vx, float vy, float vz, bool gravity);
 
+private:
+	// fetchResults plus the active-transform readback into mBoxWorlds.
+	void fetchStep();
+
 public:
     PxFoundation*           mFoundation;
     PxPhysics*              mPhysics;
@@ -68,6 +104,21 @@ public:
 
 	PxU32									mNbThreads;
 
+	FixedStepper							mStepper;
+	bool									mOverlapRendering;
+	bool									mSimulating;
+	bool									mStepPending;
+
+	XMFLOAT4X4								mBoxWorlds[MAX_BOXES];
+	UINT									mPosesUpdated;
+
+	CookedMeshCache							mCookedMeshCache;
+	std::map<UINT64, PxTriangleMesh*>		mTriangleMeshes;
+	PxTriangleMesh*							mObjectMeshes[Last];
+
+	std::map<UINT, PxRigidStatic*>			mTerrainTiles;
+	std::vector<UINT>						mWantedTerrainTiles;
+
 	
 
 	
@@ -0,0 +1,93 @@
+//***************************************************************************************
+// Platform.h
+//
+// Pulls in xnamath.h and the handful of Win32 types it depends on.  CPU-side engine
+// code includes this instead of <Windows.h> so it can also be built headless (zeus_core)
+// with GCC/Clang, where the Win32 pieces are supplied below.
+//***************************************************************************************
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#if defined(_WIN32)
+
+#include <Windows.h>
+#include <xnamath.h>
+
+#else
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// xnamath.h only knows x86/x64 and MSVC's __m128 operator overloads, so use its
+// portable scalar path.  Hot loops that want SIMD use <xmmintrin.h> directly.
+#if !defined(_XM_X64_) && !defined(_XM_X86_)
+#define _XM_X64_
+#endif
+#ifndef _XM_NO_INTRINSICS_
+#define _XM_NO_INTRINSICS_
+#endif
+
+typedef int             BOOL;
+typedef int             INT;
+typedef unsigned int    UINT;
+typedef float           FLOAT;
+typedef char            CHAR;
+typedef unsigned char   BYTE;
+typedef short           SHORT;
+typedef unsigned short  USHORT;
+typedef unsigned short  WORD;
+typedef int32_t         LONG;
+typedef uint32_t        ULONG;
+typedef uint32_t        DWORD;
+typedef int64_t         INT64;
+typedef uint64_t        UINT64;
+typedef int64_t         __int64;
+typedef const char*     LPCSTR;
+typedef void            VOID;
+
+#ifndef CONST
+#define CONST const
+#endif
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define __cdecl
+#define __inline        inline
+#define __forceinline   inline __attribute__((always_inline))
+
+// __declspec(x) -> __declspec_x so each MSVC spelling maps to its GCC attribute.
+#define __declspec(x)           __declspec_##x
+#define __declspec_align(n)     __attribute__((aligned(n)))
+#define __declspec_selectany    __attribute__((weak))
+#define __declspec_noinline     __attribute__((noinline))
+
+#define ZeroMemory(dst, len)    memset((dst), 0, (len))
+
+inline void OutputDebugStringA(const char* s) { fputs(s, stderr); }
+inline void __debugbreak() { __builtin_trap(); }
+
+#include <xnamath.h>
+
+#endif // _WIN32
+
+// Logical processors available to the process; never less than 1.
+inline UINT GetHardwareThreadCount()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	UINT count = (UINT)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	UINT count = n > 0 ? (UINT)n : 1;
+#endif
+	return count > 0 ? count : 1;
+}
+
+#endif // PLATFORM_H
@@ -0,0 +1,137 @@
+//***************************************************************************************
+// RenderQueue.cpp
+//***************************************************************************************
+
+#include "RenderQueue.h"
+#include "MathHelper.h"
+#include <cstring>
+
+RenderQueue::RenderQueue()
+{
+	Clear();
+}
+
+void RenderQueue::Clear()
+{
+	mPackets.clear();
+	mKeys.clear();
+	mOrder.clear();
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+UINT64 RenderQueue::MakeKey(UINT technique, UINT material, UINT mesh, float depth)
+{
+	UINT d = (UINT)(MathHelper::Clamp(depth, 0.0f, 1.0f)*16777215.0f);
+
+	return ((UINT64)(technique & 0xff) << 56) |
+		((UINT64)(material & 0xffff) << 40) |
+		((UINT64)(mesh & 0xffff) << 24) |
+		(UINT64)d;
+}
+
+void RenderQueue::Submit(const DrawPacket& packet, float depth)
+{
+	mKeys.push_back(MakeKey(packet.Technique, packet.Material, packet.Mesh, depth));
+	mOrder.push_back((UINT)mPackets.size());
+	mPackets.push_back(packet);
+}
+
+void RenderQueue::RadixSort(UINT64* keys, UINT* values, UINT64* keyScratch, UINT* valueScratch, UINT count)
+{
+	// Already sorted, and the skip test below reads the first key.
+	if(count < 2)
+		return;
+
+	UINT64* srcKeys = keys;
+	UINT* srcValues = values;
+	UINT64* dstKeys = keyScratch;
+	UINT* dstValues = valueScratch;
+
+	for(UINT shift = 0; shift < 64; shift += 8)
+	{
+		UINT offsets[256];
+		memset(offsets, 0, sizeof(offsets));
+		for(UINT i = 0; i < count; ++i)
+			++offsets[(srcKeys[i] >> shift) & 0xff];
+
+		// Every key has the same byte here; the pass would be a plain copy.
+		if(offsets[(srcKeys[0] >> shift) & 0xff] == count)
+			continue;
+
+		UINT sum = 0;
+		for(UINT b = 0; b < 256; ++b)
+		{
+			UINT n = offsets[b];
+			offsets[b] = sum;
+			sum += n;
+		}
+
+		for(UINT i = 0; i < count; ++i)
+		{
+			UINT dst = offsets[(srcKeys[i] >> shift) & 0xff]++;
+			dstKeys[dst] = srcKeys[i];
+			dstValues[dst] = srcValues[i];
+		}
+
+		UINT64* k = srcKeys; srcKeys = dstKeys; dstKeys = k;
+		UINT* v = srcValues; srcValues = dstValues; dstValues = v;
+	}
+
+	if(srcKeys != keys)
+	{
+		memcpy(keys, srcKeys, count*sizeof(UINT64));
+		memcpy(values, srcValues, count*sizeof(UINT));
+	}
+}
+
+void RenderQueue::Sort()
+{
+	UINT count = (UINT)mKeys.size();
+	if(count < 2)
+		return;
+
+	mKeyScratch.resize(count);
+	mOrderScratch.resize(count);
+	RadixSort(&mKeys[0], &mOrder[0], &mKeyScratch[0], &mOrderScratch[0], count);
+}
+
+void RenderQueue::Execute(RenderQueueSink& sink)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	mStats.Packets = (UINT)mPackets.size();
+
+	UINT technique = NotInstanced;
+	UINT material = NotInstanced;
+	UINT mesh = NotInstanced;
+
+	for(UINT i = 0; i < mOrder.size(); ++i)
+	{
+		const DrawPacket& packet = mPackets[mOrder[i]];
+
+		if(packet.Technique != technique)
+		{
+			technique = packet.Technique;
+			material = NotInstanced;
+			mesh = NotInstanced;
+			sink.BindTechnique(technique);
+			++mStats.TechniqueChanges;
+		}
+
+		if(packet.Material != material)
+		{
+			material = packet.Material;
+			sink.BindMaterial(material);
+			++mStats.MaterialChanges;
+		}
+
+		if(packet.Mesh != mesh)
+		{
+			mesh = packet.Mesh;
+			sink.BindMesh(mesh);
+			++mStats.MeshChanges;
+		}
+
+		sink.Draw(packet);
+		++mStats.Draws;
+	}
+}
@@ -0,0 +1,109 @@
+//***************************************************************************************
+// RenderQueue.h
+//
+// Collects the frame's draws as packets, sorts them by a 64-bit state key and replays
+// them through a RenderQueueSink that is told only about the state that changes.
+// Technique, material and mesh are ids into tables the caller owns, so the queue knows
+// nothing about D3D and can be driven headlessly.
+//
+// Key layout, most significant bits first:
+//
+//   [63..56] technique   [55..40] material   [39..24] mesh   [23..0] depth
+//
+// Packets that share all state draw front to back.
+//***************************************************************************************
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "Platform.h"
+#include <vector>
+
+struct DrawPacket
+{
+	UINT Technique;
+	UINT Material;
+	UINT Mesh;
+
+	UINT IndexCount;
+	UINT StartIndex;
+	INT  BaseVertex;
+
+	// Ignored by instanced packets, whose transforms live in the instance buffer.
+	XMFLOAT4X4 World;
+
+	// Instance batch drawn with a single instanced call, or RenderQueue::NotInstanced.
+	UINT InstanceBatch;
+};
+
+struct RenderQueueStats
+{
+	UINT Packets;
+	UINT TechniqueChanges;
+	UINT MaterialChanges;
+	UINT MeshChanges;
+	UINT Draws;
+};
+
+// Receives the sorted stream.  A technique change is followed by a material and a mesh
+// bind even when those ids are unchanged, since a new technique may belong to another
+// effect or want another input layout.
+class RenderQueueSink
+{
+public:
+	virtual ~RenderQueueSink() {}
+
+	virtual void BindTechnique(UINT technique) = 0;
+	virtual void BindMaterial(UINT material) = 0;
+	virtual void BindMesh(UINT mesh) = 0;
+	virtual void Draw(const DrawPacket& packet) = 0;
+};
+
+class RenderQueue
+{
+public:
+	static const UINT NotInstanced = 0xffffffff;
+
+	static const UINT MaxTechniques = 1 << 8;
+	static const UINT MaxMaterials  = 1 << 16;
+	static const UINT MaxMeshes     = 1 << 16;
+
+	RenderQueue();
+
+	// Drops the packets; capacity is kept between frames.
+	void Clear();
+
+	// depth is the normalized distance to the camera, 0 nearest.
+	void Submit(const DrawPacket& packet, float depth);
+
+	static UINT64 MakeKey(UINT technique, UINT material, UINT mesh, float depth);
+
+	// Stable LSD radix sort on the keys, 8 bits per pass.  Passes whose byte is the same
+	// in every key are skipped, so in practice only the technique, material and mesh
+	// bytes in use and the top depth bytes cost anything.  values move with their keys.
+	static void RadixSort(UINT64* keys, UINT* values, UINT64* keyScratch, UINT* valueScratch, UINT count);
+
+	void Sort();
+
+	// Replays the sorted packets and records the state change counts in GetStats.
+	void Execute(RenderQueueSink& sink);
+
+	const RenderQueueStats& GetStats()const { return mStats; }
+
+	UINT GetNumPackets()const { return (UINT)mPackets.size(); }
+	const DrawPacket& GetSortedPacket(UINT i)const { return mPackets[mOrder[i]]; }
+	UINT64 GetSortedKey(UINT i)const { return mKeys[i]; }
+
+private:
+	std::vector<DrawPacket> mPackets;
+
+	// Parallel arrays; after Sort, mOrder[i] is the packet with the i-th smallest key.
+	std::vector<UINT64> mKeys;
+	std::vector<UINT> mOrder;
+	std::vector<UINT64> mKeyScratch;
+	std::vector<UINT> mOrderScratch;
+
+	RenderQueueStats mStats;
+};
+
+#endif // RENDERQUEUE_H
@@ -0,0 +1,233 @@
+//***************************************************************************************
+// TangentGenerator.cpp
+//***************************************************************************************
+
+#include "TangentGenerator.h"
+#include "ParallelFor.h"
+#include <cmath>
+#include <cstddef>
+
+namespace
+{
+	const UINT MinTrianglesPerBand = 4096;
+	const UINT MinVerticesPerBand = 4096;
+
+	// Below this squared length a direction is treated as degenerate.
+	const float MinLengthSq = 1e-20f;
+
+	// Corners with no usable tangent have no handedness, and stay on the original
+	// vertex when it splits.
+	const signed char Undecided = 0;
+
+	XMVECTOR LoadFloat3(const unsigned char* vertex, UINT offset)
+	{
+		return XMLoadFloat3((const XMFLOAT3*)(vertex + offset));
+	}
+
+	XMVECTOR LoadFloat2(const unsigned char* vertex, UINT offset)
+	{
+		return XMLoadFloat2((const XMFLOAT2*)(vertex + offset));
+	}
+
+	// v/|v|, or zero if v is too short to have a direction.
+	XMVECTOR NormalizeOrZero(FXMVECTOR v)
+	{
+		float lengthSq = XMVectorGetX(XMVector3LengthSq(v));
+		return lengthSq > MinLengthSq ? XMVectorScale(v, 1.0f / sqrtf(lengthSq)) : XMVectorZero();
+	}
+
+	// The part of v perpendicular to the unit normal n, normalized, or zero.
+	XMVECTOR Perpendicular(FXMVECTOR v, FXMVECTOR n)
+	{
+		return NormalizeOrZero(v - XMVector3Dot(n, v)*n);
+	}
+
+	// Any unit vector perpendicular to n, from the axis least along it.
+	XMVECTOR AnyPerpendicular(FXMVECTOR n)
+	{
+		XMFLOAT3 a;
+		XMStoreFloat3(&a, XMVectorAbs(n));
+		XMVECTOR axis = a.x <= a.y && a.x <= a.z ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) :
+			a.y <= a.z ? XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		XMVECTOR t = Perpendicular(axis, n);
+		return XMVectorGetX(XMVector3LengthSq(t)) > 0.0f ? t : XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	// The unit normal of a vertex, or zero if it has none.
+	XMVECTOR LoadNormal(const unsigned char* vertex, UINT offset)
+	{
+		return NormalizeOrZero(LoadFloat3(vertex, offset));
+	}
+
+	float CornerAngle(FXMVECTOR e1, FXMVECTOR e2)
+	{
+		float lengthSq = XMVectorGetX(XMVector3LengthSq(e1))*XMVectorGetX(XMVector3LengthSq(e2));
+		if(lengthSq <= MinLengthSq)
+			return 0.0f;
+
+		float c = XMVectorGetX(XMVector3Dot(e1, e2)) / sqrtf(lengthSq);
+		return acosf(MathHelper::Clamp(c, -1.0f, 1.0f));
+	}
+}
+
+void TangentGenerator::Generate(const void* vertices, UINT stride, UINT numVertices, UINT normalOffset, UINT texCOffset,
+	UINT* indices, UINT numIndices, std::vector<UINT>& sourceVertices, std::vector<XMFLOAT4>& tangents,
+	UINT numThreads)
+{
+	const unsigned char* base = (const unsigned char*)vertices;
+	UINT numTriangles = numIndices / 3;
+
+	// 1. Each corner's angle weighted tangent and handedness.
+	std::vector<XMFLOAT3> cornerTangents(numTriangles*3);
+	std::vector<signed char> cornerSigns(numTriangles*3, Undecided);
+	ParallelForRows(numTriangles, MinTrianglesPerBand, numThreads, [&](UINT first, UINT end)
+	{
+		for(UINT t = first; t < end; ++t)
+		{
+			const unsigned char* v[3];
+			XMVECTOR p[3];
+			XMVECTOR uv[3];
+			for(UINT k = 0; k < 3; ++k)
+			{
+				v[k] = base + (size_t)indices[3*t + k]*stride;
+				p[k] = LoadFloat3(v[k], 0);
+				uv[k] = LoadFloat2(v[k], texCOffset);
+			}
+
+			XMVECTOR d1 = p[1] - p[0];
+			XMVECTOR d2 = p[2] - p[0];
+			XMFLOAT2 st1, st2;
+			XMStoreFloat2(&st1, uv[1] - uv[0]);
+			XMStoreFloat2(&st2, uv[2] - uv[0]);
+
+			// The derivatives scaled by the signed texture area, whose sign is put back so
+			// they do not depend on the winding.
+			float area = st1.x*st2.y - st2.x*st1.y;
+			float orientation = area < 0.0f ? -1.0f : 1.0f;
+			XMVECTOR faceTangent = orientation*(st2.y*d1 - st1.y*d2);
+			XMVECTOR faceBitangent = orientation*(st1.x*d2 - st2.x*d1);
+			bool usable = area != 0.0f;
+
+			for(UINT k = 0; k < 3; ++k)
+			{
+				UINT corner = 3*t + k;
+				XMVECTOR n = LoadNormal(v[k], normalOffset);
+				XMVECTOR tangent = usable ? Perpendicular(faceTangent, n) : XMVectorZero();
+				float weight = CornerAngle(p[(k + 1) % 3] - p[k], p[(k + 2) % 3] - p[k]);
+				XMStoreFloat3(&cornerTangents[corner], weight*tangent);
+
+				if(XMVectorGetX(XMVector3LengthSq(tangent)) > 0.0f)
+				{
+					float side = XMVectorGetX(XMVector3Dot(XMVector3Cross(n, tangent), faceBitangent));
+					cornerSigns[corner] = side < 0.0f ? -1 : 1;
+				}
+			}
+		}
+	});
+
+	// 2. Split every vertex used with both handednesses; the left handed corners move
+	// to a copy appended after the original vertices.
+	std::vector<unsigned char> sides(numVertices, 0);
+	for(UINT c = 0; c < numTriangles*3; ++c)
+	{
+		if(cornerSigns[c] != Undecided)
+			sides[indices[c]] |= cornerSigns[c] > 0 ? 1 : 2;
+	}
+
+	sourceVertices.resize(numVertices);
+	for(UINT i = 0; i < numVertices; ++i)
+		sourceVertices[i] = i;
+
+	std::vector<UINT> mirrored(numVertices, 0);
+	for(UINT i = 0; i < numVertices; ++i)
+	{
+		if(sides[i] == 3)
+		{
+			mirrored[i] = (UINT)sourceVertices.size();
+			sourceVertices.push_back(i);
+		}
+	}
+
+	for(UINT c = 0; c < numTriangles*3; ++c)
+	{
+		if(cornerSigns[c] < 0 && sides[indices[c]] == 3)
+			indices[c] = mirrored[indices[c]];
+	}
+
+	// Each vertex's corners, in corner order: Corners[offsets[v]] to Corners[offsets[v+1]].
+	UINT numResult = (UINT)sourceVertices.size();
+	std::vector<UINT> offsets(numResult + 1, 0);
+	for(UINT c = 0; c < numTriangles*3; ++c)
+		++offsets[indices[c] + 1];
+	for(UINT i = 0; i < numResult; ++i)
+		offsets[i + 1] += offsets[i];
+
+	std::vector<UINT> corners(numTriangles*3);
+	std::vector<UINT> fill(offsets.begin(), offsets.end() - 1);
+	for(UINT c = 0; c < numTriangles*3; ++c)
+		corners[fill[indices[c]]++] = c;
+
+	// 3. Sum, and make each perpendicular to its normal.
+	tangents.resize(numResult);
+	ParallelForRows(numResult, MinVerticesPerBand, numThreads, [&](UINT first, UINT end)
+	{
+		for(UINT i = first; i < end; ++i)
+		{
+			UINT source = sourceVertices[i];
+			float w = i != source || sides[source] == 2 ? -1.0f : 1.0f;
+
+			XMVECTOR sum = XMVectorZero();
+			for(UINT j = offsets[i]; j < offsets[i + 1]; ++j)
+				sum += XMLoadFloat3(&cornerTangents[corners[j]]);
+
+			XMVECTOR n = LoadNormal(base + (size_t)source*stride, normalOffset);
+			XMVECTOR tangent = Perpendicular(sum, n);
+			if(XMVectorGetX(XMVector3LengthSq(tangent)) <= 0.0f)
+				tangent = AnyPerpendicular(n);
+
+			XMStoreFloat4(&tangents[i], XMVectorSetW(tangent, w));
+		}
+	});
+}
+
+void TangentGenerator::Generate(GeometryGenerator::MeshData& mesh, UINT numThreads)
+{
+	if(mesh.Vertices.empty() || mesh.Indices.empty())
+		return;
+
+	std::vector<UINT> sources;
+	std::vector<XMFLOAT4> tangents;
+	Generate(&mesh.Vertices[0], sizeof(GeometryGenerator::Vertex), (UINT)mesh.Vertices.size(),
+		offsetof(GeometryGenerator::Vertex, Normal), offsetof(GeometryGenerator::Vertex, TexC),
+		&mesh.Indices[0], (UINT)mesh.Indices.size(), sources, tangents, numThreads);
+
+	mesh.Vertices.resize(sources.size());
+	for(size_t i = 0; i < sources.size(); ++i)
+	{
+		if(sources[i] != i)
+			mesh.Vertices[i] = mesh.Vertices[sources[i]];
+		mesh.Vertices[i].TangentU = XMFLOAT3(tangents[i].x, tangents[i].y, tangents[i].z);
+	}
+}
+
+void TangentGenerator::Generate(std::vector<MeshVertexPosNormalTexTan>& vertices, std::vector<UINT>& indices,
+	UINT numThreads)
+{
+	if(vertices.empty() || indices.empty())
+		return;
+
+	std::vector<UINT> sources;
+	std::vector<XMFLOAT4> tangents;
+	Generate(&vertices[0], sizeof(MeshVertexPosNormalTexTan), (UINT)vertices.size(),
+		offsetof(MeshVertexPosNormalTexTan, Normal), offsetof(MeshVertexPosNormalTexTan, Tex),
+		&indices[0], (UINT)indices.size(), sources, tangents, numThreads);
+
+	vertices.resize(sources.size());
+	for(size_t i = 0; i < sources.size(); ++i)
+	{
+		if(sources[i] != i)
+			vertices[i] = vertices[sources[i]];
+		vertices[i].TangentU = XMFLOAT3(tangents[i].x, tangents[i].y, tangents[i].z);
+		vertices[i].TexNum = (vertices[i].TexNum & ~TexNumMirrored) | (tangents[i].w < 0.0f ? TexNumMirrored : 0);
+	}
+}
@@ -0,0 +1,54 @@
+//***************************************************************************************
+// TangentGenerator.h
+//
+// Per vertex tangents from texture coordinate derivatives, built the way MikkTSpace
+// (Mikkelsen 2008) builds them, so normal maps baked against it light the same:
+//
+//   1. Each triangle's tangent and bitangent are the directions its position moves
+//      as u and v increase.  At each corner the tangent is projected into the plane
+//      of that corner's normal, normalized and weighted by the corner's angle.
+//   2. A corner's handedness is whether the bitangent lies along cross(normal,
+//      tangent) or against it.  Vertices whose corners disagree, where the texture
+//      is mirrored, are split so each side is summed on its own.
+//   3. Each vertex sums its corners and the result is made perpendicular to its
+//      normal.  Vertices with no usable corner, only degenerate texture coordinates,
+//      get an arbitrary perpendicular.
+//
+// Triangles and vertices are processed in parallel bands; every sum runs in corner
+// order, so the result does not depend on the number of threads.
+//***************************************************************************************
+
+#ifndef TANGENTGENERATOR_H
+#define TANGENTGENERATOR_H
+
+#include "GeometryGenerator.h"
+#include "MeshFile.h"
+#include <vector>
+
+class TangentGenerator
+{
+public:
+	///<summary>
+	/// Tangents for a triangle list whose vertices have their normal and texture
+	/// coordinates normalOffset and texCOffset bytes in.  Each vertex starts with its
+	/// position.  Split vertices are appended: indices are rewritten in place, and
+	/// sourceVertices receives the vertex each one of the result copies, the first
+	/// numVertices being themselves.  tangents gets one per vertex of the result, w
+	/// the handedness: bitangent = w*cross(normal, tangent).  numThreads == 0 uses one
+	/// per hardware thread.
+	///</summary>
+	static void Generate(const void* vertices, UINT stride, UINT numVertices, UINT normalOffset, UINT texCOffset,
+		UINT* indices, UINT numIndices, std::vector<UINT>& sourceVertices, std::vector<XMFLOAT4>& tangents,
+		UINT numThreads = 0);
+
+	///<summary>
+	/// In place, splitting vertices and filling TangentU.  MeshData has nowhere to keep
+	/// the handedness and drops it; the mesh vertices keep it as TexNumMirrored in
+	/// TexNum, which the effects read.
+	///</summary>
+	static void Generate(GeometryGenerator::MeshData& mesh, UINT numThreads = 0);
+	static void Generate(std::vector<MeshVertexPosNormalTexTan>& vertices, std::vector<UINT>& indices,
+		UINT numThreads = 0);
+};
+
+#endif // TANGENTGENERATOR_H
@@ -13,13 +13,19 @@
 Terrain::Terrain() : 
 	mQuadPatchVB(0), 
 	mQuadPatchIB(0), 
+	mPatchLodBuffer(0),
+	mPatchLodSRV(0),
 	mLayerMapArraySRV(0), 
 	mBlendMapSRV(0), 
 	mHeightMapSRV(0),
+	mHeightMapTex(0),
 	mNumPatchVertices(0),
 	mNumPatchQuadFaces(0),
 	mNumPatchVertRows(0),
-	mNumPatchVertCols(0)
+	mNumPatchVertCols(0),
+	mWindowRow(0),
+	mWindowCol(0),
+	mSelectionMs(0.0f)
 {
 	XMStoreFloat4x4(&mWorld, XMMatrixIdentity());
 
@@ -33,9 +39,12 @@ Terrain::~Terrain()
 {
 	ReleaseCOM(mQuadPatchVB);
 	ReleaseCOM(mQuadPatchIB);
+	ReleaseCOM(mPatchLodBuffer);
+	ReleaseCOM(mPatchLodSRV);
 	ReleaseCOM(mLayerMapArraySRV);
 	ReleaseCOM(mBlendMapSRV);
 	ReleaseCOM(mHeightMapSRV);
+	ReleaseCOM(mHeightMapTex);
 }
 
 float Terrain::GetWidth()const
@@ -52,41 +61,50 @@ float Terrain::GetDepth()const
 
 float Terrain::GetHeight(float x, float z)const
 {
-	// Transform from terrain local space to "cell" space.
-	float c = (x + 0.5f*GetWidth()) /  mInfo.CellSpacing;
-	float d = (z - 0.5f*GetDepth()) / -mInfo.CellSpacing;
-
-	// Get the row and column we are in.
-	int row = (int)floorf(d);
-	int col = (int)floorf(c);
-
-	// Grab the heights of the cell we are in.
-	// A*--*B
-	//  | /|
-	//  |/ |
-	// C*--*D
-	float A = mHeightmap[row*mInfo.HeightmapWidth + col];
-	float B = mHeightmap[row*mInfo.HeightmapWidth + col + 1];
-	float C = mHeightmap[(row+1)*mInfo.HeightmapWidth + col];
-	float D = mHeightmap[(row+1)*mInfo.HeightmapWidth + col + 1];
-
-	// Where we are relative to the cell.
-	float s = c - (float)col;
-	float t = d - (float)row;
-
-	// If upper triangle ABC.
-	if( s + t <= 1.0f)
-	{
-		float uy = B - A;
-		float vy = C - A;
-		return A + s*uy + t*vy;
-	}
-	else // lower triangle DCB.
-	{
-		float uy = C - D;
-		float vy = B - D;
-		return D + (1.0f-s)*uy + (1.0f-t)*vy;
-	}
+	if(IsTiled())
+		return mStreamer.GetHeight(x, z);
+
+	return mHeightmap.GetHeight(x, z, mInfo.CellSpacing);
+}
+
+void Terrain::GetHeights(const XMFLOAT3* positions, UINT count, float* heights, XMFLOAT3* normals)const
+{
+	mHeightQuery.GetHeights(positions, count, heights, normals);
+}
+
+float Terrain::GetCellSpacing()const
+{
+	return mInfo.CellSpacing;
+}
+
+const Heightmap& Terrain::GetHeightmap()const
+{
+	return mHeightmap;
+}
+
+const HeightPyramid& Terrain::GetHeightPyramid()const
+{
+	return mHeightPyramid;
+}
+
+const TerrainRaycaster& Terrain::GetRaycaster()const
+{
+	return mRaycaster;
+}
+
+const TerrainSelectionStats& Terrain::GetSelectionStats()const
+{
+	return mQuadtree.GetStats();
+}
+
+float Terrain::GetSelectionMs()const
+{
+	return mSelectionMs;
+}
+
+bool Terrain::IsTiled()const
+{
+	return mTiled.IsOpen();
 }
 
 XMMATRIX Terrain::GetWorld()const
@@ -103,6 +121,8 @@ void Terrain::Init(ID3D11Device* device, ID3D11DeviceContext* dc, const InitInfo
 {
 	mInfo = initInfo;
 
+	bool tiled = !mInfo.TiledHeightMapFilename.empty() && OpenTiledHeightmap();
+
 	// Divide heightmap into patches such that each patch has CellsPerPatch.
 	mNumPatchVertRows = ((mInfo.HeightmapHeight-1) / CellsPerPatch) + 1;
 	mNumPatchVertCols = ((mInfo.HeightmapWidth-1) / CellsPerPatch) + 1;
@@ -110,13 +130,24 @@ void Terrain::Init(ID3D11Device* device, ID3D11DeviceContext* dc, const InitInfo
 	mNumPatchVertices  = mNumPatchVertRows*mNumPatchVertCols;
 	mNumPatchQuadFaces = (mNumPatchVertRows-1)*(mNumPatchVertCols-1);
 
-	LoadHeightmap();
-	Smooth();
-	CalcAllPatchBoundsY();
+	std::vector<HALF> halfHeights;
+	if(tiled)
+	{
+		LoadWindow();
+		BuildHalfHeights(halfHeights);
+	}
+	else
+	{
+		LoadHeightmap(halfHeights);
+	}
+	mHeightPyramid.Build(mHeightmap);
+	mHeightPyramid.GetPatchBoundsY(CellsPerPatch, mPatchBoundsY);
+	InitQueries();
 
 	BuildQuadPatchVB(device);
 	BuildQuadPatchIB(device);
-	BuildHeightmapSRV(device);
+	BuildPatchLodBuffer(device);
+	BuildHeightmapSRV(device, halfHeights);
 
 	std::vector<std::wstring> layerFilenames;
 	layerFilenames.push_back(mInfo.LayerMapFilename0);
@@ -130,8 +161,76 @@ void Terrain::Init(ID3D11Device* device, ID3D11DeviceContext* dc, const InitInfo
 		mInfo.BlendMapFilename.c_str(), 0, 0, &mBlendMapSRV, 0));
 }
 
+void Terrain::Update(ID3D11DeviceContext* dc, const XMFLOAT3& eyePosW)
+{
+	if(!IsTiled())
+		return;
+
+	mStreamer.Update(eyePosW.x, eyePosW.z);
+
+	UINT row, col;
+	GetWindowOrigin(eyePosW.x, eyePosW.z, row, col);
+	if(row == mWindowRow && col == mWindowCol)
+		return;
+
+	mWindowRow = row;
+	mWindowCol = col;
+	LoadWindow();
+	mHeightPyramid.Build(mHeightmap);
+	mHeightPyramid.GetPatchBoundsY(CellsPerPatch, mPatchBoundsY);
+	InitQueries();
+
+	std::vector<Vertex::Terrain> patchVertices;
+	BuildPatchVertices(patchVertices);
+
+	D3D11_MAPPED_SUBRESOURCE mappedData;
+	HR(dc->Map(mQuadPatchVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
+	memcpy(mappedData.pData, &patchVertices[0], sizeof(Vertex::Terrain) * patchVertices.size());
+	dc->Unmap(mQuadPatchVB, 0);
+
+	std::vector<HALF> hmap;
+	BuildHalfHeights(hmap);
+	dc->UpdateSubresource(mHeightMapTex, 0, 0, &hmap[0], mInfo.HeightmapWidth*sizeof(HALF), 0);
+}
+
 void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight lights[3])
 {
+	Draw(dc, cam.ViewProj(), cam.GetPosition(), lights);
+}
+
+void Terrain::Draw(ID3D11DeviceContext* dc, CXMMATRIX viewProj, const XMFLOAT3& eyePosW, DirectionalLight lights[3])
+{
+	// Only the patches the quadtree finds inside this pass's frustum reach the
+	// tessellator; the hull shader's own test then catches the rest.
+	LARGE_INTEGER start, end, frequency;
+	QueryPerformanceCounter(&start);
+
+	mQuadtree.Select(viewProj, eyePosW, mSelectedNodes);
+	mQuadtree.GetVisiblePatches(mSelectedNodes, mVisiblePatches, &mVisiblePatchNodes);
+
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+	mSelectionMs = (float)(1000.0*(end.QuadPart - start.QuadPart) / frequency.QuadPart);
+
+	if(mVisiblePatches.empty())
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mappedData;
+	HR(dc->Map(mQuadPatchIB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
+	USHORT* indices = reinterpret_cast<USHORT*>(mappedData.pData);
+	for(size_t p = 0; p < mVisiblePatches.size(); ++p)
+		WritePatchIndices(mVisiblePatches[p], indices + 4*p);
+	dc->Unmap(mQuadPatchIB, 0);
+
+	HR(dc->Map(mPatchLodBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
+	XMFLOAT4* patchLods = reinterpret_cast<XMFLOAT4*>(mappedData.pData);
+	for(size_t p = 0; p < mVisiblePatches.size(); ++p)
+	{
+		const TerrainNode& node = mSelectedNodes[mVisiblePatchNodes[p]];
+		patchLods[p] = XMFLOAT4((float)node.Lod, node.MorphStart, node.MorphEnd, 0.0f);
+	}
+	dc->Unmap(mPatchLodBuffer, 0);
+
 	dc->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
 	dc->IASetInputLayout(InputLayouts::Terrain);
 
@@ -140,7 +239,6 @@ void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight
     dc->IASetVertexBuffers(0, 1, &mQuadPatchVB, &stride, &offset);
 	dc->IASetIndexBuffer(mQuadPatchIB, DXGI_FORMAT_R16_UINT, 0);
 
-	XMMATRIX viewProj = cam.ViewProj();
 	XMMATRIX world  = XMLoadFloat4x4(&mWorld);
 	XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
 	XMMATRIX worldViewProj = world*viewProj;
@@ -150,13 +248,14 @@ void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight
 
 	// Set per frame constants.
 	Effects::TerrainFX->SetViewProj(viewProj);
-	Effects::TerrainFX->SetEyePosW(cam.GetPosition());
+	Effects::TerrainFX->SetEyePosW(eyePosW);
 	Effects::TerrainFX->SetDirLights(lights);
 	Effects::TerrainFX->SetFogColor(Colors::Silver);
 	Effects::TerrainFX->SetFogStart(15.0f);
 	Effects::TerrainFX->SetFogRange(175.0f);
-	Effects::TerrainFX->SetMinDist(20.0f);
-	Effects::TerrainFX->SetMaxDist(500.0f);
+	Effects::TerrainFX->SetLodRange0(mQuadtree.GetLodRange(0));
+	Effects::TerrainFX->SetLodMorphRatio(mQuadtree.GetMorphRatio());
+	Effects::TerrainFX->SetNumLods((float)mQuadtree.GetNumLods());
 	Effects::TerrainFX->SetMinTess(0.0f);
 	Effects::TerrainFX->SetMaxTess(5.0f);
 	Effects::TerrainFX->SetTexelCellSpaceU(1.0f / mInfo.HeightmapWidth);
@@ -167,6 +266,7 @@ void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight
 	Effects::TerrainFX->SetLayerMapArray(mLayerMapArraySRV);
 	Effects::TerrainFX->SetBlendMap(mBlendMapSRV);
 	Effects::TerrainFX->SetHeightMap(mHeightMapSRV);
+	Effects::TerrainFX->SetPatchLods(mPatchLodSRV);
 
 	Effects::TerrainFX->SetMaterial(mMat);
 
@@ -179,7 +279,7 @@ void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight
         ID3DX11EffectPass* pass = tech->GetPassByIndex(i);
 		pass->Apply(0, dc);
 
-		dc->DrawIndexed(mNumPatchQuadFaces*4, 0, 0);
+		dc->DrawIndexed((UINT)mVisiblePatches.size()*4, 0, 0);
 	}	
 
 	// FX sets tessellation stages, but it does not disable them.  So do that here
@@ -188,137 +288,131 @@ void Terrain::Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight
 	dc->DSSetShader(0, 0, 0);
 }
 
-void Terrain::LoadHeightmap()
+void Terrain::LoadHeightmap(std::vector<HALF>& halfHeights)
 {
-	// A height for each vertex
-	std::vector<unsigned char> in( mInfo.HeightmapWidth * mInfo.HeightmapHeight );
-
-	// Open the file.
-	std::ifstream inFile;
-	inFile.open(mInfo.HeightMapFilename.c_str(), std::ios_base::binary);
+	// Heightmap paths are plain ASCII, so narrowing is lossless.
+	std::string filename(mInfo.HeightMapFilename.begin(), mInfo.HeightMapFilename.end());
 
-	if(inFile)
-	{
-		// Read the RAW bytes.
-		inFile.read((char*)&in[0], (std::streamsize)in.size());
-
-		// Done with file.
-		inFile.close();
-	}
-
-	// Copy the array data into a float array and scale it.
-	mHeightmap.resize(mInfo.HeightmapHeight * mInfo.HeightmapWidth, 0);
-	for(UINT i = 0; i < mInfo.HeightmapHeight * mInfo.HeightmapWidth; ++i)
-	{
-		mHeightmap[i] = (in[i] / 255.0f)*mInfo.HeightScale;
-	}
+	// Expands, smooths and converts for the height texture in one multithreaded pass.
+	mHeightmap.LoadRawSmoothed(filename, mInfo.HeightmapWidth, mInfo.HeightmapHeight, mInfo.HeightScale, &halfHeights);
 }
 
-void Terrain::Smooth()
+bool Terrain::OpenTiledHeightmap()
 {
-	std::vector<float> dest( mHeightmap.size() );
-
-	for(UINT i = 0; i < mInfo.HeightmapHeight; ++i)
+	std::string filename(mInfo.TiledHeightMapFilename.begin(), mInfo.TiledHeightMapFilename.end());
+	if(!mTiled.Open(filename))
+		return false;
+
+	// Windows are whole tiles, and tiles whole patches, so each patch's bounds come from
+	// one tile and the window can move a tile at a time.
+	UINT tileCells = mTiled.GetTileCells();
+	UINT tilesX = MathHelper::Min((mInfo.HeightmapWidth-1) / tileCells, mTiled.GetNumTilesX());
+	UINT tilesZ = MathHelper::Min((mInfo.HeightmapHeight-1) / tileCells, mTiled.GetNumTilesZ());
+	if(tileCells % CellsPerPatch != 0 || tilesX == 0 || tilesZ == 0)
 	{
-		for(UINT j = 0; j < mInfo.HeightmapWidth; ++j)
-		{
-			dest[i*mInfo.HeightmapWidth+j] = Average(i,j);
-		}
+		mTiled.Close();
+		return false;
 	}
 
-	// Replace the old heightmap with the filtered one.
-	mHeightmap = dest;
+	mInfo.HeightmapWidth = tilesX*tileCells + 1;
+	mInfo.HeightmapHeight = tilesZ*tileCells + 1;
+	mTileScratch.resize(mTiled.GetTileSamples()*mTiled.GetTileSamples());
+	mHeightmap.Resize(mInfo.HeightmapWidth, mInfo.HeightmapHeight, mInfo.HeightScale);
+
+	// Keep a tile's worth of map beyond the window streamed, so moving the window rarely
+	// has to wait on the disk.
+	float tileSize = tileCells*mInfo.CellSpacing;
+	float radius = 0.5f*MathHelper::Max(tilesX, tilesZ)*tileSize + tileSize;
+	mStreamer.Start(mTiled, mInfo.CellSpacing, radius);
+
+	GetWindowOrigin(0.0f, 0.0f, mWindowRow, mWindowCol);
+	mStreamer.Update(0.0f, 0.0f);
+	mStreamer.Flush();
+	return true;
 }
 
-bool Terrain::InBounds(int i, int j)
+void Terrain::GetWindowOrigin(float x, float z, UINT& row, UINT& col)const
 {
-	// True if ij are valid indices; false otherwise.
-	return 
-		i >= 0 && i < (int)mInfo.HeightmapHeight && 
-		j >= 0 && j < (int)mInfo.HeightmapWidth;
+	// The window is centered, as near as whole tiles allow, on the tile under (x, z).
+	UINT tileCells = mTiled.GetTileCells();
+	float tileSize = tileCells*mInfo.CellSpacing;
+	float halfWidth = 0.5f*(mTiled.GetNumCols()-1)*mInfo.CellSpacing;
+	float halfDepth = 0.5f*(mTiled.GetNumRows()-1)*mInfo.CellSpacing;
+	int tilesX = (int)((mInfo.HeightmapWidth-1) / tileCells);
+	int tilesZ = (int)((mInfo.HeightmapHeight-1) / tileCells);
+
+	int tileX = (int)floorf((x + halfWidth) / tileSize) - tilesX/2;
+	int tileZ = (int)floorf((halfDepth - z) / tileSize) - tilesZ/2;
+	col = (UINT)MathHelper::Clamp(tileX, 0, (int)mTiled.GetNumTilesX() - tilesX)*tileCells;
+	row = (UINT)MathHelper::Clamp(tileZ, 0, (int)mTiled.GetNumTilesZ() - tilesZ)*tileCells;
 }
 
-float Terrain::Average(int i, int j)
+void Terrain::LoadWindow()
 {
-	// Function computes the average height of the ij element.
-	// It averages itself with its eight neighbor pixels.  Note
-	// that if a pixel is missing neighbor, we just don't include it
-	// in the average--that is, edge pixels don't have a neighbor pixel.
-	//
-	// ----------
-	// | 1| 2| 3|
-	// ----------
-	// |4 |ij| 6|
-	// ----------
-	// | 7| 8| 9|
-	// ----------
-
-	float avg = 0.0f;
-	float num = 0.0f;
-
-	// Use int to allow negatives.  If we use UINT, @ i=0, m=i-1=UINT_MAX
-	// and no iterations of the outer for loop occur.
-	for(int m = i-1; m <= i+1; ++m)
+	UINT tileCells = mTiled.GetTileCells();
+	UINT tileSamples = mTiled.GetTileSamples();
+	UINT tilesX = (mInfo.HeightmapWidth-1) / tileCells;
+	UINT tilesZ = (mInfo.HeightmapHeight-1) / tileCells;
+	std::vector<float>& heights = mHeightmap.GetData();
+
+	// Neighboring tiles share their border samples, so copying every tile whole leaves
+	// each window sample written with the same value.
+	for(UINT i = 0; i < tilesZ; ++i)
 	{
-		for(int n = j-1; n <= j+1; ++n)
+		for(UINT j = 0; j < tilesX; ++j)
 		{
-			if( InBounds(m,n) )
+			UINT tileX = mWindowCol/tileCells + j;
+			UINT tileZ = mWindowRow/tileCells + i;
+
+			const float* tile = mStreamer.GetTile(tileX, tileZ);
+			if(!tile)
+			{
+				mTiled.DecodeTile(tileX, tileZ, &mTileScratch[0]);
+				tile = &mTileScratch[0];
+			}
+
+			for(UINT r = 0; r < tileSamples; ++r)
 			{
-				avg += mHeightmap[m*mInfo.HeightmapWidth + n];
-				num += 1.0f;
+				memcpy(&heights[(i*tileCells + r)*mInfo.HeightmapWidth + j*tileCells],
+					&tile[r*tileSamples], tileSamples*sizeof(float));
 			}
 		}
 	}
-
-	return avg / num;
 }
 
-void Terrain::CalcAllPatchBoundsY()
+XMFLOAT2 Terrain::GetPatchOrigin()const
 {
-	mPatchBoundsY.resize(mNumPatchQuadFaces);
-
-	// For each patch
-	for(UINT i = 0; i < mNumPatchVertRows-1; ++i)
+	// The top left corner of the map, or of the window onto a tiled map, as (x, z).
+	float halfWidth = 0.5f*GetWidth();
+	float halfDepth = 0.5f*GetDepth();
+	if(IsTiled())
 	{
-		for(UINT j = 0; j < mNumPatchVertCols-1; ++j)
-		{
-			CalcPatchBoundsY(i, j);
-		}
+		halfWidth = 0.5f*(mTiled.GetNumCols()-1)*mInfo.CellSpacing - mWindowCol*mInfo.CellSpacing;
+		halfDepth = 0.5f*(mTiled.GetNumRows()-1)*mInfo.CellSpacing - mWindowRow*mInfo.CellSpacing;
 	}
+
+	return XMFLOAT2(-halfWidth, halfDepth);
 }
 
-void Terrain::CalcPatchBoundsY(UINT i, UINT j)
+void Terrain::InitQueries()
 {
-	// Scan the heightmap values this patch covers and compute the min/max height.
-
-	UINT x0 = j*CellsPerPatch;
-	UINT x1 = (j+1)*CellsPerPatch;
-
-	UINT y0 = i*CellsPerPatch;
-	UINT y1 = (i+1)*CellsPerPatch;
-
-	float minY = +MathHelper::Infinity;
-	float maxY = -MathHelper::Infinity;
-	for(UINT y = y0; y <= y1; ++y)
-	{
-		for(UINT x = x0; x <= x1; ++x)
-		{
-			UINT k = y*mInfo.HeightmapWidth + x;
-			minY = MathHelper::Min(minY, mHeightmap[k]);
-			maxY = MathHelper::Max(maxY, mHeightmap[k]);
-		}
-	}
-
-	UINT patchID = i*(mNumPatchVertCols-1)+j;
-	mPatchBoundsY[patchID] = XMFLOAT2(minY, maxY);
+	XMFLOAT2 origin = GetPatchOrigin();
+	mQuadtree.Init(mHeightPyramid, CellsPerPatch, mInfo.CellSpacing, origin.x, origin.y);
+	mHeightQuery.Init(mHeightmap, mInfo.CellSpacing, origin.x, origin.y);
+	mRaycaster.Init(mHeightmap, mHeightPyramid, mInfo.CellSpacing, origin.x, origin.y);
+
+	// LOD 0 reaches a little over two patches out, so neighboring nodes stay within one
+	// LOD of each other.
+	mQuadtree.SetLodRanges(2.5f*CellsPerPatch*mInfo.CellSpacing);
 }
 
-void Terrain::BuildQuadPatchVB(ID3D11Device* device)
+void Terrain::BuildPatchVertices(std::vector<Vertex::Terrain>& patchVertices)const
 {
-	std::vector<Vertex::Terrain> patchVertices(mNumPatchVertRows*mNumPatchVertCols);
+	patchVertices.resize(mNumPatchVertRows*mNumPatchVertCols);
 
-	float halfWidth = 0.5f*GetWidth();
-	float halfDepth = 0.5f*GetDepth();
+	XMFLOAT2 origin = GetPatchOrigin();
+	float halfWidth = -origin.x;
+	float halfDepth = origin.y;
 
 	float patchWidth = GetWidth() / (mNumPatchVertCols-1);
 	float patchDepth = GetDepth() / (mNumPatchVertRows-1);
@@ -349,19 +443,19 @@ void Terrain::BuildQuadPatchVB(ID3D11Device* device)
 			patchVertices[i*mNumPatchVertCols+j].BoundsY = mPatchBoundsY[patchID];
 		}
 	}
+}
 
-	mMesh.vertcount = patchVertices.size();
-	
-	for(int i = 0; i < patchVertices.size(); i++)
-	{
-		mMesh.positions.push_back(patchVertices[i].Pos);
-	}
+void Terrain::BuildQuadPatchVB(ID3D11Device* device)
+{
+	std::vector<Vertex::Terrain> patchVertices;
+	BuildPatchVertices(patchVertices);
 
+	// A tiled map's window is rewritten whenever it moves.
     D3D11_BUFFER_DESC vbd;
-    vbd.Usage = D3D11_USAGE_IMMUTABLE;
+    vbd.Usage = IsTiled() ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_IMMUTABLE;
 	vbd.ByteWidth = sizeof(Vertex::Terrain) * patchVertices.size();
     vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    vbd.CPUAccessFlags = 0;
+    vbd.CPUAccessFlags = IsTiled() ? D3D11_CPU_ACCESS_WRITE : 0;
     vbd.MiscFlags = 0;
 	vbd.StructureByteStride = 0;
 
@@ -370,49 +464,65 @@ void Terrain::BuildQuadPatchVB(ID3D11Device* device)
     HR(device->CreateBuffer(&vbd, &vinitData, &mQuadPatchVB));
 }
 
-void Terrain::BuildQuadPatchIB(ID3D11Device* device)
+void Terrain::WritePatchIndices(UINT patch, USHORT* indices)const
 {
-	std::vector<USHORT> indices(mNumPatchQuadFaces*4); // 4 indices per quad face
-
-	// Iterate over each quad and compute indices.
-	int k = 0;
-	for(UINT i = 0; i < mNumPatchVertRows-1; ++i)
-	{
-		for(UINT j = 0; j < mNumPatchVertCols-1; ++j)
-		{
-			// Top row of 2x2 quad patch
-			indices[k]   = i*mNumPatchVertCols+j;
-			indices[k+1] = i*mNumPatchVertCols+j+1;
+	UINT i = patch / (mNumPatchVertCols-1);
+	UINT j = patch % (mNumPatchVertCols-1);
 
-			// Bottom row of 2x2 quad patch
-			indices[k+2] = (i+1)*mNumPatchVertCols+j;
-			indices[k+3] = (i+1)*mNumPatchVertCols+j+1;
+	// Top row of 2x2 quad patch
+	indices[0] = i*mNumPatchVertCols+j;
+	indices[1] = i*mNumPatchVertCols+j+1;
 
-			k += 4; // next quad
-		}
-	}
-	
-	mMesh.indcount = indices.size();
-	
-	for(int i = 0; i < indices.size(); i++)
-	{
-		mMesh.indices.push_back(indices[i]);
-	}
+	// Bottom row of 2x2 quad patch
+	indices[2] = (i+1)*mNumPatchVertCols+j;
+	indices[3] = (i+1)*mNumPatchVertCols+j+1;
+}
 
+void Terrain::BuildQuadPatchIB(ID3D11Device* device)
+{
+	// Rewritten by every Draw with the patches that pass survives; room for all of them.
 	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(USHORT) * indices.size();
+    ibd.Usage = D3D11_USAGE_DYNAMIC;
+	ibd.ByteWidth = sizeof(USHORT) * mNumPatchQuadFaces*4; // 4 indices per quad face
     ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
+    ibd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     ibd.MiscFlags = 0;
 	ibd.StructureByteStride = 0;
 
-    D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &indices[0];
-    HR(device->CreateBuffer(&ibd, &iinitData, &mQuadPatchIB));
+    HR(device->CreateBuffer(&ibd, 0, &mQuadPatchIB));
 }
 
-void Terrain::BuildHeightmapSRV(ID3D11Device* device)
+void Terrain::BuildPatchLodBuffer(ID3D11Device* device)
+{
+	// Rewritten by every Draw alongside the index buffer.
+	D3D11_BUFFER_DESC bd;
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = sizeof(XMFLOAT4) * mNumPatchQuadFaces;
+	bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bd.MiscFlags = 0;
+	bd.StructureByteStride = 0;
+
+	HR(device->CreateBuffer(&bd, 0, &mPatchLodBuffer));
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+	srvDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = mNumPatchQuadFaces;
+
+	HR(device->CreateShaderResourceView(mPatchLodBuffer, &srvDesc, &mPatchLodSRV));
+}
+
+void Terrain::BuildHalfHeights(std::vector<HALF>& hmap)const
+{
+	// HALF is defined in xnamath.h, for storing 16-bit float.
+	const std::vector<float>& heights = mHeightmap.GetData();
+	hmap.resize(heights.size());
+	std::transform(heights.begin(), heights.end(), hmap.begin(), XMConvertFloatToHalf);
+}
+
+void Terrain::BuildHeightmapSRV(ID3D11Device* device, const std::vector<HALF>& halfHeights)
 {
 	D3D11_TEXTURE2D_DESC texDesc;
 	texDesc.Width = mInfo.HeightmapWidth;
@@ -427,30 +537,17 @@ void Terrain::BuildHeightmapSRV(ID3D11Device* device)
 	texDesc.CPUAccessFlags = 0;
 	texDesc.MiscFlags = 0;
 
-	// HALF is defined in xnamath.h, for storing 16-bit float.
-	std::vector<HALF> hmap(mHeightmap.size());
-	std::transform(mHeightmap.begin(), mHeightmap.end(), hmap.begin(), XMConvertFloatToHalf);
-	
 	D3D11_SUBRESOURCE_DATA data;
-	data.pSysMem = &hmap[0];
+	data.pSysMem = &halfHeights[0];
     data.SysMemPitch = mInfo.HeightmapWidth*sizeof(HALF);
     data.SysMemSlicePitch = 0;
 
-	ID3D11Texture2D* hmapTex = 0;
-	HR(device->CreateTexture2D(&texDesc, &data, &hmapTex));
+	HR(device->CreateTexture2D(&texDesc, &data, &mHeightMapTex));
 
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
 	srvDesc.Format = texDesc.Format;
 	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
 	srvDesc.Texture2D.MostDetailedMip = 0;
 	srvDesc.Texture2D.MipLevels = -1;
-	HR(device->CreateShaderResourceView(hmapTex, &srvDesc, &mHeightMapSRV));
-
-	// SRV saves reference.
-	ReleaseCOM(hmapTex);
+	HR(device->CreateShaderResourceView(mHeightMapTex, &srvDesc, &mHeightMapSRV));
 }
-
-terrainMeshInfo Terrain::GetMeshInfo()
-{
-	return mMesh;
-}
\ No newline at end of file
@@ -8,18 +8,18 @@
 #define TERRAIN_H
 
 #include "d3dUtil.h"
+#include "Heightmap.h"
+#include "HeightPyramid.h"
+#include "HeightQuery.h"
+#include "TerrainQuadtree.h"
+#include "TerrainRaycaster.h"
+#include "TerrainStreamer.h"
+#include "TiledHeightmap.h"
+#include "Vertex.h"
 
 class Camera;
 struct DirectionalLight;
 
-struct terrainMeshInfo
-{
-	int vertcount;
-	int indcount;
-	std::vector<XMFLOAT3> positions;
-	std::vector<int> indices;
-};
-
 class Terrain
 {
 public:
@@ -36,6 +36,12 @@ public:
 		UINT HeightmapWidth;
 		UINT HeightmapHeight;
 		float CellSpacing;
+
+		// Optional TiledHeightmap file, with final (already smoothed) heights.  When it
+		// opens, HeightMapFilename is ignored and HeightmapWidth x HeightmapHeight is the
+		// size of a window onto the map, rounded down to whole tiles, that follows the
+		// camera.  The map stays centered on the origin.
+		std::wstring TiledHeightMapFilename;
 	};
 
 public:
@@ -46,28 +52,57 @@ public:
 	float GetDepth()const;
 	float GetHeight(float x, float z)const;
 
+	// Heights and normals (if normals is not null) under many points at once, for
+	// agents, projectiles and particles; see HeightQuery.  Reads GetHeightmap, so with a
+	// tiled map points off the current window get its edge.
+	void GetHeights(const XMFLOAT3* positions, UINT count, float* heights, XMFLOAT3* normals)const;
+	float GetCellSpacing()const;
+
+	// CPU copy of the smoothed heights; used to build the physics heightfield.  With a
+	// tiled map this is the current window.
+	const Heightmap& GetHeightmap()const;
+
+	// Min/max bounds over GetHeightmap, for culling and queries that would otherwise
+	// rescan heights.
+	const HeightPyramid& GetHeightPyramid()const;
+
+	// Ray and segment casts against GetHeightmap, for picking and line of sight.
+	const TerrainRaycaster& GetRaycaster()const;
+	bool IsTiled()const;
+
+	// What the last Draw's quadtree selection visited and kept, and how long it took.
+	const TerrainSelectionStats& GetSelectionStats()const;
+	float GetSelectionMs()const;
+
 	XMMATRIX GetWorld()const;
 	void SetWorld(CXMMATRIX M);
 
 	void Init(ID3D11Device* device, ID3D11DeviceContext* dc, const InitInfo& initInfo);
 
+	// Once a frame.  With a tiled map, streams tiles around the eye and moves the window
+	// when the eye crosses into another tile.
+	void Update(ID3D11DeviceContext* dc, const XMFLOAT3& eyePosW);
+
 	void Draw(ID3D11DeviceContext* dc, const Camera& cam, DirectionalLight lights[3]);
 
-	terrainMeshInfo GetMeshInfo();
+	// For passes without a camera of their own, such as shadow maps: selects and draws
+	// against viewProj, with detail still chosen by the distance to eyePosW.
+	void Draw(ID3D11DeviceContext* dc, CXMMATRIX viewProj, const XMFLOAT3& eyePosW, DirectionalLight lights[3]);
 
 private:
-	void LoadHeightmap();
-	void Smooth();
-	bool InBounds(int i, int j);
-	float Average(int i, int j);
-	void CalcAllPatchBoundsY();
-	void CalcPatchBoundsY(UINT i, UINT j);
+	void LoadHeightmap(std::vector<HALF>& halfHeights);
+	bool OpenTiledHeightmap();
+	void GetWindowOrigin(float x, float z, UINT& row, UINT& col)const;
+	void LoadWindow();
+	XMFLOAT2 GetPatchOrigin()const;
+	void InitQueries();
+	void BuildPatchVertices(std::vector<Vertex::Terrain>& patchVertices)const;
+	void WritePatchIndices(UINT patch, USHORT* indices)const;
+	void BuildHalfHeights(std::vector<HALF>& hmap)const;
 	void BuildQuadPatchVB(ID3D11Device* device);
 	void BuildQuadPatchIB(ID3D11Device* device);
-	void BuildHeightmapSRV(ID3D11Device* device);
-
-	
-	terrainMeshInfo mMesh;
+	void BuildPatchLodBuffer(ID3D11Device* device);
+	void BuildHeightmapSRV(ID3D11Device* device, const std::vector<HALF>& halfHeights);
 
 private:
 
@@ -79,9 +114,14 @@ private:
 	ID3D11Buffer* mQuadPatchVB;
 	ID3D11Buffer* mQuadPatchIB;
 
+	// Each drawn patch's node LOD and morph range, in draw order, for the hull shader.
+	ID3D11Buffer* mPatchLodBuffer;
+	ID3D11ShaderResourceView* mPatchLodSRV;
+
 	ID3D11ShaderResourceView* mLayerMapArraySRV;
 	ID3D11ShaderResourceView* mBlendMapSRV;
 	ID3D11ShaderResourceView* mHeightMapSRV;
+	ID3D11Texture2D* mHeightMapTex;
 
 	InitInfo mInfo;
 
@@ -96,7 +136,23 @@ private:
 	Material mMat;
 
 	std::vector<XMFLOAT2> mPatchBoundsY;
-	std::vector<float> mHeightmap;
+	Heightmap mHeightmap;
+	HeightPyramid mHeightPyramid;
+	HeightQuery mHeightQuery;
+	TerrainRaycaster mRaycaster;
+
+	TerrainQuadtree mQuadtree;
+	std::vector<TerrainNode> mSelectedNodes;
+	std::vector<UINT> mVisiblePatches;
+	std::vector<UINT> mVisiblePatchNodes;
+	float mSelectionMs;
+
+	// Tiled maps only.  The window's top left sample, in map rows and columns.
+	TiledHeightmap mTiled;
+	TerrainStreamer mStreamer;
+	UINT mWindowRow;
+	UINT mWindowCol;
+	std::vector<float> mTileScratch;
 };
 
 #endif // TERRAIN_H
\ No newline at end of file
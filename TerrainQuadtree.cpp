@@ -0,0 +1,285 @@
+//***************************************************************************************
+// TerrainQuadtree.cpp
+//***************************************************************************************
+
+#include "TerrainQuadtree.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const UINT AllPlanes = 0x3f;
+
+	struct ChildOrder
+	{
+		float DistanceSq;
+		UINT Row;
+		UINT Col;
+
+		bool operator<(const ChildOrder& rhs)const { return DistanceSq < rhs.DistanceSq; }
+	};
+}
+
+TerrainQuadtree::TerrainQuadtree() :
+	mPyramid(0),
+	mCellsPerPatch(1),
+	mPatchLevel(0),
+	mNumPatchRows(0),
+	mNumPatchCols(0),
+	mRootSize(1),
+	mNumLods(0),
+	mPatchSize(1.0f),
+	mOriginX(0.0f),
+	mOriginZ(0.0f),
+	mFinestRange(1.0f),
+	mMorphRatio(0.7f),
+	mEye(0.0f, 0.0f, 0.0f)
+{
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+void TerrainQuadtree::Init(const HeightPyramid& pyramid, UINT cellsPerPatch, float cellSpacing, float originX, float originZ)
+{
+	mPyramid = &pyramid;
+	mCellsPerPatch = cellsPerPatch;
+	mPatchSize = cellsPerPatch*cellSpacing;
+	mOriginX = originX;
+	mOriginZ = originZ;
+
+	mPatchLevel = 0;
+	while((1u << mPatchLevel) < cellsPerPatch)
+		++mPatchLevel;
+
+	mNumPatchRows = pyramid.GetNumLevels() > 0 ? pyramid.GetNumRows(0) / cellsPerPatch : 0;
+	mNumPatchCols = pyramid.GetNumLevels() > 0 ? pyramid.GetNumCols(0) / cellsPerPatch : 0;
+
+	mRootSize = 1;
+	mNumLods = 1;
+	while(mRootSize < mNumPatchRows || mRootSize < mNumPatchCols)
+	{
+		mRootSize *= 2;
+		++mNumLods;
+	}
+
+	SetLodRanges(mFinestRange, mMorphRatio);
+}
+
+void TerrainQuadtree::SetLodRanges(float finestRange, float morphRatio)
+{
+	mFinestRange = finestRange;
+	mMorphRatio = morphRatio;
+
+	mLodRanges.resize(mNumLods);
+	for(UINT k = 0; k < mNumLods; ++k)
+		mLodRanges[k] = finestRange*(float)(1u << k);
+}
+
+void TerrainQuadtree::Select(CXMMATRIX viewProj, const XMFLOAT3& eyePosW, std::vector<TerrainNode>& selected)
+{
+	selected.clear();
+	memset(&mStats, 0, sizeof(mStats));
+	if(mNumPatchRows == 0 || mNumPatchCols == 0)
+		return;
+
+	ExtractFrustumPlanes(mPlanes, viewProj);
+	mEye = eyePosW;
+
+	// Beyond the coarsest range the root is drawn at the coarsest LOD anyway.
+	if(!SelectNode(0, 0, mRootSize, mNumLods - 1, AllPlanes, selected))
+		AddNode(0, 0, mRootSize, mNumLods - 1, AllPlanes, selected);
+}
+
+void TerrainQuadtree::GetVisiblePatches(const std::vector<TerrainNode>& selected, std::vector<UINT>& patches,
+	std::vector<UINT>* patchNodes)
+{
+	patches.clear();
+	if(patchNodes)
+		patchNodes->clear();
+
+	for(size_t n = 0; n < selected.size(); ++n)
+	{
+		const TerrainNode& node = selected[n];
+		UINT row1 = MathHelper::Min(node.Row + node.Size, mNumPatchRows);
+		UINT col1 = MathHelper::Min(node.Col + node.Size, mNumPatchCols);
+
+		for(UINT i = node.Row; i < row1; ++i)
+		{
+			for(UINT j = node.Col; j < col1; ++j)
+			{
+				// Only nodes straddling a plane have patches outside the frustum.
+				if(node.PlaneMask != 0)
+				{
+					XMFLOAT3 boxMin, boxMax;
+					GetNodeBounds(i, j, 1, boxMin, boxMax);
+
+					UINT planeMask = node.PlaneMask;
+					if(!Cull(boxMin, boxMax, planeMask))
+						continue;
+				}
+
+				patches.push_back(i*mNumPatchCols + j);
+				if(patchNodes)
+					patchNodes->push_back((UINT)n);
+			}
+		}
+	}
+
+	mStats.PatchesSelected = (UINT)patches.size();
+}
+
+void TerrainQuadtree::GetNodeBounds(UINT row, UINT col, UINT size, XMFLOAT3& boxMin, XMFLOAT3& boxMax)const
+{
+	UINT sizeLevel = 0;
+	while((1u << sizeLevel) < size)
+		++sizeLevel;
+
+	XMFLOAT2 boundsY;
+	UINT level = mPatchLevel + sizeLevel;
+	if(level < mPyramid->GetNumLevels())
+		boundsY = mPyramid->GetBoundsY(level, row >> sizeLevel, col >> sizeLevel);
+	else
+		boundsY = mPyramid->GetBoundsY();
+
+	UINT row1 = MathHelper::Min(row + size, mNumPatchRows);
+	UINT col1 = MathHelper::Min(col + size, mNumPatchCols);
+
+	boxMin = XMFLOAT3(mOriginX + col*mPatchSize, boundsY.x, mOriginZ - row1*mPatchSize);
+	boxMax = XMFLOAT3(mOriginX + col1*mPatchSize, boundsY.y, mOriginZ - row*mPatchSize);
+}
+
+bool TerrainQuadtree::SelectNode(UINT row, UINT col, UINT size, UINT lod, UINT planeMask, std::vector<TerrainNode>& selected)
+{
+	++mStats.NodesVisited;
+
+	XMFLOAT3 boxMin, boxMax;
+	GetNodeBounds(row, col, size, boxMin, boxMax);
+
+	// Culled nodes count as handled, so the parent does not draw them either.
+	if(!Cull(boxMin, boxMax, planeMask))
+	{
+		++mStats.NodesCulled;
+		return true;
+	}
+
+	if(lod == 0)
+	{
+		AddNode(row, col, size, lod, planeMask, selected);
+		return true;
+	}
+
+	float distSq = DistanceSq(boxMin, boxMax);
+	if(distSq > mLodRanges[lod]*mLodRanges[lod])
+		return false;
+
+	if(distSq > mLodRanges[lod-1]*mLodRanges[lod-1])
+	{
+		AddNode(row, col, size, lod, planeMask, selected);
+		return true;
+	}
+
+	// Within reach of the finer LOD: recurse, nearest child first for front-to-back
+	// drawing.  Children the finer range misses are drawn at this LOD.
+	UINT half = size / 2;
+	ChildOrder children[4];
+	UINT numChildren = 0;
+	for(UINT i = 0; i < 2; ++i)
+	{
+		for(UINT j = 0; j < 2; ++j)
+		{
+			UINT childRow = row + i*half;
+			UINT childCol = col + j*half;
+			if(childRow >= mNumPatchRows || childCol >= mNumPatchCols)
+				continue;
+
+			XMFLOAT3 childMin, childMax;
+			GetNodeBounds(childRow, childCol, half, childMin, childMax);
+
+			children[numChildren].DistanceSq = DistanceSq(childMin, childMax);
+			children[numChildren].Row = childRow;
+			children[numChildren].Col = childCol;
+			++numChildren;
+		}
+	}
+	std::sort(children, children + numChildren);
+
+	for(UINT c = 0; c < numChildren; ++c)
+	{
+		if(!SelectNode(children[c].Row, children[c].Col, half, lod - 1, planeMask, selected))
+			AddNode(children[c].Row, children[c].Col, half, lod, planeMask, selected);
+	}
+
+	return true;
+}
+
+float TerrainQuadtree::GetMorphLod(float distance)const
+{
+	UINT lod = 0;
+	while(lod + 1 < mNumLods && distance > mLodRanges[lod])
+		++lod;
+
+	float morphStart = GetMorphStart(lod);
+	return lod + MathHelper::Clamp((distance - morphStart) / (mLodRanges[lod] - morphStart), 0.0f, 1.0f);
+}
+
+float TerrainQuadtree::GetNodeMorphLod(const TerrainNode& node, float distance)
+{
+	return node.Lod + MathHelper::Clamp((distance - node.MorphStart) / (node.MorphEnd - node.MorphStart), 0.0f, 1.0f);
+}
+
+float TerrainQuadtree::GetMorphStart(UINT lod)const
+{
+	float range = mLodRanges[lod];
+	float prevRange = lod > 0 ? mLodRanges[lod-1] : 0.0f;
+	return prevRange + (range - prevRange)*mMorphRatio;
+}
+
+void TerrainQuadtree::AddNode(UINT row, UINT col, UINT size, UINT lod, UINT planeMask, std::vector<TerrainNode>& selected)
+{
+	TerrainNode node;
+	node.Row = row;
+	node.Col = col;
+	node.Size = size;
+	node.Lod = lod;
+	node.MorphStart = GetMorphStart(lod);
+	node.MorphEnd = mLodRanges[lod];
+	node.PlaneMask = planeMask;
+	selected.push_back(node);
+
+	++mStats.NodesSelected;
+}
+
+bool TerrainQuadtree::Cull(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, UINT& planeMask)const
+{
+	float cx = 0.5f*(boxMin.x + boxMax.x);
+	float cy = 0.5f*(boxMin.y + boxMax.y);
+	float cz = 0.5f*(boxMin.z + boxMax.z);
+	float ex = 0.5f*(boxMax.x - boxMin.x);
+	float ey = 0.5f*(boxMax.y - boxMin.y);
+	float ez = 0.5f*(boxMax.z - boxMin.z);
+
+	// A plane the box is wholly inside needs no testing further down the tree.
+	for(UINT i = 0; i < 6; ++i)
+	{
+		if(!(planeMask & (1u << i)))
+			continue;
+
+		const XMFLOAT4& p = mPlanes[i];
+		float d = p.x*cx + p.y*cy + p.z*cz + p.w;
+		float r = fabsf(p.x)*ex + fabsf(p.y)*ey + fabsf(p.z)*ez;
+
+		if(d + r < 0.0f)
+			return false;
+		if(d - r >= 0.0f)
+			planeMask &= ~(1u << i);
+	}
+
+	return true;
+}
+
+float TerrainQuadtree::DistanceSq(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)const
+{
+	float dx = MathHelper::Max(MathHelper::Max(boxMin.x - mEye.x, mEye.x - boxMax.x), 0.0f);
+	float dy = MathHelper::Max(MathHelper::Max(boxMin.y - mEye.y, mEye.y - boxMax.y), 0.0f);
+	float dz = MathHelper::Max(MathHelper::Max(boxMin.z - mEye.z, mEye.z - boxMax.z), 0.0f);
+	return dx*dx + dy*dy + dz*dz;
+}
@@ -0,0 +1,116 @@
+//***************************************************************************************
+// TerrainQuadtree.h
+//
+// CPU quadtree over the terrain's patches, for culling against a pass's frustum and
+// CDLOD-style level of detail selection.  The leaves are the patches Terrain draws; a
+// node at LOD k covers 2^k x 2^k of them.  Bounds come from the HeightPyramid, so
+// nothing rescans heights.
+//
+// Select walks the tree from the root, nearest child first, and picks for each visible
+// area the coarsest LOD whose distance range still reaches it.  Ranges double with each
+// LOD, which keeps neighboring selections within one LOD of each other.
+//***************************************************************************************
+
+#ifndef TERRAINQUADTREE_H
+#define TERRAINQUADTREE_H
+
+#include "HeightPyramid.h"
+
+struct TerrainNode
+{
+	// Patches [Row, Row + Size) x [Col, Col + Size), clipped to the map.
+	UINT Row;
+	UINT Col;
+	UINT Size;
+
+	// 0 is the finest.  A node may be selected at its parent's LOD when it is the part
+	// of the parent that the finer range does not reach.
+	UINT Lod;
+
+	// Eye distances over which the node morphs into its parent's LOD.
+	float MorphStart;
+	float MorphEnd;
+
+	// Frustum planes (bit i for plane i) the node straddles; 0 if it is wholly inside.
+	UINT PlaneMask;
+};
+
+struct TerrainSelectionStats
+{
+	UINT NodesVisited;
+	UINT NodesCulled;
+	UINT NodesSelected;
+	UINT PatchesSelected;
+};
+
+class TerrainQuadtree
+{
+public:
+	TerrainQuadtree();
+
+	// Patches are cellsPerPatch (a power of two) cells of the pyramid's heightmap, whose
+	// top left (row 0, column 0) sample is at (originX, originZ); rows run toward -z.
+	// The pyramid must outlive the quadtree.
+	void Init(const HeightPyramid& pyramid, UINT cellsPerPatch, float cellSpacing, float originX, float originZ);
+
+	// Distance from the eye that LOD 0 reaches; each coarser LOD reaches twice as far.
+	// morphRatio is where in its range a node starts morphing into its parent.
+	void SetLodRanges(float finestRange, float morphRatio = 0.7f);
+
+	// Visible nodes for the pass whose view-projection is given, nearest first.
+	void Select(CXMMATRIX viewProj, const XMFLOAT3& eyePosW, std::vector<TerrainNode>& selected);
+
+	// The patches (row*GetNumPatchCols() + col) of the selected nodes that are inside the
+	// frustum, in the same near-to-far order.  patchNodes, if given, receives the index in
+	// selected of each patch's node.
+	void GetVisiblePatches(const std::vector<TerrainNode>& selected, std::vector<UINT>& patches,
+		std::vector<UINT>* patchNodes = 0);
+
+	UINT GetNumPatchRows()const { return mNumPatchRows; }
+	UINT GetNumPatchCols()const { return mNumPatchCols; }
+	UINT GetNumLods()const { return mNumLods; }
+	float GetLodRange(UINT lod)const { return mLodRanges[lod]; }
+	float GetMorphRatio()const { return mMorphRatio; }
+
+	// Continuous LOD at a distance from the eye: the LOD whose range reaches it, plus how
+	// far into its morph range it is.  Terrain.fx tessellates patch edges by this and
+	// patch interiors by GetNodeMorphLod, so shared edges always agree.
+	float GetMorphLod(float distance)const;
+	static float GetNodeMorphLod(const TerrainNode& node, float distance);
+
+	// Counts for the last Select and GetVisiblePatches.
+	const TerrainSelectionStats& GetStats()const { return mStats; }
+
+	// World space bounds of patches [row, row + size) x [col, col + size).
+	void GetNodeBounds(UINT row, UINT col, UINT size, XMFLOAT3& boxMin, XMFLOAT3& boxMax)const;
+
+private:
+	bool SelectNode(UINT row, UINT col, UINT size, UINT lod, UINT planeMask, std::vector<TerrainNode>& selected);
+	void AddNode(UINT row, UINT col, UINT size, UINT lod, UINT planeMask, std::vector<TerrainNode>& selected);
+	float GetMorphStart(UINT lod)const;
+	bool Cull(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, UINT& planeMask)const;
+	float DistanceSq(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax)const;
+
+private:
+	const HeightPyramid* mPyramid;
+	UINT mCellsPerPatch;
+	UINT mPatchLevel;
+	UINT mNumPatchRows;
+	UINT mNumPatchCols;
+	UINT mRootSize;
+	UINT mNumLods;
+	float mPatchSize;
+	float mOriginX;
+	float mOriginZ;
+
+	float mFinestRange;
+	float mMorphRatio;
+	std::vector<float> mLodRanges;
+
+	// Per Select.
+	XMFLOAT4 mPlanes[6];
+	XMFLOAT3 mEye;
+	TerrainSelectionStats mStats;
+};
+
+#endif // TERRAINQUADTREE_H
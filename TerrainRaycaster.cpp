@@ -0,0 +1,247 @@
+//***************************************************************************************
+// TerrainRaycaster.cpp
+//***************************************************************************************
+
+#include "TerrainRaycaster.h"
+#include "ParallelFor.h"
+#include "xnacollision.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Fewer rays than this per worker is not worth a thread.
+	const UINT MinRaysPerBand = 256;
+
+	// Each level pushes at most four entries and pops one.
+	const UINT MaxStack = 3*32 + 1;
+
+	struct RaySlabs
+	{
+		float Origin[3];
+		float InvDirection[3];
+		bool Parallel[3];
+	};
+
+	struct StackEntry
+	{
+		float Enter;
+		UINT Level;
+		UINT Row;
+		UINT Col;
+
+		// Farthest first, so the nearest is popped first.
+		bool operator<(const StackEntry& rhs)const { return Enter > rhs.Enter; }
+	};
+
+	void SetupSlabs(const XMFLOAT3& origin, const XMFLOAT3& direction, RaySlabs& slabs)
+	{
+		const float o[3] = { origin.x, origin.y, origin.z };
+		const float d[3] = { direction.x, direction.y, direction.z };
+		for(int i = 0; i < 3; ++i)
+		{
+			slabs.Origin[i] = o[i];
+			slabs.Parallel[i] = fabsf(d[i]) < 1e-20f;
+			slabs.InvDirection[i] = slabs.Parallel[i] ? 0.0f : 1.0f / d[i];
+		}
+	}
+
+	// Where the ray enters the box, if it does before maxDistance.
+	bool ClipBox(const RaySlabs& slabs, const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, float maxDistance, float& enter)
+	{
+		const float lo[3] = { boxMin.x, boxMin.y, boxMin.z };
+		const float hi[3] = { boxMax.x, boxMax.y, boxMax.z };
+
+		float t0 = 0.0f;
+		float t1 = maxDistance;
+		for(int i = 0; i < 3; ++i)
+		{
+			if(slabs.Parallel[i])
+			{
+				if(slabs.Origin[i] < lo[i] || slabs.Origin[i] > hi[i])
+					return false;
+				continue;
+			}
+
+			float a = (lo[i] - slabs.Origin[i])*slabs.InvDirection[i];
+			float b = (hi[i] - slabs.Origin[i])*slabs.InvDirection[i];
+			t0 = MathHelper::Max(t0, MathHelper::Min(a, b));
+			t1 = MathHelper::Min(t1, MathHelper::Max(a, b));
+			if(t0 > t1)
+				return false;
+		}
+
+		enter = t0;
+		return true;
+	}
+}
+
+TerrainRaycaster::TerrainRaycaster() :
+	mHeightmap(0),
+	mPyramid(0),
+	mCellSpacing(1.0f),
+	mOriginX(0.0f),
+	mOriginZ(0.0f)
+{
+}
+
+void TerrainRaycaster::Init(const Heightmap& heightmap, const HeightPyramid& pyramid, float cellSpacing, float originX, float originZ)
+{
+	mHeightmap = &heightmap;
+	mPyramid = &pyramid;
+	mCellSpacing = cellSpacing;
+	mOriginX = originX;
+	mOriginZ = originZ;
+}
+
+bool TerrainRaycaster::Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainRayHit& hit)const
+{
+	hit.Distance = MathHelper::Infinity;
+	if(!mPyramid || mPyramid->GetNumLevels() == 0)
+		return false;
+
+	XMVECTOR dir = XMLoadFloat3(&direction);
+	float length = XMVectorGetX(XMVector3Length(dir));
+	if(!(length > 0.0f) || !(maxDistance >= 0.0f))
+		return false;
+
+	XMFLOAT3 unitDir;
+	dir = XMVectorScale(dir, 1.0f / length);
+	XMStoreFloat3(&unitDir, dir);
+	XMVECTOR o = XMLoadFloat3(&origin);
+
+	RaySlabs slabs;
+	SetupSlabs(origin, unitDir, slabs);
+
+	StackEntry stack[MaxStack];
+	UINT top = mPyramid->GetNumLevels() - 1;
+	XMFLOAT3 boxMin, boxMax;
+	GetBlockBounds(top, 0, 0, boxMin, boxMax);
+	if(!ClipBox(slabs, boxMin, boxMax, maxDistance, stack[0].Enter))
+		return false;
+
+	stack[0].Level = top;
+	stack[0].Row = 0;
+	stack[0].Col = 0;
+	UINT size = 1;
+
+	float best = maxDistance;
+	bool found = false;
+	while(size > 0)
+	{
+		StackEntry entry = stack[--size];
+
+		// Something already hit nearer than this block starts.
+		if(entry.Enter > best)
+			continue;
+
+		if(entry.Level == 0)
+		{
+			found = TestCell(o, dir, entry.Row, entry.Col, best, hit) || found;
+			continue;
+		}
+
+		UINT level = entry.Level - 1;
+		UINT row1 = MathHelper::Min(2*entry.Row + 2, mPyramid->GetNumRows(level));
+		UINT col1 = MathHelper::Min(2*entry.Col + 2, mPyramid->GetNumCols(level));
+
+		StackEntry children[4];
+		UINT numChildren = 0;
+		for(UINT i = 2*entry.Row; i < row1; ++i)
+		{
+			for(UINT j = 2*entry.Col; j < col1; ++j)
+			{
+				GetBlockBounds(level, i, j, boxMin, boxMax);
+
+				StackEntry& child = children[numChildren];
+				if(!ClipBox(slabs, boxMin, boxMax, best, child.Enter))
+					continue;
+
+				child.Level = level;
+				child.Row = i;
+				child.Col = j;
+				++numChildren;
+			}
+		}
+
+		std::sort(children, children + numChildren);
+		for(UINT c = 0; c < numChildren; ++c)
+			stack[size++] = children[c];
+	}
+
+	return found;
+}
+
+bool TerrainRaycaster::RaycastSegment(const XMFLOAT3& p0, const XMFLOAT3& p1, TerrainRayHit& hit)const
+{
+	XMFLOAT3 d(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+	float length = sqrtf(d.x*d.x + d.y*d.y + d.z*d.z);
+	return Raycast(p0, d, length, hit);
+}
+
+UINT TerrainRaycaster::Raycast(const TerrainRay* rays, UINT count, TerrainRayHit* hits, UINT numThreads)const
+{
+	ParallelForRows(count, MinRaysPerBand, numThreads, [=](UINT first, UINT end)
+	{
+		for(UINT i = first; i < end; ++i)
+			Raycast(rays[i].Origin, rays[i].Direction, rays[i].MaxDistance, hits[i]);
+	});
+
+	UINT numHits = 0;
+	for(UINT i = 0; i < count; ++i)
+		numHits += hits[i].Distance < MathHelper::Infinity ? 1 : 0;
+
+	return numHits;
+}
+
+void TerrainRaycaster::GetBlockBounds(UINT level, UINT row, UINT col, XMFLOAT3& boxMin, XMFLOAT3& boxMax)const
+{
+	UINT row0 = row << level;
+	UINT col0 = col << level;
+	UINT row1 = MathHelper::Min((row + 1) << level, mPyramid->GetNumRows(0));
+	UINT col1 = MathHelper::Min((col + 1) << level, mPyramid->GetNumCols(0));
+	XMFLOAT2 boundsY = mPyramid->GetBoundsY(level, row, col);
+
+	// Padded a little so rays grazing a block's faces are not lost to rounding.
+	float pad = 1e-3f*mCellSpacing;
+	boxMin = XMFLOAT3(mOriginX + col0*mCellSpacing - pad, boundsY.x - pad, mOriginZ - row1*mCellSpacing - pad);
+	boxMax = XMFLOAT3(mOriginX + col1*mCellSpacing + pad, boundsY.y + pad, mOriginZ - row0*mCellSpacing + pad);
+}
+
+bool TerrainRaycaster::TestCell(FXMVECTOR origin, FXMVECTOR direction, UINT row, UINT col, float& bestDistance, TerrainRayHit& hit)const
+{
+	float x0 = mOriginX + col*mCellSpacing;
+	float z0 = mOriginZ - row*mCellSpacing;
+
+	// Heightmap::GetHeight's split of the cell.
+	// A*--*B
+	//  | /|
+	//  |/ |
+	// C*--*D
+	XMVECTOR A = XMVectorSet(x0, mHeightmap->At(row, col), z0, 0.0f);
+	XMVECTOR B = XMVectorSet(x0 + mCellSpacing, mHeightmap->At(row, col + 1), z0, 0.0f);
+	XMVECTOR C = XMVectorSet(x0, mHeightmap->At(row + 1, col), z0 - mCellSpacing, 0.0f);
+	XMVECTOR D = XMVectorSet(x0 + mCellSpacing, mHeightmap->At(row + 1, col + 1), z0 - mCellSpacing, 0.0f);
+
+	// Both triangles wind so that (V1 - V0) x (V2 - V0) faces up.
+	XMVECTOR tris[2][3] = { { A, B, C }, { D, C, B } };
+
+	bool found = false;
+	for(int k = 0; k < 2; ++k)
+	{
+		float t;
+		if(!XNA::IntersectRayTriangle(origin, direction, tris[k][0], tris[k][1], tris[k][2], &t) || t > bestDistance)
+			continue;
+
+		bestDistance = t;
+		hit.Distance = t;
+		XMStoreFloat3(&hit.Position, XMVectorAdd(origin, XMVectorScale(direction, t)));
+		XMVECTOR n = XMVector3Cross(XMVectorSubtract(tris[k][1], tris[k][0]), XMVectorSubtract(tris[k][2], tris[k][0]));
+		XMStoreFloat3(&hit.Normal, XMVector3Normalize(n));
+		hit.Row = row;
+		hit.Col = col;
+		found = true;
+	}
+
+	return found;
+}
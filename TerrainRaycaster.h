@@ -0,0 +1,78 @@
+//***************************************************************************************
+// TerrainRaycaster.h
+//
+// Ray and segment casts against the heightfield on the CPU, for picking, line of sight,
+// placing objects and server-side hit validation.  The HeightPyramid doubles as a
+// min/max quadtree: a ray descends only into the blocks whose bounds it passes
+// through, nearest first, and stops looking once no remaining block can be closer than
+// its best hit.  Cells are tested as the two triangles Heightmap::GetHeight splits
+// them into, with XNA::IntersectRayTriangle.
+//
+// Const after Init, so any number of threads may cast at once.
+//***************************************************************************************
+
+#ifndef TERRAINRAYCASTER_H
+#define TERRAINRAYCASTER_H
+
+#include "HeightPyramid.h"
+
+struct TerrainRay
+{
+	XMFLOAT3 Origin;
+
+	// Need not be unit length.
+	XMFLOAT3 Direction;
+
+	// Along the normalized direction.
+	float MaxDistance;
+};
+
+struct TerrainRayHit
+{
+	// Along the normalized direction; MathHelper::Infinity if the ray missed.
+	float Distance;
+
+	XMFLOAT3 Position;
+
+	// Unit normal of the triangle hit, facing up.
+	XMFLOAT3 Normal;
+
+	// The cell hit, in heightmap rows and columns.
+	UINT Row;
+	UINT Col;
+};
+
+class TerrainRaycaster
+{
+public:
+	TerrainRaycaster();
+
+	// pyramid must have been built from heightmap; sample (row, col) sits at (originX +
+	// col*cellSpacing, originZ - row*cellSpacing).  Both must outlive the raycaster.
+	void Init(const Heightmap& heightmap, const HeightPyramid& pyramid, float cellSpacing, float originX, float originZ);
+
+	// The nearest hit within maxDistance of origin.
+	bool Raycast(const XMFLOAT3& origin, const XMFLOAT3& direction, float maxDistance, TerrainRayHit& hit)const;
+
+	// The hit nearest p0 on the segment from p0 to p1.
+	bool RaycastSegment(const XMFLOAT3& p0, const XMFLOAT3& p1, TerrainRayHit& hit)const;
+
+	// Casts each ray into hits and returns how many hit.  numThreads == 0 uses one
+	// worker per hardware thread; the default keeps to the calling thread, for callers
+	// that already run on a job of their own.
+	UINT Raycast(const TerrainRay* rays, UINT count, TerrainRayHit* hits, UINT numThreads = 1)const;
+
+private:
+	// World space bounds of the cells under pyramid entry (level, row, col).
+	void GetBlockBounds(UINT level, UINT row, UINT col, XMFLOAT3& boxMin, XMFLOAT3& boxMax)const;
+	bool TestCell(FXMVECTOR origin, FXMVECTOR direction, UINT row, UINT col, float& bestDistance, TerrainRayHit& hit)const;
+
+private:
+	const Heightmap* mHeightmap;
+	const HeightPyramid* mPyramid;
+	float mCellSpacing;
+	float mOriginX;
+	float mOriginZ;
+};
+
+#endif // TERRAINRAYCASTER_H
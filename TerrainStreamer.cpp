@@ -0,0 +1,302 @@
+//***************************************************************************************
+// TerrainStreamer.cpp
+//***************************************************************************************
+
+#include "TerrainStreamer.h"
+#include <algorithm>
+#include <cmath>
+
+const float TerrainStreamer::EvictScale = 1.25f;
+
+TerrainStreamer::TerrainStreamer() :
+	mMap(0),
+	mCellSpacing(1.0f),
+	mRadius(0.0f),
+	mTileSamples(0),
+	mTilesLoaded(0),
+	mTilesEvicted(0),
+	mHeightMisses(0),
+	mBusy(false),
+	mQuit(false)
+{
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+	Stop();
+}
+
+void TerrainStreamer::Start(const TiledHeightmap& map, float cellSpacing, float radius)
+{
+	Stop();
+
+	mMap = &map;
+	mCellSpacing = cellSpacing;
+	mRadius = radius;
+	mTileSamples = map.GetTileSamples();
+
+	UINT numTiles = map.GetNumTilesX()*map.GetNumTilesZ();
+	mResident.assign(numTiles, (float*)0);
+	mRequested.assign(numTiles, false);
+	mResidentList.clear();
+	mTilesLoaded = 0;
+	mTilesEvicted = 0;
+	mHeightMisses = 0;
+
+	mBusy = false;
+	mQuit = false;
+	mWorker = std::thread(&TerrainStreamer::WorkerMain, this);
+}
+
+void TerrainStreamer::Stop()
+{
+	if(!mMap)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	mWorker.join();
+
+	for(size_t i = 0; i < mResidentList.size(); ++i)
+		delete[] mResident[mResidentList[i]];
+	for(size_t i = 0; i < mCompleted.size(); ++i)
+		delete[] mCompleted[i].second;
+	for(size_t i = 0; i < mFreeBuffers.size(); ++i)
+		delete[] mFreeBuffers[i];
+
+	mResident.clear();
+	mResidentList.clear();
+	mRequested.clear();
+	mPending.clear();
+	mCompleted.clear();
+	mFreeBuffers.clear();
+	mMap = 0;
+}
+
+void TerrainStreamer::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for(;;)
+	{
+		while(!mQuit && mPending.empty())
+			mWake.wait(lock);
+		if(mQuit)
+			break;
+
+		UINT tile = mPending.front();
+		mPending.pop_front();
+
+		float* buffer = 0;
+		if(!mFreeBuffers.empty())
+		{
+			buffer = mFreeBuffers.back();
+			mFreeBuffers.pop_back();
+		}
+		mBusy = true;
+		lock.unlock();
+
+		if(!buffer)
+			buffer = new float[mTileSamples*mTileSamples];
+
+		// The page faults happen here, off the render thread.  Once decoded the mapped
+		// pages are not needed again until the tile is next paged in.
+		UINT tileX = tile % mMap->GetNumTilesX();
+		UINT tileZ = tile / mMap->GetNumTilesX();
+		mMap->DecodeTile(tileX, tileZ, buffer);
+		mMap->ReleaseTile(tileX, tileZ);
+
+		lock.lock();
+		mCompleted.push_back(std::make_pair(tile, buffer));
+		mBusy = false;
+		if(mPending.empty())
+			mIdle.notify_all();
+	}
+}
+
+void TerrainStreamer::TakeCompleted()
+{
+	std::vector< std::pair<UINT, float*> > completed;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		completed.swap(mCompleted);
+	}
+
+	for(size_t i = 0; i < completed.size(); ++i)
+	{
+		UINT tile = completed[i].first;
+		mRequested[tile] = false;
+		mResident[tile] = completed[i].second;
+		mResidentList.push_back(tile);
+		++mTilesLoaded;
+	}
+}
+
+void TerrainStreamer::FreeBuffer(float* buffer)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mFreeBuffers.push_back(buffer);
+}
+
+void TerrainStreamer::Update(float x, float z)
+{
+	if(!mMap)
+		return;
+
+	TakeCompleted();
+
+	// Evict what is now out of range.
+	float evictRadius = mRadius*EvictScale;
+	for(size_t i = 0; i < mResidentList.size(); )
+	{
+		UINT tile = mResidentList[i];
+		if(TileDistance(tile, x, z) > evictRadius)
+		{
+			FreeBuffer(mResident[tile]);
+			mResident[tile] = 0;
+			++mTilesEvicted;
+
+			mResidentList[i] = mResidentList.back();
+			mResidentList.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	// Replace the queue with the tiles missing now, nearest first.  Tiles the worker
+	// has already started on stay requested.
+	GetTilesInRadius(x, z, mRadius, mWanted);
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		for(size_t i = 0; i < mPending.size(); ++i)
+			mRequested[mPending[i]] = false;
+		mPending.clear();
+
+		mMissing.clear();
+		for(size_t i = 0; i < mWanted.size(); ++i)
+		{
+			UINT tile = mWanted[i];
+			if(!mResident[tile] && !mRequested[tile])
+				mMissing.push_back(std::make_pair(TileDistance(tile, x, z), tile));
+		}
+		std::sort(mMissing.begin(), mMissing.end());
+
+		for(size_t i = 0; i < mMissing.size(); ++i)
+		{
+			mPending.push_back(mMissing[i].second);
+			mRequested[mMissing[i].second] = true;
+		}
+	}
+
+	if(!mMissing.empty())
+		mWake.notify_one();
+}
+
+void TerrainStreamer::Flush()
+{
+	if(!mMap)
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while(!mPending.empty() || mBusy)
+			mIdle.wait(lock);
+	}
+	TakeCompleted();
+}
+
+const float* TerrainStreamer::GetTile(UINT tileX, UINT tileZ)const
+{
+	return mResident[tileZ*mMap->GetNumTilesX() + tileX];
+}
+
+float TerrainStreamer::GetHeight(float x, float z)const
+{
+	if(!mMap)
+		return 0.0f;
+
+	UINT numCols = mMap->GetNumCols();
+	UINT numRows = mMap->GetNumRows();
+	float width = (numCols-1)*mCellSpacing;
+	float depth = (numRows-1)*mCellSpacing;
+
+	float c = (x + 0.5f*width) /  mCellSpacing;
+	float d = (z - 0.5f*depth) / -mCellSpacing;
+
+	int row = MathHelper::Clamp((int)floorf(d), 0, (int)numRows - 2);
+	int col = MathHelper::Clamp((int)floorf(c), 0, (int)numCols - 2);
+
+	// A cell's four samples always lie in one tile, thanks to the shared borders.
+	UINT tileCells = mMap->GetTileCells();
+	UINT tileZ = MathHelper::Min((UINT)row / tileCells, mMap->GetNumTilesZ() - 1);
+	UINT tileX = MathHelper::Min((UINT)col / tileCells, mMap->GetNumTilesX() - 1);
+
+	const float* tile = GetTile(tileX, tileZ);
+	if(!tile)
+	{
+		++mHeightMisses;
+		return mMap->GetHeight(x, z, mCellSpacing);
+	}
+
+	UINT k = (row - tileZ*tileCells)*mTileSamples + (col - tileX*tileCells);
+	return TiledHeightmap::InterpolateCell(tile[k], tile[k + 1], tile[k + mTileSamples], tile[k + mTileSamples + 1],
+		c - (float)col, d - (float)row);
+}
+
+TerrainStreamer::Stats TerrainStreamer::GetStats()const
+{
+	Stats stats;
+	stats.TilesLoaded = mTilesLoaded;
+	stats.TilesEvicted = mTilesEvicted;
+	stats.HeightMisses = mHeightMisses;
+	return stats;
+}
+
+float TerrainStreamer::TileDistance(UINT tile, float x, float z)const
+{
+	float tileSize = mMap->GetTileCells()*mCellSpacing;
+	float halfWidth = 0.5f*(mMap->GetNumCols()-1)*mCellSpacing;
+	float halfDepth = 0.5f*(mMap->GetNumRows()-1)*mCellSpacing;
+
+	UINT tileX = tile % mMap->GetNumTilesX();
+	UINT tileZ = tile / mMap->GetNumTilesX();
+	float x0 = -halfWidth + tileX*tileSize;
+	float z1 = halfDepth - tileZ*tileSize;
+
+	float dx = MathHelper::Max(MathHelper::Max(x0 - x, x - (x0 + tileSize)), 0.0f);
+	float dz = MathHelper::Max(MathHelper::Max((z1 - tileSize) - z, z - z1), 0.0f);
+	return sqrtf(dx*dx + dz*dz);
+}
+
+void TerrainStreamer::GetTilesInRadius(float x, float z, float radius, std::vector<UINT>& tiles)const
+{
+	tiles.clear();
+
+	float tileSize = mMap->GetTileCells()*mCellSpacing;
+	float halfWidth = 0.5f*(mMap->GetNumCols()-1)*mCellSpacing;
+	float halfDepth = 0.5f*(mMap->GetNumRows()-1)*mCellSpacing;
+	int maxX = (int)mMap->GetNumTilesX() - 1;
+	int maxZ = (int)mMap->GetNumTilesZ() - 1;
+
+	// Tile rows count down from the +z edge.
+	int x0 = MathHelper::Clamp((int)floorf((x - radius + halfWidth) / tileSize), 0, maxX);
+	int x1 = MathHelper::Clamp((int)floorf((x + radius + halfWidth) / tileSize), 0, maxX);
+	int z0 = MathHelper::Clamp((int)floorf((halfDepth - (z + radius)) / tileSize), 0, maxZ);
+	int z1 = MathHelper::Clamp((int)floorf((halfDepth - (z - radius)) / tileSize), 0, maxZ);
+
+	for(int tz = z0; tz <= z1; ++tz)
+	{
+		for(int tx = x0; tx <= x1; ++tx)
+		{
+			UINT tile = (UINT)(tz*(maxX + 1) + tx);
+			if(TileDistance(tile, x, z) <= radius)
+				tiles.push_back(tile);
+		}
+	}
+}
@@ -0,0 +1,100 @@
+//***************************************************************************************
+// TerrainStreamer.h
+//
+// Keeps the tiles of a TiledHeightmap that lie within a radius of a focus point (the
+// camera) decoded in memory, paging them in on a background thread and dropping them
+// once the focus has moved away.  The working set is set by the radius, not the size
+// of the map: a decoded tile's mapped pages are released straight after decoding, and
+// evicted tiles' buffers are recycled for the next ones.
+//
+// Everything but the worker runs on the thread that calls Update.  Tiles become visible
+// to GetTile and GetHeight only in Update, so lookups need no locking.
+//***************************************************************************************
+
+#ifndef TERRAINSTREAMER_H
+#define TERRAINSTREAMER_H
+
+#include "TiledHeightmap.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TerrainStreamer
+{
+public:
+	struct Stats
+	{
+		UINT TilesLoaded;
+		UINT TilesEvicted;
+
+		// GetHeight calls that had to read the mapping because their tile was not in yet.
+		UINT HeightMisses;
+	};
+
+	TerrainStreamer();
+	~TerrainStreamer();
+
+	// Tiles touching the circle of radius around the focus are loaded; they are evicted
+	// once they are more than radius*EvictScale away, so small moves back and forth do
+	// not thrash.  The map must outlive the streamer.
+	void Start(const TiledHeightmap& map, float cellSpacing, float radius);
+	void Stop();
+	bool IsRunning()const { return mMap != 0; }
+
+	// Once a frame.  Takes in the tiles the worker finished, evicts those out of range
+	// and queues the missing ones, nearest first.
+	void Update(float x, float z);
+
+	// Waits for every queued tile, then takes them in.  For tools, tests and loading
+	// screens.
+	void Flush();
+
+	// Decoded samples, as TiledHeightmap::DecodeTile writes them, or 0 if not resident.
+	const float* GetTile(UINT tileX, UINT tileZ)const;
+
+	// Resident tiles where possible, otherwise the mapping.
+	float GetHeight(float x, float z)const;
+
+	UINT GetNumResident()const { return (UINT)mResidentList.size(); }
+	Stats GetStats()const;
+
+	static const float EvictScale;
+
+private:
+	void WorkerMain();
+	void TakeCompleted();
+	float TileDistance(UINT tile, float x, float z)const;
+	void GetTilesInRadius(float x, float z, float radius, std::vector<UINT>& tiles)const;
+	void FreeBuffer(float* buffer);
+
+private:
+	const TiledHeightmap* mMap;
+	float mCellSpacing;
+	float mRadius;
+	UINT mTileSamples;
+
+	// Owned by the Update thread.
+	std::vector<float*> mResident;
+	std::vector<UINT> mResidentList;
+	std::vector<bool> mRequested;
+	std::vector<UINT> mWanted;
+	std::vector< std::pair<float, UINT> > mMissing;
+	UINT mTilesLoaded;
+	UINT mTilesEvicted;
+	mutable UINT mHeightMisses;
+
+	// Shared with the worker; guarded by mMutex.
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mIdle;
+	std::deque<UINT> mPending;
+	std::vector< std::pair<UINT, float*> > mCompleted;
+	std::vector<float*> mFreeBuffers;
+	bool mBusy;
+	bool mQuit;
+	std::thread mWorker;
+};
+
+#endif // TERRAINSTREAMER_H
@@ -0,0 +1,439 @@
+//***************************************************************************************
+// TextureData.cpp
+//***************************************************************************************
+
+#include "TextureData.h"
+#include "MathHelper.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	const UINT DdsMagic = 0x20534444; // "DDS "
+
+	const UINT DdsdMipMapCount = 0x20000;
+	const UINT DdpfAlphaPixels = 0x1;
+	const UINT DdpfFourCC = 0x4;
+	const UINT DdpfRgb = 0x40;
+	const UINT DdpfLuminance = 0x20000;
+	const UINT DdsCaps2CubeMap = 0x200;
+	const UINT DdsCaps2Volume = 0x200000;
+
+	const UINT Dx10Texture2D = 3;
+	const UINT Dx10MiscTextureCube = 0x4;
+
+	struct DdsPixelFormat
+	{
+		UINT Size;
+		UINT Flags;
+		UINT FourCC;
+		UINT RGBBitCount;
+		UINT RBitMask;
+		UINT GBitMask;
+		UINT BBitMask;
+		UINT ABitMask;
+	};
+
+	struct DdsHeader
+	{
+		UINT Size;
+		UINT Flags;
+		UINT Height;
+		UINT Width;
+		UINT PitchOrLinearSize;
+		UINT Depth;
+		UINT MipMapCount;
+		UINT Reserved1[11];
+		DdsPixelFormat PixelFormat;
+		UINT Caps;
+		UINT Caps2;
+		UINT Caps3;
+		UINT Caps4;
+		UINT Reserved2;
+	};
+
+	struct DdsHeaderDx10
+	{
+		UINT DxgiFormat;
+		UINT ResourceDimension;
+		UINT MiscFlag;
+		UINT ArraySize;
+		UINT MiscFlags2;
+	};
+
+	// What a DDS file holds; its texels follow the headers.
+	struct DdsLayout
+	{
+		UINT Width;
+		UINT Height;
+		UINT MipLevels;
+		UINT ArraySize;
+		DXGI_FORMAT Format;
+		bool CubeMap;
+
+		// An X8 format loaded as its A8 counterpart, whose alpha must be made opaque.
+		bool FillAlpha;
+	};
+
+	UINT MakeFourCC(char a, char b, char c, char d)
+	{
+		return (UINT)(BYTE)a | ((UINT)(BYTE)b << 8) | ((UINT)(BYTE)c << 16) | ((UINT)(BYTE)d << 24);
+	}
+
+	bool HasMasks(const DdsPixelFormat& pf, UINT r, UINT g, UINT b, UINT a)
+	{
+		return pf.RBitMask == r && pf.GBitMask == g && pf.BBitMask == b && pf.ABitMask == a;
+	}
+
+	// The DXGI format of a pre-DX10 header, or DXGI_FORMAT_UNKNOWN.  X8 formats map to
+	// their A8 counterparts so that, as with D3DX, files with and without alpha can be
+	// slices of one array.
+	DXGI_FORMAT GetLegacyFormat(const DdsPixelFormat& pf, bool& fillAlpha)
+	{
+		fillAlpha = false;
+
+		if(pf.Flags & DdpfFourCC)
+		{
+			UINT fourCC = pf.FourCC;
+			if(fourCC == MakeFourCC('D', 'X', 'T', '1'))
+				return DXGI_FORMAT_BC1_UNORM;
+			if(fourCC == MakeFourCC('D', 'X', 'T', '2') || fourCC == MakeFourCC('D', 'X', 'T', '3'))
+				return DXGI_FORMAT_BC2_UNORM;
+			if(fourCC == MakeFourCC('D', 'X', 'T', '4') || fourCC == MakeFourCC('D', 'X', 'T', '5'))
+				return DXGI_FORMAT_BC3_UNORM;
+			if(fourCC == MakeFourCC('A', 'T', 'I', '1') || fourCC == MakeFourCC('B', 'C', '4', 'U'))
+				return DXGI_FORMAT_BC4_UNORM;
+			if(fourCC == MakeFourCC('A', 'T', 'I', '2') || fourCC == MakeFourCC('B', 'C', '5', 'U'))
+				return DXGI_FORMAT_BC5_UNORM;
+
+			// D3DFMT_A16B16G16R16F and D3DFMT_A32B32G32R32F.
+			if(fourCC == 113)
+				return DXGI_FORMAT_R16G16B16A16_FLOAT;
+			if(fourCC == 116)
+				return DXGI_FORMAT_R32G32B32A32_FLOAT;
+
+			return DXGI_FORMAT_UNKNOWN;
+		}
+
+		if(pf.Flags & DdpfRgb)
+		{
+			bool alpha = (pf.Flags & DdpfAlphaPixels) != 0;
+			if(pf.RGBBitCount == 32)
+			{
+				if(HasMasks(pf, 0xff0000, 0xff00, 0xff, alpha ? 0xff000000 : 0))
+				{
+					fillAlpha = !alpha;
+					return DXGI_FORMAT_B8G8R8A8_UNORM;
+				}
+				if(HasMasks(pf, 0xff, 0xff00, 0xff0000, alpha ? 0xff000000 : 0))
+				{
+					fillAlpha = !alpha;
+					return DXGI_FORMAT_R8G8B8A8_UNORM;
+				}
+				if(HasMasks(pf, 0xffff, 0xffff0000, 0, 0))
+					return DXGI_FORMAT_R16G16_UNORM;
+			}
+			else if(pf.RGBBitCount == 16)
+			{
+				if(HasMasks(pf, 0xf800, 0x7e0, 0x1f, 0))
+					return DXGI_FORMAT_B5G6R5_UNORM;
+			}
+
+			return DXGI_FORMAT_UNKNOWN;
+		}
+
+		if(pf.Flags & DdpfLuminance)
+		{
+			if(pf.RGBBitCount == 8)
+				return DXGI_FORMAT_R8_UNORM;
+			if(pf.RGBBitCount == 16)
+				return DXGI_FORMAT_R16_UNORM;
+		}
+
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	// Reads the headers, leaving the file at the first texel.
+	bool ReadDdsHeader(FILE* file, DdsLayout& layout)
+	{
+		UINT magic;
+		DdsHeader header;
+		if(fread(&magic, sizeof(magic), 1, file) != 1 || magic != DdsMagic ||
+			fread(&header, sizeof(header), 1, file) != 1 || header.Size != sizeof(header))
+			return false;
+
+		// Volume textures are not supported.
+		if((header.Caps2 & DdsCaps2Volume) || header.Width == 0 || header.Height == 0)
+			return false;
+
+		layout.Width = header.Width;
+		layout.Height = header.Height;
+		layout.MipLevels = (header.Flags & DdsdMipMapCount) && header.MipMapCount > 0 ? header.MipMapCount : 1;
+		layout.ArraySize = 1;
+		layout.CubeMap = (header.Caps2 & DdsCaps2CubeMap) != 0;
+		layout.FillAlpha = false;
+
+		if((header.PixelFormat.Flags & DdpfFourCC) && header.PixelFormat.FourCC == MakeFourCC('D', 'X', '1', '0'))
+		{
+			DdsHeaderDx10 dx10;
+			if(fread(&dx10, sizeof(dx10), 1, file) != 1 || dx10.ResourceDimension != Dx10Texture2D || dx10.ArraySize == 0)
+				return false;
+
+			layout.Format = (DXGI_FORMAT)dx10.DxgiFormat;
+			layout.ArraySize = dx10.ArraySize;
+			layout.CubeMap = (dx10.MiscFlag & Dx10MiscTextureCube) != 0;
+		}
+		else
+		{
+			layout.Format = GetLegacyFormat(header.PixelFormat, layout.FillAlpha);
+		}
+
+		// Legacy cube maps must have all six faces; DX10 ones count cubes, not faces.
+		if(layout.CubeMap)
+		{
+			if(layout.ArraySize == 1 && (header.Caps2 & 0xfc00) != 0xfc00)
+				return false;
+			layout.ArraySize *= 6;
+		}
+
+		UINT maxMips = 1;
+		for(UINT size = MathHelper::Max(layout.Width, layout.Height); size > 1; size >>= 1)
+			++maxMips;
+
+		return TextureData::GetBitsPerPixel(layout.Format) != 0 && layout.MipLevels <= maxMips;
+	}
+
+	void MakeOpaque(BYTE* texels, UINT64 size)
+	{
+		for(UINT64 i = 3; i < size; i += 4)
+			texels[i] = 0xff;
+	}
+
+	bool HasExtension(const std::string& filename, const char* ext)
+	{
+		size_t n = strlen(ext);
+		if(filename.size() < n)
+			return false;
+
+		for(size_t i = 0; i < n; ++i)
+		{
+			if(tolower((unsigned char)filename[filename.size() - n + i]) != ext[i])
+				return false;
+		}
+
+		return true;
+	}
+}
+
+TextureData::TextureData()
+{
+	Clear();
+}
+
+void TextureData::Clear()
+{
+	Width = 0;
+	Height = 0;
+	MipLevels = 0;
+	ArraySize = 0;
+	Format = DXGI_FORMAT_UNKNOWN;
+	CubeMap = false;
+	Texels.clear();
+	Subresources.clear();
+}
+
+bool TextureData::Load(const std::string& filename)
+{
+	if(HasExtension(filename, ".dds"))
+		return LoadDds(filename);
+
+	Clear();
+
+	FILE* file = fopen(filename.c_str(), "rb");
+	if(!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	bool read = size > 0;
+	if(read)
+	{
+		Texels.resize((size_t)size);
+		read = fread(&Texels[0], Texels.size(), 1, file) == 1;
+	}
+	fclose(file);
+
+	if(!read)
+		Texels.clear();
+
+	return read;
+}
+
+bool TextureData::LoadDds(const std::string& filename)
+{
+	std::vector<std::string> filenames(1, filename);
+	return LoadDdsArray(filenames);
+}
+
+bool TextureData::LoadDdsArray(const std::vector<std::string>& filenames)
+{
+	Clear();
+	if(filenames.empty())
+		return false;
+
+	// Every header first, so the buffer is sized once and each file's texels are read
+	// straight into their slices.
+	std::vector<FILE*> files(filenames.size(), (FILE*)0);
+	std::vector<DdsLayout> layouts(filenames.size());
+	bool ok = true;
+	for(size_t i = 0; i < filenames.size() && ok; ++i)
+	{
+		files[i] = fopen(filenames[i].c_str(), "rb");
+		ok = files[i] && ReadDdsHeader(files[i], layouts[i]);
+
+		const DdsLayout& first = layouts[0];
+		const DdsLayout& l = layouts[i];
+		ok = ok && l.Width == first.Width && l.Height == first.Height && l.MipLevels == first.MipLevels &&
+			l.Format == first.Format && l.CubeMap == first.CubeMap;
+		if(ok)
+			ArraySize += l.ArraySize;
+	}
+
+	if(ok)
+	{
+		Width = layouts[0].Width;
+		Height = layouts[0].Height;
+		MipLevels = layouts[0].MipLevels;
+		Format = layouts[0].Format;
+		CubeMap = layouts[0].CubeMap;
+		Texels.resize((size_t)BuildSubresources());
+
+		// A file's slices are all its mips in turn, as in the file.
+		UINT slice = 0;
+		for(size_t i = 0; i < filenames.size() && ok; ++i)
+		{
+			UINT end = slice + layouts[i].ArraySize;
+			UINT64 offset = Subresources[GetSubresource(0, slice)].Offset;
+			UINT64 size = (end < ArraySize ? Subresources[GetSubresource(0, end)].Offset : Texels.size()) - offset;
+
+			ok = fread(&Texels[(size_t)offset], (size_t)size, 1, files[i]) == 1;
+			if(ok && layouts[i].FillAlpha)
+				MakeOpaque(&Texels[(size_t)offset], size);
+
+			slice = end;
+		}
+	}
+
+	for(size_t i = 0; i < files.size(); ++i)
+	{
+		if(files[i])
+			fclose(files[i]);
+	}
+
+	if(!ok)
+		Clear();
+
+	return ok;
+}
+
+UINT64 TextureData::BuildSubresources()
+{
+	bool compressed = IsBlockCompressed(Format);
+	UINT bitsPerPixel = GetBitsPerPixel(Format);
+
+	Subresources.resize(MipLevels*ArraySize);
+	UINT64 offset = 0;
+	for(UINT slice = 0; slice < ArraySize; ++slice)
+	{
+		for(UINT mip = 0; mip < MipLevels; ++mip)
+		{
+			TextureSubresource& s = Subresources[GetSubresource(mip, slice)];
+			s.Width = MathHelper::Max(Width >> mip, 1u);
+			s.Height = MathHelper::Max(Height >> mip, 1u);
+			s.Offset = offset;
+
+			if(compressed)
+			{
+				// 4x4 blocks of 16 pixels.
+				s.RowPitch = MathHelper::Max((s.Width + 3) / 4, 1u)*bitsPerPixel*2;
+				s.SlicePitch = s.RowPitch*MathHelper::Max((s.Height + 3) / 4, 1u);
+			}
+			else
+			{
+				s.RowPitch = (s.Width*bitsPerPixel + 7) / 8;
+				s.SlicePitch = s.RowPitch*s.Height;
+			}
+
+			offset += s.SlicePitch;
+		}
+	}
+
+	return offset;
+}
+
+UINT TextureData::GetBitsPerPixel(DXGI_FORMAT format)
+{
+	switch(format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+	case DXGI_FORMAT_R32G32B32A32_UINT:
+		return 128;
+
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R32G32_FLOAT:
+		return 64;
+
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R11G11B10_FLOAT:
+	case DXGI_FORMAT_R16G16_FLOAT:
+	case DXGI_FORMAT_R16G16_UNORM:
+	case DXGI_FORMAT_R32_FLOAT:
+		return 32;
+
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_B5G6R5_UNORM:
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+		return 16;
+
+	case DXGI_FORMAT_R8_UNORM:
+	case DXGI_FORMAT_A8_UNORM:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 8;
+
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		return 4;
+
+	default:
+		return 0;
+	}
+}
+
+bool TextureData::IsBlockCompressed(DXGI_FORMAT format)
+{
+	return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+		(format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
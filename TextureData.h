@@ -0,0 +1,82 @@
+//***************************************************************************************
+// TextureData.h
+//
+// A texture decoded into CPU memory, laid out the way D3D11 takes initial data: every
+// subresource of every array slice in one buffer, in D3D11CalcSubresource order, with
+// the pitches a D3D11_SUBRESOURCE_DATA needs.  A 2D texture, cube map or texture array
+// is then created in a single immutable CreateTexture2D, with no staging copies.
+//
+// DDS files are decoded here, without a device, so it can run on loader threads.  An
+// array is read straight from its files into its slot of the one buffer.  Other image
+// files (JPG, PNG, BMP) are only read; their bytes are kept for D3DX to decode from
+// memory.
+//***************************************************************************************
+
+#ifndef TEXTUREDATA_H
+#define TEXTUREDATA_H
+
+#include "Platform.h"
+#include <DXGIFormat.h>
+#include <string>
+#include <vector>
+
+struct TextureSubresource
+{
+	UINT Width;
+	UINT Height;
+
+	// Into TextureData::Texels.
+	UINT64 Offset;
+
+	// Bytes per row of texels, or of 4x4 blocks for compressed formats, and for the
+	// whole subresource.
+	UINT RowPitch;
+	UINT SlicePitch;
+};
+
+class TextureData
+{
+public:
+	TextureData();
+
+	// By extension: .dds files are decoded, anything else is read as it is.
+	bool Load(const std::string& filename);
+
+	bool LoadDds(const std::string& filename);
+
+	// One texture array of every slice of every file, in order.  The files must agree
+	// in size, format and mip count.
+	bool LoadDdsArray(const std::vector<std::string>& filenames);
+
+	void Clear();
+
+	// Whether Texels holds an image file still to be decoded, rather than subresources.
+	bool IsEncoded()const { return Format == DXGI_FORMAT_UNKNOWN && !Texels.empty(); }
+
+	UINT GetSubresource(UINT mip, UINT slice)const { return mip + slice*MipLevels; }
+	const BYTE* GetTexels(UINT subresource)const { return &Texels[(size_t)Subresources[subresource].Offset]; }
+
+	// 0 for formats the loader does not know.
+	static UINT GetBitsPerPixel(DXGI_FORMAT format);
+	static bool IsBlockCompressed(DXGI_FORMAT format);
+
+public:
+	UINT Width;
+	UINT Height;
+	UINT MipLevels;
+	UINT ArraySize;
+	DXGI_FORMAT Format;
+
+	// ArraySize counts the faces, six per cube.
+	bool CubeMap;
+
+	std::vector<BYTE> Texels;
+	std::vector<TextureSubresource> Subresources;
+
+private:
+	// Fills Subresources for the current size, format and counts; returns the bytes
+	// they take.
+	UINT64 BuildSubresources();
+};
+
+#endif // TEXTUREDATA_H
@@ -25,27 +25,72 @@ TextureHelper::~TextureHelper()
 	mTextureSRV.clear();
 }
 
-void TextureHelper::Init(ID3D11Device* device)
+void TextureHelper::Init(ID3D11Device* device, UINT numLoaderThreads)
 {
 	md3dDevice = device;
+	mLoader.Start(numLoaderThreads);
 }
 
-ID3D11ShaderResourceView* TextureHelper::CreateTexture(std::wstring filename)
+void TextureHelper::Request(const std::wstring& filename)
 {
-	ID3D11ShaderResourceView* srv = 0;
+	if( mTextureSRV.find(filename) != mTextureSRV.end() || mPending.find(filename) != mPending.end() )
+		return;
 
-	// Does it already exist?
-	if( mTextureSRV.find(filename) != mTextureSRV.end() )
+	mPending[filename] = mLoader.Load(std::string(filename.begin(), filename.end()));
+}
+
+UINT TextureHelper::Poll()
+{
+	for(auto it = mPending.begin(); it != mPending.end(); )
 	{
-		srv = mTextureSRV[filename];
+		if( mLoader.IsReady(it->second) )
+		{
+			std::wstring filename = it->first;
+			TextureLoader::Handle handle = it->second;
+			it = mPending.erase(it);
+			Finish(filename, handle);
+		}
+		else
+		{
+			++it;
+		}
 	}
+
+	return (UINT)mPending.size();
+}
+
+ID3D11ShaderResourceView* TextureHelper::GetTexture(const std::wstring& filename)const
+{
+	auto it = mTextureSRV.find(filename);
+	return it != mTextureSRV.end() ? it->second : 0;
+}
+
+ID3D11ShaderResourceView* TextureHelper::CreateTexture(std::wstring filename)
+{
+	// Does it already exist?
+	auto it = mTextureSRV.find(filename);
+	if( it != mTextureSRV.end() )
+		return it->second;
+
+	Request(filename);
+
+	TextureLoader::Handle handle = mPending[filename];
+	mPending.erase(filename);
+	return Finish(filename, handle);
+}
+
+ID3D11ShaderResourceView* TextureHelper::Finish(const std::wstring& filename, TextureLoader::Handle handle)
+{
+	ID3D11ShaderResourceView* srv = 0;
+
+	// Formats TextureData does not know, and missing files, go through D3DX as before.
+	TextureData data;
+	if( mLoader.Take(handle, data) )
+		srv = d3dHelper::CreateTextureSRV(md3dDevice, data);
 	else
-	{
 		HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, filename.c_str(), 0, 0, &srv, 0 ));
 
-		mTextureSRV[filename] = srv;
-	}
+	mTextureSRV[filename] = srv;
 
 	return srv;
 }
- 
@@ -13,11 +13,14 @@
 #define TextureHelper_H
 
 #include "d3dUtil.h"
+#include "TextureLoader.h"
 #include <map>
 
 ///<summary>
 /// Simple texture manager to avoid loading duplicate textures from file.  That can
 /// happen, for example, if multiple meshes reference the same texture filename. 
+/// Files asked for with Request are read and decoded on loader threads while the
+/// caller gets on with other work.
 ///</summary>
 class TextureHelper
 {
@@ -25,17 +28,33 @@ public:
 	TextureHelper();
 	~TextureHelper();
 
-	void Init(ID3D11Device* device);
+	// numLoaderThreads == 0 uses one per hardware thread.
+	void Init(ID3D11Device* device, UINT numLoaderThreads = 0);
 
+	// Starts loading filename in the background unless it is loaded or loading already.
+	void Request(const std::wstring& filename);
+
+	// Creates the views of the requests that have finished; once a frame, on the render
+	// thread.  Returns how many are still loading.
+	UINT Poll();
+
+	// The view, or 0 until Poll has seen the file finish.
+	ID3D11ShaderResourceView* GetTexture(const std::wstring& filename)const;
+
+	// The view, waiting for the file if it was requested and loading it now if not.
 	ID3D11ShaderResourceView* CreateTexture(std::wstring filename);
 
 private:
 	TextureHelper(const TextureHelper& rhs);
 	TextureHelper& operator=(const TextureHelper& rhs);
+
+	ID3D11ShaderResourceView* Finish(const std::wstring& filename, TextureLoader::Handle handle);
 	
 private:
 	ID3D11Device* md3dDevice;
+	TextureLoader mLoader;
 	std::map<std::wstring, ID3D11ShaderResourceView*> mTextureSRV;
+	std::map<std::wstring, TextureLoader::Handle> mPending;
 };
 
 #endif // TextureHelper_H
\ No newline at end of file
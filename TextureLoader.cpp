@@ -0,0 +1,157 @@
+//***************************************************************************************
+// TextureLoader.cpp
+//***************************************************************************************
+
+#include "TextureLoader.h"
+#include <utility>
+
+TextureLoader::TextureLoader() :
+	mNextHandle(1),
+	mNumPending(0),
+	mQuit(false)
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	Stop();
+}
+
+void TextureLoader::Start(UINT numThreads)
+{
+	Stop();
+
+	if(numThreads == 0)
+		numThreads = GetHardwareThreadCount();
+
+	mQuit = false;
+	for(UINT i = 0; i < numThreads; ++i)
+		mWorkers.push_back(std::thread(&TextureLoader::WorkerMain, this));
+}
+
+void TextureLoader::Stop()
+{
+	if(mWorkers.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+	for(size_t i = 0; i < mWorkers.size(); ++i)
+		mWorkers[i].join();
+	mWorkers.clear();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mRequests.clear();
+	mQueue.clear();
+	mNumPending = 0;
+	mDone.notify_all();
+}
+
+TextureLoader::Handle TextureLoader::Load(const std::string& filename)
+{
+	return Queue(std::vector<std::string>(1, filename), false);
+}
+
+TextureLoader::Handle TextureLoader::LoadArray(const std::vector<std::string>& filenames)
+{
+	return Queue(filenames, true);
+}
+
+TextureLoader::Handle TextureLoader::Queue(const std::vector<std::string>& filenames, bool array)
+{
+	Handle handle;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		handle = mNextHandle++;
+		if(mNextHandle == InvalidHandle)
+			++mNextHandle;
+
+		Request& request = mRequests[handle];
+		request.Filenames = filenames;
+		request.Array = array;
+		request.Done = false;
+		request.Loaded = false;
+		mQueue.push_back(handle);
+		++mNumPending;
+	}
+	mWake.notify_one();
+
+	return handle;
+}
+
+bool TextureLoader::IsReady(Handle handle)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::map<Handle, Request>::const_iterator it = mRequests.find(handle);
+	return it == mRequests.end() || it->second.Done;
+}
+
+void TextureLoader::Wait(Handle handle)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for(;;)
+	{
+		std::map<Handle, Request>::const_iterator it = mRequests.find(handle);
+		if(it == mRequests.end() || it->second.Done)
+			break;
+		mDone.wait(lock);
+	}
+}
+
+void TextureLoader::WaitAll()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while(mNumPending > 0)
+		mDone.wait(lock);
+}
+
+bool TextureLoader::Take(Handle handle, TextureData& data)
+{
+	data.Clear();
+	Wait(handle);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::map<Handle, Request>::iterator it = mRequests.find(handle);
+	if(it == mRequests.end())
+		return false;
+
+	bool loaded = it->second.Loaded;
+	if(loaded)
+		data = std::move(it->second.Data);
+	mRequests.erase(it);
+
+	return loaded;
+}
+
+UINT TextureLoader::GetNumPending()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mNumPending;
+}
+
+void TextureLoader::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for(;;)
+	{
+		while(!mQuit && mQueue.empty())
+			mWake.wait(lock);
+		if(mQuit)
+			break;
+
+		Request& request = mRequests[mQueue.front()];
+		mQueue.pop_front();
+		lock.unlock();
+
+		request.Loaded = request.Array ? request.Data.LoadDdsArray(request.Filenames) :
+			request.Data.Load(request.Filenames[0]);
+
+		lock.lock();
+		request.Done = true;
+		--mNumPending;
+		mDone.notify_all();
+	}
+}
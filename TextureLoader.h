@@ -0,0 +1,89 @@
+//***************************************************************************************
+// TextureLoader.h
+//
+// Reads and decodes textures into TextureData on a pool of worker threads, so a dozen
+// files load in parallel with each other and with whatever the caller does meanwhile.
+// Each Load returns a handle the render thread polls with IsReady and then Takes the
+// texture from, to create it on the device with all its initial data at once.
+//
+// Only the workers touch the files; handles are plain numbers and every other call
+// may come from any thread.
+//***************************************************************************************
+
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include "TextureData.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+class TextureLoader
+{
+public:
+	typedef UINT Handle;
+
+	// Never returned by Load.
+	static const Handle InvalidHandle = 0;
+
+	TextureLoader();
+	~TextureLoader();
+
+	// numThreads == 0 uses one worker per hardware thread.
+	void Start(UINT numThreads = 0);
+
+	// Drops requests not yet started and waits for the rest.  Handles not taken are
+	// no longer valid.
+	void Stop();
+	bool IsRunning()const { return !mWorkers.empty(); }
+
+	// TextureData::Load of filename, or LoadDdsArray of filenames, in the background.
+	// Requests queue up until Start.
+	Handle Load(const std::string& filename);
+	Handle LoadArray(const std::vector<std::string>& filenames);
+
+	// Whether the request has finished, loaded or not.  Never blocks.
+	bool IsReady(Handle handle);
+
+	// Blocks until the request has finished.
+	void Wait(Handle handle);
+	void WaitAll();
+
+	// Waits for the request, moves its texture into data and frees the handle.  Returns
+	// false, leaving data empty, if the file could not be loaded.
+	bool Take(Handle handle, TextureData& data);
+
+	// Requests queued or being loaded.
+	UINT GetNumPending();
+
+private:
+	struct Request
+	{
+		std::vector<std::string> Filenames;
+		bool Array;
+		bool Done;
+		bool Loaded;
+		TextureData Data;
+	};
+
+	Handle Queue(const std::vector<std::string>& filenames, bool array);
+	void WorkerMain();
+
+private:
+	// Guarded by mMutex.  Requests are only erased once Done, so workers may fill one
+	// in without holding the lock.
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+	std::map<Handle, Request> mRequests;
+	std::deque<Handle> mQueue;
+	Handle mNextHandle;
+	UINT mNumPending;
+	bool mQuit;
+
+	std::vector<std::thread> mWorkers;
+};
+
+#endif // TEXTURELOADER_H
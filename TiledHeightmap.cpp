@@ -0,0 +1,452 @@
+//***************************************************************************************
+// TiledHeightmap.cpp
+//***************************************************************************************
+
+#include "TiledHeightmap.h"
+#include "HeightmapFilter.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const char TiledMagic[4] = { 'Z', 'T', 'H', 'M' };
+	const UINT TiledVersion = 1;
+	const UINT64 TileAlignment = 4096;
+
+	struct TiledHeader
+	{
+		char   Magic[4];
+		UINT   Version;
+		UINT   NumCols;
+		UINT   NumRows;
+		UINT   TileCells;
+		UINT   NumTilesX;
+		UINT   NumTilesZ;
+		UINT   Format;
+		float  HeightMin;
+		float  HeightRange;
+		UINT64 DataOffset;
+		UINT64 TileStride;
+	};
+
+	UINT64 AlignUp(UINT64 n)
+	{
+		return (n + TileAlignment - 1) & ~(TileAlignment - 1);
+	}
+
+	UINT NumTiles(UINT samples, UINT tileCells)
+	{
+		UINT cells = samples > 1 ? samples - 1 : 1;
+		return (cells + tileCells - 1) / tileCells;
+	}
+
+	bool SeekFile(FILE* file, UINT64 offset)
+	{
+#ifdef _WIN32
+		return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+		return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+	}
+
+	// Supplies whole heightmap rows to the tile writer, top (+z) row first.
+	class RowSource
+	{
+	public:
+		virtual ~RowSource() {}
+		virtual bool ReadRows(UINT firstRow, UINT count, float* out) = 0;
+	};
+
+	class HeightmapRows : public RowSource
+	{
+	public:
+		explicit HeightmapRows(const Heightmap& heightmap) : mHeightmap(heightmap) {}
+
+		bool ReadRows(UINT firstRow, UINT count, float* out)
+		{
+			const std::vector<float>& heights = mHeightmap.GetData();
+			size_t cols = mHeightmap.GetNumCols();
+			memcpy(out, &heights[firstRow*cols], count*cols*sizeof(float));
+			return true;
+		}
+
+	private:
+		const Heightmap& mHeightmap;
+	};
+
+	class RawRows : public RowSource
+	{
+	public:
+		RawRows(FILE* file, UINT numCols, UINT numRows, UINT bytesPerSample, float heightScale, bool smooth) :
+			mFile(file), mNumCols(numCols), mNumRows(numRows), mBytesPerSample(bytesPerSample),
+			mHeightScale(heightScale), mSmooth(smooth)
+		{
+		}
+
+		bool ReadRows(UINT firstRow, UINT count, float* out)
+		{
+			if(!mSmooth)
+				return Read(firstRow, count, out);
+
+			// One extra row either side, where the map has them, for the 3x3 filter.
+			UINT first = firstRow > 0 ? firstRow - 1 : 0;
+			UINT last = MathHelper::Min(firstRow + count, mNumRows - 1);
+			mRows.resize((size_t)(last - first + 1)*mNumCols);
+			if(!Read(first, last - first + 1, &mRows[0]))
+				return false;
+
+			// The filter Heightmap::Smooth runs, so the result matches it bit for bit.
+			for(UINT i = firstRow; i < firstRow + count; ++i)
+			{
+				const float* row = &mRows[(size_t)(i - first)*mNumCols];
+				const float* above = i > 0 ? row - mNumCols : 0;
+				const float* below = i + 1 < mNumRows ? row + mNumCols : 0;
+				HeightmapFilter::SmoothRow(above, row, below, out + (size_t)(i - firstRow)*mNumCols, mNumCols);
+			}
+			return true;
+		}
+
+	private:
+		bool Read(UINT firstRow, UINT count, float* out)
+		{
+			size_t samples = (size_t)count*mNumCols;
+			mBytes.resize(samples*mBytesPerSample);
+			if(!SeekFile(mFile, (UINT64)firstRow*mNumCols*mBytesPerSample) ||
+				fread(&mBytes[0], mBytes.size(), 1, mFile) != 1)
+				return false;
+
+			if(mBytesPerSample == 2)
+			{
+				for(size_t i = 0; i < samples; ++i)
+					out[i] = ((mBytes[2*i] | (mBytes[2*i+1] << 8)) / 65535.0f)*mHeightScale;
+			}
+			else
+			{
+				// Same expression as Heightmap::BuildFromRaw.
+				for(size_t i = 0; i < samples; ++i)
+					out[i] = (mBytes[i] / 255.0f)*mHeightScale;
+			}
+			return true;
+		}
+
+		FILE* mFile;
+		UINT mNumCols;
+		UINT mNumRows;
+		UINT mBytesPerSample;
+		float mHeightScale;
+		bool mSmooth;
+		std::vector<unsigned char> mBytes;
+		std::vector<float> mRows;
+	};
+
+	bool WriteTiles(const std::string& filename, UINT numCols, UINT numRows, UINT tileCells,
+		TiledHeightmap::Format format, float heightMin, float heightRange, RowSource& source)
+	{
+		if(numCols < 2 || numRows < 2 || tileCells == 0)
+			return false;
+
+		TiledHeader header;
+		memcpy(header.Magic, TiledMagic, sizeof(TiledMagic));
+		header.Version = TiledVersion;
+		header.NumCols = numCols;
+		header.NumRows = numRows;
+		header.TileCells = tileCells;
+		header.NumTilesX = NumTiles(numCols, tileCells);
+		header.NumTilesZ = NumTiles(numRows, tileCells);
+		header.Format = format;
+		header.HeightMin = heightMin;
+		header.HeightRange = heightRange > 0.0f ? heightRange : 1.0f;
+
+		UINT tileSamples = tileCells + 1;
+		UINT sampleBytes = format == TiledHeightmap::FormatUnorm16 ? 2 : 4;
+		UINT64 tileBytes = (UINT64)tileSamples*tileSamples*sampleBytes;
+		UINT numTiles = header.NumTilesX*header.NumTilesZ;
+
+		header.DataOffset = AlignUp(sizeof(TiledHeader) + numTiles*2*sizeof(float));
+		header.TileStride = AlignUp(tileBytes);
+
+		std::string tempPath = filename + ".tmp";
+		FILE* file = fopen(tempPath.c_str(), "wb");
+		if(!file)
+			return false;
+
+		// The header and directory are filled in last; reserve their space.
+		std::vector<unsigned char> zeros((size_t)header.DataOffset, 0);
+		bool ok = fwrite(&zeros[0], zeros.size(), 1, file) == 1;
+
+		std::vector<float> strip((size_t)tileSamples*numCols);
+		std::vector<unsigned char> tile((size_t)header.TileStride, 0);
+		std::vector<float> boundsY(numTiles*2);
+		float invStep = 65535.0f / header.HeightRange;
+		float step = header.HeightRange / 65535.0f;
+
+		for(UINT tz = 0; tz < header.NumTilesZ && ok; ++tz)
+		{
+			// Rows past the bottom of the map repeat its last row.
+			UINT firstRow = tz*tileCells;
+			UINT count = MathHelper::Min(tileSamples, numRows - firstRow);
+			ok = source.ReadRows(firstRow, count, &strip[0]);
+			for(UINT r = count; r < tileSamples && ok; ++r)
+				memcpy(&strip[(size_t)r*numCols], &strip[(size_t)(count-1)*numCols], numCols*sizeof(float));
+
+			for(UINT tx = 0; tx < header.NumTilesX && ok; ++tx)
+			{
+				float minY = +MathHelper::Infinity;
+				float maxY = -MathHelper::Infinity;
+				for(UINT r = 0; r < tileSamples; ++r)
+				{
+					const float* row = &strip[(size_t)r*numCols];
+					for(UINT c = 0; c < tileSamples; ++c)
+					{
+						float h = row[MathHelper::Min(tx*tileCells + c, numCols - 1)];
+						UINT k = r*tileSamples + c;
+
+						if(format == TiledHeightmap::FormatUnorm16)
+						{
+							float q = MathHelper::Clamp((h - heightMin)*invStep + 0.5f, 0.0f, 65535.0f);
+							USHORT v = (USHORT)q;
+							memcpy(&tile[k*2], &v, 2);
+
+							// Bounds of what will be decoded, not of the source.
+							h = heightMin + v*step;
+						}
+						else
+						{
+							memcpy(&tile[k*4], &h, 4);
+						}
+
+						minY = MathHelper::Min(minY, h);
+						maxY = MathHelper::Max(maxY, h);
+					}
+				}
+
+				UINT index = tz*header.NumTilesX + tx;
+				boundsY[index*2+0] = minY;
+				boundsY[index*2+1] = maxY;
+				ok = fwrite(&tile[0], tile.size(), 1, file) == 1;
+			}
+		}
+
+		ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+			fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(&boundsY[0], boundsY.size()*sizeof(float), 1, file) == 1;
+		ok = fclose(file) == 0 && ok;
+
+		if(ok)
+		{
+			// rename() does not replace an existing file on Windows.
+			remove(filename.c_str());
+			ok = rename(tempPath.c_str(), filename.c_str()) == 0;
+		}
+
+		if(!ok)
+			remove(tempPath.c_str());
+		return ok;
+	}
+}
+
+TiledHeightmap::TiledHeightmap() :
+	mNumCols(0),
+	mNumRows(0),
+	mTileCells(0),
+	mNumTilesX(0),
+	mNumTilesZ(0),
+	mFormat(FormatUnorm16),
+	mHeightMin(0.0f),
+	mHeightStep(0.0f),
+	mDataOffset(0),
+	mTileStride(0),
+	mBoundsY(0)
+{
+}
+
+bool TiledHeightmap::Open(const std::string& filename)
+{
+	Close();
+
+	if(!mFile.Open(filename) || mFile.GetSize() < sizeof(TiledHeader))
+	{
+		Close();
+		return false;
+	}
+
+	TiledHeader header;
+	memcpy(&header, mFile.GetData(), sizeof(header));
+
+	bool ok = memcmp(header.Magic, TiledMagic, sizeof(TiledMagic)) == 0 &&
+		header.Version == TiledVersion &&
+		(header.Format == FormatUnorm16 || header.Format == FormatFloat32) &&
+		header.NumCols >= 2 && header.NumRows >= 2 && header.TileCells > 0 &&
+		header.NumTilesX == NumTiles(header.NumCols, header.TileCells) &&
+		header.NumTilesZ == NumTiles(header.NumRows, header.TileCells);
+
+	// Every tile must hold its (TileCells+1)^2 samples, and the bounds and tiles fit in
+	// the file.  Divided rather than multiplied so a corrupt header cannot overflow.
+	UINT64 numTiles = (UINT64)header.NumTilesX*header.NumTilesZ;
+	UINT64 tileSamples = (UINT64)header.TileCells + 1;
+	UINT64 sampleBytes = header.Format == FormatUnorm16 ? 2 : 4;
+	ok = ok && header.TileStride / sampleBytes / tileSamples >= tileSamples &&
+		header.DataOffset >= sizeof(TiledHeader) &&
+		(header.DataOffset - sizeof(TiledHeader)) / (2*sizeof(float)) >= numTiles &&
+		header.DataOffset <= mFile.GetSize() &&
+		(mFile.GetSize() - header.DataOffset) / header.TileStride >= numTiles;
+
+	if(!ok)
+	{
+		Close();
+		return false;
+	}
+
+	mNumCols = header.NumCols;
+	mNumRows = header.NumRows;
+	mTileCells = header.TileCells;
+	mNumTilesX = header.NumTilesX;
+	mNumTilesZ = header.NumTilesZ;
+	mFormat = (Format)header.Format;
+	mHeightMin = header.HeightMin;
+	mHeightStep = header.HeightRange / 65535.0f;
+	mDataOffset = header.DataOffset;
+	mTileStride = header.TileStride;
+	mBoundsY = (const float*)(mFile.GetData() + sizeof(TiledHeader));
+	return true;
+}
+
+void TiledHeightmap::Close()
+{
+	mFile.Close();
+	mNumCols = mNumRows = 0;
+	mTileCells = 0;
+	mNumTilesX = mNumTilesZ = 0;
+	mBoundsY = 0;
+}
+
+UINT64 TiledHeightmap::GetTileOffset(UINT tileX, UINT tileZ)const
+{
+	return mDataOffset + (UINT64)(tileZ*mNumTilesX + tileX)*mTileStride;
+}
+
+UINT64 TiledHeightmap::GetTileBytes()const
+{
+	UINT64 samples = (UINT64)GetTileSamples()*GetTileSamples();
+	return samples*(mFormat == FormatUnorm16 ? 2 : 4);
+}
+
+XMFLOAT2 TiledHeightmap::GetTileBoundsY(UINT tileX, UINT tileZ)const
+{
+	UINT index = tileZ*mNumTilesX + tileX;
+	return XMFLOAT2(mBoundsY[index*2+0], mBoundsY[index*2+1]);
+}
+
+void TiledHeightmap::DecodeTile(UINT tileX, UINT tileZ, float* out)const
+{
+	const unsigned char* data = mFile.GetData() + GetTileOffset(tileX, tileZ);
+	UINT samples = GetTileSamples()*GetTileSamples();
+
+	if(mFormat == FormatUnorm16)
+	{
+		const USHORT* q = (const USHORT*)data;
+		for(UINT i = 0; i < samples; ++i)
+			out[i] = mHeightMin + q[i]*mHeightStep;
+	}
+	else
+	{
+		memcpy(out, data, samples*sizeof(float));
+	}
+}
+
+void TiledHeightmap::PrefetchTile(UINT tileX, UINT tileZ)const
+{
+	mFile.Prefetch(GetTileOffset(tileX, tileZ), GetTileBytes());
+}
+
+void TiledHeightmap::ReleaseTile(UINT tileX, UINT tileZ)const
+{
+	mFile.Release(GetTileOffset(tileX, tileZ), GetTileBytes());
+}
+
+float TiledHeightmap::GetSample(UINT row, UINT col)const
+{
+	UINT tileZ = MathHelper::Min(row / mTileCells, mNumTilesZ - 1);
+	UINT tileX = MathHelper::Min(col / mTileCells, mNumTilesX - 1);
+	UINT k = (row - tileZ*mTileCells)*GetTileSamples() + (col - tileX*mTileCells);
+
+	const unsigned char* data = mFile.GetData() + GetTileOffset(tileX, tileZ);
+	if(mFormat == FormatUnorm16)
+		return mHeightMin + ((const USHORT*)data)[k]*mHeightStep;
+	return ((const float*)data)[k];
+}
+
+float TiledHeightmap::GetHeight(float x, float z, float cellSpacing)const
+{
+	float width = (mNumCols-1)*cellSpacing;
+	float depth = (mNumRows-1)*cellSpacing;
+
+	// Transform from terrain local space to "cell" space.
+	float c = (x + 0.5f*width) /  cellSpacing;
+	float d = (z - 0.5f*depth) / -cellSpacing;
+
+	// Clamped so queries off the map read its edge rather than past the mapping.
+	int row = MathHelper::Clamp((int)floorf(d), 0, (int)mNumRows - 2);
+	int col = MathHelper::Clamp((int)floorf(c), 0, (int)mNumCols - 2);
+
+	float A = GetSample(row, col);
+	float B = GetSample(row, col + 1);
+	float C = GetSample(row + 1, col);
+	float D = GetSample(row + 1, col + 1);
+
+	return InterpolateCell(A, B, C, D, c - (float)col, d - (float)row);
+}
+
+float TiledHeightmap::InterpolateCell(float A, float B, float C, float D, float s, float t)
+{
+	// If upper triangle ABC.
+	if(s + t <= 1.0f)
+	{
+		float uy = B - A;
+		float vy = C - A;
+		return A + s*uy + t*vy;
+	}
+	else // lower triangle DCB.
+	{
+		float uy = C - D;
+		float vy = B - D;
+		return D + (1.0f-s)*uy + (1.0f-t)*vy;
+	}
+}
+
+bool TiledHeightmap::Write(const std::string& filename, const Heightmap& heightmap, UINT tileCells, Format format)
+{
+	const std::vector<float>& heights = heightmap.GetData();
+	if(heights.empty())
+		return false;
+
+	float minY = heights[0];
+	float maxY = heights[0];
+	for(size_t i = 1; i < heights.size(); ++i)
+	{
+		minY = MathHelper::Min(minY, heights[i]);
+		maxY = MathHelper::Max(maxY, heights[i]);
+	}
+
+	HeightmapRows rows(heightmap);
+	return WriteTiles(filename, heightmap.GetNumCols(), heightmap.GetNumRows(), tileCells, format, minY, maxY - minY, rows);
+}
+
+bool TiledHeightmap::ConvertRaw(const std::string& rawFilename, UINT numCols, UINT numRows, UINT bytesPerSample,
+	float heightScale, bool smooth, const std::string& filename, UINT tileCells, Format format)
+{
+	if(bytesPerSample != 1 && bytesPerSample != 2)
+		return false;
+
+	FILE* file = fopen(rawFilename.c_str(), "rb");
+	if(!file)
+		return false;
+
+	RawRows rows(file, numCols, numRows, bytesPerSample, heightScale, smooth);
+	bool ok = WriteTiles(filename, numCols, numRows, tileCells, format, 0.0f, heightScale, rows);
+
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,100 @@
+//***************************************************************************************
+// TiledHeightmap.h
+//
+// Heightmaps too large to hold in memory, stored as fixed-size square tiles and
+// memory-mapped.  A tile covers TileCells x TileCells cells and stores the
+// (TileCells+1)^2 samples around them, so neighboring tiles repeat their shared border
+// and any cell can be interpolated from one tile.  Tiles past the map's last row or
+// column repeat its edge samples.
+//
+// Tiles are numbered like Heightmap rows, starting at the +z edge: tile (x, z) is
+// tileZ*NumTilesX + tileX.  Each starts on a 4 KB boundary so paging a tile in or out
+// never touches its neighbors, and the directory keeps every tile's min/max height so
+// bounds can be tested without reading height data.
+//
+// Heights are either 16-bit, spread over the map's [HeightMin, HeightMin + HeightRange],
+// or 32-bit floats.
+//***************************************************************************************
+
+#ifndef TILEDHEIGHTMAP_H
+#define TILEDHEIGHTMAP_H
+
+#include "Heightmap.h"
+#include "MappedFile.h"
+#include <string>
+
+class TiledHeightmap
+{
+public:
+	enum Format
+	{
+		FormatUnorm16 = 0,
+		FormatFloat32 = 1
+	};
+
+	TiledHeightmap();
+
+	bool Open(const std::string& filename);
+	void Close();
+	bool IsOpen()const { return mFile.IsOpen(); }
+
+	UINT GetNumCols()const { return mNumCols; }
+	UINT GetNumRows()const { return mNumRows; }
+	UINT GetTileCells()const { return mTileCells; }
+	UINT GetTileSamples()const { return mTileCells + 1; }
+	UINT GetNumTilesX()const { return mNumTilesX; }
+	UINT GetNumTilesZ()const { return mNumTilesZ; }
+	Format GetFormat()const { return mFormat; }
+
+	// Min/max height of a tile, from the directory.
+	XMFLOAT2 GetTileBoundsY(UINT tileX, UINT tileZ)const;
+
+	// Writes the tile's GetTileSamples()^2 heights into out, row major from its +z edge.
+	void DecodeTile(UINT tileX, UINT tileZ, float* out)const;
+
+	// Hints for the OS; the tile's data stays readable either way.
+	void PrefetchTile(UINT tileX, UINT tileZ)const;
+	void ReleaseTile(UINT tileX, UINT tileZ)const;
+
+	// Straight from the mapping, touching whatever pages it needs.
+	float GetSample(UINT row, UINT col)const;
+
+	// Same as Heightmap::GetHeight, for a map centered on the origin.
+	float GetHeight(float x, float z, float cellSpacing)const;
+
+	// The height inside cell ABCD (A top left, D bottom right) at (s, t), split along
+	// the B-C diagonal as the terrain mesh is.
+	static float InterpolateCell(float A, float B, float C, float D, float s, float t);
+
+	// Writes an in-memory heightmap as tiles.
+	static bool Write(const std::string& filename, const Heightmap& heightmap, UINT tileCells, Format format);
+
+	// Converts an 8- or 16-bit (little endian) RAW file a strip of tiles at a time, so
+	// maps of any size convert in a few MB.  Heights are scaled to [0, heightScale] and,
+	// with smooth set, box filtered exactly as Heightmap::Smooth does.
+	static bool ConvertRaw(const std::string& rawFilename, UINT numCols, UINT numRows, UINT bytesPerSample,
+		float heightScale, bool smooth, const std::string& filename, UINT tileCells, Format format);
+
+private:
+	UINT64 GetTileOffset(UINT tileX, UINT tileZ)const;
+	UINT64 GetTileBytes()const;
+
+private:
+	MappedFile mFile;
+
+	UINT mNumCols;
+	UINT mNumRows;
+	UINT mTileCells;
+	UINT mNumTilesX;
+	UINT mNumTilesZ;
+	Format mFormat;
+	float mHeightMin;
+	float mHeightStep;
+	UINT64 mDataOffset;
+	UINT64 mTileStride;
+
+	// Two floats, min then max, per tile.
+	const float* mBoundsY;
+};
+
+#endif // TILEDHEIGHTMAP_H
@@ -11,6 +11,14 @@
 
 #include "Vertex.h"
 #include "Effects.h"
+#include "MeshFile.h"
+#include "VertexPacker.h"
+
+// MeshFile streams are created as vertex buffers as they are.
+static_assert(sizeof(Vertex::Basic32) == sizeof(MeshVertexBasic32), "MeshVertexBasic32 must match Vertex::Basic32");
+static_assert(sizeof(Vertex::PosNormalTexTan) == sizeof(MeshVertexPosNormalTexTan), "MeshVertexPosNormalTexTan must match Vertex::PosNormalTexTan");
+static_assert(sizeof(PackedVertexBasic) == 16, "InputLayoutDesc::PackedBasic must match PackedVertexBasic");
+static_assert(sizeof(PackedVertexPosNormalTexTan) == 20, "InputLayoutDesc::PackedPosNormalTexTan must match PackedVertexPosNormalTexTan");
 
 #pragma region InputLayoutDesc
 
@@ -53,6 +61,49 @@ const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::Particle[5] =
 	{"TYPE",     0, DXGI_FORMAT_R32_UINT,        0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0},
 };
 
+const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::InstancedPosNormalTexTan[10] = 
+{
+	{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT,    0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"NORMAL",   0, DXGI_FORMAT_R32G32B32_FLOAT,    0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT,       0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TEXNUM",   0, DXGI_FORMAT_R32_FLOAT,          0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TANGENT",  0, DXGI_FORMAT_R32G32B32_FLOAT,    0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"WORLD",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1},
+	{"WORLD",    1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+	{"WORLD",    2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+	{"WORLD",    3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+	{"COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 64, D3D11_INPUT_PER_INSTANCE_DATA, 1}
+};
+
+// The material rides in POSITION.w.
+const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::PackedBasic[3] = 
+{
+	{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,      0, 8,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,      0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0}
+};
+
+const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::PackedPosNormalTexTan[4] = 
+{
+	{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,      0, 8,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TANGENT",  0, DXGI_FORMAT_R16G16_SNORM,      0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,      0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0}
+};
+
+const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::InstancedPackedPosNormalTexTan[9] = 
+{
+	{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UINT,  0, 0,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"NORMAL",   0, DXGI_FORMAT_R16G16_SNORM,       0, 8,  D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TANGENT",  0, DXGI_FORMAT_R16G16_SNORM,       0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT,       0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0},
+	{"WORLD",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,  D3D11_INPUT_PER_INSTANCE_DATA, 1},
+	{"WORLD",    1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+	{"WORLD",    2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+	{"WORLD",    3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+	{"COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 64, D3D11_INPUT_PER_INSTANCE_DATA, 1}
+};
+
 #pragma endregion
 
 #pragma region InputLayouts
@@ -62,6 +113,10 @@ ID3D11InputLayout* InputLayouts::Basic32 = 0;
 ID3D11InputLayout* InputLayouts::Terrain = 0;
 ID3D11InputLayout* InputLayouts::PosNormalTexTan = 0;
 ID3D11InputLayout* InputLayouts::Particle = 0;
+ID3D11InputLayout* InputLayouts::InstancedPosNormalTexTan = 0;
+ID3D11InputLayout* InputLayouts::PackedBasic = 0;
+ID3D11InputLayout* InputLayouts::PackedPosNormalTexTan = 0;
+ID3D11InputLayout* InputLayouts::InstancedPackedPosNormalTexTan = 0;
 
 void InputLayouts::InitAll(ID3D11Device* device)
 {
@@ -106,6 +161,42 @@ void InputLayouts::InitAll(ID3D11Device* device)
 	Effects::FireFX->StreamOutTech->GetPassByIndex(0)->GetDesc(&passDesc);
 	HR(device->CreateInputLayout(InputLayoutDesc::Particle, 5, passDesc.pIAInputSignature, 
 		passDesc.IAInputSignatureSize, &Particle));
+
+	//
+	// InstancedPosNormalTexTan
+	//
+
+	if(Effects::NormalMapFX->Light3TexInstancedTech->IsValid())
+	{
+		Effects::NormalMapFX->Light3TexInstancedTech->GetPassByIndex(0)->GetDesc(&passDesc);
+		HR(device->CreateInputLayout(InputLayoutDesc::InstancedPosNormalTexTan, 10, passDesc.pIAInputSignature, 
+			passDesc.IAInputSignatureSize, &InstancedPosNormalTexTan));
+	}
+
+	//
+	// Packed
+	//
+
+	if(Effects::BasicFX->Light3TexPackedTech->IsValid())
+	{
+		Effects::BasicFX->Light3TexPackedTech->GetPassByIndex(0)->GetDesc(&passDesc);
+		HR(device->CreateInputLayout(InputLayoutDesc::PackedBasic, 3, passDesc.pIAInputSignature, 
+			passDesc.IAInputSignatureSize, &PackedBasic));
+	}
+
+	if(Effects::NormalMapFX->Light3TexPackedTech->IsValid())
+	{
+		Effects::NormalMapFX->Light3TexPackedTech->GetPassByIndex(0)->GetDesc(&passDesc);
+		HR(device->CreateInputLayout(InputLayoutDesc::PackedPosNormalTexTan, 4, passDesc.pIAInputSignature, 
+			passDesc.IAInputSignatureSize, &PackedPosNormalTexTan));
+	}
+
+	if(Effects::NormalMapFX->Light3TexInstancedPackedTech->IsValid())
+	{
+		Effects::NormalMapFX->Light3TexInstancedPackedTech->GetPassByIndex(0)->GetDesc(&passDesc);
+		HR(device->CreateInputLayout(InputLayoutDesc::InstancedPackedPosNormalTexTan, 9, passDesc.pIAInputSignature, 
+			passDesc.IAInputSignatureSize, &InstancedPackedPosNormalTexTan));
+	}
 }
 
 void InputLayouts::DestroyAll()
@@ -115,6 +206,10 @@ void InputLayouts::DestroyAll()
 	ReleaseCOM(Terrain);
 	ReleaseCOM(PosNormalTexTan);
 	ReleaseCOM(Particle);
+	ReleaseCOM(InstancedPosNormalTexTan);
+	ReleaseCOM(PackedBasic);
+	ReleaseCOM(PackedPosNormalTexTan);
+	ReleaseCOM(InstancedPackedPosNormalTexTan);
 }
 
 #pragma endregion
@@ -60,6 +60,10 @@ public:
 	static const D3D11_INPUT_ELEMENT_DESC Terrain[3];
 	static const D3D11_INPUT_ELEMENT_DESC PosNormalTexTan[5];
 	static const D3D11_INPUT_ELEMENT_DESC Particle[5];
+	static const D3D11_INPUT_ELEMENT_DESC InstancedPosNormalTexTan[10];
+	static const D3D11_INPUT_ELEMENT_DESC PackedBasic[3];
+	static const D3D11_INPUT_ELEMENT_DESC PackedPosNormalTexTan[4];
+	static const D3D11_INPUT_ELEMENT_DESC InstancedPackedPosNormalTexTan[9];
 };
 
 class InputLayouts
@@ -73,6 +77,16 @@ public:
 	static ID3D11InputLayout* Terrain;
 	static ID3D11InputLayout* PosNormalTexTan;
 	static ID3D11InputLayout* Particle;
+
+	// PosNormalTexTan in slot 0 plus per-instance InstancedData in slot 1.  Null when
+	// the compiled effects predate the instanced techniques.
+	static ID3D11InputLayout* InstancedPosNormalTexTan;
+
+	// VertexPacker's PackedVertexBasic and PackedVertexPosNormalTexTan, the latter also
+	// instanced.  Null when the compiled effects predate the packed techniques.
+	static ID3D11InputLayout* PackedBasic;
+	static ID3D11InputLayout* PackedPosNormalTexTan;
+	static ID3D11InputLayout* InstancedPackedPosNormalTexTan;
 };
 
 #endif // VERTEX_H
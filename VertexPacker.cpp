@@ -0,0 +1,196 @@
+//***************************************************************************************
+// VertexPacker.cpp
+//***************************************************************************************
+
+#include "VertexPacker.h"
+#include "MathHelper.h"
+#include <cmath>
+
+// The precise octahedral encoding keeps 16-bit lanes within about 5e-5 radians; the
+// constant leaves room for the float arithmetic on either side.
+const float VertexPacker::MaxDirectionError = 1e-4f;
+
+// Half floats carry 11 significant bits, rounded to nearest.
+const float VertexPacker::MaxTexCoordError = 1.0f / 2048.0f;
+
+namespace
+{
+	const float UShortMax = 65535.0f;
+	const float ShortMax = 32767.0f;
+
+	float SignNotZero(float x)
+	{
+		return x >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// D3D's SNORM conversion: -32768 and -32767 both give -1.
+	float DecodeSNorm(SHORT q)
+	{
+		return MathHelper::Max((float)q / ShortMax, -1.0f);
+	}
+
+	SHORT ToSNorm(float x)
+	{
+		return (SHORT)MathHelper::Clamp(x, -ShortMax, ShortMax);
+	}
+
+	USHORT Quantize(float x, float offset, float scale)
+	{
+		if(scale <= 0.0f)
+			return 0;
+
+		return (USHORT)MathHelper::Clamp(floorf((x - offset) / scale + 0.5f), 0.0f, UShortMax);
+	}
+
+	XMFLOAT3 Normalize(const XMFLOAT3& v)
+	{
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&v)));
+		return n;
+	}
+}
+
+VertexQuantization VertexPacker::GetQuantization(const XNA::AxisAlignedBox& bounds)
+{
+	VertexQuantization q;
+	q.Offset.x = bounds.Center.x - bounds.Extents.x;
+	q.Offset.y = bounds.Center.y - bounds.Extents.y;
+	q.Offset.z = bounds.Center.z - bounds.Extents.z;
+	q.Scale.x = 2.0f*bounds.Extents.x / UShortMax;
+	q.Scale.y = 2.0f*bounds.Extents.y / UShortMax;
+	q.Scale.z = 2.0f*bounds.Extents.z / UShortMax;
+	return q;
+}
+
+XMUSHORT4 VertexPacker::EncodePosition(const XMFLOAT3& p, int texNum, const VertexQuantization& quantization)
+{
+	UINT lane = 0;
+	if(texNum > 0)
+		lane = MathHelper::Min((UINT)(texNum & ~TexNumMirrored), MaxMaterial) | (texNum & TexNumMirrored);
+
+	return XMUSHORT4(
+		Quantize(p.x, quantization.Offset.x, quantization.Scale.x),
+		Quantize(p.y, quantization.Offset.y, quantization.Scale.y),
+		Quantize(p.z, quantization.Offset.z, quantization.Scale.z),
+		(USHORT)lane);
+}
+
+XMFLOAT3 VertexPacker::DecodePosition(const XMUSHORT4& q, const VertexQuantization& quantization)
+{
+	return XMFLOAT3(
+		quantization.Offset.x + (float)q.x*quantization.Scale.x,
+		quantization.Offset.y + (float)q.y*quantization.Scale.y,
+		quantization.Offset.z + (float)q.z*quantization.Scale.z);
+}
+
+XMSHORTN2 VertexPacker::EncodeOctahedral(const XMFLOAT3& n)
+{
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if(l1 <= 0.0f)
+		return XMSHORTN2((SHORT)0, (SHORT)0);
+
+	// Project onto the octahedron, and fold the lower half over the upper.
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if(n.z < 0.0f)
+	{
+		float fx = (1.0f - fabsf(y))*SignNotZero(x);
+		float fy = (1.0f - fabsf(x))*SignNotZero(y);
+		x = fx;
+		y = fy;
+	}
+
+	XMFLOAT3 target = Normalize(n);
+	float bx = floorf(x*ShortMax);
+	float by = floorf(y*ShortMax);
+
+	// By distance rather than the cosine, which rounds to 1 for all four.
+	XMSHORTN2 best((SHORT)0, (SHORT)0);
+	float bestDistance = 5.0f;
+	for(int i = 0; i < 4; ++i)
+	{
+		XMSHORTN2 e(ToSNorm(bx + (float)(i & 1)), ToSNorm(by + (float)(i >> 1)));
+		XMFLOAT3 d = DecodeOctahedral(e);
+		float dx = d.x - target.x, dy = d.y - target.y, dz = d.z - target.z;
+		float distance = dx*dx + dy*dy + dz*dz;
+		if(distance < bestDistance)
+		{
+			bestDistance = distance;
+			best = e;
+		}
+	}
+
+	return best;
+}
+
+XMFLOAT3 VertexPacker::DecodeOctahedral(const XMSHORTN2& e)
+{
+	float x = DecodeSNorm(e.x);
+	float y = DecodeSNorm(e.y);
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if(z < 0.0f)
+	{
+		float fx = (1.0f - fabsf(y))*SignNotZero(x);
+		float fy = (1.0f - fabsf(x))*SignNotZero(y);
+		x = fx;
+		y = fy;
+	}
+
+	return Normalize(XMFLOAT3(x, y, z));
+}
+
+void VertexPacker::Pack(PackedVertexBasic* destination, const MeshVertexBasic32* vertices, UINT numVertices,
+	const VertexQuantization& quantization)
+{
+	for(UINT i = 0; i < numVertices; ++i)
+	{
+		const MeshVertexBasic32& v = vertices[i];
+		PackedVertexBasic& p = destination[i];
+		p.Pos = EncodePosition(v.Pos, v.TexNum, quantization);
+		p.Normal = EncodeOctahedral(v.Normal);
+		p.Tex = XMHALF2(v.Tex.x, v.Tex.y);
+	}
+}
+
+void VertexPacker::Pack(PackedVertexPosNormalTexTan* destination, const MeshVertexPosNormalTexTan* vertices, UINT numVertices,
+	const VertexQuantization& quantization)
+{
+	for(UINT i = 0; i < numVertices; ++i)
+	{
+		const MeshVertexPosNormalTexTan& v = vertices[i];
+		PackedVertexPosNormalTexTan& p = destination[i];
+		p.Pos = EncodePosition(v.Pos, v.TexNum, quantization);
+		p.Normal = EncodeOctahedral(v.Normal);
+		p.TangentU = EncodeOctahedral(v.TangentU);
+		p.Tex = XMHALF2(v.Tex.x, v.Tex.y);
+	}
+}
+
+void VertexPacker::Unpack(MeshVertexBasic32* destination, const PackedVertexBasic* vertices, UINT numVertices,
+	const VertexQuantization& quantization)
+{
+	for(UINT i = 0; i < numVertices; ++i)
+	{
+		const PackedVertexBasic& p = vertices[i];
+		MeshVertexBasic32& v = destination[i];
+		v.Pos = DecodePosition(p.Pos, quantization);
+		v.Normal = DecodeOctahedral(p.Normal);
+		v.Tex = XMFLOAT2(XMConvertHalfToFloat(p.Tex.x), XMConvertHalfToFloat(p.Tex.y));
+		v.TexNum = p.Pos.w;
+	}
+}
+
+void VertexPacker::Unpack(MeshVertexPosNormalTexTan* destination, const PackedVertexPosNormalTexTan* vertices, UINT numVertices,
+	const VertexQuantization& quantization)
+{
+	for(UINT i = 0; i < numVertices; ++i)
+	{
+		const PackedVertexPosNormalTexTan& p = vertices[i];
+		MeshVertexPosNormalTexTan& v = destination[i];
+		v.Pos = DecodePosition(p.Pos, quantization);
+		v.Normal = DecodeOctahedral(p.Normal);
+		v.TangentU = DecodeOctahedral(p.TangentU);
+		v.Tex = XMFLOAT2(XMConvertHalfToFloat(p.Tex.x), XMConvertHalfToFloat(p.Tex.y));
+		v.TexNum = p.Pos.w;
+	}
+}
@@ -0,0 +1,82 @@
+//***************************************************************************************
+// VertexPacker.h
+//
+// Compact vertex layouts for the static mesh streams, and their encoding:
+//
+//   position  16-bit unsigned integers spanning the mesh's bounds, decoded as
+//             Offset + q*Scale; the fourth lane carries TexNum, material and
+//             TexNumMirrored
+//   normal    octahedral (Cigolle et al. 2014), two 16-bit SNORMs
+//   tangent   the same
+//   texcoord  two half floats
+//
+// 16 bytes for Basic32's 36 and 20 for PosNormalTexTan's 48.  Each attribute's largest
+// error is one of the constants below; positions are off by at most half a step of
+// their bounds.  A zero normal or tangent decodes as +Z.
+//***************************************************************************************
+
+#ifndef VERTEXPACKER_H
+#define VERTEXPACKER_H
+
+#include "MeshFile.h"
+
+struct PackedVertexBasic
+{
+	XMUSHORT4 Pos;
+	XMSHORTN2 Normal;
+	XMHALF2 Tex;
+};
+
+struct PackedVertexPosNormalTexTan
+{
+	XMUSHORT4 Pos;
+	XMSHORTN2 Normal;
+	XMSHORTN2 TangentU;
+	XMHALF2 Tex;
+};
+
+// p = Offset + q*Scale for q the integer lanes of a packed position.
+struct VertexQuantization
+{
+	XMFLOAT3 Offset;
+	XMFLOAT3 Scale;
+};
+
+class VertexPacker
+{
+public:
+	// Largest material the position's fourth lane holds beside TexNumMirrored.
+	static const UINT MaxMaterial = TexNumMaterial;
+
+	// Largest angle, in radians, between a unit vector and its decoded octahedral
+	// encoding.
+	static const float MaxDirectionError;
+
+	// Largest relative error of a half float texture coordinate in the normal range.
+	static const float MaxTexCoordError;
+
+	static VertexQuantization GetQuantization(const XNA::AxisAlignedBox& bounds);
+
+	// A negative texNum is stored as 0.
+	static XMUSHORT4 EncodePosition(const XMFLOAT3& p, int texNum, const VertexQuantization& quantization);
+	static XMFLOAT3 DecodePosition(const XMUSHORT4& q, const VertexQuantization& quantization);
+
+	///<summary>
+	/// Of the four encodings around the exact one, the one that decodes nearest n.
+	///</summary>
+	static XMSHORTN2 EncodeOctahedral(const XMFLOAT3& n);
+	static XMFLOAT3 DecodeOctahedral(const XMSHORTN2& e);
+
+	// Materials past MaxMaterial are clamped to it; TexNumMirrored is kept.
+	static void Pack(PackedVertexBasic* destination, const MeshVertexBasic32* vertices, UINT numVertices,
+		const VertexQuantization& quantization);
+	static void Pack(PackedVertexPosNormalTexTan* destination, const MeshVertexPosNormalTexTan* vertices, UINT numVertices,
+		const VertexQuantization& quantization);
+
+	static void Unpack(MeshVertexBasic32* destination, const PackedVertexBasic* vertices, UINT numVertices,
+		const VertexQuantization& quantization);
+	static void Unpack(MeshVertexPosNormalTexTan* destination, const PackedVertexPosNormalTexTan* vertices, UINT numVertices,
+		const VertexQuantization& quantization);
+};
+
+#endif // VERTEXPACKER_H
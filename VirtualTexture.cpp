@@ -0,0 +1,298 @@
+//***************************************************************************************
+// VirtualTexture.cpp
+//***************************************************************************************
+
+#include "VirtualTexture.h"
+#include <algorithm>
+
+namespace
+{
+	UINT64 PackPage(UINT mip, UINT pageX, UINT pageY)
+	{
+		return ((UINT64)mip << 48) | ((UINT64)pageY << 24) | (UINT64)pageX;
+	}
+
+	void UnpackPage(UINT64 page, UINT& mip, UINT& pageX, UINT& pageY)
+	{
+		mip = (UINT)(page >> 48);
+		pageY = (UINT)(page >> 24) & 0xffffff;
+		pageX = (UINT)page & 0xffffff;
+	}
+}
+
+VirtualTexture::VirtualTexture() :
+	mSource(0),
+	mSlotBytes(0),
+	mLruHead(NoSlot),
+	mLruTail(NoSlot),
+	mNumResident(0),
+	mFrame(0)
+{
+	memset(&mInfo, 0, sizeof(mInfo));
+	memset(&mStats, 0, sizeof(mStats));
+}
+
+bool VirtualTexture::Init(const InitInfo& info, VirtualTextureSource* source)
+{
+	// Slots are named by 16-bit page table entries, and one is the coarsest page's.
+	if(!source || info.PageSize == 0 || info.Width == 0 || info.Height == 0 ||
+		info.NumSlots < 2 || info.NumSlots > 0xffff)
+		return false;
+
+	mInfo = info;
+	mSource = source;
+	memset(&mStats, 0, sizeof(mStats));
+
+	// Each mip halves the pages of the one below, rounding up, down to a single page.
+	mMips.clear();
+	UINT numPagesX = (info.Width + info.PageSize - 1) / info.PageSize;
+	UINT numPagesY = (info.Height + info.PageSize - 1) / info.PageSize;
+	if(numPagesX > 0xffffff || numPagesY > 0xffffff)
+		return false;
+
+	for(;;)
+	{
+		mMips.push_back(Mip());
+		Mip& m = mMips.back();
+		m.NumPagesX = numPagesX;
+		m.NumPagesY = numPagesY;
+		m.Table.resize(numPagesX*numPagesY);
+		m.Dirty = true;
+		if(numPagesX == 1 && numPagesY == 1)
+			break;
+
+		numPagesX = (numPagesX + 1) / 2;
+		numPagesY = (numPagesY + 1) / 2;
+	}
+
+	UINT side = info.PageSize + 2*info.Border;
+	mSlotBytes = side*side*info.BytesPerTexel;
+	mSlotTexels.assign((size_t)info.NumSlots*mSlotBytes, 0);
+
+	mSlots.resize(info.NumSlots);
+	mFreeSlots.clear();
+	for(UINT i = info.NumSlots - 1; i > 0; --i)
+		mFreeSlots.push_back(i);
+	mLruHead = NoSlot;
+	mLruTail = NoSlot;
+	mFeedback.clear();
+	mDirtySlots.clear();
+	mFrame = 0;
+
+	// Slot 0 holds the coarsest page for good, outside the LRU list.
+	UINT top = GetNumMips() - 1;
+	mSource->BuildPage(top, 0, 0, &mSlotTexels[0]);
+	mSlots[0].Mip = top;
+	mSlots[0].PageX = 0;
+	mSlots[0].PageY = 0;
+	mSlots[0].LastUsedFrame = 0;
+	mSlots[0].Prev = NoSlot;
+	mSlots[0].Next = NoSlot;
+
+	PageTableEntry entry;
+	entry.Slot = 0;
+	entry.Mip = (USHORT)top;
+	for(size_t k = 0; k < mMips.size(); ++k)
+		std::fill(mMips[k].Table.begin(), mMips[k].Table.end(), entry);
+
+	mDirtySlots.push_back(0);
+	mNumResident = 1;
+	++mStats.TotalBuilt;
+
+	return true;
+}
+
+void VirtualTexture::AddFeedback(float u, float v, float mip)
+{
+	// Written so NaNs clamp as well.
+	u = u > 0.0f ? MathHelper::Min(u, 1.0f) : 0.0f;
+	v = v > 0.0f ? MathHelper::Min(v, 1.0f) : 0.0f;
+	UINT m = mip > 0.0f ? MathHelper::Min((UINT)mip, GetNumMips() - 1) : 0;
+
+	UINT texelX = MathHelper::Min((UINT)(u*mInfo.Width), mInfo.Width - 1);
+	UINT texelY = MathHelper::Min((UINT)(v*mInfo.Height), mInfo.Height - 1);
+	AddFeedback(m, (texelX >> m) / mInfo.PageSize, (texelY >> m) / mInfo.PageSize);
+}
+
+void VirtualTexture::AddFeedback(UINT mip, UINT pageX, UINT pageY)
+{
+	mFeedback.push_back(PackPage(mip, pageX, pageY));
+}
+
+void VirtualTexture::Update()
+{
+	++mFrame;
+	mStats.PagesRequested = 0;
+	mStats.PagesMissing = 0;
+	mStats.PagesBuilt = 0;
+
+	// Collapse the feedback to distinct pages and how often each was reported.  Pages
+	// already in, and the ancestors standing in for those that are not, count as used
+	// before anything is evicted.
+	std::sort(mFeedback.begin(), mFeedback.end());
+	mRequests.clear();
+	for(size_t i = 0; i < mFeedback.size(); )
+	{
+		size_t end = i + 1;
+		while(end < mFeedback.size() && mFeedback[end] == mFeedback[i])
+			++end;
+
+		UINT mip, pageX, pageY;
+		UnpackPage(mFeedback[i], mip, pageX, pageY);
+		if(mip < GetNumMips() && pageX < GetNumPagesX(mip) && pageY < GetNumPagesY(mip))
+		{
+			const PageTableEntry& entry = GetEntry(mip, pageX, pageY);
+			Touch(entry.Slot);
+			++mStats.PagesRequested;
+
+			if(entry.Mip != mip)
+			{
+				Request request;
+				request.Page = mFeedback[i];
+				request.Count = (UINT)(end - i);
+				mRequests.push_back(request);
+			}
+		}
+
+		i = end;
+	}
+	mFeedback.clear();
+	mStats.PagesMissing = (UINT)mRequests.size();
+
+	std::sort(mRequests.begin(), mRequests.end());
+	for(size_t i = 0; i < mRequests.size() && mStats.PagesBuilt < mInfo.MaxPagesPerUpdate; ++i)
+	{
+		// Everything resident is on screen; the rest waits for pages to fall out of view.
+		UINT slot = AllocateSlot();
+		if(slot == NoSlot)
+			break;
+
+		UINT mip, pageX, pageY;
+		UnpackPage(mRequests[i].Page, mip, pageX, pageY);
+		mSource->BuildPage(mip, pageX, pageY, &mSlotTexels[(size_t)slot*mSlotBytes]);
+		Map(slot, mip, pageX, pageY);
+
+		++mStats.PagesBuilt;
+		++mStats.TotalBuilt;
+	}
+}
+
+void VirtualTexture::ClearDirty()
+{
+	mDirtySlots.clear();
+	for(size_t k = 0; k < mMips.size(); ++k)
+		mMips[k].Dirty = false;
+}
+
+void VirtualTexture::Touch(UINT slot)
+{
+	mSlots[slot].LastUsedFrame = mFrame;
+	if(slot == 0 || slot == mLruHead)
+		return;
+
+	Unlink(slot);
+	PushFront(slot);
+}
+
+void VirtualTexture::Unlink(UINT slot)
+{
+	Slot& s = mSlots[slot];
+	if(s.Prev != NoSlot)
+		mSlots[s.Prev].Next = s.Next;
+	else
+		mLruHead = s.Next;
+
+	if(s.Next != NoSlot)
+		mSlots[s.Next].Prev = s.Prev;
+	else
+		mLruTail = s.Prev;
+
+	s.Prev = NoSlot;
+	s.Next = NoSlot;
+}
+
+void VirtualTexture::PushFront(UINT slot)
+{
+	Slot& s = mSlots[slot];
+	s.Prev = NoSlot;
+	s.Next = mLruHead;
+	if(mLruHead != NoSlot)
+		mSlots[mLruHead].Prev = slot;
+	mLruHead = slot;
+	if(mLruTail == NoSlot)
+		mLruTail = slot;
+}
+
+UINT VirtualTexture::AllocateSlot()
+{
+	if(!mFreeSlots.empty())
+	{
+		UINT slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		return slot;
+	}
+
+	UINT slot = mLruTail;
+	if(slot == NoSlot || mSlots[slot].LastUsedFrame == mFrame)
+		return NoSlot;
+
+	Unmap(slot);
+	++mStats.TotalEvicted;
+	return slot;
+}
+
+void VirtualTexture::Map(UINT slot, UINT mip, UINT pageX, UINT pageY)
+{
+	Slot& s = mSlots[slot];
+	s.Mip = mip;
+	s.PageX = pageX;
+	s.PageY = pageY;
+	s.LastUsedFrame = mFrame;
+	PushFront(slot);
+
+	PageTableEntry entry;
+	entry.Slot = (USHORT)slot;
+	entry.Mip = (USHORT)mip;
+	FillDown(mip, pageX, pageY, entry);
+
+	mDirtySlots.push_back(slot);
+	++mNumResident;
+}
+
+void VirtualTexture::Unmap(UINT slot)
+{
+	Slot& s = mSlots[slot];
+	Unlink(slot);
+
+	// The entries that named this page fall back to whatever its parent's entry names.
+	PageTableEntry parent = GetEntry(s.Mip + 1, s.PageX >> 1, s.PageY >> 1);
+	FillDown(s.Mip, s.PageX, s.PageY, parent);
+
+	--mNumResident;
+}
+
+void VirtualTexture::FillDown(UINT mip, UINT pageX, UINT pageY, const PageTableEntry& entry)
+{
+	// Entries mapping something finer than mip have a nearer page of their own.
+	for(int k = (int)mip; k >= 0; --k)
+	{
+		Mip& m = mMips[k];
+		UINT shift = mip - k;
+		UINT x0 = pageX << shift;
+		UINT y0 = pageY << shift;
+		UINT x1 = MathHelper::Min((pageX + 1) << shift, m.NumPagesX);
+		UINT y1 = MathHelper::Min((pageY + 1) << shift, m.NumPagesY);
+
+		for(UINT y = y0; y < y1; ++y)
+		{
+			PageTableEntry* row = &m.Table[y*m.NumPagesX];
+			for(UINT x = x0; x < x1; ++x)
+			{
+				if(row[x].Mip >= mip)
+					row[x] = entry;
+			}
+		}
+
+		m.Dirty = true;
+	}
+}
@@ -0,0 +1,194 @@
+//***************************************************************************************
+// VirtualTexture.h
+//
+// Page management for a virtual texture: a texture far larger than video memory (the
+// terrain's blend map, or its layers composited over the whole map) split into square
+// pages per mip, of which only those the screen currently needs are kept in a fixed
+// pool of physical slots.  What is resident is therefore set by the screen resolution
+// and the size of the pool, not by the size of the world.
+//
+// Each frame the renderer reports which (u, v, mip) it sampled; a GPU feedback pass
+// read back, or a CPU estimate from the terrain's selected patches.  Update turns that
+// into a request queue, coarse pages first so every area quickly has something close,
+// builds up to a budget of missing pages through a VirtualTextureSource and evicts the
+// least recently used pages no longer on screen to make room.
+//
+// The page table has an entry per page per mip naming the slot to sample and the mip
+// it holds; pages not yet in point at their nearest resident ancestor.  The coarsest
+// mip is one page, loaded in Init and never evicted, so every entry always has one.
+// The page table and the slots' texels are all CPU side, ready to be copied into an
+// indirection texture and a physical atlas; nothing here needs a device.
+//***************************************************************************************
+
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#include "MathHelper.h"
+#include <vector>
+
+class VirtualTextureSource
+{
+public:
+	virtual ~VirtualTextureSource() {}
+
+	// Writes page (pageX, pageY) of mip into texels: PageSize + 2*Border texels square,
+	// row major, with Border texels of the neighboring pages (or the clamped edge)
+	// around it so bilinear filtering does not bleed between slots.
+	virtual void BuildPage(UINT mip, UINT pageX, UINT pageY, BYTE* texels) = 0;
+};
+
+class VirtualTexture
+{
+public:
+	struct InitInfo
+	{
+		// Virtual size of mip 0, in texels.
+		UINT Width;
+		UINT Height;
+
+		UINT PageSize;
+		UINT Border;
+		UINT BytesPerTexel;
+
+		// Physical slots, including the one the coarsest mip keeps.
+		UINT NumSlots;
+
+		// Pages built per Update, to bound the frame's cost.
+		UINT MaxPagesPerUpdate;
+	};
+
+	struct PageTableEntry
+	{
+		USHORT Slot;
+
+		// The mip the slot holds; coarser than the entry's own while the page is not in.
+		USHORT Mip;
+	};
+
+	struct Stats
+	{
+		// For the last Update: distinct pages in the feedback, those of them that were
+		// not resident, and those built.
+		UINT PagesRequested;
+		UINT PagesMissing;
+		UINT PagesBuilt;
+
+		// Over the texture's life.
+		UINT TotalBuilt;
+		UINT TotalEvicted;
+	};
+
+	VirtualTexture();
+
+	// The source must outlive the texture.  Builds the coarsest page.
+	bool Init(const InitInfo& info, VirtualTextureSource* source);
+
+	UINT GetNumMips()const { return (UINT)mMips.size(); }
+	UINT GetNumPagesX(UINT mip)const { return mMips[mip].NumPagesX; }
+	UINT GetNumPagesY(UINT mip)const { return mMips[mip].NumPagesY; }
+	const InitInfo& GetInfo()const { return mInfo; }
+
+	// Feedback for the frame being drawn.  u and v are in [0, 1] over the whole texture;
+	// mip is the level the sampler would pick, fractions rounding toward detail.
+	void AddFeedback(float u, float v, float mip);
+	void AddFeedback(UINT mip, UINT pageX, UINT pageY);
+
+	// Once a frame, after the feedback is in.  Marks the pages asked for as used,
+	// builds the missing ones, coarsest first, and clears the feedback.
+	void Update();
+
+	const PageTableEntry& GetEntry(UINT mip, UINT pageX, UINT pageY)const
+	{
+		const Mip& m = mMips[mip];
+		return m.Table[pageY*m.NumPagesX + pageX];
+	}
+
+	// The whole table for a mip, NumPagesX wide, and whether it changed since the last
+	// ClearDirty; for uploading into an indirection texture.
+	const std::vector<PageTableEntry>& GetPageTable(UINT mip)const { return mMips[mip].Table; }
+	bool IsPageTableDirty(UINT mip)const { return mMips[mip].Dirty; }
+
+	bool IsResident(UINT mip, UINT pageX, UINT pageY)const { return GetEntry(mip, pageX, pageY).Mip == mip; }
+	UINT GetNumResident()const { return mNumResident; }
+
+	// The texels of a slot, as the source built them.
+	const BYTE* GetSlotTexels(UINT slot)const { return &mSlotTexels[(size_t)slot*mSlotBytes]; }
+	UINT GetSlotBytes()const { return mSlotBytes; }
+
+	// Slots rebuilt since the last ClearDirty, for copying into the physical atlas.
+	const std::vector<UINT>& GetDirtySlots()const { return mDirtySlots; }
+	void ClearDirty();
+
+	const Stats& GetStats()const { return mStats; }
+
+private:
+	struct Mip
+	{
+		UINT NumPagesX;
+		UINT NumPagesY;
+		std::vector<PageTableEntry> Table;
+		bool Dirty;
+	};
+
+	struct Slot
+	{
+		// The page held; only meaningful while the slot is in the LRU list.
+		UINT Mip;
+		UINT PageX;
+		UINT PageY;
+		UINT LastUsedFrame;
+
+		// LRU list, most recent first.
+		UINT Prev;
+		UINT Next;
+	};
+
+	struct Request
+	{
+		UINT64 Page;
+		UINT Count;
+
+		// Coarsest first, then the most reported.
+		bool operator<(const Request& rhs)const
+		{
+			return (Page >> 48) != (rhs.Page >> 48) ? (Page >> 48) > (rhs.Page >> 48) : Count > rhs.Count;
+		}
+	};
+
+	static const UINT NoSlot = 0xffffffff;
+
+	void Touch(UINT slot);
+	void Unlink(UINT slot);
+	void PushFront(UINT slot);
+	UINT AllocateSlot();
+
+	void Map(UINT slot, UINT mip, UINT pageX, UINT pageY);
+	void Unmap(UINT slot);
+
+	// Sets the entries of (mip, pageX, pageY) and every page under it at finer mips
+	// that map mip or coarser to entry.
+	void FillDown(UINT mip, UINT pageX, UINT pageY, const PageTableEntry& entry);
+
+private:
+	InitInfo mInfo;
+	VirtualTextureSource* mSource;
+	std::vector<Mip> mMips;
+
+	std::vector<Slot> mSlots;
+	std::vector<BYTE> mSlotTexels;
+	UINT mSlotBytes;
+	UINT mLruHead;
+	UINT mLruTail;
+	std::vector<UINT> mFreeSlots;
+	UINT mNumResident;
+	UINT mFrame;
+
+	// Packed (mip, y, x) of every page reported this frame, duplicates included.
+	std::vector<UINT64> mFeedback;
+	std::vector<Request> mRequests;
+	std::vector<UINT> mDirtySlots;
+
+	Stats mStats;
+};
+
+#endif // VIRTUALTEXTURE_H
@@ -29,6 +29,19 @@
 #include "ParticleSystem.h"
 #include "xnacollision.h"
 #include "importer.h"
+#include "ObjLoader.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "LodSelector.h"
+#include "VertexPacker.h"
+#include "TangentGenerator.h"
+#include "InstanceBuffer.h"
+#include "RenderQueue.h"
+#include "PassCache.h"
+#include "FrustumCuller.h"
+#include "BatchCuller.h"
+#include "TextureHelper.h"
 
 #pragma comment(lib, "XInput.lib")        // Library containing necessary 360 functions
 
@@ -40,10 +53,127 @@ enum RenderOptions
     RenderOptionsDisplacementMap = 2
 };
 
-struct InstancedData
+// Levels of detail kept per mesh; see MeshSimplifier::BuildLodChain.
+const UINT MaxMeshLods = MeshSimplifier::DefaultMaxLods;
+
+// Passes whose detail matters less pick coarser levels: shadow map texels are larger
+// than the pixels they shade, and cube faces are only seen in reflections.
+const float ShadowLodBias = 4.0f;
+const float CubeFaceLodBias = 2.0f;
+
+// One per mesh/material pair drawn through the instanced path, MaxMeshLods batches
+// per pair, one for each level of detail.
+enum InstanceBatches
+{
+	InstanceBatchSkull = 0,
+	InstanceBatchBox = InstanceBatchSkull + MaxMeshLods,
+	InstanceBatchCylinder = InstanceBatchBox + MaxMeshLods,
+	InstanceBatchTree = InstanceBatchCylinder + MaxMeshLods,
+	InstanceBatchCount = InstanceBatchTree + MaxMeshLods
+};
+
+// Ids the main pass submits to its RenderQueue; they index the tables that
+// ZeusApp::BuildSceneTables fills each frame.
+enum SceneTechniques
+{
+	SceneTechObject = 0,
+	SceneTechInstanced,
+	SceneTechReflect,
+
+	// The same for meshes in VertexPacker's layouts.
+	SceneTechObjectPacked,
+	SceneTechInstancedPacked,
+	SceneTechReflectPacked,
+	SceneTechCount
+};
+
+enum SceneMaterials
+{
+	SceneMatGrid = 0,
+	SceneMatBox,
+	SceneMatCylinder,
+	SceneMatTree,
+	SceneMatCloth,
+	SceneMatSphere,
+	SceneMatCount
+};
+
+enum SceneMeshes
+{
+	SceneMeshShapes = 0,
+	SceneMeshTree,
+	SceneMeshCloth,
+	SceneMeshCount
+};
+
+// Render-to-texture passes that are reused while nothing they see changes.
+enum CachedPasses
+{
+	CachedPassShadow = 0,
+	CachedPassShadow2,
+	CachedPassSphereFace,
+	CachedPassOmniFace = CachedPassSphereFace + 6,
+	CachedPassCount = CachedPassOmniFace + 6
+};
+
+// Whatever changes the lighting of the whole scene; when any of it changes every
+// cached pass is redrawn.
+struct CachedLighting
+{
+	XMFLOAT3 DirLights[3];
+	XMFLOAT3 PointLightPos;
+	int DirectionalLight;
+	int PointLight;
+	int RenderOption;
+};
+
+// Indices of the objects one pass can see, filled by CullPass, and the level of
+// detail each tree, box and cylinder is drawn at.
+struct PassVisibility
+{
+	std::vector<UINT> Trees;
+	std::vector<UINT> Boxes;
+	std::vector<UINT> Cylinders;
+	std::vector<UINT> Spheres;
+
+	std::vector<UINT> TreeLods;
+	std::vector<UINT> BoxLods;
+	std::vector<UINT> CylinderLods;
+};
+
+struct SceneTechnique
+{
+	ID3DX11EffectTechnique* Tech;
+
+	// The effect Tech belongs to, which decides the setters used with it.
+	RenderOptions Effect;
+	D3D11_PRIMITIVE_TOPOLOGY Topology;
+	bool Instanced;
+	bool Packed;
+};
+
+struct SceneMaterial
+{
+	Material Mat;
+	XMFLOAT4X4 TexTransform;
+
+	// Null maps are left as bound.
+	ID3D11ShaderResourceView* DiffuseMap;
+	ID3D11ShaderResourceView* NormalMap;
+	ID3D11ShaderResourceView* CubeMap;
+	bool TextureArrays;
+};
+
+struct SceneMesh
 {
-    XMFLOAT4X4 World;
-    XMFLOAT4 Color;
+	ID3D11Buffer* VB;
+	ID3D11Buffer* IB;
+	ID3D11InputLayout* InputLayout;
+	UINT Stride;
+
+	// Whether VB holds VertexPacker's layouts, and what decodes its positions.
+	bool Packed;
+	VertexQuantization Quantization;
 };
 
 struct BoundingSphere
@@ -54,7 +184,7 @@ struct BoundingSphere
 };
 
 
-class ZeusApp : public D3DApp 
+class ZeusApp : public D3DApp, private RenderQueueSink
 {
 public:
     ZeusApp(HINSTANCE hInstance);
@@ -88,10 +218,29 @@ private:
 	void CreateTreeMatrixes();
     void BuildInstancedBuffer();
 
-	void PxtoXMMatrix(PxTransform input, XMMATRIX* start);
-	void CreatePhysXTriangleMesh(	ObjectNumbers objnum, int numVerts, std::vector<XMFLOAT3> verts,
-									int numInds, std::vector<int> inds, float x, float y, float z);
-	void CreatePhysXTriangleMeshTerrain( int numVerts, std::vector<XMFLOAT3> verts, int numInds, std::vector<int> inds);
+	void CreatePhysXTriangleMesh(	ObjectNumbers objnum, int numVerts, const std::vector<XMFLOAT3>& verts,
+									int numInds, const std::vector<int>& inds, float x, float y, float z, float scale);
+
+	void CullPass(CXMMATRIX viewProj, bool drawSkulls, const LodSelector& lodSelector);
+	void AddLodBatches(UINT batch, const XMFLOAT4X4* worlds, const std::vector<UINT>& visible,
+		const std::vector<UINT>& lodOfEach, const std::vector<MeshLod>& lods);
+	bool UseInstancing(ID3DX11EffectTechnique* tech)const;
+	void DrawInstanceBatch(ID3D11Buffer* meshVB, bool packed, UINT batch, UINT indexCount, UINT startIndex, INT baseVertex);
+	void DrawInstanceLods(ID3D11Buffer* meshVB, bool packed, UINT batch, const std::vector<MeshLod>& lods, INT baseVertex);
+	void UpdatePassCache();
+
+	// Main pass render queue.  ZeusApp is its sink.
+	void BuildSceneTables(bool drawSphere);
+	void SubmitSceneObjects(const Camera& camera);
+	void SubmitSceneBatch(DrawPacket& packet, UINT instanceBatch, const XMFLOAT4X4* worlds,
+		const std::vector<UINT>& visible, const Camera& camera,
+		const std::vector<MeshLod>* lods = 0, const std::vector<UINT>* lodOfEach = 0);
+	void SetObjectConstants(RenderOptions effect, CXMMATRIX world);
+	void SetVertexQuantization(RenderOptions effect, const VertexQuantization& quantization);
+	void BindTechnique(UINT technique);
+	void BindMaterial(UINT material);
+	void BindMesh(UINT mesh);
+	void Draw(const DrawPacket& packet);
 
 private:
 
@@ -100,7 +249,60 @@ private:
 
 	PhysX* mPhysX;
 
+	// 0 workers means one per hardware thread.  With overlap rendering on, each
+	// frame's physics step runs while that frame draws the poses read during update.
+	static const UINT PhysicsWorkerThreads = 0;
+	static const UINT PhysicsMaxSubsteps = 4;
+	static const bool PhysicsOverlapRendering = false;
+
+	// Terrain collision is a heightfield built from the terrain's heightmap.  With a
+	// nonzero tile size it is paged in tiles within TerrainCollisionRadius of the camera;
+	// 0 builds one heightfield covering the whole map.
+	HeightfieldBuilder* mTerrainCollision;
+	static const UINT TerrainCollisionTileCells = 0;
+	static const int TerrainCollisionRadius = 256;
+
+    // Skulls, boxes, cylinders and trees, one contiguous range per InstanceBatches entry.
+    // mLodInstances gathers one level's instances for AddSelected.
+    // Each pass appends the instances it can see after the previous pass's, so the
+    // buffer is only discarded once it has filled up; it holds InstanceBufferPasses
+    // passes' worth of every instance.
+    static const UINT InstanceBufferPasses = 4;
     ID3D11Buffer* mInstancedBuffer;
+    UINT mInstancedBufferCapacity;
+    UINT mInstancedBufferUsed;
+    InstanceBufferBuilder mInstanceBuilder;
+    std::vector<UINT> mLodInstances;
+    bool mInstancingEnabled;
+
+    // Shadow maps, point light shadow faces and sphere cube faces are redrawn only when
+    // PassCache says so, sphere faces at most CubeFaceBudget a frame.  Faces are
+    // refreshed every CubeFaceMaxAge frames anyway so the fire in them keeps moving.
+    static const UINT CubeFaceBudget = 2;
+    static const UINT CubeFaceMaxAge = 30;
+    PassCache mPassCache;
+    CachedLighting mCachedLighting;
+    std::vector<XNA::AxisAlignedBox> mBoxBounds;
+    std::vector<UINT> mCubeFaceUpdates;
+
+    // Every pass, shadow maps and cube faces included, draws only what its own frustum
+    // touches.  Local bounds of the culled meshes; spheres have radius 1.
+    PassVisibility mVisible;
+    std::vector<InstancedData> mVisibleSkulls;
+    XNA::AxisAlignedBox mTreeBounds;
+    XNA::AxisAlignedBox mUnitBoxBounds;
+    XNA::AxisAlignedBox mCylinderBounds;
+
+    RenderQueue mSceneQueue;
+    SceneTechnique mSceneTechs[SceneTechCount];
+    SceneMaterial mSceneMats[SceneMatCount];
+    SceneMesh mSceneMeshes[SceneMeshCount];
+
+    // State of the queue's current DrawScene call.
+    UINT mSceneTech;
+    XMFLOAT4X4 mSceneViewProj;
+    XMFLOAT4X4 mSceneShadowTransform;
+    XMFLOAT4X4 mSceneShadowTransform2;
 
     ID3D11Buffer* mShapesVB;
     ID3D11Buffer* mShapesIB;
@@ -114,12 +316,23 @@ private:
 	ID3D11Buffer* mClothVB;
     ID3D11Buffer* mClothIB;
 
+    // The tree, skull and shapes buffers hold VertexPacker's layouts when the effects
+    // were compiled with the packed techniques.  The cloth stays float: it is a Basic32
+    // mesh, and there is no packed technique or input layout for that vertex.
+    bool mPackedVertices;
+    VertexQuantization mShapesQuantization;
+    VertexQuantization mSkullQuantization;
+    VertexQuantization mTreeQuantization;
+
     ID3D11Buffer* mSkySphereVB;
     ID3D11Buffer* mSkySphereIB;
 
     ID3D11Buffer* mScreenQuadVB;
     ID3D11Buffer* mScreenQuadIB;
 
+	// Owns the scene textures below.
+	TextureHelper mTexMgr;
+
     ID3D11ShaderResourceView* mStoneTexSRV;
     ID3D11ShaderResourceView* mBrickTexSRV;
 
@@ -150,9 +363,10 @@ private:
     bool mFrustumCullingEnabled;
     UINT mVisibleObjectCount;
 
-    // Bounding box of the skull.
+    // Bounding box of the skull, and every instance's world box for culling.
     XNA::AxisAlignedBox mSkullBox;
-    XNA::Frustum mCamFrustum;
+    BatchCuller mSkullCuller;
+    std::vector<UINT> mVisibleSkullIndices;
 
     static const int SMapSize = 2048;
     ShadowMap* mSmap;
@@ -195,7 +409,6 @@ private:
     // Define transformations from local spaces to world space.
     XMFLOAT4X4 mSphereWorld[10];
     XMFLOAT4X4 mCylWorld[10];
-    XMFLOAT4X4 mBoxWorld[MAX_BOXES];
 	XMFLOAT4X4 mBoxScale;
     XMFLOAT4X4 mGridWorld;
     XMFLOAT4X4 mSkullWorld;
@@ -228,6 +441,13 @@ private:
     UINT mSphereIndexCount;
     UINT mCylinderIndexCount;
     UINT mSkullIndexCount;
+
+    // Level of detail chains; index ranges are into each mesh's whole index buffer, and
+    // the counts above are LOD 0's.
+    std::vector<MeshLod> mTreeLods;
+    std::vector<MeshLod> mSkullLods;
+    std::vector<MeshLod> mBoxLods;
+    std::vector<MeshLod> mCylinderLods;
  
     RenderOptions mRenderOptions;
 
@@ -280,9 +500,14 @@ ZeusApp::ZeusApp(HINSTANCE hInstance)
   mScreenQuadVB(0), mScreenQuadIB(0), mStoneTexSRV(0), mBrickTexSRV(0), mTreeTexSRV(0), mClothTexSRV(0), mStoneNormalTexSRV(0), 
   mBrickNormalTexSRV(0), mTreeNormalTexSRV(0), mDynamicCubeMapDSVSphere(0), mDynamicCubeMapSRVSphere(0), mDynamicCubeMapDSVSkull(0), 
   mDynamicCubeMapSRVSkull(0), mDynamicCubeMapDSVMirror(0), mDynamicCubeMapSRVMirror(0), mSkullIndexCount(0), mInstancedBuffer(0),
-  mRenderOptions(RenderOptionsNormalMap), mSmap(0), mSmap2(0), mPhysX(0), mLightRotationAngle(0.0f), mFrustumCullingEnabled(true), mVisibleObjectCount(0)
+  mInstancedBufferCapacity(0), mInstancedBufferUsed(0), mInstanceBuilder(InstanceBatchCount), mInstancingEnabled(true), mSceneTech(0), mPackedVertices(false),
+  mPassCache(CachedPassCount),
+  mRenderOptions(RenderOptionsNormalMap), mSmap(0), mSmap2(0), mPhysX(0), mTerrainCollision(0), mLightRotationAngle(0.0f), mFrustumCullingEnabled(true), mVisibleObjectCount(0)
 {
     mMainWndCaption = L"Zeus";
+
+    mPassCache.SetMaxAge(CubeFaceMaxAge);
+    memset(&mCachedLighting, 0, sizeof(mCachedLighting));
     
     mSkullRotationAngle = 0;
     mSkullPos = 0;
@@ -329,12 +554,6 @@ ZeusApp::ZeusApp(HINSTANCE hInstance)
     // Box
     XMMATRIX boxScale = XMMatrixScaling(2.5f, 2.5f, 2.5f);
 	XMStoreFloat4x4(&mBoxScale, boxScale);
-    XMMATRIX boxOffset = XMMatrixTranslation(0.0f, 0.5f, 0.0f);
-	XMMATRIX final = XMMatrixMultiply(boxScale, boxOffset);
-	for(int i = 0; i < MAX_BOXES; i++)
-	{
-		XMStoreFloat4x4(&mBoxWorld[i], final);
-	}
 
 
     // Alligned cylinders and spheres
@@ -347,6 +566,15 @@ ZeusApp::ZeusApp(HINSTANCE hInstance)
         XMStoreFloat4x4(&mSphereWorld[i*2+1], XMMatrixTranslation(+5.0f, 4.0f, -10.0f + i*5.0f));
     }
 
+    mSkullBox.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    mSkullBox.Extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    mTreeBounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    mTreeBounds.Extents = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    mUnitBoxBounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    mUnitBoxBounds.Extents = XMFLOAT3(0.5f, 0.5f, 0.5f);
+    mCylinderBounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    mCylinderBounds.Extents = XMFLOAT3(0.5f, 1.5f, 0.5f);
+
     // Fallen Sphere
     XMStoreFloat4x4(&mCylWorld[2*2+0], XMMatrixTranslation(-5.0f, 1.5f, 10.0f));
     XMStoreFloat4x4(&mSphereWorld[2*2+0], XMMatrixTranslation(-3.5f, 1.0f, 9.5f));
@@ -450,6 +678,7 @@ ZeusApp::~ZeusApp()
     SafeDelete(mSmap);
     SafeDelete(mSmap2);
 	SafeDelete(mPhysX);
+	SafeDelete(mTerrainCollision);
     ReleaseCOM(mInstancedBuffer);
     ReleaseCOM(mShapesVB);
     ReleaseCOM(mShapesIB);
@@ -461,13 +690,6 @@ ZeusApp::~ZeusApp()
     ReleaseCOM(mClothIB);
     ReleaseCOM(mScreenQuadVB);
     ReleaseCOM(mScreenQuadIB);
-    ReleaseCOM(mStoneTexSRV);
-    ReleaseCOM(mBrickTexSRV);
-	ReleaseCOM(mTreeTexSRV);
-    ReleaseCOM(mClothTexSRV);
-    ReleaseCOM(mStoneNormalTexSRV);
-    ReleaseCOM(mBrickNormalTexSRV);
-	ReleaseCOM(mTreeNormalTexSRV);
     ReleaseCOM(mRandomTexSRV);
     ReleaseCOM(mFlareTexSRV);
     //ReleaseCOM(mRainTexSRV);
@@ -492,7 +714,10 @@ ZeusApp::~ZeusApp()
 
 bool ZeusApp::Init()
 {
-	mPhysX->Init();
+	mPhysX = new PhysX;
+	mPhysX->Init(PhysicsWorkerThreads);
+	mPhysX->SetMaxSubsteps(PhysicsMaxSubsteps);
+	mPhysX->SetOverlapRendering(PhysicsOverlapRendering);
 
 	
 
@@ -504,6 +729,33 @@ bool ZeusApp::Init()
     InputLayouts::InitAll(md3dDevice);
     RenderStates::InitAll(md3dDevice);
 
+    // Meshes are packed only if every effect drawing them can decode them; older .fxo
+    // files lack the packed techniques and get float buffers.
+    mPackedVertices = InputLayouts::PackedBasic && InputLayouts::PackedPosNormalTexTan &&
+        InputLayouts::InstancedPackedPosNormalTexTan &&
+        Effects::BasicFX->Light3TexPackedTech->IsValid() && Effects::BasicFX->Light3TexInstancedPackedTech->IsValid() &&
+        Effects::BasicFX->Light3ReflectPackedTech->IsValid() &&
+        Effects::NormalMapFX->Light3TexPackedTech->IsValid() && Effects::NormalMapFX->Light3TexInstancedPackedTech->IsValid() &&
+        Effects::DisplacementMapFX->Light3TexPackedTech->IsValid() &&
+        Effects::DisplacementMapFX->Light3TexInstancedPackedTech->IsValid() &&
+        Effects::BuildShadowMapFX->BuildShadowMapPackedTech->IsValid() &&
+        Effects::BuildShadowMapFX->TessBuildShadowMapPackedTech->IsValid() &&
+        Effects::BuildShadowMapFX->BuildShadowMapInstancedPackedTech->IsValid() &&
+        Effects::BuildShadowMapFX->TessBuildShadowMapInstancedPackedTech->IsValid();
+
+	// The scene's textures are read and decoded on loader threads while the sky, terrain
+	// and shadow maps are set up; their views are created below.
+	const wchar_t* sceneTextures[] =
+	{
+		L"Textures/floor.dds", L"Textures/bricks.dds", L"Textures/nvidiaFlag_d.jpg",
+		L"Textures/floor_nmap.dds", L"Textures/bricks_nmap.dds",
+		L"Textures/CommandoArmor_DM.dds", L"Textures/Commando_DM.dds",
+		L"Textures/CommandoArmor_NM.dds", L"Textures/Commando_NM.dds"
+	};
+	mTexMgr.Init(md3dDevice);
+	for(UINT i = 0; i < sizeof(sceneTextures) / sizeof(sceneTextures[0]); ++i)
+		mTexMgr.Request(sceneTextures[i]);
+
     mSky  = new Sky(md3dDevice, L"Textures/mountains1024.dds", 5000.0f);
 
     Terrain::InitInfo tii;
@@ -519,10 +771,21 @@ bool ZeusApp::Init()
     tii.HeightmapHeight = 2049;
     tii.CellSpacing = 0.5f;
 
+	// A TiledHeightmap::ConvertRaw output, if present, replaces the RAW map; the
+	// 2049x2049 above is then the size of the window that follows the camera.
+	tii.TiledHeightMapFilename = L"Textures/terrain.zth";
+
     mTerrain.Init(md3dDevice, md3dImmediateContext, tii);
 
-	terrainMeshInfo terMesh = mTerrain.GetMeshInfo();
-	CreatePhysXTriangleMeshTerrain(terMesh.vertcount,terMesh.positions,terMesh.indcount,terMesh.indices);
+	// A tiled terrain's heightmap is its first window, around the origin, so with
+	// one it is only that area that collides.
+	mTerrainCollision = new HeightfieldBuilder(mTerrain.GetHeightmap(), mTerrain.GetCellSpacing());
+	if(TerrainCollisionTileCells == 0)
+	{
+		HeightfieldTile tile;
+		mTerrainCollision->BuildTile(0, 0, 0, tile);
+		mPhysX->CreateTerrainHeightField(tile, mTerrainCollision->GetHeightUnit(), mTerrainCollision->GetCellSpacing());
+	}
 
     mSmap = new ShadowMap(md3dDevice, SMapSize, SMapSize);
     mSmap2 = new ShadowMap(md3dDevice, SMapSize, SMapSize);
@@ -531,38 +794,18 @@ bool ZeusApp::Init()
         mOmniSmaps[i] = new ShadowMap(md3dDevice, SMapSize, SMapSize);
     }
 
-    HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/floor.dds", 0, 0, &mStoneTexSRV, 0 ));
-
-    HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/bricks.dds", 0, 0, &mBrickTexSRV, 0 ));
-
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/floor.dds", 0, 0, &mTreeTexSRV, 0 ));
-
-    HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/nvidiaFlag_d.jpg", 0, 0, &mClothTexSRV, 0 ));
-
-    HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/floor_nmap.dds", 0, 0, &mStoneNormalTexSRV, 0 ));
-
-    HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/bricks_nmap.dds", 0, 0, &mBrickNormalTexSRV, 0 ));
-
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/CommandoArmor_DM.dds", 0, 0, &mCommandoArmor, 0 ));
-
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/Commando_DM.dds", 0, 0, &mCommandoSkin, 0 ));
-
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/CommandoArmor_NM.dds", 0, 0, &mCommandoArmorNM, 0 ));
-
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/Commando_NM.dds", 0, 0, &mCommandoSkinNM, 0 ));
-
-	HR(D3DX11CreateShaderResourceViewFromFile(md3dDevice, 
-        L"Textures/floor_nmap.dds", 0, 0, &mTreeNormalTexSRV, 0 ));
+	// floor.dds and floor_nmap.dds are shared, and loaded once.
+	mStoneTexSRV = mTexMgr.CreateTexture(L"Textures/floor.dds");
+	mBrickTexSRV = mTexMgr.CreateTexture(L"Textures/bricks.dds");
+	mTreeTexSRV = mTexMgr.CreateTexture(L"Textures/floor.dds");
+	mClothTexSRV = mTexMgr.CreateTexture(L"Textures/nvidiaFlag_d.jpg");
+	mStoneNormalTexSRV = mTexMgr.CreateTexture(L"Textures/floor_nmap.dds");
+	mBrickNormalTexSRV = mTexMgr.CreateTexture(L"Textures/bricks_nmap.dds");
+	mCommandoArmor = mTexMgr.CreateTexture(L"Textures/CommandoArmor_DM.dds");
+	mCommandoSkin = mTexMgr.CreateTexture(L"Textures/Commando_DM.dds");
+	mCommandoArmorNM = mTexMgr.CreateTexture(L"Textures/CommandoArmor_NM.dds");
+	mCommandoSkinNM = mTexMgr.CreateTexture(L"Textures/Commando_NM.dds");
+	mTreeNormalTexSRV = mTexMgr.CreateTexture(L"Textures/floor_nmap.dds");
 
     HR(mFont.Initialize(md3dDevice, L"Perpetua", 36.0f, FontSheet::FontStyleRegular, true));
     HR(mFontc.Initialize(md3dDevice, L"Perpetua", 48.0f, FontSheet::FontStyleRegular, true));
@@ -600,11 +843,13 @@ bool ZeusApp::Init()
     BuildScreenQuadGeometryBuffers();
     LoadTreeBuffer();
 	LoadClothBuffer();
-    BuildInstancedBuffer();
 
 	// Trees
     CreateTreeMatrixes();
 
+    // Sized from the tree count, so after CreateTreeMatrixes.
+    BuildInstancedBuffer();
+
     return true;
 }
 
@@ -613,9 +858,6 @@ void ZeusApp::OnResize()
 {
     D3DApp::OnResize();
     mCam.SetLens(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
-
-    // Build the frustum from the projection matrix in view space.
-    ComputeFrustumFromProjection(&mCamFrustum, &mCam.Proj());
 }
 
 
@@ -871,14 +1113,7 @@ void ZeusApp::UpdateScene(float dt)
     /////////////////////////////////////
 	
 
-	// Box
-	for(int i = 0; i < mPhysX->GetNumBoxes(); i++)
-	{
-		PxTransform pt = mPhysX->GetBoxWorld(i);
-		XMMATRIX world = /*XMLoadFloat4x4(&mBoxScale) **/ XMLoadFloat4x4(&mBoxWorld[i]) ;
-		PxtoXMMatrix(pt, &world);
-		XMStoreFloat4x4(&mBoxWorld[i], world);
-	}
+	// Box world matrices are written by PhysX when a step is fetched; see PhysX::GetBoxWorlds.
 
     /*// Cow 
     XMMATRIX SkullScale = XMMatrixScaling(5.0f, 5.0f, 5.0f);
@@ -931,70 +1166,614 @@ void ZeusApp::UpdateScene(float dt)
     //
     mCam.UpdateViewMatrix();
     mVisibleObjectCount = 0;
+    mVisibleSkulls.clear();
 
     if(mFrustumCullingEnabled)
     {
-        XMVECTOR detView = XMMatrixDeterminant(mCam.View());
-        XMMATRIX invView = XMMatrixInverse(&detView, mCam.View());
-    
-        D3D11_MAPPED_SUBRESOURCE mappedData; 
-        md3dImmediateContext->Map(mInstancedBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData);
-
-        InstancedData* dataView = reinterpret_cast<InstancedData*>(mappedData.pData);
-
-        for(UINT i = 0; i < mInstancedData.size(); ++i)
+        // The skulls never move; mSkullCuller has held their world bounds since
+        // BuildInstancedBuffer.
+        mSkullCuller.Cull(mCam.ViewProj(), mVisibleSkullIndices);
+        for(size_t i = 0; i < mVisibleSkullIndices.size(); ++i)
         {
-            XMMATRIX W = XMLoadFloat4x4(&mInstancedData[i].World);
-            XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(W), W);
-
-            // View space to the object's local space.
-            XMMATRIX toLocal = XMMatrixMultiply(invView, invWorld);
-        
-            // Decompose the matrix into its individual parts.
-            XMVECTOR scale;
-            XMVECTOR rotQuat;
-            XMVECTOR translation;
-            XMMatrixDecompose(&scale, &rotQuat, &translation, toLocal);
-
-            // Transform the camera frustum from view space to the object's local space.
-            XNA::Frustum localspaceFrustum;
-            XNA::TransformFrustum(&localspaceFrustum, &mCamFrustum, XMVectorGetX(scale), rotQuat, translation);
-
-            // Perform the box/frustum intersection test in local space.
-            if(XNA::IntersectAxisAlignedBoxFrustum(&mSkullBox, &localspaceFrustum) != 0)
-            {
-                // Write the instance data to dynamic VB of the visible objects.
-                dataView[mVisibleObjectCount++] = mInstancedData[i];
-            }
+            // Keep the visible objects; CullPass writes them out for the main pass.
+            mVisibleSkulls.push_back(mInstancedData[mVisibleSkullIndices[i]]);
+            ++mVisibleObjectCount;
         }
-
-        md3dImmediateContext->Unmap(mInstancedBuffer, 0);
     }
     else // No culling enabled, draw all objects.
     {
-        D3D11_MAPPED_SUBRESOURCE mappedData; 
-        md3dImmediateContext->Map(mInstancedBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData);
-
-        InstancedData* dataView = reinterpret_cast<InstancedData*>(mappedData.pData);
-
         for(UINT i = 0; i < mInstancedData.size(); ++i)
         {
-            dataView[mVisibleObjectCount++] = mInstancedData[i];
+            mVisibleSkulls.push_back(mInstancedData[i]);
+            ++mVisibleObjectCount;
         }
-
-        md3dImmediateContext->Unmap(mInstancedBuffer, 0);
     }
 
     std::wostringstream outs;   
     outs.precision(6);
     outs << L"Zeus - Frustum Culling Test" << 
         L"    " << mVisibleObjectCount << 
-        L" objects visible out of " << mInstancedData.size();
+        L" objects visible out of " << mInstancedData.size() <<
+        L"    " << mTerrain.GetSelectionStats().PatchesSelected << L" terrain patches, " <<
+        mTerrain.GetSelectionStats().NodesVisited << L" nodes visited in " << mTerrain.GetSelectionMs() << L" ms";
     mMainWndCaption = outs.str();
 
+	mTerrain.Update(md3dImmediateContext, mCam.GetPosition());
+
     // If things are ready to get, fetch 'em
     if(fetch)
         mPhysX->fetch();
+
+	// The scene is idle here, so actors can be added and removed.
+	if(TerrainCollisionTileCells != 0)
+	{
+		mPhysX->StreamTerrainTiles(*mTerrainCollision, TerrainCollisionTileCells,
+			mCam.GetPosition().x, mCam.GetPosition().z, (float)TerrainCollisionRadius);
+	}
+
+	// Box poses are final for this frame once fetched.
+	UpdatePassCache();
+
+	mPhysX->beginOverlappedStep();
+}
+
+void ZeusApp::UpdatePassCache()
+{
+	mPassCache.BeginFrame();
+
+	CachedLighting lighting;
+	memset(&lighting, 0, sizeof(lighting));
+	for(int i = 0; i < 3; ++i)
+		lighting.DirLights[i] = mDirLights[i].Direction;
+	lighting.PointLightPos = mPointLights[0].Position;
+	lighting.DirectionalLight = directionalLight;
+	lighting.PointLight = pointLight;
+	lighting.RenderOption = mRenderOptions;
+
+	if(memcmp(&lighting, &mCachedLighting, sizeof(lighting)) != 0)
+	{
+		mCachedLighting = lighting;
+		mPassCache.InvalidateAll();
+	}
+
+	// Boxes are the only objects that move.  Compare their bounds with last frame's so
+	// only the passes that can see a moved box are redrawn.
+	const XMFLOAT4X4* boxWorlds = mPhysX->GetBoxWorlds();
+	UINT numBoxes = mPhysX->GetNumBoxes();
+	for(UINT i = 0; i < numBoxes; ++i)
+	{
+		XNA::AxisAlignedBox bounds;
+		PassCache::TransformBounds(bounds, mUnitBoxBounds, boxWorlds[i]);
+
+		if(i >= mBoxBounds.size())
+		{
+			mBoxBounds.push_back(bounds);
+			mPassCache.NotifyMoved(bounds, bounds);
+		}
+		else if(memcmp(&bounds, &mBoxBounds[i], sizeof(XMFLOAT3)*2) != 0)
+		{
+			mPassCache.NotifyMoved(mBoxBounds[i], bounds);
+			mBoxBounds[i] = bounds;
+		}
+	}
+}
+
+void ZeusApp::CullPass(CXMMATRIX viewProj, bool drawSkulls, const LodSelector& lodSelector)
+{
+	FrustumCuller culler(viewProj);
+
+	const XMFLOAT4X4* boxWorlds = mPhysX->GetBoxWorlds();
+	culler.CullInstances(mTreeBounds, mTreeWorld, mTreecount, mVisible.Trees);
+	culler.CullInstances(mUnitBoxBounds, boxWorlds, mPhysX->GetNumBoxes(), mVisible.Boxes);
+	culler.CullInstances(mCylinderBounds, mCylWorld, 5, mVisible.Cylinders);
+
+	lodSelector.SelectInstances(mTreeLods.empty() ? 0 : &mTreeLods[0], (UINT)mTreeLods.size(), mTreeBounds,
+		mTreeWorld, mVisible.Trees, mVisible.TreeLods);
+	lodSelector.SelectInstances(mBoxLods.empty() ? 0 : &mBoxLods[0], (UINT)mBoxLods.size(), mUnitBoxBounds,
+		boxWorlds, mVisible.Boxes, mVisible.BoxLods);
+	lodSelector.SelectInstances(mCylinderLods.empty() ? 0 : &mCylinderLods[0], (UINT)mCylinderLods.size(), mCylinderBounds,
+		mCylWorld, mVisible.Cylinders, mVisible.CylinderLods);
+
+	mVisible.Spheres.clear();
+	for(UINT i = 0; i < 5; ++i)
+	{
+		XNA::Sphere sphere;
+		sphere.Center = XMFLOAT3(mSphereWorld[i]._41, mSphereWorld[i]._42, mSphereWorld[i]._43);
+		sphere.Radius = 1.0f;
+		if(culler.IsVisible(sphere))
+			mVisible.Spheres.push_back(i);
+	}
+
+	if(!mInstancingEnabled || InputLayouts::InstancedPosNormalTexTan == 0)
+		return;
+
+	mInstanceBuilder.Reset();
+	if(drawSkulls)
+	{
+		for(size_t i = 0; i < mVisibleSkulls.size(); ++i)
+			mInstanceBuilder.Add(InstanceBatchSkull, mVisibleSkulls[i]);
+	}
+	AddLodBatches(InstanceBatchBox, boxWorlds, mVisible.Boxes, mVisible.BoxLods, mBoxLods);
+	AddLodBatches(InstanceBatchCylinder, mCylWorld, mVisible.Cylinders, mVisible.CylinderLods, mCylinderLods);
+	AddLodBatches(InstanceBatchTree, mTreeWorld, mVisible.Trees, mVisible.TreeLods, mTreeLods);
+
+	// Earlier passes' instances may still be in flight, so write after them without
+	// overwriting and only discard the buffer when this pass does not fit.
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if(mInstancedBufferUsed + mInstanceBuilder.GetNumQueued() > mInstancedBufferCapacity)
+	{
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		mInstancedBufferUsed = 0;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedData;
+	HR(md3dImmediateContext->Map(mInstancedBuffer, 0, mapType, 0, &mappedData));
+	InstancedData* dest = reinterpret_cast<InstancedData*>(mappedData.pData) + mInstancedBufferUsed;
+	mInstancedBufferUsed += mInstanceBuilder.Build(dest, mInstancedBufferCapacity - mInstancedBufferUsed, mInstancedBufferUsed);
+	md3dImmediateContext->Unmap(mInstancedBuffer, 0);
+}
+
+void ZeusApp::AddLodBatches(UINT batch, const XMFLOAT4X4* worlds, const std::vector<UINT>& visible,
+	const std::vector<UINT>& lodOfEach, const std::vector<MeshLod>& lods)
+{
+	XMFLOAT4 white(1.0f, 1.0f, 1.0f, 1.0f);
+	for(UINT lod = 0; lod < lods.size(); ++lod)
+	{
+		mLodInstances.clear();
+		for(size_t i = 0; i < visible.size(); ++i)
+		{
+			if(lodOfEach[i] == lod)
+				mLodInstances.push_back(visible[i]);
+		}
+		mInstanceBuilder.AddSelected(batch + lod, worlds, mLodInstances, white);
+	}
+}
+
+bool ZeusApp::UseInstancing(ID3DX11EffectTechnique* tech)const
+{
+	// Falls back to per-object draws when the .fxo files predate the instanced techniques.
+	return mInstancingEnabled && InputLayouts::InstancedPosNormalTexTan != 0 && tech->IsValid();
+}
+
+void ZeusApp::DrawInstanceBatch(ID3D11Buffer* meshVB, bool packed, UINT batch, UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	const InstanceBatch& range = mInstanceBuilder.GetBatch(batch);
+	if(range.InstanceCount == 0)
+		return;
+
+	UINT strides[2] = {packed ? sizeof(PackedVertexPosNormalTexTan) : sizeof(Vertex::PosNormalTexTan), sizeof(InstancedData)};
+	UINT offsets[2] = {0, 0};
+	ID3D11Buffer* vbs[2] = {meshVB, mInstancedBuffer};
+
+	md3dImmediateContext->IASetInputLayout(packed ? InputLayouts::InstancedPackedPosNormalTexTan : InputLayouts::InstancedPosNormalTexTan);
+	md3dImmediateContext->IASetVertexBuffers(0, 2, vbs, strides, offsets);
+	md3dImmediateContext->DrawIndexedInstanced(indexCount, range.InstanceCount, startIndex, baseVertex, range.StartInstance);
+
+	// Leave the per-object layout bound for the draws that follow; slot 1 is ignored by it.
+	md3dImmediateContext->IASetInputLayout(packed ? InputLayouts::PackedPosNormalTexTan : InputLayouts::PosNormalTexTan);
+}
+
+void ZeusApp::DrawInstanceLods(ID3D11Buffer* meshVB, bool packed, UINT batch, const std::vector<MeshLod>& lods, INT baseVertex)
+{
+	for(UINT lod = 0; lod < lods.size(); ++lod)
+		DrawInstanceBatch(meshVB, packed, batch + lod, lods[lod].NumIndices, lods[lod].FirstIndex, baseVertex);
+}
+
+namespace
+{
+	void SetSceneMaterial(SceneMaterial& m, const Material& mat, CXMMATRIX texTransform,
+		ID3D11ShaderResourceView* diffuseMap, ID3D11ShaderResourceView* normalMap)
+	{
+		m.Mat = mat;
+		XMStoreFloat4x4(&m.TexTransform, texTransform);
+		m.DiffuseMap = diffuseMap;
+		m.NormalMap = normalMap;
+		m.CubeMap = 0;
+		m.TextureArrays = false;
+	}
+}
+
+void ZeusApp::BuildSceneTables(bool drawSphere)
+{
+	// The lit objects use the effect picked by the render option; the reflective
+	// spheres always use BasicFX.
+	SceneTechnique& obj = mSceneTechs[SceneTechObject];
+	SceneTechnique& inst = mSceneTechs[SceneTechInstanced];
+	SceneTechnique& reflect = mSceneTechs[SceneTechReflect];
+	SceneTechnique& objPacked = mSceneTechs[SceneTechObjectPacked];
+	SceneTechnique& instPacked = mSceneTechs[SceneTechInstancedPacked];
+	SceneTechnique& reflectPacked = mSceneTechs[SceneTechReflectPacked];
+
+	obj.Topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	switch(mRenderOptions)
+	{
+	case RenderOptionsBasic:
+		obj.Tech = Effects::BasicFX->Light3TexTech;
+		inst.Tech = Effects::BasicFX->Light3TexInstancedTech;
+		objPacked.Tech = Effects::BasicFX->Light3TexPackedTech;
+		instPacked.Tech = Effects::BasicFX->Light3TexInstancedPackedTech;
+		break;
+	case RenderOptionsNormalMap:
+		obj.Tech = Effects::NormalMapFX->Light3TexTech;
+		inst.Tech = Effects::NormalMapFX->Light3TexInstancedTech;
+		objPacked.Tech = Effects::NormalMapFX->Light3TexPackedTech;
+		instPacked.Tech = Effects::NormalMapFX->Light3TexInstancedPackedTech;
+		break;
+	case RenderOptionsDisplacementMap:
+		obj.Tech = Effects::DisplacementMapFX->Light3TexTech;
+		inst.Tech = Effects::DisplacementMapFX->Light3TexInstancedTech;
+		objPacked.Tech = Effects::DisplacementMapFX->Light3TexPackedTech;
+		instPacked.Tech = Effects::DisplacementMapFX->Light3TexInstancedPackedTech;
+		obj.Topology = D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST;
+		break;
+	}
+	obj.Effect = mRenderOptions;
+	obj.Instanced = false;
+	obj.Packed = false;
+	inst.Effect = mRenderOptions;
+	inst.Topology = obj.Topology;
+	inst.Instanced = true;
+	inst.Packed = false;
+
+	reflect.Tech = Effects::BasicFX->Light3ReflectTech;
+	reflect.Effect = RenderOptionsBasic;
+	reflect.Topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	reflect.Instanced = false;
+	reflect.Packed = false;
+
+	objPacked.Effect = obj.Effect;
+	objPacked.Topology = obj.Topology;
+	objPacked.Instanced = false;
+	objPacked.Packed = true;
+	instPacked.Effect = inst.Effect;
+	instPacked.Topology = inst.Topology;
+	instPacked.Instanced = true;
+	instPacked.Packed = true;
+	reflectPacked = reflect;
+	reflectPacked.Tech = Effects::BasicFX->Light3ReflectPackedTech;
+	reflectPacked.Packed = true;
+
+	SetSceneMaterial(mSceneMats[SceneMatGrid], mGridMat, XMMatrixScaling(8.0f, 10.0f, 1.0f), mStoneTexSRV, mStoneNormalTexSRV);
+	SetSceneMaterial(mSceneMats[SceneMatBox], mBoxMat, XMMatrixScaling(2.0f, 1.0f, 1.0f), mBrickTexSRV, mBrickNormalTexSRV);
+	SetSceneMaterial(mSceneMats[SceneMatCylinder], mCylinderMat, XMMatrixScaling(1.0f, 2.0f, 1.0f), mBrickTexSRV, mBrickNormalTexSRV);
+	SetSceneMaterial(mSceneMats[SceneMatCloth], mClothMat, XMMatrixScaling(1.0f, 2.0f, 1.0f), mClothTexSRV, 0);
+	SetSceneMaterial(mSceneMats[SceneMatSphere], mSphereMat, XMMatrixIdentity(), 0, 0);
+
+	// Don't sample the sphere cube map while it is the render target.
+	mSceneMats[SceneMatSphere].CubeMap = drawSphere ? mDynamicCubeMapSRVSphere : 0;
+
+	switch(mRenderOptions)
+	{
+	case RenderOptionsBasic:
+		SetSceneMaterial(mSceneMats[SceneMatTree], mTreeMat, XMMatrixIdentity(), mTreeTexSRV, 0);
+		mSceneMats[SceneMatTree].TextureArrays = true;
+		break;
+	case RenderOptionsNormalMap:
+		SetSceneMaterial(mSceneMats[SceneMatTree], mTreeMat, XMMatrixIdentity(), mCommandoArmor, mCommandoArmorNM);
+		mSceneMats[SceneMatTree].TextureArrays = true;
+		break;
+	case RenderOptionsDisplacementMap:
+		SetSceneMaterial(mSceneMats[SceneMatTree], mTreeMat, XMMatrixScaling(1.0f, 2.0f, 1.0f), mTreeTexSRV, mTreeNormalTexSRV);
+		break;
+	}
+
+	SceneMesh& shapes = mSceneMeshes[SceneMeshShapes];
+	shapes.VB = mShapesVB;
+	shapes.IB = mShapesIB;
+	shapes.InputLayout = mPackedVertices ? InputLayouts::PackedPosNormalTexTan : InputLayouts::PosNormalTexTan;
+	shapes.Stride = mPackedVertices ? sizeof(PackedVertexPosNormalTexTan) : sizeof(Vertex::PosNormalTexTan);
+	shapes.Packed = mPackedVertices;
+	shapes.Quantization = mShapesQuantization;
+
+	SceneMesh& tree = mSceneMeshes[SceneMeshTree];
+	tree.VB = mTreeVB;
+	tree.IB = mTreeIB;
+	tree.InputLayout = mPackedVertices ? InputLayouts::PackedPosNormalTexTan : InputLayouts::PosNormalTexTan;
+	tree.Stride = mPackedVertices ? sizeof(PackedVertexPosNormalTexTan) : sizeof(Vertex::PosNormalTexTan);
+	tree.Packed = mPackedVertices;
+	tree.Quantization = mTreeQuantization;
+
+	SceneMesh& cloth = mSceneMeshes[SceneMeshCloth];
+	cloth.VB = mClothVB;
+	cloth.IB = mClothIB;
+	cloth.InputLayout = InputLayouts::Basic32;
+	cloth.Stride = sizeof(Vertex::Basic32);
+	cloth.Packed = false;
+}
+
+void ZeusApp::SubmitSceneObjects(const Camera& camera)
+{
+	// The cloth and grid are not culled.
+	static const std::vector<UINT> onlyObject(1, 0);
+	DrawPacket packet;
+
+	// Everything but the cloth is in the packed layouts when they are in use.
+	UINT objectTech = mPackedVertices ? SceneTechObjectPacked : SceneTechObject;
+
+	packet.Technique = objectTech;
+	packet.Material = SceneMatTree;
+	packet.Mesh = SceneMeshTree;
+	packet.IndexCount = mTreeIndexCount;
+	packet.StartIndex = 0;
+	packet.BaseVertex = 0;
+	SubmitSceneBatch(packet, InstanceBatchTree, mTreeWorld, mVisible.Trees, camera, &mTreeLods, &mVisible.TreeLods);
+
+	packet.Technique = SceneTechObject;
+	packet.Material = SceneMatCloth;
+	packet.Mesh = SceneMeshCloth;
+	packet.IndexCount = mClothIndexCount;
+	SubmitSceneBatch(packet, RenderQueue::NotInstanced, &mClothWorld, onlyObject, camera);
+
+	packet.Technique = objectTech;
+	packet.Material = SceneMatGrid;
+	packet.Mesh = SceneMeshShapes;
+	packet.IndexCount = mGridIndexCount;
+	packet.StartIndex = mGridIndexOffset;
+	packet.BaseVertex = mGridVertexOffset;
+	SubmitSceneBatch(packet, RenderQueue::NotInstanced, &mGridWorld, onlyObject, camera);
+
+	packet.Material = SceneMatBox;
+	packet.IndexCount = mBoxIndexCount;
+	packet.StartIndex = mBoxIndexOffset;
+	packet.BaseVertex = mBoxVertexOffset;
+	SubmitSceneBatch(packet, InstanceBatchBox, mPhysX->GetBoxWorlds(), mVisible.Boxes, camera, &mBoxLods, &mVisible.BoxLods);
+
+	packet.Material = SceneMatCylinder;
+	packet.IndexCount = mCylinderIndexCount;
+	packet.StartIndex = mCylinderIndexOffset;
+	packet.BaseVertex = mCylinderVertexOffset;
+	SubmitSceneBatch(packet, InstanceBatchCylinder, mCylWorld, mVisible.Cylinders, camera,
+		&mCylinderLods, &mVisible.CylinderLods);
+
+	packet.Technique = mPackedVertices ? SceneTechReflectPacked : SceneTechReflect;
+	packet.Material = SceneMatSphere;
+	packet.IndexCount = mSphereIndexCount;
+	packet.StartIndex = mSphereIndexOffset;
+	packet.BaseVertex = mSphereVertexOffset;
+	SubmitSceneBatch(packet, RenderQueue::NotInstanced, mSphereWorld, mVisible.Spheres, camera);
+}
+
+void ZeusApp::SubmitSceneBatch(DrawPacket& packet, UINT instanceBatch, const XMFLOAT4X4* worlds,
+	const std::vector<UINT>& visible, const Camera& camera,
+	const std::vector<MeshLod>* lods, const std::vector<UINT>* lodOfEach)
+{
+	if(visible.empty())
+		return;
+
+	UINT technique = packet.Technique;
+	UINT indexCount = packet.IndexCount;
+	UINT startIndex = packet.StartIndex;
+	UINT instancedTech = mSceneTechs[technique].Packed ? SceneTechInstancedPacked : SceneTechInstanced;
+
+	// One packet for the whole batch when it is in the instance buffer, or one per
+	// level of detail that has instances.
+	if(instanceBatch != RenderQueue::NotInstanced && UseInstancing(mSceneTechs[instancedTech].Tech))
+	{
+		packet.Technique = instancedTech;
+		XMStoreFloat4x4(&packet.World, XMMatrixIdentity());
+		if(!lods)
+		{
+			packet.InstanceBatch = instanceBatch;
+			mSceneQueue.Submit(packet, 0.0f);
+		}
+		else
+		{
+			for(UINT lod = 0; lod < lods->size(); ++lod)
+			{
+				if(mInstanceBuilder.GetBatch(instanceBatch + lod).InstanceCount == 0)
+					continue;
+
+				packet.InstanceBatch = instanceBatch + lod;
+				packet.IndexCount = (*lods)[lod].NumIndices;
+				packet.StartIndex = (*lods)[lod].FirstIndex;
+				mSceneQueue.Submit(packet, 0.0f);
+			}
+		}
+		packet.Technique = technique;
+		packet.IndexCount = indexCount;
+		packet.StartIndex = startIndex;
+		return;
+	}
+
+	XMFLOAT3 eye = camera.GetPosition();
+	float invFar = 1.0f / camera.GetFarZ();
+
+	packet.InstanceBatch = RenderQueue::NotInstanced;
+	for(size_t i = 0; i < visible.size(); ++i)
+	{
+		const XMFLOAT4X4& world = worlds[visible[i]];
+		packet.World = world;
+		if(lods)
+		{
+			const MeshLod& lod = (*lods)[(*lodOfEach)[i]];
+			packet.IndexCount = lod.NumIndices;
+			packet.StartIndex = lod.FirstIndex;
+		}
+
+		float dx = world._41 - eye.x;
+		float dy = world._42 - eye.y;
+		float dz = world._43 - eye.z;
+		mSceneQueue.Submit(packet, sqrtf(dx*dx + dy*dy + dz*dz)*invFar);
+	}
+	packet.IndexCount = indexCount;
+	packet.StartIndex = startIndex;
+}
+
+void ZeusApp::SetObjectConstants(RenderOptions effect, CXMMATRIX world)
+{
+	XMMATRIX viewProj = XMLoadFloat4x4(&mSceneViewProj);
+	XMMATRIX shadowTransform = XMLoadFloat4x4(&mSceneShadowTransform);
+	XMMATRIX shadowTransform2 = XMLoadFloat4x4(&mSceneShadowTransform2);
+	XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
+	XMMATRIX worldViewProj = world*viewProj;
+
+	switch(effect)
+	{
+	case RenderOptionsBasic:
+		Effects::BasicFX->SetWorld(world);
+		Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
+		Effects::BasicFX->SetWorldViewProj(worldViewProj);
+		Effects::BasicFX->SetShadowTransform(world*shadowTransform);
+		Effects::BasicFX->SetShadowTransform2(world*shadowTransform2);
+		break;
+	case RenderOptionsNormalMap:
+		Effects::NormalMapFX->SetWorld(world);
+		Effects::NormalMapFX->SetWorldInvTranspose(worldInvTranspose);
+		Effects::NormalMapFX->SetWorldViewProj(worldViewProj);
+		Effects::NormalMapFX->SetShadowTransform(world*shadowTransform);
+		Effects::NormalMapFX->SetShadowTransform2(world*shadowTransform2);
+		break;
+	case RenderOptionsDisplacementMap:
+		Effects::DisplacementMapFX->SetWorld(world);
+		Effects::DisplacementMapFX->SetWorldInvTranspose(worldInvTranspose);
+		Effects::DisplacementMapFX->SetViewProj(viewProj);
+		Effects::DisplacementMapFX->SetWorldViewProj(worldViewProj);
+
+		// No world pre-multiply for displacement mapping since the DS computes the world
+		// space position, we just need the light view/proj.
+		Effects::DisplacementMapFX->SetShadowTransform(shadowTransform);
+		Effects::DisplacementMapFX->SetShadowTransform2(shadowTransform2);
+		break;
+	}
+}
+
+void ZeusApp::SetVertexQuantization(RenderOptions effect, const VertexQuantization& quantization)
+{
+	switch(effect)
+	{
+	case RenderOptionsBasic:
+		Effects::BasicFX->SetVertexQuantization(quantization.Offset, quantization.Scale);
+		break;
+	case RenderOptionsNormalMap:
+		Effects::NormalMapFX->SetVertexQuantization(quantization.Offset, quantization.Scale);
+		break;
+	case RenderOptionsDisplacementMap:
+		Effects::DisplacementMapFX->SetVertexQuantization(quantization.Offset, quantization.Scale);
+		break;
+	}
+}
+
+void ZeusApp::BindTechnique(UINT technique)
+{
+	mSceneTech = technique;
+
+	const SceneTechnique& tech = mSceneTechs[technique];
+	md3dImmediateContext->IASetPrimitiveTopology(tech.Topology);
+
+	// FX sets tessellation stages, but it does not disable them.
+	if(tech.Effect != RenderOptionsDisplacementMap)
+	{
+		md3dImmediateContext->HSSetShader(0, 0, 0);
+		md3dImmediateContext->DSSetShader(0, 0, 0);
+	}
+}
+
+void ZeusApp::BindMaterial(UINT material)
+{
+	const SceneMaterial& m = mSceneMats[material];
+	XMMATRIX texTransform = XMLoadFloat4x4(&m.TexTransform);
+
+	vector<ID3D11ShaderResourceView*> texVec;
+	vector<ID3D11ShaderResourceView*> normVec;
+	if(m.TextureArrays)
+	{
+		texVec.push_back(mCommandoArmor);
+		texVec.push_back(mCommandoSkin);
+
+		normVec.push_back(mCommandoArmorNM);
+		normVec.push_back(mCommandoSkinNM);
+	}
+
+	switch(mSceneTechs[mSceneTech].Effect)
+	{
+	case RenderOptionsBasic:
+		Effects::BasicFX->SetTexTransform(texTransform);
+		Effects::BasicFX->SetMaterial(m.Mat);
+		if(m.DiffuseMap)
+			Effects::BasicFX->SetDiffuseMap(m.DiffuseMap);
+		if(m.CubeMap)
+			Effects::BasicFX->SetCubeMap(m.CubeMap);
+		if(m.TextureArrays)
+			Effects::BasicFX->SetTextureArray(texVec);
+		break;
+	case RenderOptionsNormalMap:
+		Effects::NormalMapFX->SetTexTransform(texTransform);
+		Effects::NormalMapFX->SetMaterial(m.Mat);
+		if(m.DiffuseMap)
+			Effects::NormalMapFX->SetDiffuseMap(m.DiffuseMap);
+		if(m.NormalMap)
+			Effects::NormalMapFX->SetNormalMap(m.NormalMap);
+		if(m.TextureArrays)
+		{
+			Effects::NormalMapFX->SetNormalArray(normVec);
+			Effects::NormalMapFX->SetTextureArray(texVec);
+		}
+		break;
+	case RenderOptionsDisplacementMap:
+		Effects::DisplacementMapFX->SetTexTransform(texTransform);
+		Effects::DisplacementMapFX->SetMaterial(m.Mat);
+		if(m.DiffuseMap)
+			Effects::DisplacementMapFX->SetDiffuseMap(m.DiffuseMap);
+		if(m.NormalMap)
+			Effects::DisplacementMapFX->SetNormalMap(m.NormalMap);
+		break;
+	}
+}
+
+void ZeusApp::BindMesh(UINT mesh)
+{
+	const SceneMesh& m = mSceneMeshes[mesh];
+	UINT offsets[2] = {0, 0};
+
+	if(mSceneTechs[mSceneTech].Instanced)
+	{
+		UINT strides[2] = {m.Stride, sizeof(InstancedData)};
+		ID3D11Buffer* vbs[2] = {m.VB, mInstancedBuffer};
+
+		md3dImmediateContext->IASetInputLayout(m.Packed ? InputLayouts::InstancedPackedPosNormalTexTan : InputLayouts::InstancedPosNormalTexTan);
+		md3dImmediateContext->IASetVertexBuffers(0, 2, vbs, strides, offsets);
+	}
+	else
+	{
+		md3dImmediateContext->IASetInputLayout(m.InputLayout);
+		md3dImmediateContext->IASetVertexBuffers(0, 1, &m.VB, &m.Stride, offsets);
+	}
+	md3dImmediateContext->IASetIndexBuffer(m.IB, DXGI_FORMAT_R32_UINT, 0);
+
+	// The queue binds the mesh again after every technique change, so the technique's
+	// effect is the one drawing it.
+	if(m.Packed)
+		SetVertexQuantization(mSceneTechs[mSceneTech].Effect, m.Quantization);
+}
+
+void ZeusApp::Draw(const DrawPacket& packet)
+{
+	const SceneTechnique& tech = mSceneTechs[mSceneTech];
+	bool instanced = packet.InstanceBatch != RenderQueue::NotInstanced;
+
+	InstanceBatch range = {0, 0};
+	if(instanced)
+	{
+		range = mInstanceBuilder.GetBatch(packet.InstanceBatch);
+		if(range.InstanceCount == 0)
+			return;
+		SetObjectConstants(tech.Effect, XMMatrixIdentity());
+	}
+	else
+	{
+		SetObjectConstants(tech.Effect, XMLoadFloat4x4(&packet.World));
+	}
+
+	D3DX11_TECHNIQUE_DESC techDesc;
+	tech.Tech->GetDesc( &techDesc );
+	for(UINT p = 0; p < techDesc.Passes; ++p)
+	{
+		tech.Tech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+		if(instanced)
+			md3dImmediateContext->DrawIndexedInstanced(packet.IndexCount, range.InstanceCount, packet.StartIndex, packet.BaseVertex, range.StartInstance);
+		else
+			md3dImmediateContext->DrawIndexed(packet.IndexCount, packet.StartIndex, packet.BaseVertex);
+	}
 }
 
 
@@ -1002,21 +1781,33 @@ void ZeusApp::DrawScene()
 {
 	// Draw directional shadow maps
     
+    // A shadow map is kept while its light transform is unchanged and no box moved
+    // through it.
     if(directionalLight) {
         BuildShadowTransform(0, false);
-        mSmap->BindDsvAndSetNullRenderTarget(md3dImmediateContext);
-        DrawSceneToShadowMap();
+        mPassCache.SetViewProj(CachedPassShadow, XMLoadFloat4x4(&mLightView)*XMLoadFloat4x4(&mLightProj));
+        if(mPassCache.NeedsUpdate(CachedPassShadow))
+        {
+            mSmap->BindDsvAndSetNullRenderTarget(md3dImmediateContext);
+            DrawSceneToShadowMap();
+            mPassCache.MarkDrawn(CachedPassShadow);
+        }
     
         BuildShadowTransform(1, false);
-        mSmap2->BindDsvAndSetNullRenderTarget(md3dImmediateContext);
-        DrawSceneToShadowMap();
+        mPassCache.SetViewProj(CachedPassShadow2, XMLoadFloat4x4(&mLightView)*XMLoadFloat4x4(&mLightProj));
+        if(mPassCache.NeedsUpdate(CachedPassShadow2))
+        {
+            mSmap2->BindDsvAndSetNullRenderTarget(md3dImmediateContext);
+            DrawSceneToShadowMap();
+            mPassCache.MarkDrawn(CachedPassShadow2);
+        }
     }
 	
 	// Draw omni directional shadow maps
+    // Each face is kept, like the directional maps, while the light stays put and no box
+    // moved through it.
     if(pointLight)
-    {
 	    BuildCubeFaceShadowTransforms(mPointLights[0].Position.x, mPointLights[0].Position.y, mPointLights[0].Position.z); // point light position
-    }
 
     md3dImmediateContext->RSSetState(0);
     ID3D11RenderTargetView* renderTargets[1];
@@ -1028,11 +1819,16 @@ void ZeusApp::DrawScene()
 		 (camPosition.y > 25.0f || camPosition.y < -25.0) ||
          (camPosition.z > 15.0f || camPosition.z < -25.0)) ){
     */
-		// Sphere with dynamic cube mapping
+		// Sphere with dynamic cube mapping.  Only the dirty faces are redrawn, a few per frame.
 		BuildCubeFaceCamera(-5.0f, 4.0f, 5.0f); // Sphere position
+		for(int i = 0; i < 6; ++i)
+			mPassCache.SetViewProj(CachedPassSphereFace + i, mCubeMapCamera[i].ViewProj());
+		mPassCache.SelectUpdates(CachedPassSphereFace, 6, CubeFaceBudget, mCubeFaceUpdates);
     
-		for(int i = 0; i < 6; ++i) // for mirror, just do (int i = 0; i < 1; ++i) for 1 camera mapped to mirror surface
+		for(UINT f = 0; f < mCubeFaceUpdates.size(); ++f)
 		{
+			int i = mCubeFaceUpdates[f] - CachedPassSphereFace;
+
 			// Clear cube map face and depth buffer.
 			md3dImmediateContext->ClearRenderTargetView(mDynamicCubeMapRTVSphere[i], reinterpret_cast<const float*>(&Colors::Silver));
 			md3dImmediateContext->ClearDepthStencilView(mDynamicCubeMapDSVSphere, D3D11_CLEAR_DEPTH|D3D11_CLEAR_STENCIL, 1.0f, 0);
@@ -1043,10 +1839,12 @@ void ZeusApp::DrawScene()
 
 	        // Draw the scene with the exception of the center sphere to this cube map face
 	        DrawScene(mCubeMapCamera[i], false, false, false);
+			mPassCache.MarkDrawn(CachedPassSphereFace + i);
 	    }
 
 		// Have hardware generate lower mipmap levels of cube map
-		md3dImmediateContext->GenerateMips(mDynamicCubeMapSRVSphere);
+		if(!mCubeFaceUpdates.empty())
+			md3dImmediateContext->GenerateMips(mDynamicCubeMapSRVSphere);
     //}
 
 
@@ -1308,431 +2106,31 @@ void ZeusApp::DrawScene(const Camera& camera, bool drawSphere, bool drawSkull, b
     Effects::DisplacementMapFX->SetMinTessFactor(1.0f);
     Effects::DisplacementMapFX->SetMaxTessFactor(3.0f);
  
-    // Figure out which technique to use for different geometry.
-    ID3DX11EffectTechnique* activeTech       = Effects::DisplacementMapFX->Light3TexTech;
-    ID3DX11EffectTechnique* activeObjTech    = Effects::BasicFX->Light3Tech;
-    ID3DX11EffectTechnique* activeSphereTech = Effects::BasicFX->Light3ReflectTech;
-    ID3DX11EffectTechnique* activeGayTech = Effects::NormalMapFX->Light3ReflectTech;
-    ID3DX11EffectTechnique* activeSkullTech  = Effects::BasicFX->Light3ReflectTech;
-    switch(mRenderOptions)
-    {
-    case RenderOptionsBasic:
-        activeTech = Effects::BasicFX->Light3TexTech;
-        activeObjTech = Effects::BasicFX->Light3TexTech;
-        md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        break;
-    case RenderOptionsNormalMap:
-        activeTech = Effects::NormalMapFX->Light3TexTech;
-        activeObjTech = Effects::NormalMapFX->Light3TexTech;
-        md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        break;
-    case RenderOptionsDisplacementMap:
-        activeTech = Effects::DisplacementMapFX->Light3TexTech;
-        activeObjTech = Effects::DisplacementMapFX->Light3TexTech;
-        md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
-        break;
-    }
-
-    XMMATRIX world;
-    XMMATRIX worldInvTranspose;
-    XMMATRIX worldViewProj;
-
-
-    // Draw the loaded objects
-    UINT stride = sizeof(Vertex::PosNormalTexTan);
-    UINT offset = 0;
-    D3DX11_TECHNIQUE_DESC techDesc;
-
-    // Draw Loaded Objects
-    md3dImmediateContext->IASetInputLayout(InputLayouts::PosNormalTexTan);
-    md3dImmediateContext->IASetVertexBuffers(0, 1, &mTreeVB, &stride, &offset);
-    md3dImmediateContext->IASetIndexBuffer(mTreeIB, DXGI_FORMAT_R32_UINT, 0);
-     
-    activeObjTech->GetDesc( &techDesc );
-    for(UINT p = 0; p < techDesc.Passes; ++p)
-    {
-        //int ofs = 0;
-        // Draw the trees.
-        for(int i = 0; i < mTreecount; i++)
-        {
-            world = XMLoadFloat4x4(&mTreeWorld[i]);
-            worldInvTranspose = MathHelper::InverseTranspose(world);
-            worldViewProj = world*view*proj;
-			vector<ID3D11ShaderResourceView*> texVec;
-			vector<ID3D11ShaderResourceView*> normVec;
-
-			texVec.push_back(mCommandoArmor);
-			texVec.push_back(mCommandoSkin);
-
-			normVec.push_back(mCommandoArmorNM);
-			normVec.push_back(mCommandoSkinNM);
-
-            switch(mRenderOptions)
-            {
-            case RenderOptionsBasic:
-                Effects::BasicFX->SetWorld(world);
-                Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-                Effects::BasicFX->SetWorldViewProj(worldViewProj);
-                Effects::BasicFX->SetShadowTransform(world*shadowTransform);
-                Effects::BasicFX->SetShadowTransform2(world*shadowTransform2);
-				/*Effects::BasicFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-                Effects::BasicFX->SetTexTransform(XMMatrixScaling(1.0f, 1.0f, 1.0f));
-                Effects::BasicFX->SetMaterial(mTreeMat);
-                Effects::BasicFX->SetDiffuseMap(mTreeTexSRV);
-				Effects::BasicFX->SetTextureArray(texVec);
-                break;
-            case RenderOptionsNormalMap:
-                Effects::NormalMapFX->SetWorld(world);
-                Effects::NormalMapFX->SetWorldInvTranspose(worldInvTranspose);
-                Effects::NormalMapFX->SetWorldViewProj(worldViewProj);
-                Effects::NormalMapFX->SetShadowTransform(world*shadowTransform);
-                Effects::NormalMapFX->SetShadowTransform2(world*shadowTransform2);
-				/*Effects::NormalMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-                Effects::NormalMapFX->SetTexTransform(XMMatrixScaling(1.0f, 1.0f, 1.0f));
-                Effects::NormalMapFX->SetMaterial(mTreeMat);
-                Effects::NormalMapFX->SetDiffuseMap(mCommandoArmor);
-                Effects::NormalMapFX->SetNormalMap(mCommandoArmorNM);
-				Effects::NormalMapFX->SetNormalArray(normVec);
-				Effects::NormalMapFX->SetTextureArray(texVec);
-                break;
-
-            case RenderOptionsDisplacementMap:
-                Effects::DisplacementMapFX->SetWorld(world);
-                Effects::DisplacementMapFX->SetWorldInvTranspose(worldInvTranspose);
-                Effects::DisplacementMapFX->SetViewProj(viewProj);
-                Effects::DisplacementMapFX->SetWorldViewProj(worldViewProj);
-                    
-                // Note: No world pre-multiply for displacement mapping since the DS computes the world
-                // space position, we just need the light view/proj.
-                Effects::DisplacementMapFX->SetShadowTransform(shadowTransform);
-                Effects::DisplacementMapFX->SetShadowTransform2(shadowTransform2);
-				/*Effects::DisplacementMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-                Effects::DisplacementMapFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
-                Effects::DisplacementMapFX->SetMaterial(mTreeMat);
-                Effects::DisplacementMapFX->SetDiffuseMap(mTreeTexSRV);
-                Effects::DisplacementMapFX->SetNormalMap(mTreeNormalTexSRV);
-                break;
-            }
-
-            activeObjTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-            md3dImmediateContext->DrawIndexed(mTreeIndexCount, 0, 0);
-        }
-    }
-
-	// Draw the cloth
-	md3dImmediateContext->IASetInputLayout(InputLayouts::Basic32);
-    md3dImmediateContext->IASetVertexBuffers(0, 1, &mClothVB, &stride, &offset);
-    md3dImmediateContext->IASetIndexBuffer(mClothIB, DXGI_FORMAT_R32_UINT, 0);
-
-	activeObjTech->GetDesc( &techDesc );
-    for(UINT p = 0; p < techDesc.Passes; ++p)
-    {
-        // Draw the cloth.
-        world = XMLoadFloat4x4(&mClothWorld);
-        worldInvTranspose = MathHelper::InverseTranspose(world);
-        worldViewProj = world*view*proj;
-
-        switch(mRenderOptions)
-        {
-        case RenderOptionsBasic:
-            Effects::BasicFX->SetWorld(world);
-            Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-            Effects::BasicFX->SetWorldViewProj(worldViewProj);
-            Effects::BasicFX->SetShadowTransform(world*shadowTransform);
-            Effects::BasicFX->SetShadowTransform2(world*shadowTransform2);
-			/*Effects::BasicFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-	world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-	world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-            Effects::BasicFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
-            Effects::BasicFX->SetMaterial(mClothMat);
-            Effects::BasicFX->SetDiffuseMap(mClothTexSRV);
-            break;
-        case RenderOptionsNormalMap:
-            Effects::NormalMapFX->SetWorld(world);
-            Effects::NormalMapFX->SetWorldInvTranspose(worldInvTranspose);
-            Effects::NormalMapFX->SetWorldViewProj(worldViewProj);
-            Effects::NormalMapFX->SetShadowTransform(world*shadowTransform);
-            Effects::NormalMapFX->SetShadowTransform2(world*shadowTransform2);
-			/*Effects::NormalMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-	world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-	world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-            Effects::NormalMapFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
-            Effects::NormalMapFX->SetMaterial(mClothMat);
-            Effects::NormalMapFX->SetDiffuseMap(mClothTexSRV);
-            break;
-        case RenderOptionsDisplacementMap:
-            Effects::DisplacementMapFX->SetWorld(world);
-            Effects::DisplacementMapFX->SetWorldInvTranspose(worldInvTranspose);
-            Effects::DisplacementMapFX->SetViewProj(viewProj);
-            Effects::DisplacementMapFX->SetWorldViewProj(worldViewProj);
-                    
-            // Note: No world pre-multiply for displacement mapping since the DS computes the world
-            // space position, we just need the light view/proj.
-            Effects::DisplacementMapFX->SetShadowTransform(shadowTransform);
-            Effects::DisplacementMapFX->SetShadowTransform2(shadowTransform2);
-			/*Effects::DisplacementMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-	world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-	world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-            Effects::DisplacementMapFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
-            Effects::DisplacementMapFX->SetMaterial(mClothMat);
-            Effects::DisplacementMapFX->SetDiffuseMap(mClothTexSRV);
-            break;
-        }
-        
-        activeObjTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-        md3dImmediateContext->DrawIndexed(mClothIndexCount, 0, 0);
-    }
-
-    // Draw the grid, cylinders, and box without any cubemap reflection.
-    stride = sizeof(Vertex::PosNormalTexTan);
-    offset = 0;
-     
-    md3dImmediateContext->IASetInputLayout(InputLayouts::PosNormalTexTan);
-    md3dImmediateContext->IASetVertexBuffers(0, 1, &mShapesVB, &stride, &offset);
-    md3dImmediateContext->IASetIndexBuffer(mShapesIB, DXGI_FORMAT_R32_UINT, 0);
-
-    activeTech->GetDesc( &techDesc );
-    for(UINT p = 0; p < techDesc.Passes; ++p)
-    {
-        // Draw the grid.
-        world = XMLoadFloat4x4(&mGridWorld);
-        worldInvTranspose = MathHelper::InverseTranspose(world);
-        worldViewProj = world*view*proj;
-
-        switch(mRenderOptions)
-        {
-        case RenderOptionsBasic:
-            Effects::BasicFX->SetWorld(world);
-            Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-            Effects::BasicFX->SetWorldViewProj(worldViewProj);
-            Effects::BasicFX->SetShadowTransform(world*shadowTransform);
-            Effects::BasicFX->SetShadowTransform2(world*shadowTransform2);
-			/*Effects::BasicFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-            Effects::BasicFX->SetTexTransform(XMMatrixScaling(8.0f, 10.0f, 1.0f));
-            Effects::BasicFX->SetMaterial(mGridMat);
-            Effects::BasicFX->SetDiffuseMap(mStoneTexSRV);
-            break;
-        case RenderOptionsNormalMap:
-            Effects::NormalMapFX->SetWorld(world);
-            Effects::NormalMapFX->SetWorldInvTranspose(worldInvTranspose);
-            Effects::NormalMapFX->SetWorldViewProj(worldViewProj);
-            Effects::NormalMapFX->SetShadowTransform(world*shadowTransform);
-            Effects::NormalMapFX->SetShadowTransform2(world*shadowTransform2);
-			/*Effects::NormalMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-            Effects::NormalMapFX->SetTexTransform(XMMatrixScaling(8.0f, 10.0f, 1.0f));
-            Effects::NormalMapFX->SetMaterial(mGridMat);
-            Effects::NormalMapFX->SetDiffuseMap(mStoneTexSRV);
-            Effects::NormalMapFX->SetNormalMap(mStoneNormalTexSRV);
-            break;
-        case RenderOptionsDisplacementMap:
-            Effects::DisplacementMapFX->SetWorld(world);
-            Effects::DisplacementMapFX->SetWorldInvTranspose(worldInvTranspose);
-            Effects::DisplacementMapFX->SetViewProj(viewProj);
-            Effects::DisplacementMapFX->SetWorldViewProj(worldViewProj);
-            
-            Effects::DisplacementMapFX->SetShadowTransform(shadowTransform);				     // Note: No world pre-multiply for displacement mapping since 
-            Effects::DisplacementMapFX->SetShadowTransform2(shadowTransform2);
-			/*Effects::DisplacementMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-            Effects::DisplacementMapFX->SetTexTransform(XMMatrixScaling(8.0f, 10.0f, 1.0f));     // the DS computes the world space position, we just need the 
-            Effects::DisplacementMapFX->SetMaterial(mGridMat);                                   // light view/proj.
-            Effects::DisplacementMapFX->SetDiffuseMap(mStoneTexSRV);
-            Effects::DisplacementMapFX->SetNormalMap(mStoneNormalTexSRV);
-            break;
-        }
-
-        activeTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-        md3dImmediateContext->DrawIndexed(mGridIndexCount, mGridIndexOffset, mGridVertexOffset);
-
-        // Draw the boxes.
-        for(int i = 0; i < mPhysX->GetNumBoxes(); i++)
-		{
-			world = XMLoadFloat4x4(&mBoxWorld[i]);
-			worldInvTranspose = MathHelper::InverseTranspose(world);
-			worldViewProj = world*view*proj;
-
-			switch(mRenderOptions)
-			{
-			case RenderOptionsBasic:
-				Effects::BasicFX->SetWorld(world);
-				Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-				Effects::BasicFX->SetWorldViewProj(worldViewProj);
-				Effects::BasicFX->SetShadowTransform(world*shadowTransform);
-				Effects::BasicFX->SetShadowTransform2(world*shadowTransform2);
-				/*Effects::BasicFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-				Effects::BasicFX->SetTexTransform(XMMatrixScaling(2.0f, 1.0f, 1.0f));
-				Effects::BasicFX->SetMaterial(mBoxMat);
-				Effects::BasicFX->SetDiffuseMap(mBrickTexSRV);
-				break;
-			case RenderOptionsNormalMap:
-				Effects::NormalMapFX->SetWorld(world);
-				Effects::NormalMapFX->SetWorldInvTranspose(worldInvTranspose);
-				Effects::NormalMapFX->SetWorldViewProj(worldViewProj);
-				Effects::NormalMapFX->SetShadowTransform(world*shadowTransform);
-				Effects::NormalMapFX->SetShadowTransform2(world*shadowTransform2);
-				/*Effects::NormalMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-				Effects::NormalMapFX->SetTexTransform(XMMatrixScaling(2.0f, 1.0f, 1.0f));
-				Effects::NormalMapFX->SetMaterial(mBoxMat);
-				Effects::NormalMapFX->SetDiffuseMap(mBrickTexSRV);
-				Effects::NormalMapFX->SetNormalMap(mBrickNormalTexSRV);
-				break;
-			case RenderOptionsDisplacementMap:
-				Effects::DisplacementMapFX->SetWorld(world);
-				Effects::DisplacementMapFX->SetWorldInvTranspose(worldInvTranspose);
-				Effects::DisplacementMapFX->SetViewProj(viewProj);
-				Effects::DisplacementMapFX->SetWorldViewProj(worldViewProj);
-				Effects::DisplacementMapFX->SetShadowTransform(shadowTransform);
-				Effects::DisplacementMapFX->SetShadowTransform2(shadowTransform2);
-				/*Effects::DisplacementMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-				Effects::DisplacementMapFX->SetTexTransform(XMMatrixScaling(2.0f, 1.0f, 1.0f));
-				Effects::DisplacementMapFX->SetMaterial(mBoxMat);
-				Effects::DisplacementMapFX->SetDiffuseMap(mBrickTexSRV);
-				Effects::DisplacementMapFX->SetNormalMap(mBrickNormalTexSRV);
-				break;
-			}
-
-			activeTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(mBoxIndexCount, mBoxIndexOffset, mBoxVertexOffset);
-		}
-
-        // Draw the cylinders.
-        for(int i = 0; i < 5; ++i)
-        {
-            world = XMLoadFloat4x4(&mCylWorld[i]);
-            worldInvTranspose = MathHelper::InverseTranspose(world);
-            worldViewProj = world*view*proj;
+    // The skulls were culled against the player camera in UpdateScene.  Cube faces are
+    // CubeMapSizeSphere pixels high.
+    LodSelector lodSelector;
+    if(&camera == &mCam)
+        lodSelector.SetView(camera, (float)mClientHeight);
+    else
+        lodSelector.SetView(camera, (float)CubeMapSizeSphere, CubeFaceLodBias);
+    CullPass(viewProj, &camera == &mCam, lodSelector);
 
-            switch(mRenderOptions)
-            {
-            case RenderOptionsBasic:
-                Effects::BasicFX->SetWorld(world);
-                Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-                Effects::BasicFX->SetWorldViewProj(worldViewProj);
-                Effects::BasicFX->SetShadowTransform(world*shadowTransform);
-                Effects::BasicFX->SetShadowTransform2(world*shadowTransform2);
-				/*Effects::BasicFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-                Effects::BasicFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
-                Effects::BasicFX->SetMaterial(mCylinderMat);
-                Effects::BasicFX->SetDiffuseMap(mBrickTexSRV);
-                break;
-            case RenderOptionsNormalMap:
-                Effects::NormalMapFX->SetWorld(world);
-                Effects::NormalMapFX->SetWorldInvTranspose(worldInvTranspose);
-                Effects::NormalMapFX->SetWorldViewProj(worldViewProj);
-                Effects::NormalMapFX->SetShadowTransform(world*shadowTransform);
-                Effects::NormalMapFX->SetShadowTransform2(world*shadowTransform2);
-				/*Effects::NormalMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-                Effects::NormalMapFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
-                Effects::NormalMapFX->SetMaterial(mCylinderMat);
-                Effects::NormalMapFX->SetDiffuseMap(mBrickTexSRV);
-                Effects::NormalMapFX->SetNormalMap(mBrickNormalTexSRV);
-                break;
-            case RenderOptionsDisplacementMap:
-                Effects::DisplacementMapFX->SetWorld(world);
-                Effects::DisplacementMapFX->SetWorldInvTranspose(worldInvTranspose);
-                Effects::DisplacementMapFX->SetViewProj(viewProj);
-                Effects::DisplacementMapFX->SetWorldViewProj(worldViewProj);
-                Effects::DisplacementMapFX->SetShadowTransform(shadowTransform);
-                Effects::DisplacementMapFX->SetShadowTransform2(shadowTransform2);
-				/*Effects::DisplacementMapFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-                Effects::DisplacementMapFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
-                Effects::DisplacementMapFX->SetMaterial(mCylinderMat);
-                Effects::DisplacementMapFX->SetDiffuseMap(mBrickTexSRV);
-                Effects::DisplacementMapFX->SetNormalMap(mBrickNormalTexSRV);
-                break;
-            }
+    // Every lit object goes through the render queue, which sorts the packets so each
+    // technique, material and mesh is bound once.
+    BuildSceneTables(drawSphere);
+    XMStoreFloat4x4(&mSceneViewProj, viewProj);
+    XMStoreFloat4x4(&mSceneShadowTransform, shadowTransform);
+    XMStoreFloat4x4(&mSceneShadowTransform2, shadowTransform2);
 
-            activeTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-            md3dImmediateContext->DrawIndexed(mCylinderIndexCount, mCylinderIndexOffset, mCylinderVertexOffset);
-        }
-    }
+    mSceneQueue.Clear();
+    SubmitSceneObjects(camera);
+    mSceneQueue.Sort();
+    mSceneQueue.Execute(*this);
 
     // FX sets tessellation stages, but it does not disable them.  So do that here to turn off tessellation.
     md3dImmediateContext->HSSetShader(0, 0, 0);
     md3dImmediateContext->DSSetShader(0, 0, 0);
-
-    // Draw the spheres with cubemap reflection.
     md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    if(drawSphere)
-    {
-        activeSphereTech->GetDesc( &techDesc );
-        for(UINT p = 0; p < techDesc.Passes; ++p)
-        {
-            // Draw the spheres.
-            for(int i = 0; i < 5; ++i)
-            {
-                world = XMLoadFloat4x4(&mSphereWorld[i]);
-                worldInvTranspose = MathHelper::InverseTranspose(world);
-                worldViewProj = world*view*proj;
-
-                Effects::BasicFX->SetWorld(world);
-                Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-                Effects::BasicFX->SetWorldViewProj(worldViewProj);
-                Effects::BasicFX->SetShadowTransform(world*shadowTransform);
-                Effects::BasicFX->SetShadowTransform2(world*shadowTransform2);
-				/*Effects::BasicFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-                Effects::BasicFX->SetTexTransform(XMMatrixIdentity());
-                Effects::BasicFX->SetMaterial(mSphereMat);
-                Effects::BasicFX->SetCubeMap(mDynamicCubeMapSRVSphere);
-
-                activeSphereTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-                md3dImmediateContext->DrawIndexed(mSphereIndexCount, mSphereIndexOffset, mSphereVertexOffset);
-            }
-        }
-    }
-    else{
-        activeSphereTech->GetDesc( &techDesc );
-        for(UINT p = 0; p < techDesc.Passes; ++p)
-        {
-            // Draw the spheres.
-            for(int i = 0; i < 5; ++i)
-            {
-                world = XMLoadFloat4x4(&mSphereWorld[i]);
-                worldInvTranspose = MathHelper::InverseTranspose(world);
-                worldViewProj = world*view*proj;
-
-                Effects::BasicFX->SetWorld(world);
-                Effects::BasicFX->SetWorldInvTranspose(worldInvTranspose);
-                Effects::BasicFX->SetWorldViewProj(worldViewProj);
-                Effects::BasicFX->SetShadowTransform(world*shadowTransform);
-                Effects::BasicFX->SetShadowTransform2(world*shadowTransform2);
-				/*Effects::BasicFX->SetShadowTransforms(world*XMLoadFloat4x4(&mShadowTransformOmni[0]),world*XMLoadFloat4x4(&mShadowTransformOmni[1]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[2]),world*XMLoadFloat4x4(&mShadowTransformOmni[3]),
-		world*XMLoadFloat4x4(&mShadowTransformOmni[4]),world*XMLoadFloat4x4(&mShadowTransformOmni[5]));*/
-                Effects::BasicFX->SetTexTransform(XMMatrixIdentity());
-                Effects::BasicFX->SetMaterial(mSphereMat);
-                //Effects::BasicFX->SetCubeMap(mSky->CubeMapSRV());
-
-                activeSphereTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-                md3dImmediateContext->DrawIndexed(mSphereIndexCount, mSphereIndexOffset, mSphereVertexOffset);
-            }
-        }
-    }
 
     // Draw Skull with cubemap reflection.
    /* stride = sizeof(Vertex::Basic32);
@@ -1937,8 +2335,13 @@ void ZeusApp::BuildCubeFaceShadowTransforms(float x, float y, float z)
 		XMStoreFloat4x4(&mLightProj, P);
 		XMStoreFloat4x4(&mShadowTransformOmni[i], S);
 
+		mPassCache.SetViewProj(CachedPassOmniFace + i, V*P);
+		if(!mPassCache.NeedsUpdate(CachedPassOmniFace + i))
+			continue;
+
 		mOmniSmaps[i]->BindDsvAndSetNullRenderTarget(md3dImmediateContext);
         DrawSceneToShadowMap();
+		mPassCache.MarkDrawn(CachedPassOmniFace + i);
 	}
 }
 
@@ -2191,16 +2594,23 @@ void ZeusApp::DrawSceneToShadowMap()
     //
     // Decide if we want to render shadows from the terrain map.
 
-    // Draw terrain
-    mTerrain.Draw(md3dImmediateContext, mCam, mDirLights);
-
     XMMATRIX view     = XMLoadFloat4x4(&mLightView);
     XMMATRIX proj     = XMLoadFloat4x4(&mLightProj);
     XMMATRIX viewProj = XMMatrixMultiply(view, proj);
 
+    // Draw terrain, selecting patches against the light's frustum rather than the
+    // camera's, at the detail the camera would see.
+    mTerrain.Draw(md3dImmediateContext, viewProj, mCam.GetPosition(), mDirLights);
+
     Effects::BuildShadowMapFX->SetEyePosW(mCam.GetPosition());
     Effects::BuildShadowMapFX->SetViewProj(viewProj);
 
+    // Only what the light's frustum touches casts into this map, at the levels of detail
+    // the player's view would pick, made coarser by ShadowLodBias.
+    LodSelector lodSelector;
+    lodSelector.SetView(mCam, (float)mClientHeight, ShadowLodBias);
+    CullPass(viewProj, false, lodSelector);
+
     // These properties could be set per object if needed.
     Effects::BuildShadowMapFX->SetHeightScale(0.07f);
     Effects::BuildShadowMapFX->SetMaxTessDistance(1.0f);
@@ -2210,6 +2620,7 @@ void ZeusApp::DrawSceneToShadowMap()
 
     ID3DX11EffectTechnique* tessSmapTech = Effects::BuildShadowMapFX->BuildShadowMapTech;
     ID3DX11EffectTechnique* smapTech = Effects::BuildShadowMapFX->BuildShadowMapTech;
+    ID3DX11EffectTechnique* instancedSmapTech = Effects::BuildShadowMapFX->BuildShadowMapInstancedTech;
     switch(mRenderOptions)
     {
     case RenderOptionsBasic:
@@ -2226,42 +2637,85 @@ void ZeusApp::DrawSceneToShadowMap()
         md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
         smapTech = Effects::BuildShadowMapFX->BuildShadowMapTech;
         tessSmapTech = Effects::BuildShadowMapFX->TessBuildShadowMapTech;
+        instancedSmapTech = Effects::BuildShadowMapFX->TessBuildShadowMapInstancedTech;
         break;
     }
 
+    // The same for the tree, shapes and skull when their buffers are packed; the cloth
+    // keeps the float techniques.
+    ID3DX11EffectTechnique* meshSmapTech = tessSmapTech;
+    ID3DX11EffectTechnique* meshInstancedSmapTech = instancedSmapTech;
+    ID3DX11EffectTechnique* sphereSmapTech = smapTech;
+    ID3DX11EffectTechnique* skullSmapTech = Effects::BuildShadowMapFX->BuildShadowMapTech;
+    if(mPackedVertices)
+    {
+        bool tess = mRenderOptions == RenderOptionsDisplacementMap;
+        meshSmapTech = tess ? Effects::BuildShadowMapFX->TessBuildShadowMapPackedTech
+            : Effects::BuildShadowMapFX->BuildShadowMapPackedTech;
+        meshInstancedSmapTech = tess ? Effects::BuildShadowMapFX->TessBuildShadowMapInstancedPackedTech
+            : Effects::BuildShadowMapFX->BuildShadowMapInstancedPackedTech;
+        sphereSmapTech = Effects::BuildShadowMapFX->BuildShadowMapPackedTech;
+        skullSmapTech = Effects::BuildShadowMapFX->BuildShadowMapPackedTech;
+    }
+
+    bool instanced = UseInstancing(meshInstancedSmapTech);
+
     XMMATRIX world;
     XMMATRIX worldInvTranspose;
     XMMATRIX worldViewProj;
 
     // Draw Loaded Objects
-    UINT stride = sizeof(Vertex::PosNormalTexTan);
+    UINT meshStride = mPackedVertices ? sizeof(PackedVertexPosNormalTexTan) : sizeof(Vertex::PosNormalTexTan);
+    ID3D11InputLayout* meshLayout = mPackedVertices ? InputLayouts::PackedPosNormalTexTan : InputLayouts::PosNormalTexTan;
+    UINT stride = meshStride;
     UINT offset = 0;
     D3DX11_TECHNIQUE_DESC techDesc;
 
-    md3dImmediateContext->IASetInputLayout(InputLayouts::PosNormalTexTan);
+    md3dImmediateContext->IASetInputLayout(meshLayout);
     md3dImmediateContext->IASetVertexBuffers(0, 1, &mTreeVB, &stride, &offset);
     md3dImmediateContext->IASetIndexBuffer(mTreeIB, DXGI_FORMAT_R32_UINT, 0);
+    Effects::BuildShadowMapFX->SetVertexQuantization(mTreeQuantization.Offset, mTreeQuantization.Scale);
      
-    tessSmapTech->GetDesc( &techDesc );
-    for(UINT p = 0; p < techDesc.Passes; ++p)
+    if(instanced)
     {
-        // Draw the trees.
-        for(int i = 0; i < mTreecount; i++)
+        Effects::BuildShadowMapFX->SetWorld(XMMatrixIdentity());
+        Effects::BuildShadowMapFX->SetWorldInvTranspose(XMMatrixIdentity());
+        Effects::BuildShadowMapFX->SetWorldViewProj(viewProj);
+        Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(2.0f, 4.0f, 2.0f));
+
+        meshInstancedSmapTech->GetDesc( &techDesc );
+        for(UINT p = 0; p < techDesc.Passes; ++p)
         {
-            world = XMLoadFloat4x4(&mTreeWorld[i]);
-            worldInvTranspose = MathHelper::InverseTranspose(world);
-            worldViewProj = world*view*proj;
+            meshInstancedSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+            DrawInstanceLods(mTreeVB, mPackedVertices, InstanceBatchTree, mTreeLods, 0);
+        }
+    }
+    else
+    {
+        meshSmapTech->GetDesc( &techDesc );
+        for(UINT p = 0; p < techDesc.Passes; ++p)
+        {
+            // Draw the trees.
+            for(size_t i = 0; i < mVisible.Trees.size(); i++)
+            {
+                world = XMLoadFloat4x4(&mTreeWorld[mVisible.Trees[i]]);
+                worldInvTranspose = MathHelper::InverseTranspose(world);
+                worldViewProj = world*view*proj;
             
-            Effects::BuildShadowMapFX->SetWorld(world);
-            Effects::BuildShadowMapFX->SetWorldInvTranspose(worldInvTranspose);
-            Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
-            Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(2.0f, 4.0f, 2.0f));
-
-            tessSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-            md3dImmediateContext->DrawIndexed(mTreeIndexCount, 0, 0);
+                Effects::BuildShadowMapFX->SetWorld(world);
+                Effects::BuildShadowMapFX->SetWorldInvTranspose(worldInvTranspose);
+                Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
+                Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(2.0f, 4.0f, 2.0f));
+
+                const MeshLod& lod = mTreeLods[mVisible.TreeLods[i]];
+                meshSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+                md3dImmediateContext->DrawIndexed(lod.NumIndices, lod.FirstIndex, 0);
+            }
         }
     }
 
+    stride = sizeof(Vertex::Basic32);
+
 	md3dImmediateContext->IASetInputLayout(InputLayouts::Basic32);
     md3dImmediateContext->IASetVertexBuffers(0, 1, &mClothVB, &stride, &offset);
     md3dImmediateContext->IASetIndexBuffer(mClothIB, DXGI_FORMAT_R32_UINT, 0);
@@ -2284,14 +2738,15 @@ void ZeusApp::DrawSceneToShadowMap()
     }
 
     // Draw the grid, cylinders, and box.
-    stride = sizeof(Vertex::PosNormalTexTan);
+    stride = meshStride;
     offset = 0;
 
-    md3dImmediateContext->IASetInputLayout(InputLayouts::PosNormalTexTan);
+    md3dImmediateContext->IASetInputLayout(meshLayout);
     md3dImmediateContext->IASetVertexBuffers(0, 1, &mShapesVB, &stride, &offset);
     md3dImmediateContext->IASetIndexBuffer(mShapesIB, DXGI_FORMAT_R32_UINT, 0);
+    Effects::BuildShadowMapFX->SetVertexQuantization(mShapesQuantization.Offset, mShapesQuantization.Scale);
     
-    tessSmapTech->GetDesc( &techDesc );
+    meshSmapTech->GetDesc( &techDesc );
     for(UINT p = 0; p < techDesc.Passes; ++p)
     {
         // Draw the grid.
@@ -2304,39 +2759,58 @@ void ZeusApp::DrawSceneToShadowMap()
         Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
         Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(8.0f, 10.0f, 1.0f));
 
-        tessSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+        meshSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
         md3dImmediateContext->DrawIndexed(mGridIndexCount, mGridIndexOffset, mGridVertexOffset);
 
-        // Draw the box.
-		for(int i = 0; i < mPhysX->GetNumBoxes(); i++)
-		{
-			world = XMLoadFloat4x4(&mBoxWorld[i]);
-			worldInvTranspose = MathHelper::InverseTranspose(world);
-			worldViewProj = world*view*proj;
-
-			Effects::BuildShadowMapFX->SetWorld(world);
-			Effects::BuildShadowMapFX->SetWorldInvTranspose(worldInvTranspose);
-			Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
-			Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(2.0f, 1.0f, 1.0f));
-
-			tessSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-			md3dImmediateContext->DrawIndexed(mBoxIndexCount, mBoxIndexOffset, mBoxVertexOffset);
-		}
-
-        // Draw the cylinders.
-        for(int i = 0; i < 5; ++i)
+        if(instanced)
         {
-            world = XMLoadFloat4x4(&mCylWorld[i]);
-            worldInvTranspose = MathHelper::InverseTranspose(world);
-            worldViewProj = world*view*proj;
+            Effects::BuildShadowMapFX->SetWorld(XMMatrixIdentity());
+            Effects::BuildShadowMapFX->SetWorldInvTranspose(XMMatrixIdentity());
+            Effects::BuildShadowMapFX->SetWorldViewProj(viewProj);
+            Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(2.0f, 1.0f, 1.0f));
+            meshInstancedSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+            DrawInstanceLods(mShapesVB, mPackedVertices, InstanceBatchBox, mBoxLods, mBoxVertexOffset);
 
-            Effects::BuildShadowMapFX->SetWorld(world);
-            Effects::BuildShadowMapFX->SetWorldInvTranspose(worldInvTranspose);
-            Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
             Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
+            meshInstancedSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+            DrawInstanceLods(mShapesVB, mPackedVertices, InstanceBatchCylinder, mCylinderLods, mCylinderVertexOffset);
+        }
+        else
+        {
+            // Draw the box.
+    		const XMFLOAT4X4* boxWorlds = mPhysX->GetBoxWorlds();
+    		for(size_t i = 0; i < mVisible.Boxes.size(); i++)
+    		{
+    			world = XMLoadFloat4x4(&boxWorlds[mVisible.Boxes[i]]);
+    			worldInvTranspose = MathHelper::InverseTranspose(world);
+    			worldViewProj = world*view*proj;
+
+    			Effects::BuildShadowMapFX->SetWorld(world);
+    			Effects::BuildShadowMapFX->SetWorldInvTranspose(worldInvTranspose);
+    			Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
+    			Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(2.0f, 1.0f, 1.0f));
+
+    			const MeshLod& lod = mBoxLods[mVisible.BoxLods[i]];
+    			meshSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+    			md3dImmediateContext->DrawIndexed(lod.NumIndices, lod.FirstIndex, mBoxVertexOffset);
+    		}
+
+            // Draw the cylinders.
+            for(size_t i = 0; i < mVisible.Cylinders.size(); ++i)
+            {
+                world = XMLoadFloat4x4(&mCylWorld[mVisible.Cylinders[i]]);
+                worldInvTranspose = MathHelper::InverseTranspose(world);
+                worldViewProj = world*view*proj;
+
+                Effects::BuildShadowMapFX->SetWorld(world);
+                Effects::BuildShadowMapFX->SetWorldInvTranspose(worldInvTranspose);
+                Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
+                Effects::BuildShadowMapFX->SetTexTransform(XMMatrixScaling(1.0f, 2.0f, 1.0f));
 
-            tessSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-            md3dImmediateContext->DrawIndexed(mCylinderIndexCount, mCylinderIndexOffset, mCylinderVertexOffset);
+                const MeshLod& lod = mCylinderLods[mVisible.CylinderLods[i]];
+                meshSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+                md3dImmediateContext->DrawIndexed(lod.NumIndices, lod.FirstIndex, mCylinderVertexOffset);
+            }
         }
     }
 
@@ -2347,13 +2821,13 @@ void ZeusApp::DrawSceneToShadowMap()
     md3dImmediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
     // Draw the spheres with cubemap reflection.
-    smapTech->GetDesc( &techDesc );
+    sphereSmapTech->GetDesc( &techDesc );
     for(UINT p = 0; p < techDesc.Passes; ++p)
     {
         // Draw the spheres.
-        for(int i = 0; i < 5; ++i)
+        for(size_t i = 0; i < mVisible.Spheres.size(); ++i)
         {
-            world = XMLoadFloat4x4(&mSphereWorld[i]);
+            world = XMLoadFloat4x4(&mSphereWorld[mVisible.Spheres[i]]);
             worldInvTranspose = MathHelper::InverseTranspose(world);
             worldViewProj = world*view*proj;
 
@@ -2362,22 +2836,29 @@ void ZeusApp::DrawSceneToShadowMap()
             Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
             Effects::BuildShadowMapFX->SetTexTransform(XMMatrixIdentity());
 
-            smapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+            sphereSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
             md3dImmediateContext->DrawIndexed(mSphereIndexCount, mSphereIndexOffset, mSphereVertexOffset);
         }
     }
 
-    stride = sizeof(Vertex::Basic32);
+    stride = mPackedVertices ? sizeof(PackedVertexBasic) : sizeof(Vertex::Basic32);
     offset = 0;
 
     md3dImmediateContext->RSSetState(0);
 
-    md3dImmediateContext->IASetInputLayout(InputLayouts::Basic32);
+    md3dImmediateContext->IASetInputLayout(mPackedVertices ? InputLayouts::PackedBasic : InputLayouts::Basic32);
     md3dImmediateContext->IASetVertexBuffers(0, 1, &mSkullVB, &stride, &offset);
     md3dImmediateContext->IASetIndexBuffer(mSkullIB, DXGI_FORMAT_R32_UINT, 0);
+    Effects::BuildShadowMapFX->SetVertexQuantization(mSkullQuantization.Offset, mSkullQuantization.Scale);
+
+    // The skull is scaled by its world, which SelectInstances accounts for.
+    std::vector<UINT> onlySkull(1, 0), skullLod;
+    lodSelector.SelectInstances(mSkullLods.empty() ? 0 : &mSkullLods[0], (UINT)mSkullLods.size(), mSkullBox,
+        &mSkullWorld, onlySkull, skullLod);
+    UINT skullFirstIndex = mSkullLods.empty() ? 0 : mSkullLods[skullLod[0]].FirstIndex;
+    UINT skullIndexCount = mSkullLods.empty() ? 0 : mSkullLods[skullLod[0]].NumIndices;
 
-    smapTech = Effects::BuildShadowMapFX->BuildShadowMapTech;
-    smapTech->GetDesc( &techDesc );
+    skullSmapTech->GetDesc( &techDesc );
     for(UINT p = 0; p < techDesc.Passes; ++p)
     {
         // Draw the Skull.
@@ -2390,8 +2871,8 @@ void ZeusApp::DrawSceneToShadowMap()
         Effects::BuildShadowMapFX->SetWorldViewProj(worldViewProj);
         Effects::BuildShadowMapFX->SetTexTransform(XMMatrixIdentity());
 
-        smapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
-        md3dImmediateContext->DrawIndexed(mSkullIndexCount, 0, 0);
+        skullSmapTech->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
+        md3dImmediateContext->DrawIndexed(skullIndexCount, skullFirstIndex, 0);
     }
 }
 
@@ -2463,23 +2944,40 @@ void ZeusApp::BuildShapeGeometryBuffers()
     geoGen.CreateSphere(1.0f, 20, 20, sphere);
     geoGen.CreateCylinder(0.5f, 0.5f, 3.0f, 15, 15, cylinder);
 
+    // Drawn in every shadow, cube map and main pass; reorder them once here.
+    MeshOptimizer::OptimizeMesh(box);
+    MeshOptimizer::OptimizeMesh(sphere);
+    MeshOptimizer::OptimizeMesh(cylinder);
+
+    // The instanced shapes get coarser levels after their own indices.  The box has
+    // nothing to lose and keeps one.
+    MeshSimplifier::BuildLodChain(box.Indices, (UINT)box.Indices.size(), &box.Vertices[0],
+        sizeof(GeometryGenerator::Vertex), (UINT)box.Vertices.size(), MaxMeshLods, mBoxLods);
+    MeshSimplifier::BuildLodChain(cylinder.Indices, (UINT)cylinder.Indices.size(), &cylinder.Vertices[0],
+        sizeof(GeometryGenerator::Vertex), (UINT)cylinder.Vertices.size(), MaxMeshLods, mCylinderLods);
+
     // Cache the vertex offsets to each object in the concatenated vertex buffer.
     mBoxVertexOffset      = 0;
     mGridVertexOffset     = box.Vertices.size();
     mSphereVertexOffset   = mGridVertexOffset + grid.Vertices.size();
     mCylinderVertexOffset = mSphereVertexOffset + sphere.Vertices.size();
 
-    // Cache the index count of each object.
-    mBoxIndexCount      = box.Indices.size();
+    // Cache the index count of each object, LOD 0's for the box and cylinder.
+    mBoxIndexCount      = mBoxLods[0].NumIndices;
     mGridIndexCount     = grid.Indices.size();
     mSphereIndexCount   = sphere.Indices.size();
-    mCylinderIndexCount = cylinder.Indices.size();
+    mCylinderIndexCount = mCylinderLods[0].NumIndices;
 
     // Cache the starting index for each object in the concatenated index buffer.
     mBoxIndexOffset      = 0;
-    mGridIndexOffset     = mBoxIndexCount;
+    mGridIndexOffset     = mBoxIndexOffset + box.Indices.size();
     mSphereIndexOffset   = mGridIndexOffset + mGridIndexCount;
     mCylinderIndexOffset = mSphereIndexOffset + mSphereIndexCount;
+
+    for(size_t i = 0; i < mBoxLods.size(); ++i)
+        mBoxLods[i].FirstIndex += mBoxIndexOffset;
+    for(size_t i = 0; i < mCylinderLods.size(); ++i)
+        mCylinderLods[i].FirstIndex += mCylinderIndexOffset;
     
     UINT totalVertexCount = 
         box.Vertices.size() + 
@@ -2488,10 +2986,10 @@ void ZeusApp::BuildShapeGeometryBuffers()
         cylinder.Vertices.size();
 
     UINT totalIndexCount = 
-        mBoxIndexCount + 
+        box.Indices.size() + 
         mGridIndexCount + 
         mSphereIndexCount +
-        mCylinderIndexCount;
+        cylinder.Indices.size();
 
     // Extract the vertex elements we are interested in and pack the vertices of all the meshes into one vertex buffer.
     std::vector<Vertex::PosNormalTexTan> vertices(totalVertexCount);
@@ -2529,14 +3027,30 @@ void ZeusApp::BuildShapeGeometryBuffers()
         vertices[k].TangentU = cylinder.Vertices[i].TangentU;
     }
 
+    // One quantization over the union of the shapes, since they share the buffer.
+    UINT vertexStride = sizeof(Vertex::PosNormalTexTan);
+    const void* vertexData = &vertices[0];
+    std::vector<PackedVertexPosNormalTexTan> packed;
+    if(mPackedVertices)
+    {
+        XNA::AxisAlignedBox bounds;
+        XNA::ComputeBoundingAxisAlignedBoxFromPoints(&bounds, totalVertexCount, &vertices[0].Pos, sizeof(Vertex::PosNormalTexTan));
+        mShapesQuantization = VertexPacker::GetQuantization(bounds);
+
+        packed.resize(totalVertexCount);
+        VertexPacker::Pack(&packed[0], (const MeshVertexPosNormalTexTan*)&vertices[0], totalVertexCount, mShapesQuantization);
+        vertexStride = sizeof(PackedVertexPosNormalTexTan);
+        vertexData = &packed[0];
+    }
+
     D3D11_BUFFER_DESC vbd;
     vbd.Usage = D3D11_USAGE_IMMUTABLE;
-    vbd.ByteWidth = sizeof(Vertex::PosNormalTexTan) * totalVertexCount;
+    vbd.ByteWidth = vertexStride * totalVertexCount;
     vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     vbd.CPUAccessFlags = 0;
     vbd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA vinitData;
-    vinitData.pSysMem = &vertices[0];
+    vinitData.pSysMem = vertexData;
     HR(md3dDevice->CreateBuffer(&vbd, &vinitData, &mShapesVB));
 
     // Pack the indices of all the meshes into one index buffer.
@@ -2557,65 +3071,37 @@ void ZeusApp::BuildShapeGeometryBuffers()
     HR(md3dDevice->CreateBuffer(&ibd, &iinitData, &mShapesIB));
 }
  
-int normal = 0;
-int tex = 0;
 void ZeusApp::BuildSkullGeometryBuffers()
 {
-    std::ifstream fin("Models/cow.obj");
-    
-    if(!fin)
+    // Models/cow.zmsh is cow.obj converted, and is rebuilt when the OBJ is newer or it
+    // was written in the other vertex format.  The buffers are created straight from
+    // its mapping.
+    MeshFile::VertexFormat format = mPackedVertices ? MeshFile::FormatPackedBasic : MeshFile::FormatBasic32;
+    MeshFile mesh;
+    if( MeshFile::IsStale("Models/cow.zmsh", "Models/cow.obj") || !mesh.Open("Models/cow.zmsh") ||
+        mesh.GetVertexFormat() != format )
     {
-        MessageBox(0, L"Models/cow.obj not found.", 0, 0);
-        return;
-    }
-
-    char line[100];
-    float x = 0, y = 0, z = 0;
-    //int normal = 1;
-    normal = 0;
-    std::vector<Vertex::Basic32> vertices;
-    std::vector<int> indices;
-    std::vector<Vertex::Basic32> verts;
-    //std::vector<Vertex::Basic32> norms;
-    normal = 0;
-    while( !fin.eof() ) {
-        fin >> line;
-
-        if( strcmp( line, "#" ) == 0 ) {
-            // Read in the comment and do nothing
-            fin.getline( line, 100);
-        } else {
-            if( strcmp( line, "f" ) == 0 ) {
-                for(int i = 0; i < 3; i++) {
-                    fin >> line;
-                    indices.push_back( atoi( strtok( line, "/" ) ) - 1 );
-                }
-            } else if (strcmp( line, "v" ) == 0 ) {
-                Vertex::Basic32 vertex;
-                fin >> vertex.Pos.x >> vertex.Pos.y >> vertex.Pos.z;
-                    
-                verts.push_back( vertex );
-            } else if (strcmp( line, "vn" ) == 0 ) {
-                fin >> verts[normal].Normal.x >> verts[normal].Normal.y >> verts[normal].Normal.z;
-                normal++;
-            }
+        mesh.Close();
+        if( !MeshFile::ConvertObj("Models/cow.obj", "Models/cow.zmsh", format) || !mesh.Open("Models/cow.zmsh") )
+        {
+            MessageBox(0, L"Models/cow.obj not found.", 0, 0);
+            return;
         }
     }
 
-    for(int i = 0; i < verts.size(); i++) {
-        vertices.push_back(verts[i]);
-    }
-    mSkullIndexCount = indices.size();
-    fin.close();
+    mSkullQuantization = mesh.GetQuantization();
+    mSkullLods.assign(mesh.GetLods(), mesh.GetLods() + mesh.GetNumLods());
+    mSkullIndexCount = mSkullLods[0].NumIndices;
+    mSkullBox = mesh.GetBounds();
 
     D3D11_BUFFER_DESC vbd;
     vbd.Usage = D3D11_USAGE_IMMUTABLE;
-    vbd.ByteWidth = sizeof(Vertex::Basic32) * vertices.size();
+    vbd.ByteWidth = mesh.GetVertexStride() * mesh.GetNumVertices();
     vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     vbd.CPUAccessFlags = 0;
     vbd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA vinitData;
-    vinitData.pSysMem = &vertices[0];
+    vinitData.pSysMem = mesh.GetVertices();
     HR(md3dDevice->CreateBuffer(&vbd, &vinitData, &mSkullVB));
 
     //
@@ -2624,12 +3110,12 @@ void ZeusApp::BuildSkullGeometryBuffers()
 
     D3D11_BUFFER_DESC ibd;
     ibd.Usage = D3D11_USAGE_IMMUTABLE;
-    ibd.ByteWidth = sizeof(UINT) * mSkullIndexCount;
+    ibd.ByteWidth = sizeof(UINT) * mesh.GetNumIndices();
     ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
     ibd.CPUAccessFlags = 0;
     ibd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &indices[0];
+    iinitData.pSysMem = mesh.GetIndices();
     HR(md3dDevice->CreateBuffer(&ibd, &iinitData, &mSkullIB));
 }
 
@@ -2675,93 +3161,96 @@ void ZeusApp::BuildScreenQuadGeometryBuffers()
 
 void ZeusApp::LoadTreeBuffer()
 {
-    std::ifstream fin("Models/tree1.obj");
-    if(!fin)
-    {
-        MessageBox(0, L"Models/tree1.obj not found.", 0, 0);
-        return;
-    }
+    std::vector<MeshVertexPosNormalTexTan> vertices;
+    std::vector<UINT> indices;
 
-    char line[100];
-    float x = 0, y = 0, z = 0;
-    //int normal;
-    std::vector<Vertex::PosNormalTexTan> vertices;
-    std::vector<int> indices;
-    std::vector<Vertex::PosNormalTexTan> verts;
-	std::vector<XMFLOAT3> positions;
-	std::vector<XMFLOAT3> norms;
-	std::vector<XMFLOAT2> texVec;
-	std::vector<int> texNum;
-    //std::vector<Vertex::Basic32> norms;
-    normal = 0;
-    tex = 0;
- //   while( !fin.eof() ) {
- //       fin >> line;
-
- //       if( strcmp( line, "#" ) == 0 ) {
- //           // Read in the comment and do nothing
- //           fin.getline( line, 100);
- //       } else {
- //           if( strcmp( line, "f" ) == 0 ) {
- //               for(int i = 0; i < 3; i++) {
- //                   fin >> line;
- //                   indices.push_back( atoi( strtok( line, "/" ) ) - 1 );
- //               }
- //           } else if (strcmp( line, "v" ) == 0 ) {
- //               Vertex::Basic32 vertex;
- //               fin >> vertex.Pos.x >> vertex.Pos.y >> vertex.Pos.z;
- //                   
- //               verts.push_back( vertex );
- //           } else if (strcmp( line, "vn" ) == 0 ) {
- //               fin >> verts[normal].Normal.x >> verts[normal].Normal.y >> verts[normal].Normal.z;
- //               normal++;
- //           } else if (strcmp( line, "vt" ) == 0 ) {
- //               fin >> verts[tex].Tex.x >> verts[tex].Tex.y;
- //               tex++;
- //           }
- //       }
- //   }
-	//fin.close();
- //   
-	//for(int i = 0; i < verts.size(); i++) {
- //       vertices.push_back(verts[i]);
-	//	positions.push_back(verts[i].Pos);
- //   }
-	
-	Import("Models/bigbadman.fbx", &positions, &indices, &norms, &texVec, &texNum);
+	// The FBX SDK only runs when Models/bigbadman.zmsh is missing, older than the FBX
+	// or in the other vertex format; otherwise the vertices built below are mapped back
+	// in as they were written.
+	MeshFile::VertexFormat format = mPackedVertices ? MeshFile::FormatPackedPosNormalTexTan : MeshFile::FormatPosNormalTexTan;
+	MeshFile mesh;
+	if(MeshFile::IsStale("Models/bigbadman.zmsh", "Models/bigbadman.fbx") || !mesh.Open("Models/bigbadman.zmsh") ||
+		mesh.GetVertexFormat() != format)
+	{
+		mesh.Close();
 
-	Vertex::PosNormalTexTan tempVert;
+		FbxMeshImporter importer;
+		if(!importer.Import("Models/bigbadman.fbx"))
+		{
+			MessageBoxA(0, importer.GetError().c_str(), 0, 0);
+			return;
+		}
 
-	XMVECTOR p;
-	XMVECTOR n;
-	for(int i = 0; i < positions.size(); i++)
-	{
-		p = XMVectorSet(positions[i].x, positions[i].y,positions[i].z, 1.0 );
-		n = XMVectorSet(norms[i].x, norms[i].y, norms[i].z, 1.0 );
-		XMVECTOR cross = XMVector3Cross(p, n);
-		XMStoreFloat3(&tempVert.TangentU, cross);
+		const std::vector<WeldVertex>& imported = importer.GetVertices();
+		const std::vector<MeshSubmesh>& submeshes = importer.GetSubmeshes();
+		indices.assign(importer.GetIndices().begin(), importer.GetIndices().end());
+
+		MeshVertexPosNormalTexTan tempVert;
+		for(size_t i = 0; i < imported.size(); i++)
+		{
+			const WeldVertex& v = imported[i];
+			tempVert.Pos = v.Position;
+			tempVert.Normal = v.Normal;
+			tempVert.Tex = v.TexC;
+			tempVert.TexNum = v.Material;
+			tempVert.TangentU = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+			vertices.push_back(tempVert);
+		}
+
+		// Splits vertices where the texture is mirrored; the submeshes' index ranges
+		// are unchanged.
+		TangentGenerator::Generate(vertices, indices);
+
+		// The chain simplifies across submeshes; TexNum differs between materials, so
+		// their boundaries are seams and stay put.
+		UINT numVertices = (UINT)vertices.size();
+		UINT numIndices = (UINT)indices.size();
+		std::vector<MeshLod> lods;
+		if(!vertices.empty() && !indices.empty())
+		{
+			MeshOptimizer::OptimizeMesh(&vertices[0], sizeof(MeshVertexPosNormalTexTan), numVertices, &indices[0],
+				numIndices, submeshes.empty() ? 0 : &submeshes[0], (UINT)submeshes.size());
+			vertices.resize(numVertices);
+			MeshSimplifier::BuildLodChain(indices, numIndices, &vertices[0], sizeof(MeshVertexPosNormalTexTan),
+				numVertices, MaxMeshLods, lods);
+		}
 
-		tempVert.Pos = positions[i];
-		tempVert.Normal = norms[i];
-		tempVert.Tex = texVec[i];
-		tempVert.TexNum = texNum[i];
+		if(vertices.empty() || indices.empty() ||
+			!MeshFile::Write("Models/bigbadman.zmsh", format, &vertices[0], (UINT)vertices.size(),
+				&indices[0], (UINT)indices.size(), submeshes.empty() ? 0 : &submeshes[0], (UINT)submeshes.size(),
+				&lods[0], (UINT)lods.size()))
+		{
+			MessageBox(0, L"Models/bigbadman.zmsh could not be written.", 0, 0);
+			return;
+		}
 
-		vertices.push_back(tempVert);
+		if(!mesh.Open("Models/bigbadman.zmsh"))
+		{
+			MessageBox(0, L"Models/bigbadman.zmsh not found.", 0, 0);
+			return;
+		}
 	}
 
-    mTreeIndexCount = indices.size();
-    mTreeVertCount = positions.size();
-	mTreepositions = positions;
-	mTreeIndices = indices;
+	// PhysX cooks the trees from its own copies of the positions and LOD 0's indices.
+	mTreeLods.assign(mesh.GetLods(), mesh.GetLods() + mesh.GetNumLods());
+	mTreeIndexCount = mTreeLods[0].NumIndices;
+	mTreeVertCount = mesh.GetNumVertices();
+	mTreepositions.resize(mTreeVertCount);
+	for(int i = 0; i < mTreeVertCount; i++)
+		mTreepositions[i] = mesh.GetPosition(i);
+	mTreeIndices.assign(mesh.GetIndices(), mesh.GetIndices() + mTreeIndexCount);
+	mTreeBounds = mesh.GetBounds();
+	mTreeQuantization = mesh.GetQuantization();
 
     D3D11_BUFFER_DESC vbd;
     vbd.Usage = D3D11_USAGE_IMMUTABLE;
-    vbd.ByteWidth = sizeof(Vertex::PosNormalTexTan) * vertices.size();
+    vbd.ByteWidth = mesh.GetVertexStride() * mesh.GetNumVertices();
     vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     vbd.CPUAccessFlags = 0;
     vbd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA vinitData;
-    vinitData.pSysMem = &vertices[0];
+    vinitData.pSysMem = mesh.GetVertices();
     HR(md3dDevice->CreateBuffer(&vbd, &vinitData, &mTreeVB));
 
     //
@@ -2770,12 +3259,12 @@ void ZeusApp::LoadTreeBuffer()
 
     D3D11_BUFFER_DESC ibd;
     ibd.Usage = D3D11_USAGE_IMMUTABLE;
-    ibd.ByteWidth = sizeof(UINT) * mTreeIndexCount;
+    ibd.ByteWidth = sizeof(UINT) * mesh.GetNumIndices();
     ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
     ibd.CPUAccessFlags = 0;
     ibd.MiscFlags = 0;
     D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &indices[0];
+    iinitData.pSysMem = mesh.GetIndices();
     HR(md3dDevice->CreateBuffer(&ibd, &iinitData, &mTreeIB));
 }
 
@@ -2826,7 +3315,7 @@ void ZeusApp::CreateTreeMatrixes()
 		treeOffset = XMMatrixTranslation(treeposition.x,treeposition.y, treeposition.z);
 		XMStoreFloat4x4(&mTreeWorld[i], XMMatrixMultiply(treeScale, treeOffset));
 		CreatePhysXTriangleMesh(ObjectNumbers::tree, mTreeVertCount, mTreepositions,
-			mTreeIndexCount, mTreeIndices, treeposition.x, treeposition.y, treeposition.z);
+			mTreeIndexCount, mTreeIndices, treeposition.x, treeposition.y, treeposition.z, scale);
 	}
 }
 
@@ -2838,8 +3327,6 @@ void ZeusApp::LoadClothBuffer()
     std::vector<Vertex::Basic32> vertices;
     std::vector<int> indices;
     std::vector<Vertex::Basic32> verts;
-    normal = 0;
-    tex = 0;
 
 	Vertex::Basic32 vertex;
 	vector<XMFLOAT3> vertexices;
@@ -2936,10 +3423,21 @@ void ZeusApp::BuildInstancedBuffer()
             }
         }
     }
+
+    mSkullCuller.Resize((UINT)mInstancedData.size());
+    for(UINT i = 0; i < mInstancedData.size(); ++i)
+    {
+        XNA::AxisAlignedBox bounds;
+        PassCache::TransformBounds(bounds, mSkullBox, mInstancedData[i].World);
+        mSkullCuller.Set(i, bounds);
+    }
     
     D3D11_BUFFER_DESC vbd;
     vbd.Usage = D3D11_USAGE_DYNAMIC;
-    vbd.ByteWidth = sizeof(InstancedData) * mInstancedData.size();
+    // Room for every skull plus every box, cylinder and tree drawn instanced, for
+    // InstanceBufferPasses passes before the buffer is discarded.
+    mInstancedBufferCapacity = ((UINT)mInstancedData.size() + MAX_BOXES + 5 + mTreecount)*InstanceBufferPasses;
+    vbd.ByteWidth = sizeof(InstancedData) * mInstancedBufferCapacity;
     vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
     vbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     vbd.MiscFlags = 0;
@@ -2948,74 +3446,13 @@ void ZeusApp::BuildInstancedBuffer()
     HR(md3dDevice->CreateBuffer(&vbd, 0, &mInstancedBuffer));
 }
 
-
-void ZeusApp::PxtoXMMatrix(PxTransform input, XMMATRIX* start)
-{
-	
-	PxMat33 quat = PxMat33(input.q);
-
-	start->_11 = quat.column0[0];
-   start->_12 = quat.column0[1];
-   start->_13 = quat.column0[2];
-
-
-   start->_21 = quat.column1[0];
-   start->_22 = quat.column1[1];
-   start->_23 = quat.column1[2];
-
-
-   start->_31 = quat.column2[0];
-   start->_32 = quat.column2[1];
-   start->_33 = quat.column2[2];
-
-
-	start->_41 = input.p.x;
-	start->_42 = input.p.y;
-	start->_43 = input.p.z;
-	
-}
-
-void ZeusApp::CreatePhysXTriangleMesh(	ObjectNumbers objnum, int numVerts, std::vector<XMFLOAT3> verts,
-										int numInds, std::vector<int> inds, float x, float y, float z)
+void ZeusApp::CreatePhysXTriangleMesh(	ObjectNumbers objnum, int numVerts, const std::vector<XMFLOAT3>& verts,
+										int numInds, const std::vector<int>& inds, float x, float y, float z, float scale)
 
 {
-	PxVec3* vertices = new PxVec3[numVerts];
-	for(int i = 0; i < numVerts; i++)
-	{
-		vertices[i].x = verts[i].x;
-		vertices[i].y = verts[i].y;
-		vertices[i].z = verts[i].z;
-	}
-
-	int* indices = new int[numInds];
-	for(int i = 0; i < numInds; i++)
-	{
-		indices[i] = inds[i];
-	}
-
-	mPhysX->SetupTriangleMesh(objnum, numVerts, vertices, numInds, indices, x, y, z);
-	delete [] indices;
-	delete [] vertices;
-}
-
-void ZeusApp::CreatePhysXTriangleMeshTerrain( int numVerts, std::vector<XMFLOAT3> verts, int numInds, std::vector<int> inds)
-{
-	PxVec3* vertices = new PxVec3[numVerts];
-	for(int i = 0; i < numVerts; i++)
-	{
-		vertices[i].x = verts[i].x;
-		vertices[i].y = verts[i].y;
-		vertices[i].z = verts[i].z;
-	}
-
-	int* indices = new int[numInds];
-	for(int i = 0; i < numInds; i++)
-	{
-		indices[i] = inds[i];
-	}
-
-	mPhysX->CreateTerrain(numVerts,vertices,numInds,indices);
-	delete [] indices;
-	delete [] vertices;
+	// XMFLOAT3 and PxVec3 are both three packed floats, so the vectors are handed to
+	// PhysX as is.  Every tree shares one cooked mesh; see PhysX::GetTriangleMesh.
+	mPhysX->SetupTriangleMesh(objnum, numVerts, reinterpret_cast<const PxVec3*>(&verts[0]),
+		numInds, &inds[0], x, y, z, scale);
 }
 
@@ -19,7 +19,24 @@ ID3D11ShaderResourceView* d3dHelper::CreateTexture2DArraySRV(
 		UINT mipFilter)
 {
 	//
-	// Load the texture elements individually from file.  These textures
+	// DDS files used in their own format are read straight into one buffer, slice
+	// after slice, and the array is created with it as its initial data.
+	//
+
+	if(format == DXGI_FORMAT_FROM_FILE)
+	{
+		std::vector<std::string> names;
+		for(size_t i = 0; i < filenames.size(); ++i)
+			names.push_back(std::string(filenames[i].begin(), filenames[i].end()));
+
+		TextureData data;
+		if(data.LoadDdsArray(names))
+			return CreateTextureSRV(device, data, true);
+	}
+
+	//
+	// Otherwise D3DX has to decode or convert them.  Load the texture elements
+	// individually from file.  These textures
 	// won't be used by the GPU (0 bind flags), they are just used to 
 	// load the image data from file.  We use the STAGING usage so the
 	// CPU can read the resource.
@@ -122,6 +139,79 @@ ID3D11ShaderResourceView* d3dHelper::CreateTexture2DArraySRV(
 	return texArraySRV;
 }
 
+ID3D11ShaderResourceView* d3dHelper::CreateTextureSRV(ID3D11Device* device, const TextureData& data, bool arrayView)
+{
+	ID3D11ShaderResourceView* srv = 0;
+
+	if(data.IsEncoded())
+	{
+		HR(D3DX11CreateShaderResourceViewFromMemory(device, &data.Texels[0], data.Texels.size(), 0, 0, &srv, 0));
+		return srv;
+	}
+
+	D3D11_TEXTURE2D_DESC texDesc;
+	texDesc.Width              = data.Width;
+	texDesc.Height             = data.Height;
+	texDesc.MipLevels          = data.MipLevels;
+	texDesc.ArraySize          = data.ArraySize;
+	texDesc.Format             = data.Format;
+	texDesc.SampleDesc.Count   = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage              = D3D11_USAGE_IMMUTABLE;
+	texDesc.BindFlags          = D3D11_BIND_SHADER_RESOURCE;
+	texDesc.CPUAccessFlags     = 0;
+	texDesc.MiscFlags          = data.CubeMap ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initData(data.Subresources.size());
+	for(size_t i = 0; i < initData.size(); ++i)
+	{
+		initData[i].pSysMem          = data.GetTexels((UINT)i);
+		initData[i].SysMemPitch      = data.Subresources[i].RowPitch;
+		initData[i].SysMemSlicePitch = data.Subresources[i].SlicePitch;
+	}
+
+	ID3D11Texture2D* tex = 0;
+	HR(device->CreateTexture2D(&texDesc, &initData[0], &tex));
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = data.Format;
+	if(data.CubeMap && data.ArraySize == 6)
+	{
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+		viewDesc.TextureCube.MostDetailedMip = 0;
+		viewDesc.TextureCube.MipLevels = data.MipLevels;
+	}
+	else if(data.CubeMap)
+	{
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+		viewDesc.TextureCubeArray.MostDetailedMip = 0;
+		viewDesc.TextureCubeArray.MipLevels = data.MipLevels;
+		viewDesc.TextureCubeArray.First2DArrayFace = 0;
+		viewDesc.TextureCubeArray.NumCubes = data.ArraySize / 6;
+	}
+	else if(arrayView || data.ArraySize > 1)
+	{
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		viewDesc.Texture2DArray.MostDetailedMip = 0;
+		viewDesc.Texture2DArray.MipLevels = data.MipLevels;
+		viewDesc.Texture2DArray.FirstArraySlice = 0;
+		viewDesc.Texture2DArray.ArraySize = data.ArraySize;
+	}
+	else
+	{
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		viewDesc.Texture2D.MostDetailedMip = 0;
+		viewDesc.Texture2D.MipLevels = data.MipLevels;
+	}
+
+	HR(device->CreateShaderResourceView(tex, &viewDesc, &srv));
+
+	// The view keeps the texture alive.
+	ReleaseCOM(tex);
+
+	return srv;
+}
+
 ID3D11ShaderResourceView* d3dHelper::CreateRandomTexture1DSRV(ID3D11Device* device)
 {
 	// 
@@ -174,61 +264,3 @@ ID3D11ShaderResourceView* d3dHelper::CreateRandomTexture1DSRV(ID3D11Device* devi
 
 	return randomTexSRV;
 }
-
-void ExtractFrustumPlanes(XMFLOAT4 planes[6], CXMMATRIX M)
-{
-	//
-	// Left
-	//
-	planes[0].x = M(0,3) + M(0,0);
-	planes[0].y = M(1,3) + M(1,0);
-	planes[0].z = M(2,3) + M(2,0);
-	planes[0].w = M(3,3) + M(3,0);
-
-	//
-	// Right
-	//
-	planes[1].x = M(0,3) - M(0,0);
-	planes[1].y = M(1,3) - M(1,0);
-	planes[1].z = M(2,3) - M(2,0);
-	planes[1].w = M(3,3) - M(3,0);
-
-	//
-	// Bottom
-	//
-	planes[2].x = M(0,3) + M(0,1);
-	planes[2].y = M(1,3) + M(1,1);
-	planes[2].z = M(2,3) + M(2,1);
-	planes[2].w = M(3,3) + M(3,1);
-
-	//
-	// Top
-	//
-	planes[3].x = M(0,3) - M(0,1);
-	planes[3].y = M(1,3) - M(1,1);
-	planes[3].z = M(2,3) - M(2,1);
-	planes[3].w = M(3,3) - M(3,1);
-
-	//
-	// Near
-	//
-	planes[4].x = M(0,2);
-	planes[4].y = M(1,2);
-	planes[4].z = M(2,2);
-	planes[4].w = M(3,2);
-
-	//
-	// Far
-	//
-	planes[5].x = M(0,3) - M(0,2);
-	planes[5].y = M(1,3) - M(1,2);
-	planes[5].z = M(2,3) - M(2,2);
-	planes[5].w = M(3,3) - M(3,2);
-
-	// Normalize the plane equations.
-	for(int i = 0; i < 6; ++i)
-	{
-		XMVECTOR v = XMPlaneNormalize(XMLoadFloat4(&planes[i]));
-		XMStoreFloat4(&planes[i], v);
-	}
-}
\ No newline at end of file
@@ -30,6 +30,7 @@
 #include <vector>
 #include "MathHelper.h"
 #include "LightHelper.h"
+#include "TextureData.h"
 
 //---------------------------------------------------------------------------------------
 // Simple d3d error checker for book demos.
@@ -74,8 +75,9 @@ class d3dHelper
 {
 public:
 	///<summary>
-	/// 
-	/// Does not work with compressed formats.
+	/// DDS files kept in their own format go through TextureData and may be compressed.
+	/// Converting to another format goes through D3DX and staging textures, and does
+	/// not work with compressed formats.
 	///</summary>
 	static ID3D11ShaderResourceView* CreateTexture2DArraySRV(
 		ID3D11Device* device, ID3D11DeviceContext* context,
@@ -84,6 +86,13 @@ public:
 		UINT filter = D3DX11_FILTER_NONE, 
 		UINT mipFilter = D3DX11_FILTER_LINEAR);
 
+	///<summary>
+	/// Creates an immutable texture with all of data as its initial contents, or lets
+	/// D3DX decode it if it is an encoded image file.  arrayView asks for a
+	/// Texture2DArray view even of a single slice.
+	///</summary>
+	static ID3D11ShaderResourceView* CreateTextureSRV(ID3D11Device* device, const TextureData& data, bool arrayView = false);
+
 	static ID3D11ShaderResourceView* CreateRandomTexture1DSRV(ID3D11Device* device);
 };
 
@@ -111,9 +120,6 @@ public:
 	}
 };
 
-// Order: left, right, bottom, top, near, far.
-void ExtractFrustumPlanes(XMFLOAT4 planes[6], CXMMATRIX M);
-
 
 // #define XMGLOBALCONST extern CONST __declspec(selectany)
 //   1. extern so there is only one copy of the variable, and not a separate
@@ -1,241 +1,190 @@
-#include "importer.h"
-
-/*
-Make sure to include the fbx sdk and to link
-fbxsdk-2013.3d.lib
-or 
-fbxsdk-2013.3.lib
-*/
-
-using namespace std;
-
-//const char* lFilename = "traingles.fbx";
-const char* lFilename;
+//***************************************************************************************
+// importer.cpp
+//***************************************************************************************
 
-int size;
-int cornerIndex;
-int *index;
-
-int texNo = -1;
-
-FbxVector4 fbxVertex;
-FbxVector4 fbxNormal;
-FbxVector2 fbxUV;
+#include "importer.h"
+#include "ParallelFor.h"
+#include <fbxsdk.h>
 
-vector<XMFLOAT3> *vertices;
-vector<XMFLOAT3> *normals;
-vector<XMFLOAT2> *texcoords;
-vector<int>	 *indices;
-vector<int>    *texnum;
-// recursive DisplayContent Where the magic happens
-void DisplayContent(KFbxNode* pNode)
+namespace
 {
-	FbxVector4 v4; // Default translation values
-	cout << "Child name: " << pNode->GetName() << endl;
-
-	FbxMesh *mesh = pNode->GetMesh();
-
-	if(mesh)
+	struct MeshPart
 	{
-		FbxVector4* meshVertices = mesh->GetControlPoints();
-		int polygonCount = mesh->GetPolygonCount();
-		cout << "Polygon Count: " << polygonCount << endl;
+		FbxMesh* Mesh;
+
+		// Material of the part's first material slot.
+		int MaterialBase;
+		int NumMaterials;
 
-		int numIndices=mesh->GetPolygonVertexCount();
-		index = new int[numIndices];
-		index = mesh->GetPolygonVertices();
-		cout << "Num Indices: " << numIndices << endl;
+		bool Extracted;
+		std::vector<WeldVertex> Vertices;
+		std::vector<UINT> Indices;
+	};
 
-		//Because our engine doesnt support multiple meshes
-		size = vertices->size();
+	// Depth first, children in order, as the nodes appear in the file.
+	void GatherMeshes(FbxNode* root, std::vector<MeshPart>& parts)
+	{
+		std::vector<FbxNode*> stack;
+		stack.push_back(root);
 
-		for( int i = 0; i< polygonCount; i++)
+		int materialBase = 0;
+		while(!stack.empty())
 		{
-			int TriSize = mesh->GetPolygonSize(i);//Should be 3
+			FbxNode* node = stack.back();
+			stack.pop_back();
+			for(int i = node->GetChildCount() - 1; i >= 0; --i)
+				stack.push_back(node->GetChild(i));
 
-			for( int j =0; j<TriSize; j++)
-			{			
-				int index = mesh->GetPolygonVertex(i,j);
-				indices->push_back(index+size);
+			FbxMesh* mesh = node->GetMesh();
+			if(!mesh || mesh->GetControlPointsCount() == 0)
+				continue;
 
-			}
-			//cout << endl;
-		}
+			MeshPart part;
+			part.Mesh = mesh;
+			part.MaterialBase = materialBase;
+			part.NumMaterials = MathHelper::Max(node->GetMaterialCount(), 1);
+			part.Extracted = false;
+			parts.push_back(part);
 
-		//loadVectors( pNode, polygonCount, mesh, meshVertices );
-		int i, lControlPointsCount = mesh->GetControlPointsCount();
-		FbxVector4* lControlPoints = mesh->GetControlPoints();
+			materialBase += part.NumMaterials;
+		}
+	}
 
-		if( lControlPointsCount > 0 )
-			texNo++;
+	int GetPolygonMaterial(FbxMesh* mesh, int polygon, int numMaterials)
+	{
+		const FbxGeometryElementMaterial* element = mesh->GetElementMaterial(0);
+		if(!element)
+			return 0;
 
-		//		cout << "    Control Points" << endl;
+		int i = element->GetMappingMode() == FbxGeometryElement::eByPolygon ? polygon : 0;
+		int material = i < element->GetIndexArray().GetCount() ? element->GetIndexArray().GetAt(i) : 0;
+		return MathHelper::Clamp(material, 0, numMaterials - 1);
+	}
 
-		for (i = 0; i < lControlPointsCount; i++)
+	// Reads only; the SDK's getters on separate meshes are safe to call concurrently.
+	// The Polygon Vertex getters resolve each element's mapping and reference mode.
+	bool ExtractMesh(MeshPart& part)
+	{
+		FbxMesh* mesh = part.Mesh;
+		const FbxVector4* points = mesh->GetControlPoints();
+		int numPoints = mesh->GetControlPointsCount();
+		int numPolygons = mesh->GetPolygonCount();
+		bool hasNormals = mesh->GetElementNormalCount() > 0;
+
+		FbxStringList uvSets;
+		mesh->GetUVSetNames(uvSets);
+		const char* uvSet = uvSets.GetCount() > 0 ? uvSets.GetStringAt(0) : 0;
+
+		std::vector<int> sizes(numPolygons);
+		std::vector<WeldVertex> corners;
+		corners.reserve(mesh->GetPolygonVertexCount());
+		for(int p = 0; p < numPolygons; ++p)
 		{
-			//** VERTICES **//
-			vertices->push_back( XMFLOAT3((float)lControlPoints[i][0], (float)lControlPoints[i][1], (float)lControlPoints[i][2]));
-			texnum->push_back( texNo );
+			sizes[p] = mesh->GetPolygonSize(p);
+			if(sizes[p] < 0)
+				return false;
 
-			//** NORMALS **//
-			for (int j = 0; j < mesh->GetElementNormalCount(); j++)
+			int material = part.MaterialBase + GetPolygonMaterial(mesh, p, part.NumMaterials);
+			for(int j = 0; j < sizes[p]; ++j)
 			{
-				FbxGeometryElementNormal* leNormals = mesh->GetElementNormal( j);
-
-				if (leNormals->GetMappingMode() == FbxGeometryElement::eByControlPoint)
-				{
-					char header[100];
-					//					cout << "            normal Vector: "; 
-					if (leNormals->GetReferenceMode() == FbxGeometryElement::eDirect)
-					{
-						normals->push_back( XMFLOAT3( leNormals->GetDirectArray().GetAt(i)[0], 
-						leNormals->GetDirectArray().GetAt(i)[1], 
-						leNormals->GetDirectArray().GetAt(i)[2] ));
-					}
-				}
+				int point = mesh->GetPolygonVertex(p, j);
+				if(point < 0 || point >= numPoints)
+					return false;
+
+				FbxVector4 normal(0.0, 0.0, 0.0);
+				if(hasNormals)
+					mesh->GetPolygonVertexNormal(p, j, normal);
+
+				FbxVector2 uv(0.0, 0.0);
+				bool unmapped;
+				if(uvSet)
+					mesh->GetPolygonVertexUV(p, j, uvSet, uv, unmapped);
+
+				WeldVertex v;
+				v.Position = XMFLOAT3((float)points[point][0], (float)points[point][1], (float)points[point][2]);
+				v.Normal = XMFLOAT3((float)normal[0], (float)normal[1], (float)normal[2]);
+				v.TexC = XMFLOAT2((float)uv[0], 1.0f - (float)uv[1]);
+				v.Material = material;
+				corners.push_back(v);
 			}
 		}
 
+		MeshWelder::Weld(corners.empty() ? 0 : &corners[0], sizes.empty() ? 0 : &sizes[0], (UINT)numPolygons,
+			part.Vertices, part.Indices);
+		return true;
 	}
-	texcoords->resize(vertices->size());
+}
 
-	if( mesh )
+bool FbxMeshImporter::Import(const std::string& filename, UINT numThreads)
+{
+	mVertices.clear();
+	mIndices.clear();
+	mSubmeshes.clear();
+	mError.clear();
+
+	// A manager per import; the SDK shares nothing between managers.
+	FbxManager* manager = FbxManager::Create();
+	if(!manager)
 	{
-		FbxStringList lUVSetNameList;
-		mesh->GetUVSetNames(lUVSetNameList);
-
-		for (int lUVSetIndex = 0; lUVSetIndex < lUVSetNameList.GetCount(); lUVSetIndex++)
-		{
-			//get lUVSetIndex-th uv set
-			const char* lUVSetName = lUVSetNameList.GetStringAt(lUVSetIndex);
-			const FbxGeometryElementUV* lUVElement = mesh->GetElementUV(lUVSetName);
+		mError = "FbxManager::Create failed";
+		return false;
+	}
+	manager->SetIOSettings(FbxIOSettings::Create(manager, IOSROOT));
 
-			if(!lUVElement)
-				continue;
+	FbxImporter* importer = FbxImporter::Create(manager, "");
+	FbxScene* scene = FbxScene::Create(manager, "");
+	bool ok = importer->Initialize(filename.c_str(), -1, manager->GetIOSettings()) && importer->Import(scene);
+	if(!ok)
+		mError = filename + ": " + importer->GetLastErrorString();
+	importer->Destroy();
 
-			// only support mapping mode eByPolygonVertex and eByControlPoint
-			if( lUVElement->GetMappingMode() != FbxGeometryElement::eByPolygonVertex &&
-				lUVElement->GetMappingMode() != FbxGeometryElement::eByControlPoint )
-				return;
+	std::vector<MeshPart> parts;
+	if(ok && scene->GetRootNode())
+		GatherMeshes(scene->GetRootNode(), parts);
 
-			//index array, where holds the index referenced to the uv data
-			const bool lUseIndex = lUVElement->GetReferenceMode() != FbxGeometryElement::eDirect;
-			const int lIndexCount= (lUseIndex) ? lUVElement->GetIndexArray().GetCount() : 0;
+	ParallelForRows((UINT)parts.size(), 1, numThreads, [&](UINT first, UINT end)
+	{
+		for(UINT i = first; i < end; ++i)
+			parts[i].Extracted = ExtractMesh(parts[i]);
+	});
 
-			//iterating through the data by polygon
-			const int lPolyCount = mesh->GetPolygonCount();
+	for(size_t i = 0; i < parts.size() && ok; ++i)
+	{
+		const MeshPart& part = parts[i];
+		if(!part.Extracted)
+		{
+			mError = filename + ": a mesh refers to a control point it does not have";
+			ok = false;
+			break;
+		}
 
-			if (lUVElement->GetMappingMode() == FbxGeometryElement::eByPolygonVertex)
+		UINT base = (UINT)mVertices.size();
+		for(size_t t = 0; t < part.Indices.size(); t += 3)
+		{
+			int material = part.Vertices[part.Indices[t]].Material;
+			if(mSubmeshes.empty() || mSubmeshes.back().Material != (UINT)material)
 			{
-				int lPolyIndexCounter = 0;
-				for( int lPolyIndex = 0; lPolyIndex < lPolyCount; ++lPolyIndex )
-				{
-					// build the max index array that we need to pass into MakePoly
-					const int lPolySize = mesh->GetPolygonSize(lPolyIndex);
-					for( int lVertIndex = 0; lVertIndex < lPolySize; ++lVertIndex )
-					{
-						if (lPolyIndexCounter < lIndexCount)
-						{
-							FbxVector2 lUVValue;
-
-							//the UV index depends on the reference mode
-							int lUVIndex = lUseIndex ? lUVElement->GetIndexArray().GetAt(lPolyIndexCounter) : lPolyIndexCounter;
-
-							lUVValue = lUVElement->GetDirectArray().GetAt(lUVIndex);
-							int lControlPointIndex = mesh->GetPolygonVertex(lPolyIndex, lVertIndex);
-
-							cout << lControlPointIndex+size << ": " << lUVValue[0] << " " << lUVValue[1] << " " << size << endl;
-
-							texcoords[0][lControlPointIndex+size] = XMFLOAT2( (float)lUVValue[0], 1.0f-(float) lUVValue[1] );
-
-							lPolyIndexCounter++;
-						}
-					}
-				}
+				MeshSubmesh submesh = MeshSubmesh();
+				submesh.FirstIndex = (UINT)(mIndices.size() + t);
+				submesh.Material = material;
+				mSubmeshes.push_back(submesh);
 			}
+			mSubmeshes.back().NumIndices += 3;
 		}
+
+		mVertices.insert(mVertices.end(), part.Vertices.begin(), part.Vertices.end());
+		for(size_t k = 0; k < part.Indices.size(); ++k)
+			mIndices.push_back(base + part.Indices[k]);
 	}
-	for(int i = 0; i < pNode->GetChildCount(); i++)
-	{
-		DisplayContent(pNode->GetChild(i));
-	}
-}
 
-// Non-recursive DisplayContent() is called once
-void DisplayContent(FbxScene* pScene)
-{
-	cout << "Starting Recursion" << endl;
+	// Destroys the scene and everything in it.
+	manager->Destroy();
 
-	int i;
-	FbxNode* lNode = pScene->GetRootNode();
-	if(lNode)
+	if(!ok)
 	{
-		for(i = 0; i < lNode->GetChildCount(); i++)
-		{
-			// Call recursive DisplayContent() once for each child of the root node
-			DisplayContent(lNode->GetChild(i));
-		}
+		mVertices.clear();
+		mIndices.clear();
+		mSubmeshes.clear();
 	}
-
-	cout << "Done" << endl;
+	return ok;
 }
-
-
-int Import(char *name, vector<XMFLOAT3> *vec, vector<int> *ind, vector<XMFLOAT3> *norm, vector<XMFLOAT2> *tex, vector<int> *num )
-{
-
-	texNo = -1;
-	//	char* lFilename = "traingles.fbx";
-	lFilename = name;
-
-	// point to the vectors for changes to be made
-	vertices = vec;
-	indices = ind;
-	normals = norm;
-	texcoords = tex;
-	texnum = num;
-
-	//const std::string &fileName = "sadirohyea.fbx";
-	FbxVector4 fbxVertex;
-	FbxVector4 fbxNormal;
-	FbxVector2 fbxUV;
-	int cornerIndex;
-	// Create the FBX SDK manager
-	FbxManager* lSdkManager = FbxManager::Create();
-
-	// Create an IOSettings object.
-	FbxIOSettings * ios = FbxIOSettings::Create(lSdkManager, IOSROOT );
-	lSdkManager->SetIOSettings(ios);
-
-	// Create an importer.
-	FbxImporter* lImporter = FbxImporter::Create(lSdkManager, "");
-
-	// Initialize the importer.
-	bool lImportStatus = lImporter->Initialize(lFilename, -1, lSdkManager->GetIOSettings());
-
-	// Check to make sure the file exists
-	if(!lImportStatus) {
-		printf("Call to FbxImporter::Initialize() failed.\n");
-		printf("Error returned: %s\n\n", lImporter->GetLastErrorString());
-		cin >> cornerIndex;
-		exit(-1);
-	}
-
-	// Create a new scene so it can be populated by the imported file.
-	FbxScene* lScene = FbxScene::Create(lSdkManager, "MyScene");
-
-	// Import the contents of the file into the scene.
-	lImporter->Import(lScene);
-
-	// The file has been imported; we can get rid of the importer.
-	lImporter->Destroy();
-
-	FbxNode* rootNode = lScene->GetRootNode();
-	if(!rootNode)
-		cout << "failed. no rootNode" << endl;
-
-	// Traverse through the trees
-	DisplayContent( lScene );
-
-	return texNo;
-}
\ No newline at end of file
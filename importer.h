@@ -1,16 +1,52 @@
-#include <fbxsdk.h>
-#include <stdio.h>
-#include <iostream>
+//***************************************************************************************
+// importer.h
+//
+// Imports every mesh in an FBX file into one indexed triangle list.  Each importer owns
+// its FBX SDK manager and results and keeps no global state, so separate importers may
+// run at once on loader threads.
+//
+// The scene is loaded by the SDK on the calling thread; the meshes in it are then
+// extracted and welded in parallel, one per worker, from per polygon vertex positions,
+// normals, UVs and material IDs whatever mapping mode the file stores them in.
+//
+// Make sure to include the fbx sdk and to link fbxsdk-2013.3d.lib or fbxsdk-2013.3.lib.
+//***************************************************************************************
+
+#ifndef IMPORTER_H
+#define IMPORTER_H
+
+#include "MeshFile.h"
+#include "MeshWelder.h"
+#include <string>
 #include <vector>
-#include <D3D10.h>
-#include <D3DX10.h>
-#include <D3Dcompiler.h>
-#include <xnamath.h>
-#include <direct.h>
-using namespace std;
-
-
-void loadVectors(KFbxNode* pNode, int polygonCount, FbxMesh *mesh, FbxVector4* meshVertices);
-void DisplayContent(KFbxNode* pNode);
-void DisplayContent(FbxScene* pScene);
-int Import(char* filename, vector<XMFLOAT3> *vec, vector<int> *ind, vector<XMFLOAT3> *norm, vector<XMFLOAT2> *tex, vector<int> *num );
\ No newline at end of file
+
+class FbxMeshImporter
+{
+public:
+	///<summary>
+	/// Replaces the results with filename's meshes, in scene order, their vertices and
+	/// indices appended one mesh after another.  Positions are the control points as
+	/// stored, UVs have v flipped for D3D, and Material numbers every (mesh, material)
+	/// pair in turn, so a file of single material meshes numbers its meshes.
+	/// numThreads == 0 uses one per hardware thread.
+	///</summary>
+	bool Import(const std::string& filename, UINT numThreads = 0);
+
+	const std::vector<WeldVertex>& GetVertices()const { return mVertices; }
+	const std::vector<UINT>& GetIndices()const { return mIndices; }
+
+	// One per run of triangles sharing a Material; only FirstIndex, NumIndices and
+	// Material are filled in, as MeshFile::Write expects.
+	const std::vector<MeshSubmesh>& GetSubmeshes()const { return mSubmeshes; }
+
+	// Why the last Import failed.
+	const std::string& GetError()const { return mError; }
+
+private:
+	std::vector<WeldVertex> mVertices;
+	std::vector<UINT> mIndices;
+	std::vector<MeshSubmesh> mSubmeshes;
+	std::string mError;
+};
+
+#endif // IMPORTER_H